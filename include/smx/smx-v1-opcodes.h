@@ -257,7 +257,14 @@ namespace sp {
   _G(FLOAT_LE,       "float.le",    1)  \
   _G(FLOAT_NE,       "float.ne",    1)  \
   _G(FLOAT_EQ,       "float.eq",    1)  \
-  _G(FLOAT_NOT,      "float.not",   1)
+  _G(FLOAT_NOT,      "float.not",   1)  \
+  _G(FLOAT_SQRT,     "float.sqrt",  1)  \
+  _G(FLOAT_SIN,      "float.sin",   1)  \
+  _G(FLOAT_COS,      "float.cos",   1)  \
+  _G(FLOAT_ATAN2,    "float.atan2", 1)  \
+  _G(FLOAT_POW,      "float.pow",   1)  \
+  _G(FLOAT_FRACTION, "float.frac",  1)  \
+  _G(FLOAT_MOD,      "float.mod",   1)
 
 
 enum OPCODE {
@@ -23,8 +23,8 @@
 #include "sp_vm_types.h"
 
 /** SourcePawn Engine API Versions */
-#define SOURCEPAWN_ENGINE2_API_VERSION 0xC
-#define SOURCEPAWN_API_VERSION   0x020E
+#define SOURCEPAWN_ENGINE2_API_VERSION 0x1A
+#define SOURCEPAWN_API_VERSION   0x0214
 
 namespace SourceMod {
   struct IdentityToken_t;
@@ -40,6 +40,7 @@ namespace SourcePawn
 {
   class IVirtualMachine;
   class IPluginRuntime;
+  class IPluginFunction;
   class ISourcePawnEngine2;
   class ISourcePawnEnvironment;
 
@@ -155,6 +156,119 @@ namespace SourcePawn
   };
 
 
+  /**
+   * @brief Kinds of parameters in an ICallSignature.
+   */
+  enum SignatureParamType
+  {
+    SP_SIGPARAM_CELL = 0,    /**< Cell or float, passed by value */
+    SP_SIGPARAM_ARRAY = 1,   /**< Array of cells, or a cell by reference */
+    SP_SIGPARAM_STRING = 2,  /**< String buffer */
+  };
+
+  /**
+   * @brief Describes one parameter of an ICallSignature.
+   */
+  struct SignatureParam
+  {
+    SignatureParamType type;  /**< Parameter type */
+    unsigned int size;        /**< Cells for arrays, bytes for strings, otherwise unused */
+    int sz_flags;             /**< String flags, as for PushStringEx() */
+    int cp_flags;             /**< Copy-back flags, for arrays and strings */
+  };
+
+  /**
+   * @brief A call to one function with a fixed set of parameters, built once
+   * and invoked any number of times.
+   *
+   * This is cheaper than pushing parameters through IPluginFunction for
+   * callbacks that are fired often with the same shape: values stay bound
+   * between calls, so only the ones that change need to be set again, and
+   * arrays and strings share a single heap reservation whose layout is
+   * computed up front.
+   *
+   * Arrays and strings are read from their bound buffers when the call is
+   * made, and written back afterward if they have SM_PARAM_COPYBACK set.
+   * An array or string with no buffer bound is passed uninitialized.
+   *
+   * Signatures are created by IPluginFunction::CreateSignature(), and must
+   * be freed with IPluginFunction::DestroySignature() before the plugin is
+   * unloaded.
+   */
+  class ICallSignature
+  {
+   public:
+    /**
+     * @brief Returns the function this signature calls.
+     *
+     * @return        Function.
+     */
+    virtual IPluginFunction *GetFunction() =0;
+
+    /**
+     * @brief Returns the number of parameters in the signature.
+     *
+     * @return        Parameter count.
+     */
+    virtual unsigned int GetParamCount() =0;
+
+    /**
+     * @brief Sets the value of a cell parameter.
+     *
+     * @param param   Parameter index.
+     * @param value   Value to pass.
+     * @return        SP_ERROR_PARAM if the parameter is not a cell.
+     */
+    virtual int SetCell(unsigned int param, cell_t value) =0;
+
+    /**
+     * @brief Sets the value of a cell parameter to a float.
+     *
+     * @param param   Parameter index.
+     * @param value   Value to pass.
+     * @return        SP_ERROR_PARAM if the parameter is not a cell.
+     */
+    virtual int SetFloat(unsigned int param, float value) =0;
+
+    /**
+     * @brief Binds the buffer an array parameter is copied from, and copied
+     * back to. The buffer must hold as many cells as the parameter.
+     *
+     * @param param   Parameter index.
+     * @param array   Buffer, or NULL to pass the array uninitialized.
+     * @return        SP_ERROR_PARAM if the parameter is not an array.
+     */
+    virtual int BindArray(unsigned int param, cell_t *array) =0;
+
+    /**
+     * @brief Binds the buffer a string parameter is copied from, and copied
+     * back to. The buffer must be as large as the parameter.
+     *
+     * @param param   Parameter index.
+     * @param buffer  Buffer, or NULL to pass the string uninitialized.
+     * @return        SP_ERROR_PARAM if the parameter is not a string.
+     */
+    virtual int BindString(unsigned int param, char *buffer) =0;
+
+    /**
+     * @brief Calls the function with the bound parameters, which remain
+     * bound afterward. Exceptions behave as in IPluginFunction::Invoke().
+     *
+     * @param rval    Pointer to store return value in.
+     * @return        True on success, false on error.
+     */
+    virtual bool Invoke(cell_t *rval = nullptr) =0;
+
+    /**
+     * @brief Calls the function with the bound parameters, which remain
+     * bound afterward. Exceptions behave as in IPluginFunction::Execute().
+     *
+     * @param result  Pointer to store return value in.
+     * @return        Error code, if any.
+     */
+    virtual int Execute(cell_t *result) =0;
+  };
+
   /**
    * @brief Encapsulates a function call in a plugin.
    *
@@ -261,6 +375,25 @@ namespace SourcePawn
 	 * @return       String name.
      */
     virtual const char *DebugName() = 0;
+
+    /**
+     * @brief Builds a reusable call to this function. See ICallSignature.
+     *
+     * Note: This was added in API version 0x020F.
+     *
+     * @param params      Array of parameter descriptions.
+     * @param num_params  Number of parameters.
+     * @return            New signature, or NULL if a parameter is invalid
+     *                    or there are too many.
+     */
+    virtual ICallSignature *CreateSignature(const SignatureParam *params, unsigned int num_params) =0;
+
+    /**
+     * @brief Frees a signature. Paired with CreateSignature().
+     *
+     * @param sig         Signature created by this function.
+     */
+    virtual void DestroySignature(ICallSignature *sig) =0;
   };
 
 
@@ -506,7 +639,7 @@ namespace SourcePawn
      * @brief Update the native binding at the given index.
      *
      * @param pfn       Native function pointer.
-     * @param flags     Native flags.
+     * @param flags     Native flags (SP_NTVFLAG_*).
      * @param user      User data pointer.
      */
     virtual int UpdateNativeBinding(uint32_t index, SPVM_NATIVE_FUNC pfn, uint32_t flags, void *data) = 0;
@@ -523,6 +656,129 @@ namespace SourcePawn
      * @brief Return the file or location this plugin was loaded from.
      */
     virtual const char *GetFilename() = 0;
+
+    /**
+     * @brief Same as FindNativeByName(), given the name's hash from
+     * ISourcePawnEngine2::HashSymbolName(). Hosts that look up the same
+     * names in many plugins can hash each name once.
+     *
+     * Note: This was added in API version 0x0210.
+     *
+     * @param name      Name of native.
+     * @param hash      Hash of the name.
+     * @param index     Optionally filled with native index number.
+     */
+    virtual int FindNativeByHash(const char *name, uint32_t hash, uint32_t *index) = 0;
+
+    /**
+     * @brief Same as FindPublicByName(), given the name's hash from
+     * ISourcePawnEngine2::HashSymbolName().
+     *
+     * @param name      The public function name to find.
+     * @param hash      Hash of the name.
+     * @param index     Optionally filled with public function index number.
+     */
+    virtual int FindPublicByHash(const char *name, uint32_t hash, uint32_t *index) = 0;
+
+    /**
+     * @brief Same as FindPubvarByName(), given the name's hash from
+     * ISourcePawnEngine2::HashSymbolName().
+     *
+     * @param name      Name of pubvar.
+     * @param hash      Hash of the name.
+     * @param index     Optionally filled with pubvar index number.
+     */
+    virtual int FindPubvarByHash(const char *name, uint32_t hash, uint32_t *index) = 0;
+
+    /**
+     * @brief Same as GetFunctionByName(), given the name's hash from
+     * ISourcePawnEngine2::HashSymbolName().
+     *
+     * @param public_name  Name of the public function.
+     * @param hash         Hash of the name.
+     * @return             Function pointer, or NULL if not found.
+     */
+    virtual IPluginFunction *GetFunctionByHash(const char *public_name, uint32_t hash) = 0;
+
+    /**
+     * @brief Returns the number of distinct call stacks sampled in this
+     * plugin. See ISourcePawnEngine2::SetSamplingInterval().
+     *
+     * Note: This was added in API version 0x0212.
+     *
+     * @return          Number of stacks.
+     */
+    virtual uint32_t GetSampledStackCount() = 0;
+
+    /**
+     * @brief Returns a call stack sampled in this plugin, folded into
+     * function names from the outermost frame to the innermost, separated by
+     * semicolons. This is the input flame graph tools take, one stack and
+     * its sample count per line. Functions from other plugins are prefixed
+     * with their plugin's name and "::". The string is valid until the
+     * stacks are reset.
+     *
+     * @param index     Stack index, below GetSampledStackCount().
+     * @param samples   Optionally filled with the number of samples taken
+     *                  in the stack.
+     * @return          Folded stack, or NULL if the index is invalid.
+     */
+    virtual const char *GetSampledStack(uint32_t index, uint64_t *samples) = 0;
+
+    /**
+     * @brief Discards the call stacks sampled in this plugin so far.
+     */
+    virtual void ResetSampledStacks() = 0;
+
+    /**
+     * @brief Returns the number of functions in this plugin that have call
+     * stats. A function is listed once it has been called or compiled, so
+     * the count only grows. See ISourcePawnEngine2::SetCallStatsEnabled().
+     *
+     * Note: This was added in API version 0x0213.
+     *
+     * @return          Number of functions.
+     */
+    virtual uint32_t GetFunctionStatsCount() = 0;
+
+    /**
+     * @brief Copies the call stats of a function in this plugin. The counts
+     * keep going up as the plugin runs; each call takes a snapshot.
+     *
+     * @param index     Function index, below GetFunctionStatsCount().
+     * @param stats     Filled with the function's stats. The name is valid
+     *                  for the lifetime of the plugin.
+     * @return          False if the index is invalid.
+     */
+    virtual bool GetFunctionStats(uint32_t index, sp_function_stats_t *stats) = 0;
+
+    /**
+     * @brief Sets the call stats of every function in this plugin back to
+     * zero.
+     */
+    virtual void ResetFunctionStats() = 0;
+
+    /**
+     * @brief Copies the call stats of one of this plugin's natives. Natives
+     * are indexed as in GetNativeByIndex(). Calls the JIT replaces with
+     * inline code are not counted. See
+     * ISourcePawnEngine2::SetNativeStatsEnabled().
+     *
+     * Note: This was added in API version 0x0214.
+     *
+     * @param index     Native index, below GetNativesNum().
+     * @param stats     Filled with the native's stats. The name is valid
+     *                  for the lifetime of the plugin.
+     * @return          False if the index is invalid, or the plugin was
+     *                  loaded without native stats.
+     */
+    virtual bool GetNativeStats(uint32_t index, sp_native_stats_t *stats) = 0;
+
+    /**
+     * @brief Sets the call stats of every native in this plugin back to
+     * zero.
+     */
+    virtual void ResetNativeStats() = 0;
   };
 
   
@@ -611,6 +867,26 @@ namespace SourcePawn
      virtual bool IsInternalFrame() const = 0;
   };
 
+  /**
+   * @brief A saved copy of a context's memory and stack state, which the
+   * context can be put back to any number of times. Compiled code and the
+   * runtime are not part of it.
+   *
+   * Snapshots are created by IPluginContext::CreateSnapshot(), and must be
+   * freed with IPluginContext::DestroySnapshot() before the plugin is
+   * unloaded.
+   */
+  class IContextSnapshot
+  {
+   public:
+    /**
+     * @brief Returns the number of bytes of plugin memory the snapshot had
+     * to keep. Pages of the data section that still matched the plugin
+     * image are not kept.
+     */
+    virtual size_t GetSize() = 0;
+  };
+
   /**
    * @brief Interface to managing a context at runtime.
    */
@@ -1096,6 +1372,33 @@ namespace SourcePawn
      */
     virtual void DestroyFrameIterator(IFrameIterator *it) = 0;
 
+    /**
+     * @brief Saves the context's memory, heap and stack so that it can
+     * later be restored without reloading the plugin. The context must not
+     * be running.
+     *
+     * @return             New snapshot, or NULL if the context is running
+     *                     or out of memory.
+     */
+    virtual IContextSnapshot *CreateSnapshot() = 0;
+
+    /**
+     * @brief Puts the context's memory, heap and stack back to how they
+     * were when the snapshot was created. This copies what the snapshot
+     * kept; if the plugin's memory is reserved, pages that were untouched
+     * are handed back to the OS instead. The context must not be running.
+     *
+     * @param snapshot     Snapshot created by this context.
+     * @return             Error code, if any.
+     */
+    virtual int RestoreSnapshot(IContextSnapshot *snapshot) = 0;
+
+    /**
+     * @brief Frees a snapshot created by this context.
+     *
+     * @param snapshot     Snapshot to free.
+     */
+    virtual void DestroySnapshot(IContextSnapshot *snapshot) = 0;
   };
 
   /**
@@ -1390,6 +1693,126 @@ namespace SourcePawn
 
   class ExceptionHandler;
 
+  /**
+   * @brief How IDispatchGroup::Dispatch() combines return values.
+   */
+  enum DispatchPolicy
+  {
+    SP_DISPATCH_IGNORE = 0,         /**< Call every function; the result is 0 */
+    SP_DISPATCH_FIRST_NONZERO = 1,  /**< Stop at the first non-zero result, and return it */
+    SP_DISPATCH_MAX = 2,            /**< Call every function, and return the largest result */
+  };
+
+  /**
+   * @brief Calls one public function, by name, in a set of plugins.
+   *
+   * The public is looked up once per plugin, when the plugin is added, and
+   * the parameters are set once per dispatch rather than once per plugin.
+   * Parameters are described and bound the same way as in ICallSignature;
+   * arrays and strings with SM_PARAM_COPYBACK are copied back after each
+   * plugin, so the next plugin sees what the previous one wrote.
+   *
+   * Plugins are called in the order they were added. Paused plugins are
+   * skipped. Errors thrown by one plugin are reported and cleared, as with
+   * IPluginFunction::Execute(), and do not stop the dispatch.
+   *
+   * Plugins must be removed before they are unloaded, and must not be
+   * added or removed while the group is dispatching.
+   */
+  class IDispatchGroup
+  {
+   public:
+    /**
+     * @brief Adds a plugin to the group.
+     *
+     * @param runtime   Plugin runtime.
+     * @return          False if the plugin has no public by the group's
+     *                  name, or it is already in the group.
+     */
+    virtual bool AddRuntime(IPluginRuntime *runtime) =0;
+
+    /**
+     * @brief Removes a plugin from the group, if it is in it.
+     *
+     * @param runtime   Plugin runtime.
+     */
+    virtual void RemoveRuntime(IPluginRuntime *runtime) =0;
+
+    /**
+     * @brief Returns the number of plugins in the group.
+     */
+    virtual unsigned int GetRuntimeCount() =0;
+
+    /**
+     * @brief Sets the value of a cell parameter. See ICallSignature::SetCell().
+     */
+    virtual int SetCell(unsigned int param, cell_t value) =0;
+
+    /**
+     * @brief Sets the value of a cell parameter to a float. See
+     * ICallSignature::SetFloat().
+     */
+    virtual int SetFloat(unsigned int param, float value) =0;
+
+    /**
+     * @brief Binds the buffer for an array parameter. See
+     * ICallSignature::BindArray().
+     */
+    virtual int BindArray(unsigned int param, cell_t *array) =0;
+
+    /**
+     * @brief Binds the buffer for a string parameter. See
+     * ICallSignature::BindString().
+     */
+    virtual int BindString(unsigned int param, char *buffer) =0;
+
+    /**
+     * @brief Calls the public in each plugin in the group.
+     *
+     * @param policy    How to combine return values.
+     * @param result    Optional pointer to store the combined result in.
+     * @return          Number of plugins the public ran in without error.
+     */
+    virtual unsigned int Dispatch(DispatchPolicy policy, cell_t *result) =0;
+  };
+
+  /**
+   * @brief A host's natives, hashed once so that any number of plugins can
+   * be bound against them. See ISourcePawnEngine2::BindNatives().
+   */
+  class INativeRegistry
+  {
+   public:
+    /**
+     * @brief Adds a native. Adding a name again replaces its entry.
+     *
+     * @param name      Native name. It is copied.
+     * @param func      Native function.
+     * @param flags     Native flags (SP_NTVFLAG_*).
+     * @param data      User data pointer.
+     * @return          False on out of memory.
+     */
+    virtual bool AddNative(const char *name, SPVM_NATIVE_FUNC func, uint32_t flags, void *data) =0;
+
+    /**
+     * @brief Adds a list of natives, with no flags or user data.
+     *
+     * @param natives   Array of natives, terminated by an entry with a
+     *                  NULL name.
+     * @return          False on out of memory.
+     */
+    virtual bool AddNatives(const sp_nativeinfo_t *natives) =0;
+
+    /**
+     * @brief Returns the number of natives in the registry.
+     */
+    virtual size_t GetNativeCount() =0;
+  };
+
+  /* Outputs for ISourcePawnEngine2::SetPerfOutputs() */
+  #define SP_PERF_MAP      (1<<0)    /**< /tmp/perf-<pid>.map, for perf report and perf top */
+  #define SP_PERF_JITDUMP  (1<<1)    /**< jit-<pid>.dump in the working directory, for perf inject --jit */
+
   /** 
    * @brief Outlines the interface a Virtual Machine (JIT) must expose
    */
@@ -1558,6 +1981,238 @@ namespace SourcePawn
      * @brief Returns the environment.
      */
     virtual ISourcePawnEnvironment *Environment() = 0;
+
+    /**
+     * @brief Sets how many calls and loop iterations a function must run in
+     * the interpreter before it is JIT compiled. A threshold of 0 compiles
+     * every function before its first call.
+     *
+     * @param threshold  Number of calls plus loop iterations.
+     */
+    virtual void SetJitThreshold(uint32_t threshold) = 0;
+
+    /**
+     * @brief Compiles every function of each plugin loaded from now on, on
+     * a pool of background threads, instead of on first use. A function
+     * that is still being compiled when it is called makes the caller wait
+     * for it; one that no thread has started on yet is compiled lazily, as
+     * usual. This must be called before any plugins are loaded.
+     *
+     * @param threads    Number of compiler threads, or 0 to turn this off.
+     * @return           True on success, false if plugins are already
+     *                   loaded or the threads could not be started.
+     */
+    virtual bool SetCompileThreads(uint32_t threads) = 0;
+
+    /**
+     * @brief Keeps JIT compiled code for each plugin loaded from now on in
+     * the given directory, and reuses it when the same plugin is loaded
+     * again, instead of compiling it from scratch. Code in the directory is
+     * trusted, so it must not be writable by anything untrusted.
+     *
+     * @param path       Directory for cached code. It must already exist.
+     * @return           True on success, false if the JIT is disabled or
+     *                   cannot cache code on this platform.
+     */
+    virtual bool SetCodeCacheDirectory(const char* path) = 0;
+
+    /**
+     * @brief Creates a group for calling the same public in many plugins
+     * at once. See IDispatchGroup.
+     *
+     * @param name       Name of the public function.
+     * @param params     Array of parameter descriptions.
+     * @param num_params Number of parameters.
+     * @return           New group, or NULL if a parameter is invalid or
+     *                   there are too many. It must be freed with
+     *                   DestroyDispatchGroup().
+     */
+    virtual IDispatchGroup *CreateDispatchGroup(const char *name,
+                                                const SignatureParam *params,
+                                                unsigned int num_params) = 0;
+
+    /**
+     * @brief Frees a group created by CreateDispatchGroup().
+     *
+     * @param group      Group to free.
+     */
+    virtual void DestroyDispatchGroup(IDispatchGroup *group) = 0;
+
+    /**
+     * @brief Hashes a native, public or pubvar name for the IPluginRuntime
+     * *ByHash() lookups. The result depends only on the name, so it can be
+     * computed once and used with any plugin.
+     *
+     * @param name       Symbol name.
+     * @return           Hash of the name.
+     */
+    virtual uint32_t HashSymbolName(const char *name) = 0;
+
+    /**
+     * @brief Creates an empty native registry. It must be freed with
+     * DestroyNativeRegistry().
+     */
+    virtual INativeRegistry *CreateNativeRegistry() = 0;
+
+    /**
+     * @brief Frees a native registry. Plugins that were bound against it
+     * are not affected.
+     *
+     * @param registry   Registry to free.
+     */
+    virtual void DestroyNativeRegistry(INativeRegistry *registry) = 0;
+
+    /**
+     * @brief Binds every unbound native of a plugin that is in the
+     * registry, in one pass over the plugin's native table. Natives that
+     * are already bound are left alone, so registries can be applied in
+     * layers.
+     *
+     * @param runtime         Plugin runtime.
+     * @param registry        Natives to bind.
+     * @param unresolved      Optional array filled with the indexes of
+     *                        natives that are still unbound afterward.
+     * @param max_unresolved  Size of the unresolved array.
+     * @return                Number of natives still unbound afterward,
+     *                        which may be more than max_unresolved.
+     */
+    virtual uint32_t BindNatives(IPluginRuntime *runtime, INativeRegistry *registry,
+                                 uint32_t *unresolved, uint32_t max_unresolved) = 0;
+
+    /**
+     * @brief Backs the data, heap and stack of each plugin loaded from now
+     * on with memory reserved from the OS, instead of an eagerly zeroed
+     * block. Pages are committed as the plugin touches them, so resident
+     * memory follows what a plugin uses rather than what it declares, and
+     * guard pages around the region turn any access past its ends into a
+     * fault. Heap and stack collisions are still reported as
+     * SP_ERROR_HEAPLOW and SP_ERROR_STACKLOW.
+     *
+     * @param enabled    True to reserve memory, false for eager blocks.
+     * @return           False if this platform cannot reserve memory.
+     */
+    virtual bool SetReservedMemoryEnabled(bool enabled) = 0;
+
+    /**
+     * @brief Reserves 4GiB of inaccessible address space after the memory
+     * of each plugin loaded from now on, so that JIT compiled code can load
+     * and store without checking addresses against the end of memory. Any
+     * 32-bit address past the end of a plugin's memory faults, and the fault
+     * is turned into SP_ERROR_MEMACCESS. Addresses between the heap and the
+     * stack are still checked. This installs SIGSEGV and SIGBUS
+     * handlers, which pass any other fault on to the previous handlers. It
+     * cannot be combined with a code cache.
+     *
+     * @param enabled    True to skip address checks, false to check them.
+     * @return           False if this platform is not supported, the
+     *                   handlers could not be installed, or a code cache
+     *                   directory is set.
+     */
+    virtual bool SetUncheckedMemoryEnabled(bool enabled) = 0;
+
+    /**
+     * @brief Loads many plugins at once. Files are read, decompressed and
+     * validated, and then every method that can be found is verified, on
+     * worker threads. The runtimes themselves are created on the calling
+     * thread, and are ready to use when this returns.
+     *
+     * @param files      Paths of the files to load.
+     * @param count      Number of files.
+     * @param threads    Number of worker threads, or 0 to do everything on
+     *                   the calling thread.
+     * @param runtimes   Array of |count| runtime pointers. Each receives the
+     *                   new runtime, or NULL if its file failed to load.
+     * @param errors     Optional buffer of |count| error messages, each
+     *                   |maxlength| bytes long, in the order of |files|.
+     * @param maxlength  Size of each error message.
+     * @return           Number of plugins loaded.
+     */
+    virtual size_t LoadBinariesFromFiles(const char * const *files, size_t count, size_t threads,
+                                         IPluginRuntime **runtimes, char *errors,
+                                         size_t maxlength) = 0;
+
+    /**
+     * @brief Samples the call stacks of plugins running on the calling
+     * thread's environment at a fixed interval, for profiling. Each sample
+     * is counted in the plugin whose function was innermost, and can be read
+     * back with IPluginRuntime::GetSampledStack(). Nothing is sampled while
+     * the host is running outside of plugins, and sampling costs nothing per
+     * call, so it can be left on.
+     *
+     * Samples are taken with SIGPROF, so system calls made by natives may be
+     * interrupted; they are restarted where possible. Other SIGPROF signals
+     * are passed on to the handler that was installed before.
+     *
+     * @param interval_ms  Milliseconds between samples, or 0 to stop
+     *                     sampling. Stacks sampled so far are kept.
+     * @return             False if this platform cannot sample.
+     */
+    virtual bool SetSamplingInterval(uint32_t interval_ms) = 0;
+
+    /**
+     * @brief Tells Linux perf where compiled plugin code lives, so that
+     * profiles of the host process name each function instead of showing
+     * anonymous memory. Functions are named "plugin.smx::Function". The
+     * jitdump output also carries each function's code and its source
+     * lines.
+     *
+     * The files are shared by the whole process. Code already compiled on
+     * the calling thread's environment is listed right away; code compiled
+     * by any environment is listed from then on.
+     *
+     * @param flags     SP_PERF_* outputs to write, or 0 to stop writing.
+     * @return          False if this platform has no JIT or is not Linux,
+     *                  or if a file could not be created.
+     */
+    virtual bool SetPerfOutputs(uint32_t flags) = 0;
+
+    /**
+     * @brief Describes compiled plugin functions to gdb, through its JIT
+     * compilation interface, so that backtraces of the host process name
+     * them, show their source lines, and unwind through them. This costs
+     * time and memory for every compiled function, so it is off by default.
+     *
+     * The interface is shared by the whole process. Code already compiled
+     * on the calling thread's environment is described right away; code
+     * compiled by any environment is described from then on.
+     *
+     * @param enabled   True to describe new code, false to stop. Code that
+     *                  was described stays described.
+     * @return          False if this platform has no JIT or is not Linux.
+     */
+    virtual bool SetGdbJitEnabled(bool enabled) = 0;
+
+    /**
+     * @brief Counts the calls to each plugin function, and the time spent
+     * in each, on the calling thread's environment. Both the interpreter and
+     * compiled code keep count, and both count in the same units, so that
+     * functions can be ranked by their self time. Read the counts back with
+     * IPluginRuntime::GetFunctionStats().
+     *
+     * Compiled code only keeps count if it was compiled with this on, so it
+     * must be set before any plugins are loaded. Every call then reads the
+     * timestamp counter twice; with this off, nothing is added.
+     *
+     * @param enabled   True to count calls, false to stop.
+     * @return          False if plugins have been loaded, or a code cache
+     *                  directory is set.
+     */
+    virtual bool SetCallStatsEnabled(bool enabled) = 0;
+
+    /**
+     * @brief Counts the calls from plugins to each of their natives, the
+     * time spent in them, and how many calls fell in each of a set of
+     * power-of-two latency ranges. This applies to plugins loaded from now
+     * on, on the calling thread's environment. Read the counts back with
+     * IPluginRuntime::GetNativeStats().
+     *
+     * Each native call then reads the timestamp counter twice; with this
+     * off, nothing is added.
+     *
+     * @param enabled   True to count native calls, false to stop.
+     * @return          False if a code cache directory is set.
+     */
+    virtual bool SetNativeStatsEnabled(bool enabled) = 0;
   };
 
   // @brief This class is the v3 API for SourcePawn. It provides access to
@@ -1614,7 +2269,9 @@ namespace SourcePawn
     virtual int ApiVersion() = 0;
 
     // @brief Initializes a new environment on the current thread.
-    // Currently, at most one environment may be created in a process.
+    // At most one environment may exist per thread. Plugins loaded in an
+    // environment must only be run and destroyed on its thread, but
+    // environments on different threads may run plugins concurrently.
     virtual ISourcePawnEnvironment *NewEnvironment() = 0;
 
     // @brief Returns the environment for the calling thread.
@@ -160,6 +160,14 @@ typedef struct sp_pubvar_s
 #define SP_NTVFLAG_OPTIONAL		(1<<0)	/**< Native is optional */
 #define SP_NTVFLAG_EPHEMERAL		(1<<1)	/**< Native can be unbound */
 
+/**
+ * Native is a leaf: it never throws, and never calls back into the VM (by
+ * invoking functions, or allocating on the heap). The JIT calls leaf natives
+ * without setting up an exit frame, so they also will not appear in stack
+ * traces. Only honored for natives that are bound for good.
+ */
+#define SP_NTVFLAG_LEAF			(1<<2)
+
 /** 
  * @brief Information about a native entry in a plugin.
  */
@@ -260,6 +268,36 @@ typedef struct sp_debug_break_info_s
   cell_t    frm;       /**< Current virtual frame pointer */
 } sp_debug_break_info_t;
 
+/**
+ * @brief Calls to a function that have returned, and the time spent in
+ * them, while call stats are on. Times are in ticks of the processor's
+ * timestamp counter where there is one, and nanoseconds elsewhere.
+ */
+typedef struct sp_function_stats_s
+{
+  uint32_t    code_offs;    /**< Code offset of the function */
+  const char  *name;        /**< Name of the function, or NULL if unknown */
+  uint64_t    calls;        /**< Number of calls that returned */
+  uint64_t    total_ticks;  /**< Time spent in the function and its callees */
+  uint64_t    self_ticks;   /**< Time spent in the function itself */
+} sp_function_stats_t;
+
+#define SP_NATIVE_STATS_BUCKETS   64  /**< Buckets in a native's latency histogram */
+
+/**
+ * @brief Calls from a plugin to one of its natives, while native stats are
+ * on. Times are in the same units as sp_function_stats_t. Bucket n of the
+ * histogram counts the calls that took 2^n to 2^(n+1)-1 ticks; bucket 0
+ * also counts calls that took none.
+ */
+typedef struct sp_native_stats_s
+{
+  const char  *name;        /**< Name of the native */
+  uint64_t    calls;        /**< Number of calls, including ones that threw */
+  uint64_t    total_ticks;  /**< Time spent in the native */
+  uint64_t    histogram[SP_NATIVE_STATS_BUCKETS]; /**< Calls by time taken */
+} sp_native_stats_t;
+
 /**
  * Breaks into a debugger.
  * If the exception parameter is not null, 
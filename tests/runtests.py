@@ -99,6 +99,55 @@ class TestPlan(object):
           'args': [],
           'name': 'default' + arch,
           })
+        self.shells.append({
+          'path': path,
+          'args': ['--jit-threshold', '0'],
+          'name': 'jit-eager' + arch,
+          })
+        # A low threshold, so calls cross between tiers in both directions.
+        self.shells.append({
+          'path': path,
+          'args': ['--jit-threshold', '2'],
+          'name': 'jit-tiered' + arch,
+          })
+        # Everything compiled ahead of time, racing the main thread.
+        self.shells.append({
+          'path': path,
+          'args': ['--compile-threads', '2'],
+          'name': 'jit-background' + arch,
+          })
+        # Each test runs in its own folder: the first of these fills the code
+        # cache, and the second runs from it.
+        self.shells.append({
+          'path': path,
+          'args': ['--jit-threshold', '0', '--code-cache', '.'],
+          'name': 'jit-cache' + arch,
+          })
+        self.shells.append({
+          'path': path,
+          'args': ['--jit-threshold', '0', '--code-cache', '.'],
+          'name': 'jit-cached' + arch,
+          })
+        # Loads and stores without address checks, caught by guard pages.
+        if arch == '.x64' and sys.platform.startswith('linux'):
+          self.shells.append({
+            'path': path,
+            'args': ['--jit-threshold', '0', '--unchecked-memory'],
+            'name': 'jit-unchecked' + arch,
+            })
+        # Every function listed in a jitdump, written to the test's folder.
+        if sys.platform.startswith('linux'):
+          self.shells.append({
+            'path': path,
+            'args': ['--jit-threshold', '0', '--jitdump'],
+            'name': 'jit-perf' + arch,
+            })
+          # Every function described to gdb as an in-memory object.
+          self.shells.append({
+            'path': path,
+            'args': ['--jit-threshold', '0', '--gdb-jit'],
+            'name': 'jit-gdb' + arch,
+            })
 
       self.shells.append({
         'path': path,
@@ -106,6 +155,19 @@ class TestPlan(object):
         'name': 'interpreter' + arch,
       })
 
+      self.shells.append({
+        'path': path,
+        'args': ['--disable-jit', '--disable-threaded-interp'],
+        'name': 'legacy-interpreter' + arch,
+      })
+
+      # Plugin memory mapped from the OS, between guard pages.
+      self.shells.append({
+        'path': path,
+        'args': ['--reserve-memory'],
+        'name': 'reserved-memory' + arch,
+      })
+
   def find_compilers(self):
     if self.args.spcomp2:
       self.find_spcomp2()
@@ -37,7 +37,11 @@
 # define SOURCEPAWN_VERSION SOURCEMOD_VERSION
 #endif
 #include "code-stubs.h"
-#include "smx-v1-image.h"
+#include "dispatch-group.h"
+#include "native-registry.h"
+#include "plugin-loader.h"
+#include "plugin-runtime.h"
+#include "symbol-index.h"
 #include <amtl/am-string.h>
 
 using namespace sp;
@@ -248,49 +252,23 @@ SourcePawnEngine2::LoadPlugin(ICompilation* co, const char* file, int* err)
 IPluginRuntime*
 SourcePawnEngine2::LoadBinaryFromFile(const char* file, char* error, size_t maxlength)
 {
-  FILE* fp = fopen(file, "rb");
-
-  if (!fp) {
-    UTIL_Format(error, maxlength, "file not found");
-    return nullptr;
-  }
-
-  ke::AutoPtr<SmxV1Image> image(new SmxV1Image(fp));
-  fclose(fp);
-
-  if (!image->validate()) {
-    const char* errorMessage = image->errorMessage();
-    if (!errorMessage)
-      errorMessage = "file parse error";
-    UTIL_Format(error, maxlength, "%s", errorMessage);
-    return nullptr;
-  }
-
-  PluginRuntime* pRuntime = new PluginRuntime(image.take());
-  if (!pRuntime->Initialize()) {
-    delete pRuntime;
-
-    UTIL_Format(error, maxlength, "out of memory");
-    return nullptr;
-  }
-
-  size_t len = strlen(file);
-  for (size_t i = len - 1; i < len; i--) {
-    if (file[i] == '/' 
-# if defined WIN32
-      || file[i] == '\\'
-# endif
-    )
-    {
-      pRuntime->SetNames(file, &file[i + 1]);
-      break;
-    }
-  }
+  return PluginLoader::Load(file, error, maxlength);
+}
 
-  if (!pRuntime->Name())
-    pRuntime->SetNames(file, file);
+size_t
+SourcePawnEngine2::LoadBinariesFromFiles(const char* const* files, size_t count, size_t threads,
+                                         IPluginRuntime** runtimes, char* errors,
+                                         size_t maxlength)
+{
+  ke::Vector<PluginRuntime*> loaded;
+  if (!loaded.resize(count))
+    return 0;
 
-  return pRuntime;
+  size_t num_loaded =
+    PluginLoader::LoadBatch(files, count, threads, loaded.buffer(), errors, maxlength);
+  for (size_t i = 0; i < count; i++)
+    runtimes[i] = loaded[i];
+  return num_loaded;
 }
 
 SPVM_NATIVE_FUNC
@@ -321,6 +299,8 @@ SourcePawnEngine2::GetEngineName()
   } else {
 # if defined(KE_ARCH_X86)
     info = ", jit-x86";
+# elif defined(KE_ARCH_X64)
+    info = ", jit-x64";
 # else
     info = ", unknown";
 # endif
@@ -444,3 +424,105 @@ SourcePawnEngine2::Environment()
 {
   return Environment::get();
 }
+
+void
+SourcePawnEngine2::SetJitThreshold(uint32_t threshold)
+{
+  Environment::get()->SetJitThreshold(threshold);
+}
+
+bool
+SourcePawnEngine2::SetCompileThreads(uint32_t threads)
+{
+  return Environment::get()->SetCompileThreads(threads);
+}
+
+bool
+SourcePawnEngine2::SetCodeCacheDirectory(const char* path)
+{
+  return Environment::get()->SetCodeCacheDirectory(path);
+}
+
+IDispatchGroup*
+SourcePawnEngine2::CreateDispatchGroup(const char* name, const SignatureParam* params,
+                                       unsigned int num_params)
+{
+  return DispatchGroup::New(name, params, num_params);
+}
+
+void
+SourcePawnEngine2::DestroyDispatchGroup(IDispatchGroup* group)
+{
+  delete static_cast<DispatchGroup*>(group);
+}
+
+uint32_t
+SourcePawnEngine2::HashSymbolName(const char* name)
+{
+  return SymbolIndex::Hash(name);
+}
+
+INativeRegistry*
+SourcePawnEngine2::CreateNativeRegistry()
+{
+  ke::AutoPtr<NativeRegistry> registry(new NativeRegistry());
+  if (!registry->Initialize())
+    return nullptr;
+  return registry.take();
+}
+
+void
+SourcePawnEngine2::DestroyNativeRegistry(INativeRegistry* registry)
+{
+  delete static_cast<NativeRegistry*>(registry);
+}
+
+uint32_t
+SourcePawnEngine2::BindNatives(IPluginRuntime* runtime, INativeRegistry* registry,
+                               uint32_t* unresolved, uint32_t max_unresolved)
+{
+  PluginRuntime* rt = static_cast<PluginRuntime*>(runtime);
+  return static_cast<NativeRegistry*>(registry)->Bind(rt, unresolved, max_unresolved);
+}
+
+bool
+SourcePawnEngine2::SetReservedMemoryEnabled(bool enabled)
+{
+  return Environment::get()->SetReservedMemoryEnabled(enabled);
+}
+
+bool
+SourcePawnEngine2::SetUncheckedMemoryEnabled(bool enabled)
+{
+  return Environment::get()->SetUncheckedMemoryEnabled(enabled);
+}
+
+bool
+SourcePawnEngine2::SetSamplingInterval(uint32_t interval_ms)
+{
+  return Environment::get()->SetSamplingInterval(interval_ms);
+}
+
+bool
+SourcePawnEngine2::SetPerfOutputs(uint32_t flags)
+{
+  return Environment::get()->SetPerfOutputs(flags);
+}
+
+bool
+SourcePawnEngine2::SetGdbJitEnabled(bool enabled)
+{
+  return Environment::get()->SetGdbJitEnabled(enabled);
+}
+
+bool
+SourcePawnEngine2::SetCallStatsEnabled(bool enabled)
+{
+  return Environment::get()->SetCallStatsEnabled(enabled);
+}
+
+bool
+SourcePawnEngine2::SetNativeStatsEnabled(bool enabled)
+{
+  return Environment::get()->SetNativeStatsEnabled(enabled);
+}
@@ -70,6 +70,27 @@ class SourcePawnEngine2 : public ISourcePawnEngine2
   void SetProfilingTool(IProfilingTool* tool) override;
   IPluginRuntime* LoadBinaryFromFile(const char* file, char* error, size_t maxlength) override;
   ISourcePawnEnvironment* Environment() override;
+  void SetJitThreshold(uint32_t threshold) override;
+  bool SetCompileThreads(uint32_t threads) override;
+  bool SetCodeCacheDirectory(const char* path) override;
+  IDispatchGroup* CreateDispatchGroup(const char* name, const SignatureParam* params,
+                                      unsigned int num_params) override;
+  void DestroyDispatchGroup(IDispatchGroup* group) override;
+  uint32_t HashSymbolName(const char* name) override;
+  INativeRegistry* CreateNativeRegistry() override;
+  void DestroyNativeRegistry(INativeRegistry* registry) override;
+  uint32_t BindNatives(IPluginRuntime* runtime, INativeRegistry* registry,
+                       uint32_t* unresolved, uint32_t max_unresolved) override;
+  bool SetReservedMemoryEnabled(bool enabled) override;
+  bool SetUncheckedMemoryEnabled(bool enabled) override;
+  size_t LoadBinariesFromFiles(const char* const* files, size_t count, size_t threads,
+                               IPluginRuntime** runtimes, char* errors,
+                               size_t maxlength) override;
+  bool SetSamplingInterval(uint32_t interval_ms) override;
+  bool SetPerfOutputs(uint32_t flags) override;
+  bool SetGdbJitEnabled(bool enabled) override;
+  bool SetCallStatsEnabled(bool enabled) override;
+  bool SetNativeStatsEnabled(bool enabled) override;
 
  private:
   char engine_name_[256];
@@ -36,8 +36,29 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <limits.h>
+#include <amtl/am-vector.h>
 #include "label.h"
 
+// How an absolute address is encoded in the instruction stream.
+enum class RelocationKind : uint8_t
+{
+  // A full pointer-width address.
+  Pointer,
+  // A 32-bit field that the processor zero-extends.
+  Unsigned32,
+  // A 32-bit field that the processor sign-extends.
+  Signed32
+};
+
+// An absolute address written into the code, which has to be adjusted if the
+// code is ever copied somewhere else, such as out of the code cache.
+struct Relocation
+{
+  // Offset of the field from the start of the code.
+  uint32_t offset;
+  RelocationKind kind;
+};
+
 class AssemblerBase
 {
  public:
@@ -70,6 +91,12 @@ class AssemblerBase
     return uint32_t(pos_ - buffer_);
   }
 
+  // Every absolute address in the code, including references to the code
+  // itself. Only the x64 assembler records these.
+  const ke::Vector<Relocation>& relocations() const {
+    return relocations_;
+  }
+
  protected:
   void writeByte(uint8_t byte) {
     write<uint8_t>(byte);
@@ -131,6 +158,15 @@ class AssemblerBase
     return true;
   }
 
+  // Record that an address of the given kind ends at the current position.
+  void recordRelocation(RelocationKind kind) {
+    Relocation reloc;
+    reloc.kind = kind;
+    reloc.offset = pc() - (kind == RelocationKind::Pointer ? sizeof(void*) : sizeof(int32_t));
+    if (!relocations_.append(reloc))
+      outOfMemory_ = true;
+  }
+
   // Position will never be negative, but it's nice to have signed results
   // for relative address calculation.
   int32_t position() const {
@@ -148,6 +184,7 @@ class AssemblerBase
  private:
   uint8_t* buffer_;
   uint8_t* end_;
+  ke::Vector<Relocation> relocations_;
 
  protected:
   uint8_t* pos_;
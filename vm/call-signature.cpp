@@ -0,0 +1,257 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <limits.h>
+#include <string.h>
+#include <amtl/am-uniqueptr.h>
+#include "call-signature.h"
+#include "environment.h"
+#include "plugin-context.h"
+#include "scripted-invoker.h"
+
+using namespace sp;
+using namespace SourcePawn;
+
+// Matches the limit PluginContext::HeapAlloc() asserts on.
+static const uint32_t kMaxHeapCells = INT_MAX / sizeof(cell_t);
+
+CallArguments::CallArguments()
+ : env_(Environment::get()),
+   heap_cells_(0)
+{
+}
+
+bool
+CallArguments::init(const SignatureParam* params, unsigned int num_params)
+{
+  if (num_params > SP_MAX_EXEC_PARAMS)
+    return false;
+  if (!slots_.resize(num_params) || !values_.resize(num_params))
+    return false;
+
+  uint32_t heap_cells = 0;
+  for (unsigned int i = 0; i < num_params; i++) {
+    Slot& slot = slots_[i];
+    slot.type = params[i].type;
+    slot.sz_flags = params[i].sz_flags;
+    slot.cp_flags = params[i].cp_flags;
+    slot.size = params[i].size;
+    slot.offset = 0;
+    slot.buffer = nullptr;
+    values_[i] = 0;
+
+    uint32_t cells;
+    switch (slot.type) {
+      case SP_SIGPARAM_CELL:
+        continue;
+      case SP_SIGPARAM_ARRAY:
+        cells = slot.size;
+        break;
+      case SP_SIGPARAM_STRING:
+        cells = (slot.size + sizeof(cell_t) - 1) / sizeof(cell_t);
+        break;
+      default:
+        return false;
+    }
+    if (!cells || cells >= kMaxHeapCells - heap_cells)
+      return false;
+
+    slot.offset = heap_cells;
+    heap_cells += cells;
+    if (!refs_.append(i))
+      return false;
+  }
+  heap_cells_ = heap_cells;
+  return true;
+}
+
+int
+CallArguments::setCell(unsigned int param, cell_t value)
+{
+  if (param >= slots_.length() || slots_[param].type != SP_SIGPARAM_CELL)
+    return SP_ERROR_PARAM;
+  values_[param] = value;
+  return SP_ERROR_NONE;
+}
+
+int
+CallArguments::bind(unsigned int param, SignatureParamType type, void* buffer)
+{
+  if (param >= slots_.length() || slots_[param].type != type)
+    return SP_ERROR_PARAM;
+  slots_[param].buffer = buffer;
+  return SP_ERROR_NONE;
+}
+
+bool
+CallArguments::copyIn(PluginContext* cx, cell_t* block)
+{
+  // Cell values were stored when they were set, so only array addresses
+  // need to be filled in. The parameters are copied onto the plugin stack
+  // before anything runs, so this is safe even if the call is re-entered.
+  *block = 0;
+  if (!heap_cells_)
+    return true;
+
+  cell_t* phys;
+  if (int err = cx->HeapAlloc(heap_cells_, block, &phys)) {
+    env_->ReportError(err);
+    return false;
+  }
+  for (uint32_t index : refs_) {
+    const Slot& slot = slots_[index];
+    values_[index] = *block + slot.offset * sizeof(cell_t);
+    copyIn(cx, slot, values_[index], phys + slot.offset);
+  }
+  return true;
+}
+
+void
+CallArguments::copyOut(PluginContext* cx, cell_t block, bool ok)
+{
+  if (!heap_cells_)
+    return;
+
+  if (ok) {
+    const cell_t* phys = reinterpret_cast<cell_t*>(cx->memory() + block);
+    for (uint32_t index : refs_) {
+      const Slot& slot = slots_[index];
+      copyBack(slot, phys + slot.offset);
+    }
+  }
+  if (int err = cx->HeapPop(block))
+    env_->ReportError(err);
+}
+
+void
+CallArguments::copyIn(PluginContext* cx, const Slot& slot, cell_t local_addr, cell_t* phys_addr)
+{
+  if (!slot.buffer)
+    return;
+
+  if (slot.type == SP_SIGPARAM_ARRAY) {
+    memcpy(phys_addr, slot.buffer, slot.size * sizeof(cell_t));
+    return;
+  }
+
+  // Same rules as ScriptedInvoker::Invoke().
+  if (!(slot.sz_flags & SM_PARAM_STRING_COPY))
+    return;
+  if (slot.sz_flags & SM_PARAM_STRING_UTF8)
+    cx->StringToLocalUTF8(local_addr, slot.size, (const char*)slot.buffer, nullptr);
+  else if (slot.sz_flags & SM_PARAM_STRING_BINARY)
+    memmove(phys_addr, slot.buffer, slot.size);
+  else
+    cx->StringToLocal(local_addr, slot.size, (const char*)slot.buffer);
+}
+
+void
+CallArguments::copyBack(const Slot& slot, const cell_t* phys_addr)
+{
+  if (!slot.buffer || !(slot.cp_flags & SM_PARAM_COPYBACK))
+    return;
+
+  if (slot.type == SP_SIGPARAM_ARRAY)
+    memcpy(slot.buffer, phys_addr, slot.size * sizeof(cell_t));
+  else
+    memcpy(slot.buffer, phys_addr, slot.size);
+}
+
+CallSignature::CallSignature(PluginContext* cx, ScriptedInvoker* fun)
+ : env_(Environment::get()),
+   fun_(fun),
+   context_(cx)
+{
+}
+
+CallSignature*
+CallSignature::New(PluginContext* cx, ScriptedInvoker* fun, const SignatureParam* params,
+                   unsigned int num_params)
+{
+  ke::UniquePtr<CallSignature> sig(new CallSignature(cx, fun));
+  if (!sig->args_.init(params, num_params))
+    return nullptr;
+  return sig.take();
+}
+
+IPluginFunction*
+CallSignature::GetFunction()
+{
+  return fun_;
+}
+
+unsigned int
+CallSignature::GetParamCount()
+{
+  return args_.count();
+}
+
+int
+CallSignature::SetCell(unsigned int param, cell_t value)
+{
+  return args_.setCell(param, value);
+}
+
+int
+CallSignature::SetFloat(unsigned int param, float value)
+{
+  return args_.setCell(param, sp::FloatCellUnion(value).cell);
+}
+
+int
+CallSignature::BindArray(unsigned int param, cell_t* array)
+{
+  return args_.bind(param, SP_SIGPARAM_ARRAY, array);
+}
+
+int
+CallSignature::BindString(unsigned int param, char* buffer)
+{
+  return args_.bind(param, SP_SIGPARAM_STRING, buffer);
+}
+
+int
+CallSignature::Execute(cell_t* result)
+{
+  if (!context_->IsOwnerThread())
+    return SP_ERROR_NOT_RUNNABLE;
+
+  env_->clearPendingException();
+
+  // See ScriptedInvoker::Execute().
+  ExceptionHandler eh(context_);
+  if (!Invoke(result)) {
+    assert(env_->hasPendingException());
+    return env_->getPendingExceptionCode();
+  }
+  return SP_ERROR_NONE;
+}
+
+bool
+CallSignature::Invoke(cell_t* rval)
+{
+  if (!context_->CheckOwnerThread())
+    return false;
+
+  cell_t block;
+  if (!args_.copyIn(context_, &block))
+    return false;
+
+  bool ok = context_->InvokeFunction(fun_, args_.values(), args_.count(), rval);
+
+  args_.copyOut(context_, block, ok);
+  return !env_->hasPendingException();
+}
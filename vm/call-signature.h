@@ -0,0 +1,116 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_call_signature_h_
+#define _include_sourcepawn_vm_call_signature_h_
+
+#include <sp_vm_api.h>
+#include <amtl/am-vector.h>
+
+namespace sp {
+
+using namespace SourcePawn;
+
+class Environment;
+class PluginContext;
+class ScriptedInvoker;
+
+// Parameters for a call, as bound by the host. Everything that does not
+// change from call to call - parameter types, copy-back flags, and where
+// each array or string goes on the heap - is worked out once, in init().
+class CallArguments
+{
+ public:
+  CallArguments();
+
+  // Returns false if any parameter is invalid.
+  bool init(const SignatureParam* params, unsigned int num_params);
+
+  unsigned int count() const {
+    return (unsigned int)slots_.length();
+  }
+  const cell_t* values() const {
+    return values_.buffer();
+  }
+
+  int setCell(unsigned int param, cell_t value);
+  int bind(unsigned int param, SignatureParamType type, void* buffer);
+
+  // Copy arrays and strings into a single block on |cx|'s heap, and fill in
+  // their addresses. On failure, an error is reported.
+  bool copyIn(PluginContext* cx, cell_t* block);
+
+  // Copy arrays and strings back if the call succeeded, and free the block.
+  void copyOut(PluginContext* cx, cell_t block, bool ok);
+
+ private:
+  struct Slot {
+    SignatureParamType type;
+    int sz_flags;
+    int cp_flags;
+    // Size of the array in cells, or of the string in bytes.
+    uint32_t size;
+    // Offset of the array or string from the start of the heap block.
+    uint32_t offset;
+    // Buffer bound by the host, if any.
+    void* buffer;
+  };
+
+  void copyIn(PluginContext* cx, const Slot& slot, cell_t local_addr, cell_t* phys_addr);
+  void copyBack(const Slot& slot, const cell_t* phys_addr);
+
+ private:
+  Environment* env_;
+  ke::Vector<Slot> slots_;
+  ke::Vector<cell_t> values_;
+
+  // Indexes of slots that are arrays or strings.
+  ke::Vector<uint32_t> refs_;
+
+  // Number of cells needed on the heap for all arrays and strings.
+  uint32_t heap_cells_;
+};
+
+// Implements ICallSignature.
+class CallSignature final : public ICallSignature
+{
+ public:
+  // Returns null if any parameter is invalid.
+  static CallSignature* New(PluginContext* cx, ScriptedInvoker* fun,
+                            const SignatureParam* params, unsigned int num_params);
+
+  IPluginFunction* GetFunction() override;
+  unsigned int GetParamCount() override;
+  int SetCell(unsigned int param, cell_t value) override;
+  int SetFloat(unsigned int param, float value) override;
+  int BindArray(unsigned int param, cell_t* array) override;
+  int BindString(unsigned int param, char* buffer) override;
+  bool Invoke(cell_t* rval) override;
+  int Execute(cell_t* result) override;
+
+ private:
+  CallSignature(PluginContext* cx, ScriptedInvoker* fun);
+
+ private:
+  Environment* env_;
+  ScriptedInvoker* fun_;
+  PluginContext* context_;
+  CallArguments args_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_call_signature_h_
@@ -0,0 +1,120 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_call_stats_h_
+#define _include_sourcepawn_vm_call_stats_h_
+
+#include <stdint.h>
+#include <amtl/am-platform.h>
+#if defined(KE_ARCH_X86) || defined(KE_ARCH_X64)
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# else
+#  include <x86intrin.h>
+# endif
+#else
+# include <chrono>
+#endif
+#include "environment.h"
+#include "method-info.h"
+#include "plugin-runtime.h"
+
+namespace sp {
+
+// Timestamps for call stats. On x86 this is the processor's timestamp
+// counter, which compiled code reads with rdtsc, so that the interpreters
+// and the JIT count in the same units. Elsewhere it is nanoseconds.
+static inline uint64_t
+ReadCallTicks()
+{
+#if defined(KE_ARCH_X86) || defined(KE_ARCH_X64)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Times one activation of a method in the interpreters, the same way the
+// JIT's prologue and RETN do. The environment adds up the total time of the
+// running method's callees: each activation saves and clears that on entry,
+// takes it out of its own time on exit, and then adds its own total back
+// for its caller.
+class CallTimer
+{
+ public:
+  CallTimer()
+   : start_(0),
+     saved_callee_ticks_(0)
+  {}
+
+  void enter(Environment* env) {
+    start_ = ReadCallTicks();
+    saved_callee_ticks_ = env->callee_ticks();
+    env->set_callee_ticks(0);
+  }
+
+  // The method returned.
+  void leave(Environment* env, MethodInfo* method) {
+    method->call_stats().calls++;
+    handOff(env, method);
+  }
+
+  // The method goes on in compiled code, through an OSR entry, which times
+  // the rest of it and counts the call when it returns.
+  void handOff(Environment* env, MethodInfo* method) {
+    uint64_t ticks = ReadCallTicks() - start_;
+    CallStats& stats = method->call_stats();
+    stats.total_ticks += ticks;
+    stats.self_ticks += ticks - env->callee_ticks();
+    env->set_callee_ticks(saved_callee_ticks_ + ticks);
+  }
+
+ private:
+  uint64_t start_;
+  uint64_t saved_callee_ticks_;
+};
+
+// Histogram bucket for a native call that took |ticks|: the index of the
+// highest set bit, so that bucket n holds 2^n to 2^(n+1)-1. Compiled code
+// computes the same thing with bsr.
+static inline size_t
+NativeStatsBucket(uint64_t ticks)
+{
+  ticks |= 1;
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(ticks);
+#else
+  size_t bucket = 0;
+  while (ticks >>= 1)
+    bucket++;
+  return bucket;
+#endif
+}
+
+// Records a native call that started at |start|, in the interpreters.
+static inline void
+RecordNativeCall(NativeStats* stats, uint64_t start)
+{
+  uint64_t ticks = ReadCallTicks() - start;
+  stats->calls++;
+  stats->total_ticks += ticks;
+  stats->histogram[NativeStatsBucket(ticks)]++;
+}
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_call_stats_h_
@@ -16,14 +16,16 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <am-refcounting.h>
+#include <am-refcounting-threadsafe.h>
 #include <am-vector.h>
 
 namespace sp {
 
 using namespace ke;
 
-// Manages CodeChunks, optimized for the underlying system allocator.
-class CodePool : public ke::Refcounted<CodePool>
+// Manages CodeChunks, optimized for the underlying system allocator. Chunks
+// may be handed out to compile queue threads, so the refcount is atomic.
+class CodePool : public ke::RefcountedThreadsafe<CodePool>
 {
   friend class CodeAllocator;
 
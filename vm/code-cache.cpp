@@ -0,0 +1,646 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <amtl/am-string.h>
+#include "code-cache.h"
+#include "compiled-function.h"
+#include "environment.h"
+#include "file-utils.h"
+#include "jit.h"
+#include "method-info.h"
+#include "plugin-context.h"
+#include "plugin-runtime.h"
+#include "md5/md5.h"
+
+using namespace sp;
+
+// Bump the version whenever the layout below, or the code the JIT emits,
+// changes in a way the VM version would not catch.
+static const uint32_t kCacheMagic = 0x434a5053; // "SPJC"
+static const uint32_t kCacheVersion = 2;
+
+#if defined(KE_ARCH_X64)
+static const char kCacheArch[] = "x64";
+#else
+static const char kCacheArch[] = "x86";
+#endif
+
+// The file is a FileHeader, a function count, that many functions, and an
+// MD5 digest of everything before it.
+struct FileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  char vm_version[64];
+  char arch[8];
+  // The x64 JIT does not use any optional instruction sets, so this is
+  // always 0 for now.
+  uint32_t cpu_features;
+  // The code size and hash pin down the method layout; the rest are baked
+  // into the code as constants.
+  uint8_t code_hash[16];
+  uint8_t data_hash[16];
+  uint32_t data_size;
+  uint32_t heap_size;
+  uint32_t debug_breaks;
+};
+
+// Each function is a FunctionHeader, followed by its code and then each of
+// its tables.
+struct FunctionHeader
+{
+  uint32_t pcode_offset;
+  uint32_t code_length;
+  uint32_t nrelocations;
+  uint32_t nloop_edges;
+  uint32_t ncip_map;
+  uint32_t nosr_entries;
+  uint32_t nreturn_sites;
+  uint32_t nnatives;
+};
+
+// What a relocated address points into.
+enum class RelocationTarget : uint8_t
+{
+  Function,
+  Environment,
+  Context,
+  Natives,
+  // One of CompilerBase::ExternalSymbol().
+  Symbol
+};
+
+struct CachedRelocation
+{
+  uint32_t offset;
+  RelocationKind kind;
+  RelocationTarget target;
+  uint16_t padding;
+  // The offset into the target, or the symbol index.
+  uint64_t value;
+};
+
+// A native with an opcode replacement, which the compiler inlines once it is
+// bound for good.
+struct CachedNative
+{
+  uint32_t index;
+  uint32_t inlined;
+};
+
+static const size_t kDigestSize = 16;
+
+// Reads structures out of a buffer that has not been checked yet.
+class BufferReader
+{
+ public:
+  BufferReader(const uint8_t* bytes, size_t length)
+   : bytes_(bytes),
+     length_(length),
+     pos_(0)
+  {}
+
+  template <typename T>
+  bool read(T* out) {
+    const uint8_t* ptr = skip(sizeof(T));
+    if (!ptr)
+      return false;
+    memcpy(out, ptr, sizeof(T));
+    return true;
+  }
+
+  // Return a pointer to the next |count| items of |size| bytes each.
+  const uint8_t* skip(size_t count, size_t size = 1) {
+    if (size && count > (length_ - pos_) / size)
+      return nullptr;
+    const uint8_t* ptr = bytes_ + pos_;
+    pos_ += count * size;
+    return ptr;
+  }
+
+  size_t pos() const {
+    return pos_;
+  }
+
+ private:
+  const uint8_t* bytes_;
+  size_t length_;
+  size_t pos_;
+};
+
+static uintptr_t
+ReadAddress(const uint8_t* field, RelocationKind kind)
+{
+  switch (kind) {
+    case RelocationKind::Pointer:
+    {
+      uintptr_t value;
+      memcpy(&value, field, sizeof(value));
+      return value;
+    }
+    case RelocationKind::Unsigned32:
+    {
+      uint32_t value;
+      memcpy(&value, field, sizeof(value));
+      return uintptr_t(value);
+    }
+    default:
+    {
+      int32_t value;
+      memcpy(&value, field, sizeof(value));
+      return uintptr_t(intptr_t(value));
+    }
+  }
+}
+
+// Returns false if |address| cannot be encoded in the field.
+static bool
+WriteAddress(uint8_t* field, RelocationKind kind, uintptr_t address)
+{
+  switch (kind) {
+    case RelocationKind::Pointer:
+      memcpy(field, &address, sizeof(address));
+      return true;
+    case RelocationKind::Unsigned32:
+    {
+      uint32_t value = uint32_t(address);
+      if (uintptr_t(value) != address)
+        return false;
+      memcpy(field, &value, sizeof(value));
+      return true;
+    }
+    case RelocationKind::Signed32:
+    {
+      int32_t value = int32_t(intptr_t(address));
+      if (uintptr_t(intptr_t(value)) != address)
+        return false;
+      memcpy(field, &value, sizeof(value));
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+static size_t
+RelocationSize(RelocationKind kind)
+{
+  return kind == RelocationKind::Pointer ? sizeof(void*) : sizeof(int32_t);
+}
+
+// The address ranges, other than the function itself, that code may refer
+// into. These are the same for every function in a runtime.
+struct RelocationBase
+{
+  RelocationTarget target;
+  uintptr_t start;
+  size_t length;
+};
+
+static void
+GetRelocationBases(PluginRuntime* rt, RelocationBase bases[3])
+{
+  bases[0].target = RelocationTarget::Environment;
+  bases[0].start = uintptr_t(Environment::get());
+  bases[0].length = sizeof(Environment);
+  bases[1].target = RelocationTarget::Context;
+  bases[1].start = uintptr_t(rt->GetBaseContext());
+  bases[1].length = sizeof(PluginContext);
+  bases[2].target = RelocationTarget::Natives;
+  bases[2].start = uintptr_t(rt->NativeAt(0));
+  bases[2].length = rt->image()->NumNatives() * sizeof(NativeEntry);
+}
+
+bool
+CodeCache::IsSupported()
+{
+#if defined(KE_ARCH_X64)
+  return true;
+#else
+  // Only the x64 assembler records relocations.
+  return false;
+#endif
+}
+
+CodeCache*
+CodeCache::Open(PluginRuntime* rt, const char* dir)
+{
+  if (!IsSupported())
+    return nullptr;
+
+  char name[64];
+  const unsigned char* hash = rt->GetCodeHash();
+  for (size_t i = 0; i < 16; i++)
+    ke::SafeSprintf(&name[i * 2], 3, "%02x", hash[i]);
+
+  char path[4096];
+  ke::SafeSprintf(path, sizeof(path), "%s/%s-%s.jit", dir, name, kCacheArch);
+
+  ke::AutoPtr<CodeCache> cache(new CodeCache(rt, path));
+  if (!cache->load())
+    return nullptr;
+
+  // Methods with cached code skip the interpreter, since there is nothing
+  // left to wait for.
+  for (size_t i = 0; i < cache->entries_.length(); i++) {
+    FunctionHeader header;
+    memcpy(&header, cache->entries_[i].bytes.get(), sizeof(header));
+    if (RefPtr<MethodInfo> method = rt->AcquireMethod(header.pcode_offset))
+      method->setHasCachedCode();
+  }
+  return cache.take();
+}
+
+CodeCache::CodeCache(PluginRuntime* rt, const char* path)
+ : rt_(rt),
+   path_(path),
+   dirty_(false)
+{
+  entry_map_.init(16);
+}
+
+static void
+InitFileHeader(PluginRuntime* rt, FileHeader* header)
+{
+  memset(header, 0, sizeof(*header));
+  header->magic = kCacheMagic;
+  header->version = kCacheVersion;
+  ke::SafeStrcpy(header->vm_version, sizeof(header->vm_version),
+                 Environment::get()->APIv2()->GetVersionString());
+  ke::SafeStrcpy(header->arch, sizeof(header->arch), kCacheArch);
+  header->cpu_features = 0;
+  memcpy(header->code_hash, rt->GetCodeHash(), sizeof(header->code_hash));
+  memcpy(header->data_hash, rt->GetDataHash(), sizeof(header->data_hash));
+  header->data_size = rt->GetBaseContext()->DataSize();
+  header->heap_size = rt->GetBaseContext()->HeapSize();
+  header->debug_breaks = Environment::get()->IsDebugBreakEnabled();
+}
+
+bool
+CodeCache::load()
+{
+  FILE* fp = fopen(path_.chars(), "rb");
+  if (!fp)
+    return true;
+
+  FileReader file(fp);
+  fclose(fp);
+
+  // Anything that does not check out is ignored, and replaced on the next
+  // flush.
+  if (file.length() < sizeof(FileHeader) + sizeof(uint32_t) + kDigestSize)
+    return true;
+
+  size_t body_length = file.length() - kDigestSize;
+  unsigned char digest[kDigestSize];
+  MD5 md5;
+  md5.update(file.buffer(), body_length);
+  md5.finalize();
+  md5.raw_digest(digest);
+  if (memcmp(digest, file.buffer() + body_length, kDigestSize) != 0)
+    return true;
+
+  FileHeader expected, header;
+  InitFileHeader(rt_, &expected);
+
+  BufferReader reader(file.buffer(), body_length);
+  uint32_t nfunctions;
+  if (!reader.read(&header) ||
+      memcmp(&header, &expected, sizeof(header)) != 0 ||
+      !reader.read(&nfunctions))
+  {
+    return true;
+  }
+
+  for (uint32_t i = 0; i < nfunctions; i++) {
+    size_t start = reader.pos();
+
+    FunctionHeader fn;
+    if (!reader.read(&fn) ||
+        !reader.skip(fn.code_length) ||
+        !reader.skip(fn.nrelocations, sizeof(CachedRelocation)) ||
+        !reader.skip(fn.nloop_edges, sizeof(LoopEdge)) ||
+        !reader.skip(fn.ncip_map, sizeof(CipMapEntry)) ||
+        !reader.skip(fn.nosr_entries, sizeof(OsrEntry)) ||
+        !reader.skip(fn.nreturn_sites, sizeof(ReturnSite)) ||
+        !reader.skip(fn.nnatives, sizeof(CachedNative)))
+    {
+      break;
+    }
+
+    Entry entry;
+    entry.length = reader.pos() - start;
+    entry.bytes = ke::MakeUnique<uint8_t[]>(entry.length);
+    if (!entry.bytes)
+      return false;
+    memcpy(entry.bytes.get(), file.buffer() + start, entry.length);
+
+    if (!store(fn.pcode_offset, ke::Move(entry)))
+      return false;
+  }
+
+  // Nothing has changed, so there is no need to write this back out.
+  dirty_ = false;
+  return true;
+}
+
+bool
+CodeCache::store(uint32_t pcode_offset, Entry&& entry)
+{
+  EntryMap::Insert p = entry_map_.findForAdd(pcode_offset);
+  if (p.found()) {
+    entries_[p->value] = ke::Move(entry);
+  } else {
+    if (!entries_.append(ke::Move(entry)))
+      return false;
+    if (!entry_map_.add(p, pcode_offset, entries_.length() - 1))
+      return false;
+  }
+  dirty_ = true;
+  return true;
+}
+
+CompiledFunction*
+CodeCache::Lookup(MethodInfo* method, bool background)
+{
+  ke::AutoLock lock(&lock_);
+
+  EntryMap::Result r = entry_map_.find(method->pcode_offset());
+  if (!r.found())
+    return nullptr;
+
+  const Entry& entry = entries_[r->value];
+  BufferReader reader(entry.bytes.get(), entry.length);
+
+  // The entry was checked when it was loaded or added.
+  FunctionHeader fn;
+  reader.read(&fn);
+  const uint8_t* code = reader.skip(fn.code_length);
+  const CachedRelocation* relocs = reinterpret_cast<const CachedRelocation*>(
+    reader.skip(fn.nrelocations, sizeof(CachedRelocation)));
+  const uint8_t* edges = reader.skip(fn.nloop_edges, sizeof(LoopEdge));
+  const uint8_t* cip_map = reader.skip(fn.ncip_map, sizeof(CipMapEntry));
+  const uint8_t* osr_entries = reader.skip(fn.nosr_entries, sizeof(OsrEntry));
+  const uint8_t* return_sites = reader.skip(fn.nreturn_sites, sizeof(ReturnSite));
+  const CachedNative* natives = reinterpret_cast<const CachedNative*>(
+    reader.skip(fn.nnatives, sizeof(CachedNative)));
+
+  // The code is only good if natives would be inlined exactly as they were
+  // when it was compiled. Off the main thread, their bindings may be
+  // changing, so don't look.
+  for (uint32_t i = 0; i < fn.nnatives; i++) {
+    CachedNative native;
+    memcpy(&native, &natives[i], sizeof(native));
+    if (background ||
+        native.index >= rt_->image()->NumNatives() ||
+        rt_->IsNativeInlined(native.index) != !!native.inlined)
+    {
+      return nullptr;
+    }
+  }
+
+  CodeChunk chunk = Environment::get()->AllocateCode(fn.code_length);
+  if (!chunk.address())
+    return nullptr;
+  memcpy(chunk.address(), code, fn.code_length);
+
+  RelocationBase bases[3];
+  GetRelocationBases(rt_, bases);
+
+  // If anything fails from here, the chunk is simply dropped.
+  for (uint32_t i = 0; i < fn.nrelocations; i++) {
+    CachedRelocation reloc;
+    memcpy(&reloc, &relocs[i], sizeof(reloc));
+
+    size_t size = RelocationSize(reloc.kind);
+    if (reloc.offset > fn.code_length || fn.code_length - reloc.offset < size)
+      return nullptr;
+
+    uintptr_t address;
+    switch (reloc.target) {
+      case RelocationTarget::Function:
+        if (reloc.value > fn.code_length)
+          return nullptr;
+        address = uintptr_t(chunk.address()) + uintptr_t(reloc.value);
+        break;
+      case RelocationTarget::Symbol:
+      {
+        void* symbol = reloc.value <= UINT32_MAX
+                       ? CompilerBase::ExternalSymbol(uint32_t(reloc.value))
+                       : nullptr;
+        if (!symbol)
+          return nullptr;
+        address = uintptr_t(symbol);
+        break;
+      }
+      default:
+      {
+        const RelocationBase* base = nullptr;
+        for (size_t j = 0; j < 3; j++) {
+          if (bases[j].target == reloc.target)
+            base = &bases[j];
+        }
+        if (!base || reloc.value >= base->length)
+          return nullptr;
+        address = base->start + uintptr_t(reloc.value);
+        break;
+      }
+    }
+
+    if (!WriteAddress(chunk.address() + reloc.offset, reloc.kind, address))
+      return nullptr;
+  }
+
+  ke::AutoPtr<FixedArray<LoopEdge>> edge_table(new FixedArray<LoopEdge>(fn.nloop_edges));
+  memcpy(edge_table->buffer(), edges, fn.nloop_edges * sizeof(LoopEdge));
+
+  ke::AutoPtr<FixedArray<CipMapEntry>> cip_table(new FixedArray<CipMapEntry>(fn.ncip_map));
+  memcpy(cip_table->buffer(), cip_map, fn.ncip_map * sizeof(CipMapEntry));
+
+  ke::AutoPtr<FixedArray<OsrEntry>> osr_table(new FixedArray<OsrEntry>(fn.nosr_entries));
+  memcpy(osr_table->buffer(), osr_entries, fn.nosr_entries * sizeof(OsrEntry));
+
+  ke::AutoPtr<FixedArray<ReturnSite>> return_table(new FixedArray<ReturnSite>(fn.nreturn_sites));
+  memcpy(return_table->buffer(), return_sites, fn.nreturn_sites * sizeof(ReturnSite));
+
+  // Cached code always checks its memory accesses; see
+  // Environment::SetUncheckedMemoryEnabled().
+  return new CompiledFunction(chunk, fn.pcode_offset, edge_table.take(), cip_table.take(),
+                              osr_table.take(), new FixedArray<FaultSite>(0),
+                              return_table.take());
+}
+
+void
+CodeCache::Add(CompiledFunction* fun,
+               const ke::Vector<Relocation>& relocations,
+               const ke::Vector<uint32_t>& natives)
+{
+  const uint8_t* code = reinterpret_cast<const uint8_t*>(fun->GetEntryAddress());
+  size_t code_length = fun->GetCodeLength();
+
+  RelocationBase bases[3];
+  GetRelocationBases(rt_, bases);
+
+  ke::Vector<CachedRelocation> relocs;
+  for (const Relocation& reloc : relocations) {
+    uintptr_t address = ReadAddress(code + reloc.offset, reloc.kind);
+
+    CachedRelocation cached;
+    memset(&cached, 0, sizeof(cached));
+    cached.offset = reloc.offset;
+    cached.kind = reloc.kind;
+
+    bool found = false;
+    if (address >= uintptr_t(code) && address <= uintptr_t(code) + code_length) {
+      cached.target = RelocationTarget::Function;
+      cached.value = address - uintptr_t(code);
+      found = true;
+    }
+    for (size_t i = 0; !found && i < 3; i++) {
+      if (address >= bases[i].start && address - bases[i].start < bases[i].length) {
+        cached.target = bases[i].target;
+        cached.value = address - bases[i].start;
+        found = true;
+      }
+    }
+    for (uint32_t i = 0; !found; i++) {
+      void* symbol = CompilerBase::ExternalSymbol(i);
+      if (!symbol)
+        break;
+      if (uintptr_t(symbol) == address) {
+        cached.target = RelocationTarget::Symbol;
+        cached.value = i;
+        found = true;
+      }
+    }
+
+    // The code refers to something we can't find again, like another
+    // function, so it can't be cached.
+    if (!found)
+      return;
+    if (!relocs.append(cached))
+      return;
+  }
+
+  FunctionHeader fn;
+  fn.pcode_offset = fun->GetCodeOffset();
+  fn.code_length = uint32_t(code_length);
+  fn.nrelocations = uint32_t(relocs.length());
+  fn.nloop_edges = fun->NumLoopEdges();
+  fn.ncip_map = uint32_t(fun->GetCipMap().length());
+  fn.nosr_entries = uint32_t(fun->GetOsrEntries().length());
+  fn.nreturn_sites = uint32_t(fun->GetReturnSites().length());
+  fn.nnatives = uint32_t(natives.length());
+
+  Entry entry;
+  entry.length = sizeof(fn) +
+                 code_length +
+                 fn.nrelocations * sizeof(CachedRelocation) +
+                 fn.nloop_edges * sizeof(LoopEdge) +
+                 fn.ncip_map * sizeof(CipMapEntry) +
+                 fn.nosr_entries * sizeof(OsrEntry) +
+                 fn.nreturn_sites * sizeof(ReturnSite) +
+                 fn.nnatives * sizeof(CachedNative);
+  entry.bytes = ke::MakeUnique<uint8_t[]>(entry.length);
+  if (!entry.bytes)
+    return;
+
+  uint8_t* ptr = entry.bytes.get();
+  auto write = [&ptr](const void* src, size_t length) -> void {
+    memcpy(ptr, src, length);
+    ptr += length;
+  };
+
+  write(&fn, sizeof(fn));
+  write(code, code_length);
+  write(relocs.buffer(), relocs.length() * sizeof(CachedRelocation));
+  for (uint32_t i = 0; i < fn.nloop_edges; i++)
+    write(&fun->GetLoopEdge(i), sizeof(LoopEdge));
+  write(fun->GetCipMap().buffer(), fn.ncip_map * sizeof(CipMapEntry));
+  write(fun->GetOsrEntries().buffer(), fn.nosr_entries * sizeof(OsrEntry));
+  write(fun->GetReturnSites().buffer(), fn.nreturn_sites * sizeof(ReturnSite));
+  for (uint32_t index : natives) {
+    CachedNative native;
+    native.index = index;
+    native.inlined = rt_->IsNativeInlined(index);
+    write(&native, sizeof(native));
+  }
+  assert(ptr == entry.bytes.get() + entry.length);
+
+  ke::AutoLock lock(&lock_);
+  store(fn.pcode_offset, ke::Move(entry));
+}
+
+void
+CodeCache::Flush()
+{
+  ke::AutoLock lock(&lock_);
+  if (!dirty_)
+    return;
+
+  // Write to a temporary file first, so a crash or another process never
+  // sees half of one.
+  char tmp_path[4096];
+  ke::SafeSprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path_.chars());
+
+  FILE* fp = fopen(tmp_path, "wb");
+  if (!fp)
+    return;
+
+  MD5 md5;
+  bool ok = true;
+  auto write = [&](const void* src, size_t length) -> void {
+    if (!ok)
+      return;
+    md5.update(reinterpret_cast<const unsigned char*>(src), length);
+    ok = fwrite(src, 1, length, fp) == length;
+  };
+
+  FileHeader header;
+  InitFileHeader(rt_, &header);
+  write(&header, sizeof(header));
+
+  uint32_t nfunctions = uint32_t(entries_.length());
+  write(&nfunctions, sizeof(nfunctions));
+  for (const Entry& entry : entries_)
+    write(entry.bytes.get(), entry.length);
+
+  unsigned char digest[kDigestSize];
+  md5.finalize();
+  md5.raw_digest(digest);
+  if (ok)
+    ok = fwrite(digest, 1, sizeof(digest), fp) == sizeof(digest);
+
+  if (fclose(fp) != 0)
+    ok = false;
+  if (!ok) {
+    remove(tmp_path);
+    return;
+  }
+
+  if (rename(tmp_path, path_.chars()) != 0) {
+    // Windows will not rename over an existing file.
+    remove(path_.chars());
+    if (rename(tmp_path, path_.chars()) != 0) {
+      remove(tmp_path);
+      return;
+    }
+  }
+  dirty_ = false;
+}
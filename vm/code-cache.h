@@ -0,0 +1,101 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_code_cache_h_
+#define _include_sourcepawn_vm_code_cache_h_
+
+#include <stddef.h>
+#include <sp_vm_types.h>
+#include <am-thread-utils.h>
+#include <amtl/am-hashmap.h>
+#include <amtl/am-string.h>
+#include <amtl/am-uniqueptr.h>
+#include <amtl/am-vector.h>
+#include "assembler.h"
+
+namespace sp {
+
+class CompiledFunction;
+class MethodInfo;
+class PluginRuntime;
+
+// Keeps compiled code for a plugin on disk, so that it does not have to be
+// verified and compiled again the next time the same plugin is loaded.
+//
+// Each plugin gets one file in the cache directory, named after its code
+// hash. The file is only used if the data section, the VM version and the
+// target all match as well; otherwise it is ignored, and overwritten when
+// the runtime goes away. The directory is trusted: code read from it is
+// run as is.
+//
+// Functions are stored as they were linked, along with every absolute
+// address in them, which is recorded relative to whatever it points into
+// (the function itself, the environment, the context, the runtime's natives
+// or one of the compiler's helpers) and adjusted when the code is mapped
+// back in.
+class CodeCache
+{
+ public:
+  // Whether code for this target can be cached at all.
+  static bool IsSupported();
+
+  // Returns null if the cache cannot be used. A missing or stale file just
+  // gives an empty cache.
+  static CodeCache* Open(PluginRuntime* rt, const char* dir);
+
+  // Return cached code for |method|, or null if there is none or it no
+  // longer applies. Off the main thread, functions that depend on how
+  // natives are bound are never returned.
+  CompiledFunction* Lookup(MethodInfo* method, bool background);
+
+  // Offer newly compiled code to the cache. |relocations| are the ones the
+  // assembler recorded, and |natives| lists the replaceable natives the
+  // function refers to. Code that refers to anything the cache does not
+  // know about is not stored.
+  void Add(CompiledFunction* fun,
+           const ke::Vector<Relocation>& relocations,
+           const ke::Vector<uint32_t>& natives);
+
+  // Write the file back out, if anything was added. Called when the runtime
+  // is destroyed.
+  void Flush();
+
+ private:
+  CodeCache(PluginRuntime* rt, const char* path);
+
+  bool load();
+
+  // A function, as it is laid out in the file.
+  struct Entry {
+    ke::UniquePtr<uint8_t[]> bytes;
+    size_t length;
+  };
+  bool store(uint32_t pcode_offset, Entry&& entry);
+
+ private:
+  PluginRuntime* rt_;
+  ke::AString path_;
+  ke::Mutex lock_;
+  bool dirty_;
+  ke::Vector<Entry> entries_;
+
+  typedef ke::HashMap<uint32_t, size_t, ke::IntegerPolicy<uint32_t>> EntryMap;
+  EntryMap entry_map_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_code_cache_h_
@@ -12,6 +12,7 @@
 //
 #include "code-stubs.h"
 #include "environment.h"
+#include "perf-maps.h"
 
 using namespace sp;
 
@@ -28,5 +29,17 @@ CodeStubs::Initialize()
     return false;
   if (!CompileInvokeStub())
     return false;
+#if defined(SP_HAS_PERF_MAPS)
+  if (PerfMaps::IsEnabled())
+    AddToPerfMaps();
+#endif
   return true;
 }
+
+void
+CodeStubs::AddToPerfMaps()
+{
+#if defined(SP_HAS_PERF_MAPS)
+  PerfMaps::AddStub("sp::InvokeStub", invoke_stub_.address(), invoke_stub_.bytes());
+#endif
+}
@@ -34,6 +34,9 @@ class CodeStubs
 
   SPVM_NATIVE_FUNC CreateFakeNativeStub(SPVM_FAKENATIVE_FUNC callback, void* userData);
 
+  // List the stubs compiled so far; see PerfMaps.
+  void AddToPerfMaps();
+
   InvokeStubFn InvokeStub() const {
     return (InvokeStubFn)invoke_stub_.address();
   }
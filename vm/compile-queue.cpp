@@ -0,0 +1,191 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include "compile-queue.h"
+#include "environment.h"
+#include "jit.h"
+#include "method-info.h"
+#include "plugin-runtime.h"
+#include "pool-allocator.h"
+
+using namespace sp;
+
+typedef MethodInfo::CompileState CompileState;
+
+CompileQueue::CompileQueue(Environment* env)
+ : env_(env),
+   terminate_(false),
+   next_job_(0)
+{
+}
+
+CompileQueue::~CompileQueue()
+{
+  Shutdown();
+}
+
+bool
+CompileQueue::Start(size_t threads)
+{
+  for (size_t i = 0; i < threads; i++) {
+    ke::AutoPtr<Worker> worker(new Worker());
+    worker->rt = nullptr;
+
+    Worker* ptr = worker.get();
+    worker->thread = new ke::Thread([this, ptr]() -> void {
+      Run(ptr);
+    }, "SP Compiler");
+    if (!worker->thread->Succeeded())
+      return false;
+
+    if (!workers_.append(ke::Move(worker)))
+      return false;
+  }
+  return true;
+}
+
+void
+CompileQueue::Shutdown()
+{
+  {
+    ke::AutoLock lock(&cv_);
+    terminate_ = true;
+    for (size_t i = next_job_; i < jobs_.length(); i++)
+      drop(jobs_[i]);
+    cv_.NotifyAll();
+  }
+
+  for (auto& worker : workers_)
+    worker->thread->Join();
+  workers_.clear();
+}
+
+void
+CompileQueue::Enqueue(PluginRuntime* rt)
+{
+  ke::AutoLock lock(&cv_);
+
+  // Whatever is missed here is compiled lazily as usual.
+  rt->FindMethods([this, rt](cell_t offset) -> void {
+    push(rt, offset);
+  });
+
+  cv_.NotifyAll();
+}
+
+void
+CompileQueue::push(PluginRuntime* rt, cell_t offset)
+{
+  RefPtr<MethodInfo> method = rt->AcquireMethod(offset);
+  if (!method || method->jit() || method->isCompiling())
+    return;
+
+  Job job;
+  job.rt = rt;
+  job.method = method;
+  if (!jobs_.append(ke::Move(job)))
+    return;
+
+  method->setCompileState(CompileState::Queued);
+}
+
+void
+CompileQueue::drop(Job& job)
+{
+  if (job.method && job.method->compileState() == CompileState::Queued)
+    job.method->setCompileState(CompileState::None);
+  job.method = nullptr;
+}
+
+void
+CompileQueue::Wait(MethodInfo* method)
+{
+  ke::AutoLock lock(&cv_);
+
+  // If no thread has started on it, don't wait behind the rest of the queue.
+  // The method is compiled lazily instead, like any other.
+  if (method->compileState() == CompileState::Queued) {
+    method->setCompileState(CompileState::None);
+    return;
+  }
+
+  while (method->isCompiling())
+    cv_.Wait();
+}
+
+void
+CompileQueue::Cancel(PluginRuntime* rt)
+{
+  ke::AutoLock lock(&cv_);
+  for (size_t i = next_job_; i < jobs_.length(); i++) {
+    if (jobs_[i].rt == rt)
+      drop(jobs_[i]);
+  }
+
+  for (;;) {
+    bool busy = false;
+    for (const auto& worker : workers_) {
+      if (worker->rt == rt)
+        busy = true;
+    }
+    if (!busy)
+      break;
+    cv_.Wait();
+  }
+}
+
+void
+CompileQueue::Run(Worker* worker)
+{
+  // The compiler allocates from the thread's pool, and looks at the
+  // environment it is compiling for.
+  PoolAllocator::InitDefault();
+  Environment::EnterHelperThread(env_);
+
+  {
+    ke::AutoLock lock(&cv_);
+    while (!terminate_) {
+      if (next_job_ == jobs_.length()) {
+        jobs_.clear();
+        next_job_ = 0;
+        cv_.Wait();
+        continue;
+      }
+
+      Job& job = jobs_[next_job_++];
+      RefPtr<MethodInfo> method = job.method;
+      job.method = nullptr;
+      if (!method || method->compileState() != CompileState::Queued)
+        continue;
+
+      method->setCompileState(CompileState::Running);
+      worker->rt = job.rt;
+
+      // Failures are dropped here. The method is compiled again, or
+      // interpreted, when it is first called, and any error is reported
+      // then.
+      cv_.Unlock();
+      CompilerBase::CompileInBackground(worker->rt, method);
+      cv_.Lock();
+
+      worker->rt = nullptr;
+      method->setCompileState(CompileState::None);
+      cv_.NotifyAll();
+    }
+  }
+
+  PoolAllocator::FreeDefault();
+}
@@ -0,0 +1,90 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_compile_queue_h_
+#define _include_sourcepawn_vm_compile_queue_h_
+
+#include <stddef.h>
+#include <sp_vm_types.h>
+#include <am-thread-utils.h>
+#include <amtl/am-autoptr.h>
+#include <amtl/am-refcounting.h>
+#include <amtl/am-vector.h>
+
+namespace sp {
+
+class Environment;
+class MethodInfo;
+class PluginRuntime;
+
+// Compiles every method of a newly loaded plugin on a pool of background
+// threads, so that calls do not stall on the JIT later.
+//
+// A queued method is marked as compiling until a thread is done with it, and
+// nothing else may touch it in the meantime. The main thread calls Wait()
+// before running such a method: if no thread has picked it up yet, it is
+// simply dropped from the queue and compiled lazily as usual.
+class CompileQueue
+{
+ public:
+  explicit CompileQueue(Environment* env);
+  ~CompileQueue();
+
+  bool Start(size_t threads);
+  void Shutdown();
+
+  // Queue every method in |rt|. Called from the main thread.
+  void Enqueue(PluginRuntime* rt);
+
+  // Called from the main thread.
+  void Wait(MethodInfo* method);
+
+  // Drop every method of |rt| that is still queued, and wait for any that are
+  // being compiled. Called from the main thread.
+  void Cancel(PluginRuntime* rt);
+
+ private:
+  struct Worker {
+    ke::AutoPtr<ke::Thread> thread;
+
+    // The runtime whose method is being compiled, if any.
+    PluginRuntime* rt;
+  };
+  struct Job {
+    PluginRuntime* rt;
+
+    // Null once the job has been taken or dropped.
+    ke::RefPtr<MethodInfo> method;
+  };
+
+  // Worker threads.
+  void Run(Worker* worker);
+
+  void push(PluginRuntime* rt, cell_t offset);
+  void drop(Job& job);
+
+ private:
+  Environment* env_;
+  ke::ConditionVariable cv_;
+  bool terminate_;
+  ke::Vector<ke::AutoPtr<Worker>> workers_;
+  ke::Vector<Job> jobs_;
+  size_t next_job_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_compile_queue_h_
@@ -12,6 +12,8 @@
 //
 #include "compiled-function.h"
 #include "environment.h"
+#include "gdb-jit.h"
+#include "legacy-image.h"
 #include <amtl/am-platform.h>
 
 using namespace sp;
@@ -19,17 +21,28 @@ using namespace sp;
 CompiledFunction::CompiledFunction(const CodeChunk& code,
                                    cell_t pcode_offs,
                                    FixedArray<LoopEdge>* edges,
-                                   FixedArray<CipMapEntry>* cipmap)
+                                   FixedArray<CipMapEntry>* cipmap,
+                                   FixedArray<OsrEntry>* osr_entries,
+                                   FixedArray<FaultSite>* fault_sites,
+                                   FixedArray<ReturnSite>* return_sites)
  : code_(code),
    code_offset_(pcode_offs),
    edges_(edges),
    cip_map_(cipmap),
-   cip_map_sorted_(false)
+   osr_entries_(osr_entries),
+   fault_sites_(fault_sites),
+   return_sites_(return_sites),
+   cip_map_sorted_(false),
+   gdb_entry_(nullptr)
 {
 }
 
 CompiledFunction::~CompiledFunction()
 {
+#if defined(SP_HAS_GDB_JIT)
+  if (gdb_entry_)
+    GdbJit::RemoveFunction(this);
+#endif
 }
 
 static int cip_map_entry_sort_cmp(const void* a1, const void* a2)
@@ -87,3 +100,73 @@ CompiledFunction::FindCipByPc(void* pc)
 
   return code_offset_ + reinterpret_cast<CipMapEntry*>(ptr)->cipoffs;
 }
+
+bool
+CompiledFunction::BuildLineMap(LegacyImage* image, Vector<LineMapEntry>* lines) const
+{
+  // Work on a copy, since FindCipByPc() sorts the map in place on the
+  // thread running the function.
+  Vector<CipMapEntry> entries;
+  if (!entries.resize(cip_map_->length()))
+    return false;
+  for (size_t i = 0; i < cip_map_->length(); i++)
+    entries[i] = cip_map_->at(i);
+  qsort(entries.buffer(), entries.length(), sizeof(CipMapEntry), cip_map_entry_sort_cmp);
+
+  for (const auto& entry : entries) {
+    uint32_t cip = uint32_t(code_offset_) + entry.cipoffs;
+
+    uint32_t line;
+    if (!image->LookupLine(cip, &line))
+      continue;
+    const char* file = image->LookupFile(cip);
+    if (!file)
+      continue;
+
+    if (!lines->empty() && lines->back().line == line && lines->back().file == file)
+      continue;
+
+    LineMapEntry le = { entry.pcoffs, line, file };
+    if (!lines->append(le))
+      return false;
+  }
+  return true;
+}
+
+void*
+CompiledFunction::FindOsrEntry(cell_t cip)
+{
+  uint32_t cipoffs = cip - code_offset_;
+  for (size_t i = 0; i < osr_entries_->length(); i++) {
+    const OsrEntry& entry = osr_entries_->at(i);
+    if (entry.cipoffs == cipoffs)
+      return reinterpret_cast<uint8_t*>(code_.address()) + entry.pcoffs;
+  }
+  return nullptr;
+}
+
+void*
+CompiledFunction::FindFaultPath(void* pc)
+{
+  if (uintptr_t(pc) < uintptr_t(code_.address()))
+    return nullptr;
+
+  uint32_t pcoffs = intptr_t(pc) - intptr_t(code_.address());
+  if (pcoffs >= code_.bytes())
+    return nullptr;
+
+  // Sites are recorded in the order they were emitted.
+  size_t lo = 0;
+  size_t hi = fault_sites_->length();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const FaultSite& site = fault_sites_->at(mid);
+    if (site.pcoffs == pcoffs)
+      return reinterpret_cast<uint8_t*>(code_.address()) + site.path_pcoffs;
+    if (site.pcoffs < pcoffs)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return nullptr;
+}
@@ -17,6 +17,7 @@
 #include <amtl/am-autoptr.h>
 #include <amtl/am-fixedarray.h>
 #include <amtl/am-refcounting.h>
+#include <amtl/am-vector.h>
 #include "code-allocator.h"
 
 namespace sp {
@@ -24,6 +25,8 @@ namespace sp {
 using namespace ke;
 
 class PluginRuntime;
+class LegacyImage;
+struct GdbJitEntry;
 
 struct LoopEdge
 {
@@ -44,13 +47,54 @@ struct CipMapEntry {
 
 static const ucell_t kInvalidCip = 0xffffffff;
 
+// An alternate entry point at the target of a backward jump, which an
+// interpreted frame in a hot loop can use to continue in compiled code. It
+// expects pri and alt to have been pushed (alt first) on top of the
+// interpreter's stack.
+struct OsrEntry {
+  // Offset of the jump target from the first cip of the function.
+  uint32_t cipoffs;
+  // Offset of the entry point from the first pc of the function.
+  uint32_t pcoffs;
+};
+
+// A load or store that does not check its address, because the plugin's
+// memory is followed by enough guard pages that any bad address faults.
+// The fault handler resumes at the error path, as if a check had failed.
+struct FaultSite {
+  // Offset of the load or store from the first pc of the function.
+  uint32_t pcoffs;
+  // Offset of its error path from the first pc of the function.
+  uint32_t path_pcoffs;
+};
+
+// The ret that ends a RETN. By then leaveFrame() has popped the frame, so
+// the caller's frame pointer is back and only the return address is left on
+// the stack. Unwinders need to know, since everywhere else in the function
+// the frame is addressed from the frame pointer.
+struct ReturnSite {
+  // Offset of the ret from the first pc of the function.
+  uint32_t pcoffs;
+};
+
+// A line of source, and the first pc compiled from it.
+struct LineMapEntry {
+  // Offset from the first pc of the function.
+  uint32_t pcoffs;
+  uint32_t line;
+  const char* file;
+};
+
 class CompiledFunction
 {
  public:
   CompiledFunction(const CodeChunk& code,
                    cell_t pcode_offs,
                    FixedArray<LoopEdge>* edges,
-                   FixedArray<CipMapEntry>* cip_map);
+                   FixedArray<CipMapEntry>* cip_map,
+                   FixedArray<OsrEntry>* osr_entries,
+                   FixedArray<FaultSite>* fault_sites,
+                   FixedArray<ReturnSite>* return_sites);
   ~CompiledFunction();
 
  public:
@@ -60,21 +104,57 @@ class CompiledFunction
   cell_t GetCodeOffset() const {
     return code_offset_;
   }
+  size_t GetCodeLength() const {
+    return code_.bytes();
+  }
   uint32_t NumLoopEdges() const {
     return edges_->length();
   }
   LoopEdge& GetLoopEdge(size_t i) {
     return edges_->at(i);
   }
+  const FixedArray<CipMapEntry>& GetCipMap() const {
+    return *cip_map_;
+  }
+  const FixedArray<OsrEntry>& GetOsrEntries() const {
+    return *osr_entries_;
+  }
+  const FixedArray<ReturnSite>& GetReturnSites() const {
+    return *return_sites_;
+  }
 
   ucell_t FindCipByPc(void* pc);
 
+  // Return the OSR entry point for the jump target at |cip|, or null if
+  // there is none.
+  void* FindOsrEntry(cell_t cip);
+
+  // Return the error path for an unchecked load or store at |pc|, or null
+  // if |pc| is not one.
+  void* FindFaultPath(void* pc);
+
+  // Collapse the cip map into an entry per line, in pc order, for tools
+  // outside the VM. Code without debug info is left out.
+  bool BuildLineMap(LegacyImage* image, Vector<LineMapEntry>* lines) const;
+
+  // Set while the function is described to gdb; see GdbJit.
+  GdbJitEntry* gdb_entry() const {
+    return gdb_entry_;
+  }
+  void setGdbEntry(GdbJitEntry* entry) {
+    gdb_entry_ = entry;
+  }
+
  private:
   CodeChunk code_;
   cell_t code_offset_;
   AutoPtr<FixedArray<LoopEdge>> edges_;
   AutoPtr<FixedArray<CipMapEntry>> cip_map_;
+  AutoPtr<FixedArray<OsrEntry>> osr_entries_;
+  AutoPtr<FixedArray<FaultSite>> fault_sites_;
+  AutoPtr<FixedArray<ReturnSite>> return_sites_;
   bool cip_map_sorted_;
+  GdbJitEntry* gdb_entry_;
 };
 
 }
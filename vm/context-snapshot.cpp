@@ -0,0 +1,155 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <string.h>
+#include "context-snapshot.h"
+#include "plugin-context.h"
+#include "plugin-runtime.h"
+#if defined(__linux__)
+# include <sys/mman.h>
+#endif
+
+using namespace sp;
+
+ContextSnapshot::ContextSnapshot(PluginContext* cx)
+ : cx_(cx),
+   sp_(cx->sp_),
+   hp_(cx->hp_),
+   frm_(cx->frm_)
+{
+}
+
+ContextSnapshot*
+ContextSnapshot::New(PluginContext* cx)
+{
+  ke::AutoPtr<ContextSnapshot> snapshot(new ContextSnapshot(cx));
+  if (!snapshot->save())
+    return nullptr;
+  return snapshot.take();
+}
+
+static size_t
+ChunkSize()
+{
+  size_t page_size = MemoryRegion::PageSize();
+  return page_size ? page_size : 4096;
+}
+
+bool
+ContextSnapshot::save()
+{
+  const uint8_t* memory = cx_->memory_;
+  const uint8_t* data = cx_->runtime()->data().bytes;
+  size_t chunk_size = ChunkSize();
+
+  // Split everything below hp at page boundaries, so that pristine runs
+  // line up with pages that can be discarded on restore.
+  uint32_t offset = 0;
+  while (offset < uint32_t(hp_)) {
+    uintptr_t next = ke::Align(uintptr_t(memory + offset) + 1, chunk_size);
+    uint32_t end = uint32_t(ke::Min(next - uintptr_t(memory), uintptr_t(hp_)));
+    bool pristine = end <= cx_->data_size_ &&
+                    memcmp(memory + offset, data + offset, end - offset) == 0;
+    if (!addRun(offset, end - offset, pristine))
+      return false;
+    offset = end;
+  }
+
+  return addRun(sp_, cx_->mem_size_ - sp_, false);
+}
+
+bool
+ContextSnapshot::addRun(uint32_t offset, uint32_t length, bool pristine)
+{
+  if (!length)
+    return true;
+
+  if (!pristine) {
+    size_t position = bytes_.length();
+    if (!bytes_.resize(position + length))
+      return false;
+    memcpy(bytes_.buffer() + position, cx_->memory_ + offset, length);
+  }
+
+  if (runs_.length()) {
+    Run& last = runs_.back();
+    if (last.pristine == pristine && last.offset + last.length == offset) {
+      last.length += length;
+      return true;
+    }
+  }
+
+  Run run = { offset, length, pristine, pristine ? 0 : bytes_.length() - length };
+  return runs_.append(run);
+}
+
+size_t
+ContextSnapshot::GetSize()
+{
+  return bytes_.length();
+}
+
+// Put |bytes| at |start| back to |contents|, or to zero if it is null. With
+// |discard|, whole pages are dropped instead, and read back as whatever is
+// mapped under them: zeroes, or the data section's shared pages.
+static void
+ResetRange(uint8_t* start, size_t bytes, const uint8_t* contents, bool discard)
+{
+#if defined(__linux__)
+  if (discard) {
+    size_t page_size = MemoryRegion::PageSize();
+    uint8_t* first = reinterpret_cast<uint8_t*>(ke::Align(uintptr_t(start), page_size));
+    uint8_t* last = reinterpret_cast<uint8_t*>((uintptr_t(start) + bytes) & ~(page_size - 1));
+    if (first < last && madvise(first, last - first, MADV_DONTNEED) == 0) {
+      ResetRange(start, first - start, contents, false);
+      ResetRange(last, start + bytes - last,
+                 contents ? contents + (last - start) : nullptr, false);
+      return;
+    }
+  }
+#endif
+
+  if (contents)
+    memcpy(start, contents, bytes);
+  else
+    memset(start, 0, bytes);
+}
+
+void
+ContextSnapshot::restore()
+{
+  uint8_t* memory = cx_->memory_;
+  const uint8_t* data = cx_->runtime()->data().bytes;
+
+  for (const Run& run : runs_) {
+    if (run.pristine) {
+      ResetRange(memory + run.offset, run.length, data + run.offset, !!cx_->data_image_);
+    } else {
+      memcpy(memory + run.offset, bytes_.buffer() + run.position, run.length);
+    }
+  }
+
+  // Nothing between hp and sp is live, but handing it back keeps a reset
+  // plugin from holding on to memory it used once.
+#if defined(__linux__)
+  if (cx_->region_.reserved())
+    ResetRange(memory + hp_, sp_ - hp_, nullptr, true);
+#endif
+
+  cx_->sp_ = sp_;
+  cx_->hp_ = hp_;
+  cx_->frm_ = frm_;
+}
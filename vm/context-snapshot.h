@@ -0,0 +1,72 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_context_snapshot_h_
+#define _include_sourcepawn_vm_context_snapshot_h_
+
+#include <sp_vm_api.h>
+#include <amtl/am-vector.h>
+
+namespace sp {
+
+using namespace SourcePawn;
+
+class PluginContext;
+
+// Implements IContextSnapshot. Memory is split at page boundaries into
+// runs below hp, which are kept unless they still match the image's data
+// section, and the stack, which is always kept. The space between hp and
+// sp is dead, so it is not kept at all.
+class ContextSnapshot final : public IContextSnapshot
+{
+ public:
+  static ContextSnapshot* New(PluginContext* cx);
+
+  size_t GetSize() override;
+
+  PluginContext* cx() const {
+    return cx_;
+  }
+
+  void restore();
+
+ private:
+  explicit ContextSnapshot(PluginContext* cx);
+
+  bool save();
+  bool addRun(uint32_t offset, uint32_t length, bool pristine);
+
+ private:
+  struct Run {
+    uint32_t offset;
+    uint32_t length;
+    // If true, the run is still the image's data, and nothing is kept.
+    bool pristine;
+    // Position of the kept bytes in |bytes_|.
+    size_t position;
+  };
+
+  PluginContext* cx_;
+  cell_t sp_;
+  cell_t hp_;
+  cell_t frm_;
+  ke::Vector<Run> runs_;
+  ke::Vector<uint8_t> bytes_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_context_snapshot_h_
@@ -0,0 +1,132 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <string.h>
+#include "data-image.h"
+#include "environment.h"
+#include "plugin-runtime.h"
+#if defined(__linux__)
+# include <unistd.h>
+# include <sys/mman.h>
+#endif
+
+using namespace sp;
+
+DataImage::DataImage(Environment* env, int fd, size_t offset, size_t length,
+                     const unsigned char* hash)
+ : env_(env),
+   fd_(fd),
+   offset_(offset),
+   length_(length)
+{
+  memcpy(hash_, hash, sizeof(hash_));
+}
+
+DataImage::~DataImage()
+{
+  ke::Vector<DataImage*>& images = env_->data_images();
+  for (size_t i = 0; i < images.length(); i++) {
+    if (images[i] == this) {
+      images.remove(i);
+      break;
+    }
+  }
+#if defined(__linux__)
+  close(fd_);
+#endif
+}
+
+ke::RefPtr<DataImage>
+DataImage::Acquire(PluginRuntime* rt, size_t offset)
+{
+#if defined(__linux__)
+  const uint8_t* data = rt->data().bytes;
+  size_t length = rt->data().length;
+  const unsigned char* hash = rt->GetDataHash();
+
+  Environment* env = Environment::get();
+  ke::Vector<DataImage*>& images = env->data_images();
+  for (DataImage* image : images) {
+    if (image->matches(data, length, offset, hash))
+      return image;
+  }
+
+  int fd = memfd_create("sourcepawn-data", MFD_CLOEXEC);
+  if (fd == -1)
+    return nullptr;
+
+  // The padding reads back as zeroes; only the data has to be written.
+  if (ftruncate(fd, offset + length) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  for (size_t written = 0; written < length;) {
+    ssize_t rv = pwrite(fd, data + written, length - written, offset + written);
+    if (rv <= 0) {
+      close(fd);
+      return nullptr;
+    }
+    written += rv;
+  }
+
+  ke::RefPtr<DataImage> image = new DataImage(env, fd, offset, length, hash);
+  if (!images.append(image))
+    return nullptr;
+  return image;
+#else
+  return nullptr;
+#endif
+}
+
+bool
+DataImage::matches(const uint8_t* data, size_t length, size_t offset,
+                   const unsigned char* hash) const
+{
+  if (length != length_ || offset != offset_ || memcmp(hash, hash_, sizeof(hash_)) != 0)
+    return false;
+
+#if defined(__linux__)
+  // Don't trust the hash alone. The file is already in memory, so this
+  // costs a read, not a copy.
+  void* view = mmap(nullptr, offset_ + length_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (view == MAP_FAILED)
+    return false;
+  bool same = memcmp(reinterpret_cast<uint8_t*>(view) + offset_, data, length_) == 0;
+  munmap(view, offset_ + length_);
+  return same;
+#else
+  return false;
+#endif
+}
+
+bool
+DataImage::MapAt(uint8_t* address)
+{
+#if defined(__linux__)
+  // Past the end of the file, the last page reads as zeroes, which is what
+  // the heap expects.
+  size_t bytes = offset_ + length_;
+  void* rv = mmap(address, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd_, 0);
+  if (rv == address)
+    return true;
+
+  // A failed MAP_FIXED may have unmapped part of the range already.
+  mmap(address, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON|MAP_FIXED, -1, 0);
+  return false;
+#else
+  return false;
+#endif
+}
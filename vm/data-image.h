@@ -0,0 +1,71 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_data_image_h_
+#define _include_sourcepawn_vm_data_image_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <amtl/am-refcounting.h>
+
+namespace sp {
+
+class Environment;
+class PluginRuntime;
+
+// A copy of a plugin's initial data section in an anonymous file, which
+// contexts map copy-on-write instead of copying it. Pages a plugin never
+// writes are shared by every context loaded from the same data, including
+// later reloads, as long as one of them is alive.
+//
+// The file starts with |offset| bytes of padding, so that once it is mapped
+// at a page boundary, the data lands that far into the page. That is where
+// reserved memory starts, see MemoryRegion.
+class DataImage : public ke::Refcounted<DataImage>
+{
+ public:
+  ~DataImage();
+
+  // Return the image of |rt|'s data section for |offset|, creating it if no
+  // live context shares it yet. Returns null if the platform cannot do
+  // this.
+  static ke::RefPtr<DataImage> Acquire(PluginRuntime* rt, size_t offset);
+
+  // Map the image over |address|, which must be page aligned and inside a
+  // reserved MemoryRegion. On failure the range is left as zeroed, writable
+  // memory, and false is returned.
+  bool MapAt(uint8_t* address);
+
+ private:
+  DataImage(Environment* env, int fd, size_t offset, size_t length,
+            const unsigned char* hash);
+
+  bool matches(const uint8_t* data, size_t length, size_t offset,
+               const unsigned char* hash) const;
+
+ private:
+  // The environment whose list holds this image. The last reference may be
+  // dropped on another thread, where Environment::get() is someone else.
+  Environment* env_;
+  int fd_;
+  size_t offset_;
+  size_t length_;
+  unsigned char hash_[16];
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_data_image_h_
@@ -0,0 +1,165 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <amtl/am-uniqueptr.h>
+#include "dispatch-group.h"
+#include "environment.h"
+#include "plugin-context.h"
+#include "plugin-runtime.h"
+#include "scripted-invoker.h"
+#include "symbol-index.h"
+
+using namespace sp;
+using namespace SourcePawn;
+
+DispatchGroup::DispatchGroup(const char* name)
+ : env_(Environment::get()),
+   name_(name),
+   name_hash_(SymbolIndex::Hash(name))
+{
+}
+
+DispatchGroup*
+DispatchGroup::New(const char* name, const SignatureParam* params, unsigned int num_params)
+{
+  ke::UniquePtr<DispatchGroup> group(new DispatchGroup(name));
+  if (!group->args_.init(params, num_params))
+    return nullptr;
+  return group.take();
+}
+
+bool
+DispatchGroup::AddRuntime(IPluginRuntime* runtime)
+{
+  PluginRuntime* rt = PluginRuntime::FromAPI(runtime);
+  for (const Target& target : targets_) {
+    if (target.rt == rt)
+      return false;
+  }
+
+  uint32_t index;
+  if (rt->FindPublicByHash(name_.chars(), name_hash_, &index) != SP_ERROR_NONE)
+    return false;
+  ScriptedInvoker* fun = rt->GetPublicFunction(index);
+  if (!fun)
+    return false;
+
+  Target target = { rt, fun };
+  return targets_.append(target);
+}
+
+void
+DispatchGroup::RemoveRuntime(IPluginRuntime* runtime)
+{
+  PluginRuntime* rt = PluginRuntime::FromAPI(runtime);
+  for (size_t i = 0; i < targets_.length(); i++) {
+    if (targets_[i].rt == rt) {
+      targets_.remove(i);
+      return;
+    }
+  }
+}
+
+unsigned int
+DispatchGroup::GetRuntimeCount()
+{
+  return (unsigned int)targets_.length();
+}
+
+int
+DispatchGroup::SetCell(unsigned int param, cell_t value)
+{
+  return args_.setCell(param, value);
+}
+
+int
+DispatchGroup::SetFloat(unsigned int param, float value)
+{
+  return args_.setCell(param, sp::FloatCellUnion(value).cell);
+}
+
+int
+DispatchGroup::BindArray(unsigned int param, cell_t* array)
+{
+  return args_.bind(param, SP_SIGPARAM_ARRAY, array);
+}
+
+int
+DispatchGroup::BindString(unsigned int param, char* buffer)
+{
+  return args_.bind(param, SP_SIGPARAM_STRING, buffer);
+}
+
+unsigned int
+DispatchGroup::Dispatch(DispatchPolicy policy, cell_t* result)
+{
+  // The group, and the plugins in it, belong to the environment it was
+  // created in.
+  if (Environment::get() != env_)
+    return 0;
+
+  EnterProfileScope profileScope("SourcePawn", "EnterJIT");
+
+  // Errors are reported and then dropped one plugin at a time, as they
+  // would be by IPluginFunction::Execute().
+  env_->clearPendingException();
+  ExceptionHandler eh(env_->APIv2());
+
+  cell_t combined = 0;
+  unsigned int calls = 0;
+  for (const Target& target : targets_) {
+    if (target.rt->IsPaused())
+      continue;
+
+    cell_t rval = 0;
+    if (!call(target, &rval)) {
+      env_->clearPendingException();
+      continue;
+    }
+    calls++;
+
+    if (policy == SP_DISPATCH_FIRST_NONZERO) {
+      if (rval) {
+        combined = rval;
+        break;
+      }
+    } else if (policy == SP_DISPATCH_MAX) {
+      if (calls == 1 || rval > combined)
+        combined = rval;
+    }
+  }
+
+  if (result)
+    *result = combined;
+  return calls;
+}
+
+bool
+DispatchGroup::call(const Target& target, cell_t* rval)
+{
+  PluginContext* cx = target.rt->GetBaseContext();
+  if (!cx->CheckOwnerThread())
+    return false;
+
+  cell_t block;
+  if (!args_.copyIn(cx, &block))
+    return false;
+
+  bool ok = cx->InvokeFunctionInScope(target.fun, args_.values(), args_.count(), rval);
+
+  args_.copyOut(cx, block, ok);
+  return !env_->hasPendingException();
+}
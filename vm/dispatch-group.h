@@ -0,0 +1,73 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_dispatch_group_h_
+#define _include_sourcepawn_vm_dispatch_group_h_
+
+#include <sp_vm_api.h>
+#include <amtl/am-string.h>
+#include <amtl/am-vector.h>
+#include "call-signature.h"
+
+namespace sp {
+
+using namespace SourcePawn;
+
+class Environment;
+class PluginRuntime;
+class ScriptedInvoker;
+
+// Implements IDispatchGroup. The public's name is hashed once, rather than
+// for every plugin added. All plugins share one set of bound arguments, and
+// the whole dispatch runs inside one profiler scope.
+class DispatchGroup final : public IDispatchGroup
+{
+ public:
+  // Returns null if any parameter is invalid.
+  static DispatchGroup* New(const char* name, const SignatureParam* params,
+                            unsigned int num_params);
+
+  bool AddRuntime(IPluginRuntime* runtime) override;
+  void RemoveRuntime(IPluginRuntime* runtime) override;
+  unsigned int GetRuntimeCount() override;
+  int SetCell(unsigned int param, cell_t value) override;
+  int SetFloat(unsigned int param, float value) override;
+  int BindArray(unsigned int param, cell_t* array) override;
+  int BindString(unsigned int param, char* buffer) override;
+  unsigned int Dispatch(DispatchPolicy policy, cell_t* result) override;
+
+ private:
+  DispatchGroup(const char* name);
+
+  struct Target {
+    PluginRuntime* rt;
+    ScriptedInvoker* fun;
+  };
+
+  bool call(const Target& target, cell_t* rval);
+
+ private:
+
+  Environment* env_;
+  ke::AString name_;
+  uint32_t name_hash_;
+  CallArguments args_;
+  ke::Vector<Target> targets_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_dispatch_group_h_
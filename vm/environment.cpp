@@ -18,19 +18,33 @@
 #include "pool-allocator.h"
 #include "method-info.h"
 #include "compiled-function.h"
+#include "code-cache.h"
 #include "code-stubs.h"
+#include "compile-queue.h"
+#include "memory-faults.h"
+#include "memory-region.h"
+#include "gdb-jit.h"
+#include "perf-maps.h"
+#include "sampling-profiler.h"
 #ifndef KE_EMSCRIPTEN
 #include "jit.h"
 #endif
 #include "interpreter.h"
+#include "threaded-interpreter.h"
 #include "builtins.h"
 #include "debugging.h"
 #include <stdarg.h>
+#include <amtl/am-threadlocal.h>
 
 using namespace sp;
 using namespace SourcePawn;
 
-static Environment* sEnvironment = nullptr;
+// Each thread runs plugins in its own environment.
+static ke::ThreadLocal<Environment*> sEnvironment;
+
+// Enough that one-shot code, like plugin startup and config parsing, never
+// leaves the interpreter.
+static const uint32_t kDefaultJitThreshold = 1000;
 
 Environment::Environment()
  : debug_break_enabled_(false),
@@ -44,7 +58,14 @@ Environment::Environment()
 #else
    jit_enabled_(false),
 #endif
+   threaded_interp_enabled_(true),
+   jit_threshold_(kDefaultJitThreshold),
    profiling_enabled_(false),
+   reserved_memory_enabled_(false),
+   unchecked_memory_enabled_(false),
+   call_stats_enabled_(false),
+   callee_ticks_(0),
+   native_stats_enabled_(false),
    top_(nullptr)
 {
 }
@@ -56,24 +77,31 @@ Environment::~Environment()
 Environment*
 Environment::New()
 {
-  assert(!sEnvironment);
-  if (sEnvironment)
+  assert(!sEnvironment.get());
+  if (sEnvironment.get())
     return nullptr;
 
-  sEnvironment = new Environment();
-  if (!sEnvironment->Initialize()) {
-    delete sEnvironment;
+  ke::AutoPtr<Environment> env(new Environment());
+  sEnvironment = env.get();
+  if (!env->Initialize()) {
     sEnvironment = nullptr;
     return nullptr;
   }
 
-  return sEnvironment;
+  return env.take();
 }
 
 Environment*
 Environment::get()
 {
-  return sEnvironment;
+  return sEnvironment.get();
+}
+
+void
+Environment::EnterHelperThread(Environment* env)
+{
+  assert(!sEnvironment.get());
+  sEnvironment = env;
 }
 
 bool
@@ -100,12 +128,17 @@ void
 Environment::Shutdown()
 {
   watchdog_timer_->Shutdown();
+  if (sampler_) {
+    sampler_->Stop();
+    sampler_ = nullptr;
+  }
+  compile_queue_ = nullptr;
   builtins_ = nullptr;
   code_stubs_ = nullptr;
   code_alloc_ = nullptr;
   PoolAllocator::FreeDefault();
 
-  assert(sEnvironment == this);
+  assert(sEnvironment.get() == this);
   sEnvironment = nullptr;
 }
 
@@ -115,6 +148,185 @@ Environment::SetJitEnabled(bool enabled)
   jit_enabled_ = enabled;
 }
 
+bool
+Environment::ShouldCompile(MethodInfo* method) const
+{
+  if (method->isJitRefused())
+    return false;
+  if (method->hasCachedCode())
+    return true;
+
+  uint64_t hotness = uint64_t(method->invocation_count()) + method->backedge_count();
+  return hotness >= jit_threshold_;
+}
+
+bool
+Environment::SetCompileThreads(size_t threads)
+{
+  // Can't change this after any plugins are loaded.
+  if (!runtimes_.empty())
+    return false;
+
+#if defined(SP_HAS_JIT)
+  compile_queue_ = nullptr;
+  if (!threads)
+    return true;
+
+  compile_queue_ = new CompileQueue(this);
+  if (!compile_queue_->Start(threads)) {
+    compile_queue_ = nullptr;
+    return false;
+  }
+  return true;
+#else
+  return !threads;
+#endif
+}
+
+bool
+Environment::SetCodeCacheDirectory(const char* dir)
+{
+#if defined(SP_HAS_JIT)
+  // Cached code does not know whether memory accesses may skip checks, or
+  // whether to time calls.
+  if (!jit_enabled_ || !CodeCache::IsSupported() || unchecked_memory_enabled_ ||
+      call_stats_enabled_ || native_stats_enabled_)
+  {
+    return false;
+  }
+  code_cache_dir_ = dir;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool
+Environment::SetReservedMemoryEnabled(bool enabled)
+{
+  if (enabled && !MemoryRegion::CanReserve())
+    return false;
+  reserved_memory_enabled_ = enabled;
+  return true;
+}
+
+bool
+Environment::SetUncheckedMemoryEnabled(bool enabled)
+{
+#if defined(SP_HAS_UNCHECKED_MEMORY)
+  if (enabled && (code_cache_dir_.length() || !InstallMemoryFaultHandler()))
+    return false;
+  unchecked_memory_enabled_ = enabled;
+  return true;
+#else
+  return !enabled;
+#endif
+}
+
+bool
+Environment::SetSamplingInterval(uint32_t interval_ms)
+{
+  // Stop first, so the signal handler is done with the old profiler before
+  // it goes away.
+  if (sampler_) {
+    sampler_->Stop();
+    sampler_->Flush();
+    sampler_ = nullptr;
+  }
+  if (!interval_ms)
+    return true;
+
+  sampler_ = new SamplingProfiler(this);
+  if (!sampler_->Start(interval_ms)) {
+    sampler_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool
+Environment::SetPerfOutputs(uint32_t flags)
+{
+#if defined(SP_HAS_PERF_MAPS)
+  if (!PerfMaps::SetOutputs(flags))
+    return false;
+  if (!flags)
+    return true;
+
+  // Code may be listed twice if an output was already on. perf uses the
+  // latest entry for an address.
+  code_stubs_->AddToPerfMaps();
+
+  ke::AutoLock lock(&mutex_);
+  for (ke::InlineList<PluginRuntime>::iterator iter = runtimes_.begin(); iter != runtimes_.end(); iter++) {
+    PluginRuntime* rt = *iter;
+
+    const Vector<RefPtr<MethodInfo>>& methods = rt->AllMethods();
+    for (size_t i = 0; i < methods.length(); i++) {
+      if (CompiledFunction* fun = methods[i]->jit())
+        PerfMaps::AddFunction(rt, fun);
+    }
+  }
+  return true;
+#else
+  return !flags;
+#endif
+}
+
+bool
+Environment::SetGdbJitEnabled(bool enabled)
+{
+#if defined(SP_HAS_GDB_JIT)
+  GdbJit::SetEnabled(enabled);
+  if (!enabled)
+    return true;
+
+  ke::AutoLock lock(&mutex_);
+  for (ke::InlineList<PluginRuntime>::iterator iter = runtimes_.begin(); iter != runtimes_.end(); iter++) {
+    PluginRuntime* rt = *iter;
+
+    const Vector<RefPtr<MethodInfo>>& methods = rt->AllMethods();
+    for (size_t i = 0; i < methods.length(); i++) {
+      if (CompiledFunction* fun = methods[i]->jit())
+        GdbJit::AddFunction(rt, fun);
+    }
+  }
+  return true;
+#else
+  return !enabled;
+#endif
+}
+
+bool
+Environment::SetCallStatsEnabled(bool enabled)
+{
+  // Can't change this after any plugins are loaded.
+  if (!runtimes_.empty())
+    return false;
+  if (enabled && code_cache_dir_.length())
+    return false;
+  call_stats_enabled_ = enabled;
+  return true;
+}
+
+bool
+Environment::SetNativeStatsEnabled(bool enabled)
+{
+  // Compiled code points straight at each plugin's counters.
+  if (enabled && code_cache_dir_.length())
+    return false;
+  native_stats_enabled_ = enabled;
+  return true;
+}
+
+void
+Environment::WaitForCompile(MethodInfo* method)
+{
+#if defined(SP_HAS_JIT)
+  compile_queue_->Wait(method);
+#endif
+}
+
 bool
 Environment::EnableDebugBreak()
 {
@@ -204,6 +416,8 @@ Environment::GetErrorString(int error)
 CodeChunk
 Environment::AllocateCode(size_t size)
 {
+  // Compile queue threads allocate code too.
+  ke::AutoLock lock(&mutex_);
   return code_alloc_->Allocate(size);
 }
 
@@ -278,25 +492,23 @@ Environment::Invoke(PluginContext* cx,
                     cell_t* result)
 {
 #if defined(SP_HAS_JIT)
+  if (method->isCompiling())
+    WaitForCompile(method);
+
   if (jit_enabled_) {
-    if (!method->jit()) {
+    // If the JIT refuses the method, interpret it instead. The interpreter
+    // reports the error if the method does not validate. Other failures are
+    // reported here, and a later call tries again.
+    if (!method->jit() && ShouldCompile(method)) {
       int err = SP_ERROR_NONE;
-      if (!CompilerBase::Compile(cx, method, &err)) {
+      if (!CompilerBase::Compile(cx, method, &err) && !method->isJitRefused()) {
         cx->ReportErrorNumber(err);
         return false;
       }
     }
 
-    if (CompiledFunction* fn = method->jit()) {
-      JitInvokeFrame ivkframe(cx, fn->GetCodeOffset()); 
-
-      assert(top_ && top_->cx() == cx);
-
-      InvokeStubFn invoke = code_stubs_->InvokeStub();
-      invoke(cx, fn->GetEntryAddress(), result);
-
-      return exception_code_ == SP_ERROR_NONE;
-    }
+    if (CompiledFunction* fn = method->jit())
+      return InvokeCompiled(cx, fn, fn->GetEntryAddress(), result);
   }
 #endif
 
@@ -307,7 +519,40 @@ Environment::Invoke(PluginContext* cx,
     return false;
   }
 
-  return Interpreter::Run(cx, method, result);
+  method->addInvocation();
+
+  // Methods that throw do not leave their call timers, so put back the
+  // caller's callee time.
+  uint64_t callee_ticks = callee_ticks_;
+
+  bool ok;
+  if (threaded_interp_enabled_)
+    ok = ThreadedInterpreter::Run(cx, method, result);
+  else
+    ok = Interpreter::Run(cx, method, result);
+
+  if (!ok)
+    callee_ticks_ = callee_ticks;
+  return ok;
+}
+
+bool
+Environment::InvokeCompiled(PluginContext* cx, CompiledFunction* fn, void* entry, cell_t* result)
+{
+  JitInvokeFrame ivkframe(cx, fn->GetCodeOffset());
+
+  assert(top_ && top_->cx() == cx);
+
+  uint64_t callee_ticks = callee_ticks_;
+
+  InvokeStubFn invoke = code_stubs_->InvokeStub();
+  invoke(cx, entry, result);
+
+  if (exception_code_ != SP_ERROR_NONE) {
+    callee_ticks_ = callee_ticks;
+    return false;
+  }
+  return true;
 }
 
 void
@@ -512,4 +757,8 @@ void
 Environment::leaveInvoke()
 {
   top_ = top_->prev();
+
+  // Fold samples in while nothing is running, before the buffer fills up.
+  if (!top_ && sampler_ && sampler_->ShouldFlush())
+    sampler_->Flush();
 }
@@ -16,6 +16,7 @@
 #include <sp_vm_api.h>
 #include <amtl/am-cxx.h>
 #include <amtl/am-inlinelist.h>
+#include <amtl/am-string.h>
 #include <amtl/am-thread-utils.h>
 #include "code-allocator.h"
 #include "plugin-runtime.h"
@@ -27,16 +28,20 @@ using namespace SourcePawn;
 
 class PluginRuntime;
 class CodeStubs;
+class CompiledFunction;
 class WatchdogTimer;
 class ErrorReport;
 class BuiltinNatives;
+class CompileQueue;
+class DataImage;
+class SamplingProfiler;
 
 // An Environment encapsulates everything that's needed to load and run
 // instances of plugins on a single thread. There can be at most one
-// environment per thread.
-//
-// Currently, the VM is single threaded in that no more than one
-// Environment can be created per process.
+// environment per thread, and environments share nothing, so separate
+// threads can run plugins at the same time. A plugin belongs to the
+// environment it was loaded in, and must only be run, and destroyed, on
+// that environment's thread.
 class Environment : public ISourcePawnEnvironment
 {
  public:
@@ -52,9 +57,13 @@ class Environment : public ISourcePawnEnvironment
     return SOURCEPAWN_API_VERSION;
   }
 
-  // Access the current Environment.
+  // Access the current thread's Environment.
   static Environment* get();
 
+  // Make |env| the current Environment of a thread that does work on its
+  // behalf, such as a compile thread.
+  static void EnterHelperThread(Environment* env);
+
   bool InstallWatchdogTimer(int timeout_ms);
 
   void EnterExceptionHandlingScope(ExceptionHandler* handler) override;
@@ -93,6 +102,10 @@ class Environment : public ISourcePawnEnvironment
 
   bool Invoke(PluginContext* cx, const RefPtr<MethodInfo>& method, cell_t* result);
 
+  // Run compiled code from |entry|, which is either the function's entry
+  // point or one of its OSR entries.
+  bool InvokeCompiled(PluginContext* cx, CompiledFunction* fn, void* entry, cell_t* result);
+
   // Helpers.
   void SetProfiler(IProfilingTool* profiler) {
     profiler_ = profiler;
@@ -110,6 +123,109 @@ class Environment : public ISourcePawnEnvironment
   bool IsJitEnabled() const {
     return jit_enabled_;
   }
+  void SetThreadedInterpEnabled(bool enabled) {
+    threaded_interp_enabled_ = enabled;
+  }
+  bool IsThreadedInterpEnabled() const {
+    return threaded_interp_enabled_;
+  }
+
+  // A method is interpreted until its invocation and backedge counts add up
+  // to this threshold, and compiled after that. 0 compiles every method the
+  // first time it is called.
+  void SetJitThreshold(uint32_t threshold) {
+    jit_threshold_ = threshold;
+  }
+  uint32_t jit_threshold() const {
+    return jit_threshold_;
+  }
+  bool ShouldCompile(MethodInfo* method) const;
+
+  // Compile every method of each plugin loaded from now on, on this many
+  // background threads. 0 turns this off. This must be set before any
+  // plugins are loaded.
+  bool SetCompileThreads(size_t threads);
+  CompileQueue* compile_queue() const {
+    return compile_queue_;
+  }
+
+  // Keep compiled code for each plugin loaded from now on in this directory,
+  // and reuse it the next time the same plugin is loaded. Fails if the JIT
+  // is disabled or cannot cache code on this platform.
+  bool SetCodeCacheDirectory(const char* dir);
+  const char* code_cache_dir() const {
+    return code_cache_dir_.length() ? code_cache_dir_.chars() : nullptr;
+  }
+
+  // Back the memory of each plugin loaded from now on with a reserved,
+  // lazily committed region with guard pages, instead of an eager block.
+  // Fails if the platform cannot reserve memory.
+  bool SetReservedMemoryEnabled(bool enabled);
+  bool IsReservedMemoryEnabled() const {
+    return reserved_memory_enabled_;
+  }
+
+  // Reserve 4GiB of address space after the memory of each plugin loaded
+  // from now on, so that compiled code can load and store without checking
+  // addresses; a fault is turned back into SP_ERROR_MEMACCESS. Fails if the
+  // platform does not support this, or a code cache is in use.
+  bool SetUncheckedMemoryEnabled(bool enabled);
+  bool IsUncheckedMemoryEnabled() const {
+    return unchecked_memory_enabled_;
+  }
+
+  // Sample the stacks of running plugins every |interval_ms| milliseconds,
+  // into each plugin's SampledStacks. 0 stops sampling. Fails if the
+  // platform cannot sample.
+  bool SetSamplingInterval(uint32_t interval_ms);
+  SamplingProfiler* sampler() const {
+    return sampler_;
+  }
+
+  // Write the SP_PERF_* outputs for code compiled from now on, in any
+  // environment, and list what this environment has compiled already. Fails
+  // if the platform does not support this, or a file cannot be created.
+  bool SetPerfOutputs(uint32_t flags);
+
+  // Describe functions compiled from now on, in any environment, to gdb,
+  // along with what this environment has compiled already. Fails if the
+  // platform does not support this.
+  bool SetGdbJitEnabled(bool enabled);
+
+  // Count the calls to each method, and the time spent in them, in both the
+  // interpreters and compiled code; see MethodInfo::call_stats(). Compiled
+  // code is only timed if it was compiled with this on, so it must be set
+  // before any plugins are loaded, and cannot be combined with a code cache.
+  bool SetCallStatsEnabled(bool enabled);
+  bool IsCallStatsEnabled() const {
+    return call_stats_enabled_;
+  }
+
+  // Count the calls to each native, the time spent in them, and a latency
+  // histogram, at every native call site; see NativeEntry::stats. This
+  // applies to plugins loaded afterward, and cannot be combined with a code
+  // cache.
+  bool SetNativeStatsEnabled(bool enabled);
+  bool IsNativeStatsEnabled() const {
+    return native_stats_enabled_;
+  }
+
+  // Total time spent in the callees of the method being timed; see
+  // CallTimer.
+  uint64_t callee_ticks() const {
+    return callee_ticks_;
+  }
+  void set_callee_ticks(uint64_t ticks) {
+    callee_ticks_ = ticks;
+  }
+
+  // Shared data sections of live contexts; see DataImage.
+  ke::Vector<DataImage*>& data_images() {
+    return data_images_;
+  }
+
+  // Call before running a method for which isCompiling() is true.
+  void WaitForCompile(MethodInfo* method);
   void SetDebugger(IDebugListener* debugger) {
     debugger_ = debugger;
   }
@@ -168,6 +284,9 @@ class Environment : public ISourcePawnEnvironment
   void* addressOfExceptionCode() {
     return &exception_code_;
   }
+  void* addressOfCalleeTicks() {
+    return &callee_ticks_;
+  }
 
  private:
   bool Initialize();
@@ -191,12 +310,23 @@ class Environment : public ISourcePawnEnvironment
 
   IProfilingTool* profiler_;
   bool jit_enabled_;
+  bool threaded_interp_enabled_;
+  uint32_t jit_threshold_;
   bool profiling_enabled_;
+  bool reserved_memory_enabled_;
+  bool unchecked_memory_enabled_;
+  bool call_stats_enabled_;
+  uint64_t callee_ticks_;
+  bool native_stats_enabled_;
 
   ke::AutoPtr<CodeAllocator> code_alloc_;
   ke::AutoPtr<CodeStubs> code_stubs_;
+  ke::AutoPtr<CompileQueue> compile_queue_;
+  ke::AutoPtr<SamplingProfiler> sampler_;
+  ke::AString code_cache_dir_;
 
   ke::InlineList<PluginRuntime> runtimes_;
+  ke::Vector<DataImage*> data_images_;
 
   uintptr_t frame_id_;
 
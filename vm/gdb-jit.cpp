@@ -0,0 +1,750 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include "gdb-jit.h"
+
+#if defined(SP_HAS_GDB_JIT)
+#include <elf.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <amtl/am-autoptr.h>
+#include <amtl/am-thread-utils.h>
+#include <amtl/am-vector.h>
+#include "compiled-function.h"
+#include "plugin-runtime.h"
+
+// The interface gdb looks for, by these names. See "JIT Compilation
+// Interface" in the gdb manual.
+extern "C" {
+
+enum jit_actions_t {
+  JIT_NOACTION = 0,
+  JIT_REGISTER_FN,
+  JIT_UNREGISTER_FN
+};
+
+struct jit_code_entry {
+  jit_code_entry* next_entry;
+  jit_code_entry* prev_entry;
+  const char* symfile_addr;
+  uint64_t symfile_size;
+};
+
+struct jit_descriptor {
+  uint32_t version;
+  uint32_t action_flag;
+  jit_code_entry* relevant_entry;
+  jit_code_entry* first_entry;
+};
+
+// gdb sets a breakpoint here, and reads the descriptor when it is hit.
+void __attribute__((noinline, used, visibility("default")))
+__jit_debug_register_code()
+{
+  __asm__ __volatile__("" ::: "memory");
+}
+
+__attribute__((used, visibility("default")))
+jit_descriptor __jit_debug_descriptor = { 1, JIT_NOACTION, nullptr, nullptr };
+
+} // extern "C"
+
+using namespace sp;
+
+#if defined(KE_ARCH_X64)
+typedef Elf64_Ehdr ElfHeader;
+typedef Elf64_Shdr ElfSection;
+typedef Elf64_Sym ElfSymbol;
+static const uint8_t kElfClass = ELFCLASS64;
+static const uint16_t kElfMachine = EM_X86_64;
+
+// DWARF register numbers, from the psABI.
+static const uint8_t kDwarfFp = 6;
+static const uint8_t kDwarfSp = 7;
+static const uint8_t kDwarfRa = 16;
+
+// The length of "mov rbp, rsp".
+static const uint32_t kMoveFpLength = 3;
+#else
+typedef Elf32_Ehdr ElfHeader;
+typedef Elf32_Shdr ElfSection;
+typedef Elf32_Sym ElfSymbol;
+static const uint8_t kElfClass = ELFCLASS32;
+static const uint16_t kElfMachine = EM_386;
+
+static const uint8_t kDwarfFp = 5;
+static const uint8_t kDwarfSp = 4;
+static const uint8_t kDwarfRa = 8;
+
+// The length of "mov ebp, esp".
+static const uint32_t kMoveFpLength = 2;
+#endif
+
+// The length of "push fp".
+static const uint32_t kPushFpLength = 1;
+
+// The length of "ret".
+static const uint32_t kRetLength = 1;
+
+// The few DWARF 2 constants we need.
+static const uint8_t DW_TAG_compile_unit = 0x11;
+static const uint8_t DW_TAG_subprogram = 0x2e;
+static const uint8_t DW_CHILDREN_no = 0;
+static const uint8_t DW_CHILDREN_yes = 1;
+static const uint8_t DW_AT_name = 0x03;
+static const uint8_t DW_AT_stmt_list = 0x10;
+static const uint8_t DW_AT_low_pc = 0x11;
+static const uint8_t DW_AT_high_pc = 0x12;
+static const uint8_t DW_AT_language = 0x13;
+static const uint8_t DW_FORM_addr = 0x01;
+static const uint8_t DW_FORM_data2 = 0x05;
+static const uint8_t DW_FORM_data4 = 0x06;
+static const uint8_t DW_FORM_string = 0x08;
+static const uint16_t DW_LANG_C = 0x0002;
+
+static const uint8_t DW_LNS_copy = 1;
+static const uint8_t DW_LNS_advance_pc = 2;
+static const uint8_t DW_LNS_advance_line = 3;
+static const uint8_t DW_LNS_set_file = 4;
+static const uint8_t DW_LNE_end_sequence = 1;
+static const uint8_t DW_LNE_set_address = 2;
+
+static const uint8_t DW_CFA_nop = 0x00;
+static const uint8_t DW_CFA_advance_loc1 = 0x02;
+static const uint8_t DW_CFA_advance_loc2 = 0x03;
+static const uint8_t DW_CFA_advance_loc4 = 0x04;
+static const uint8_t DW_CFA_remember_state = 0x0a;
+static const uint8_t DW_CFA_restore_state = 0x0b;
+static const uint8_t DW_CFA_def_cfa = 0x0c;
+static const uint8_t DW_CFA_def_cfa_register = 0x0d;
+static const uint8_t DW_CFA_def_cfa_offset = 0x0e;
+static const uint8_t DW_CFA_advance_loc = 0x40;
+static const uint8_t DW_CFA_offset = 0x80;
+static const uint8_t DW_CFA_restore = 0xc0;
+
+// The bytes of one section, or of the whole object, in host order.
+class SectionWriter
+{
+ public:
+  SectionWriter()
+   : ok_(true)
+  {}
+
+  void write(const void* data, size_t length) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++)
+      ok_ &= bytes_.append(bytes[i]);
+  }
+  template <typename T>
+  void put(const T& value) {
+    write(&value, sizeof(value));
+  }
+  void u8(uint8_t value) {
+    put(value);
+  }
+  void u16(uint16_t value) {
+    put(value);
+  }
+  void u32(uint32_t value) {
+    put(value);
+  }
+  void addr(uintptr_t value) {
+    put(value);
+  }
+  void string(const char* str) {
+    write(str, strlen(str) + 1);
+  }
+  void uleb(uint64_t value) {
+    do {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      if (value)
+        byte |= 0x80;
+      u8(byte);
+    } while (value);
+  }
+  void sleb(int64_t value) {
+    for (;;) {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40))) {
+        u8(byte);
+        return;
+      }
+      u8(byte | 0x80);
+    }
+  }
+  void align(size_t alignment, uint8_t fill) {
+    while (bytes_.length() % alignment)
+      u8(fill);
+  }
+
+  // Fill in a length that was written as 0, once what it covers is known.
+  void patchLength(size_t at) {
+    if (ok_) {
+      uint32_t length = uint32_t(bytes_.length() - at - sizeof(uint32_t));
+      memcpy(&bytes_[at], &length, sizeof(length));
+    }
+  }
+  void patch(size_t at, const void* data, size_t length) {
+    if (ok_)
+      memcpy(&bytes_[at], data, length);
+  }
+
+  size_t length() const {
+    return bytes_.length();
+  }
+  const uint8_t* bytes() const {
+    return bytes_.buffer();
+  }
+  bool ok() const {
+    return ok_;
+  }
+
+ private:
+  ke::Vector<uint8_t> bytes_;
+  bool ok_;
+};
+
+namespace sp {
+
+struct GdbJitEntry
+{
+  // Must come first; gdb walks these.
+  jit_code_entry link;
+  SectionWriter object;
+};
+
+} // namespace sp
+
+// gdb reads the list whenever the breakpoint is hit, so changes to it are
+// serialized across every environment.
+static ke::Mutex sLock;
+static std::atomic<bool> sEnabled(false);
+
+static void
+WriteAbbrevs(SectionWriter& w)
+{
+  w.uleb(1);
+  w.uleb(DW_TAG_compile_unit);
+  w.u8(DW_CHILDREN_yes);
+  w.uleb(DW_AT_name);
+  w.uleb(DW_FORM_string);
+  w.uleb(DW_AT_language);
+  w.uleb(DW_FORM_data2);
+  w.uleb(DW_AT_low_pc);
+  w.uleb(DW_FORM_addr);
+  w.uleb(DW_AT_high_pc);
+  w.uleb(DW_FORM_addr);
+  w.uleb(DW_AT_stmt_list);
+  w.uleb(DW_FORM_data4);
+  w.uleb(0);
+  w.uleb(0);
+
+  w.uleb(2);
+  w.uleb(DW_TAG_subprogram);
+  w.u8(DW_CHILDREN_no);
+  w.uleb(DW_AT_name);
+  w.uleb(DW_FORM_string);
+  w.uleb(DW_AT_low_pc);
+  w.uleb(DW_FORM_addr);
+  w.uleb(DW_AT_high_pc);
+  w.uleb(DW_FORM_addr);
+  w.uleb(0);
+  w.uleb(0);
+
+  w.uleb(0);
+}
+
+// A compile unit for the plugin, holding the one function. Its line
+// program is at the start of .debug_line.
+static void
+WriteDebugInfo(SectionWriter& w, const char* unit, const char* name, uintptr_t base,
+               size_t length)
+{
+  size_t start = w.length();
+  w.u32(0);
+  w.u16(2);
+  w.u32(0);
+  w.u8(sizeof(uintptr_t));
+
+  w.uleb(1);
+  w.string(unit);
+  w.u16(DW_LANG_C);
+  w.addr(base);
+  w.addr(base + length);
+  w.u32(0);
+
+  w.uleb(2);
+  w.string(name);
+  w.addr(base);
+  w.addr(base + length);
+
+  w.u8(0);
+  w.patchLength(start);
+}
+
+static size_t
+FindFile(const ke::Vector<const char*>& files, const char* file)
+{
+  for (size_t i = 0; i < files.length(); i++) {
+    if (files[i] == file)
+      return i;
+  }
+  return files.length();
+}
+
+static void
+WriteDebugLine(SectionWriter& w, uintptr_t base, size_t length,
+               const ke::Vector<LineMapEntry>& lines, const ke::Vector<const char*>& files)
+{
+  static const uint8_t kOpcodeLengths[] = { 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 };
+
+  size_t start = w.length();
+  w.u32(0);
+  w.u16(2);
+
+  size_t header_start = w.length();
+  w.u32(0);
+  w.u8(1);              // minimum_instruction_length
+  w.u8(1);              // default_is_stmt
+  w.u8(uint8_t(-5));    // line_base
+  w.u8(14);             // line_range
+  w.u8(sizeof(kOpcodeLengths) + 1);
+  w.write(kOpcodeLengths, sizeof(kOpcodeLengths));
+  w.u8(0);              // No include directories.
+  for (const auto& file : files) {
+    w.string(file);
+    w.uleb(0);
+    w.uleb(0);
+    w.uleb(0);
+  }
+  w.u8(0);
+  w.patchLength(header_start);
+
+  w.u8(0);
+  w.uleb(1 + sizeof(uintptr_t));
+  w.u8(DW_LNE_set_address);
+  w.addr(base);
+
+  uint32_t pcoffs = 0;
+  uint32_t line = 1;
+  size_t file = 1;
+  for (const auto& entry : lines) {
+    size_t index = FindFile(files, entry.file) + 1;
+    if (index != file) {
+      w.u8(DW_LNS_set_file);
+      w.uleb(index);
+      file = index;
+    }
+    if (entry.pcoffs != pcoffs) {
+      w.u8(DW_LNS_advance_pc);
+      w.uleb(entry.pcoffs - pcoffs);
+      pcoffs = entry.pcoffs;
+    }
+    if (entry.line != line) {
+      w.u8(DW_LNS_advance_line);
+      w.sleb(int64_t(entry.line) - int64_t(line));
+      line = entry.line;
+    }
+    w.u8(DW_LNS_copy);
+  }
+
+  if (length > pcoffs) {
+    w.u8(DW_LNS_advance_pc);
+    w.uleb(length - pcoffs);
+  }
+  w.u8(0);
+  w.uleb(1);
+  w.u8(DW_LNE_end_sequence);
+
+  w.patchLength(start);
+}
+
+static void
+AdvanceLoc(SectionWriter& w, uint32_t* cursor, uint32_t pcoffs)
+{
+  uint32_t delta = pcoffs - *cursor;
+  if (delta < 0x40) {
+    w.u8(DW_CFA_advance_loc | delta);
+  } else if (delta <= 0xff) {
+    w.u8(DW_CFA_advance_loc1);
+    w.u8(uint8_t(delta));
+  } else if (delta <= 0xffff) {
+    w.u8(DW_CFA_advance_loc2);
+    w.u16(uint16_t(delta));
+  } else {
+    w.u8(DW_CFA_advance_loc4);
+    w.u32(delta);
+  }
+  *cursor = pcoffs;
+}
+
+// Each entry point, the function's own and its OSR entries, starts with
+// enterFrame(): the frame pointer is pushed, then pointed at its saved
+// copy. After that the frame is addressed from the frame pointer, even in
+// the out-of-line paths at the end of the function, and an inline exit
+// frame just looks like another frame of the same function.
+static void
+WriteEntryFrame(SectionWriter& w, uint32_t* cursor, uint32_t pcoffs)
+{
+  if (pcoffs) {
+    AdvanceLoc(w, cursor, pcoffs);
+    w.u8(DW_CFA_def_cfa);
+    w.uleb(kDwarfSp);
+    w.uleb(sizeof(uintptr_t));
+    w.u8(DW_CFA_restore | kDwarfFp);
+  }
+
+  AdvanceLoc(w, cursor, pcoffs + kPushFpLength);
+  w.u8(DW_CFA_def_cfa_offset);
+  w.uleb(2 * sizeof(uintptr_t));
+  w.u8(DW_CFA_offset | kDwarfFp);
+  w.uleb(2);
+
+  AdvanceLoc(w, cursor, pcoffs + kPushFpLength + kMoveFpLength);
+  w.u8(DW_CFA_def_cfa_register);
+  w.uleb(kDwarfFp);
+}
+
+// The one exception is the ret after leaveFrame() in each RETN, which sees
+// the stack as it was on entry. The rules before it come back right after.
+static void
+WriteReturnFrame(SectionWriter& w, uint32_t* cursor, uint32_t pcoffs)
+{
+  AdvanceLoc(w, cursor, pcoffs);
+  w.u8(DW_CFA_remember_state);
+  w.u8(DW_CFA_def_cfa);
+  w.uleb(kDwarfSp);
+  w.uleb(sizeof(uintptr_t));
+  w.u8(DW_CFA_restore | kDwarfFp);
+
+  AdvanceLoc(w, cursor, pcoffs + kRetLength);
+  w.u8(DW_CFA_restore_state);
+}
+
+static int
+osr_entry_sort_cmp(const void* a1, const void* a2)
+{
+  const OsrEntry* e1 = reinterpret_cast<const OsrEntry*>(a1);
+  const OsrEntry* e2 = reinterpret_cast<const OsrEntry*>(a2);
+  if (e1->pcoffs < e2->pcoffs)
+    return -1;
+  if (e1->pcoffs == e2->pcoffs)
+    return 0;
+  return 1;
+}
+
+static bool
+WriteDebugFrame(SectionWriter& w, CompiledFunction* fn)
+{
+  // The CIE gives the rules on entry, right after the call.
+  size_t cie = w.length();
+  w.u32(0);
+  w.u32(0xffffffff);
+  w.u8(1);
+  w.u8(0);
+  w.uleb(1);
+  w.sleb(-int64_t(sizeof(uintptr_t)));
+  w.u8(kDwarfRa);
+  w.u8(DW_CFA_def_cfa);
+  w.uleb(kDwarfSp);
+  w.uleb(sizeof(uintptr_t));
+  w.u8(DW_CFA_offset | kDwarfRa);
+  w.uleb(1);
+  w.align(sizeof(uintptr_t), DW_CFA_nop);
+  w.patchLength(cie);
+
+  const FixedArray<OsrEntry>& osr = fn->GetOsrEntries();
+  ke::Vector<OsrEntry> entries;
+  if (!entries.resize(osr.length()))
+    return false;
+  for (size_t i = 0; i < osr.length(); i++)
+    entries[i] = osr.at(i);
+  qsort(entries.buffer(), entries.length(), sizeof(OsrEntry), osr_entry_sort_cmp);
+
+  size_t fde = w.length();
+  w.u32(0);
+  w.u32(uint32_t(cie));
+  w.addr(uintptr_t(fn->GetEntryAddress()));
+  w.addr(fn->GetCodeLength());
+
+  // Return sites are recorded in pc order; the rules have to be too.
+  const FixedArray<ReturnSite>& returns = fn->GetReturnSites();
+  size_t next_return = 0;
+
+  uint32_t cursor = 0;
+  WriteEntryFrame(w, &cursor, 0);
+  for (const auto& entry : entries) {
+    while (next_return < returns.length() && returns.at(next_return).pcoffs < entry.pcoffs)
+      WriteReturnFrame(w, &cursor, returns.at(next_return++).pcoffs);
+    WriteEntryFrame(w, &cursor, entry.pcoffs);
+  }
+  while (next_return < returns.length())
+    WriteReturnFrame(w, &cursor, returns.at(next_return++).pcoffs);
+
+  w.align(sizeof(uintptr_t), DW_CFA_nop);
+  w.patchLength(fde);
+  return true;
+}
+
+enum SectionIndex {
+  kNullSection,
+  kTextSection,
+  kSymtabSection,
+  kStrtabSection,
+  kDebugInfoSection,
+  kDebugAbbrevSection,
+  kDebugLineSection,
+  kDebugFrameSection,
+  kShstrtabSection,
+  kNumSections
+};
+
+struct SectionInfo {
+  const char* name;
+  uint32_t type;
+  uint32_t flags;
+  SectionWriter* data;
+  uint32_t link;
+  uint32_t info;
+  size_t entsize;
+};
+
+// An ET_REL object whose sections are already at their final addresses.
+// .text has no bytes of its own; gdb reads the code from memory.
+static bool
+BuildObject(PluginRuntime* rt, CompiledFunction* fn, const char* name, SectionWriter& out)
+{
+  uintptr_t base = uintptr_t(fn->GetEntryAddress());
+  size_t length = fn->GetCodeLength();
+
+  ke::Vector<LineMapEntry> lines;
+  if (!fn->BuildLineMap(rt->image(), &lines))
+    return false;
+  ke::Vector<const char*> files;
+  for (const auto& line : lines) {
+    if (FindFile(files, line.file) == files.length() && !files.append(line.file))
+      return false;
+  }
+
+  SectionWriter strtab;
+  strtab.u8(0);
+  strtab.string(name);
+
+  SectionWriter symtab;
+  ElfSymbol syms[2];
+  memset(syms, 0, sizeof(syms));
+  syms[1].st_name = 1;
+  syms[1].st_info = (STB_GLOBAL << 4) | STT_FUNC;
+  syms[1].st_shndx = kTextSection;
+  syms[1].st_value = base;
+  syms[1].st_size = length;
+  symtab.write(syms, sizeof(syms));
+
+  SectionWriter abbrevs, info, line_program, frames;
+  WriteAbbrevs(abbrevs);
+  WriteDebugInfo(info, rt->Name(), name, base, length);
+  WriteDebugLine(line_program, base, length, lines, files);
+  if (!WriteDebugFrame(frames, fn))
+    return false;
+
+  SectionWriter shstrtab;
+  SectionInfo sections[kNumSections] = {
+    { "", SHT_NULL, 0, nullptr, 0, 0, 0 },
+    { ".text", SHT_NOBITS, SHF_ALLOC | SHF_EXECINSTR, nullptr, 0, 0, 0 },
+    { ".symtab", SHT_SYMTAB, 0, &symtab, kStrtabSection, 1, sizeof(ElfSymbol) },
+    { ".strtab", SHT_STRTAB, 0, &strtab, 0, 0, 0 },
+    { ".debug_info", SHT_PROGBITS, 0, &info, 0, 0, 0 },
+    { ".debug_abbrev", SHT_PROGBITS, 0, &abbrevs, 0, 0, 0 },
+    { ".debug_line", SHT_PROGBITS, 0, &line_program, 0, 0, 0 },
+    { ".debug_frame", SHT_PROGBITS, 0, &frames, 0, 0, 0 },
+    { ".shstrtab", SHT_STRTAB, 0, &shstrtab, 0, 0, 0 },
+  };
+
+  uint32_t names[kNumSections];
+  for (size_t i = 0; i < kNumSections; i++) {
+    names[i] = uint32_t(shstrtab.length());
+    shstrtab.string(sections[i].name);
+  }
+
+  ElfHeader header;
+  memset(&header, 0, sizeof(header));
+  out.put(header);
+
+  size_t offsets[kNumSections];
+  for (size_t i = 0; i < kNumSections; i++) {
+    offsets[i] = 0;
+    if (!sections[i].data)
+      continue;
+    if (!sections[i].data->ok())
+      return false;
+    out.align(sizeof(uintptr_t), 0);
+    offsets[i] = out.length();
+    out.write(sections[i].data->bytes(), sections[i].data->length());
+  }
+
+  out.align(sizeof(uintptr_t), 0);
+  size_t section_headers = out.length();
+  for (size_t i = 0; i < kNumSections; i++) {
+    const SectionInfo& section = sections[i];
+
+    ElfSection sh;
+    memset(&sh, 0, sizeof(sh));
+    sh.sh_name = names[i];
+    sh.sh_type = section.type;
+    sh.sh_flags = section.flags;
+    sh.sh_offset = offsets[i];
+    sh.sh_link = section.link;
+    sh.sh_info = section.info;
+    sh.sh_addralign = 1;
+    sh.sh_entsize = section.entsize;
+    if (i == kTextSection) {
+      sh.sh_addr = base;
+      sh.sh_size = length;
+      sh.sh_addralign = 16;
+    } else if (section.data) {
+      sh.sh_size = section.data->length();
+      if (i == kSymtabSection || i == kDebugFrameSection)
+        sh.sh_addralign = sizeof(uintptr_t);
+    }
+    out.put(sh);
+  }
+
+  memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = kElfClass;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_type = ET_REL;
+  header.e_machine = kElfMachine;
+  header.e_version = EV_CURRENT;
+  header.e_shoff = section_headers;
+  header.e_ehsize = sizeof(ElfHeader);
+  header.e_shentsize = sizeof(ElfSection);
+  header.e_shnum = kNumSections;
+  header.e_shstrndx = kShstrtabSection;
+  out.patch(0, &header, sizeof(header));
+
+  return out.ok();
+}
+
+bool
+GdbJit::IsSupported()
+{
+  return true;
+}
+
+bool
+GdbJit::SetEnabled(bool enabled)
+{
+  sEnabled = enabled;
+  return true;
+}
+
+bool
+GdbJit::IsEnabled()
+{
+  return sEnabled;
+}
+
+void
+GdbJit::AddFunction(PluginRuntime* rt, CompiledFunction* fn)
+{
+  if (fn->gdb_entry())
+    return;
+
+  char name[256];
+  if (const char* function = rt->image()->LookupFunction(fn->GetCodeOffset()))
+    snprintf(name, sizeof(name), "%s::%s", rt->Name(), function);
+  else
+    snprintf(name, sizeof(name), "%s::%x", rt->Name(), unsigned(fn->GetCodeOffset()));
+
+  ke::AutoPtr<GdbJitEntry> entry(new GdbJitEntry);
+  if (!BuildObject(rt, fn, name, entry->object))
+    return;
+
+  jit_code_entry* link = &entry->link;
+  link->symfile_addr = reinterpret_cast<const char*>(entry->object.bytes());
+  link->symfile_size = entry->object.length();
+
+  {
+    ke::AutoLock lock(&sLock);
+    link->prev_entry = nullptr;
+    link->next_entry = __jit_debug_descriptor.first_entry;
+    if (link->next_entry)
+      link->next_entry->prev_entry = link;
+    __jit_debug_descriptor.first_entry = link;
+    __jit_debug_descriptor.relevant_entry = link;
+    __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+    __jit_debug_register_code();
+  }
+
+  fn->setGdbEntry(entry.take());
+}
+
+void
+GdbJit::RemoveFunction(CompiledFunction* fn)
+{
+  ke::AutoPtr<GdbJitEntry> entry(fn->gdb_entry());
+  fn->setGdbEntry(nullptr);
+
+  ke::AutoLock lock(&sLock);
+  jit_code_entry* link = &entry->link;
+  if (link->prev_entry)
+    link->prev_entry->next_entry = link->next_entry;
+  else
+    __jit_debug_descriptor.first_entry = link->next_entry;
+  if (link->next_entry)
+    link->next_entry->prev_entry = link->prev_entry;
+  __jit_debug_descriptor.relevant_entry = link;
+  __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+  __jit_debug_register_code();
+}
+
+#else // SP_HAS_GDB_JIT
+
+using namespace sp;
+
+bool
+GdbJit::IsSupported()
+{
+  return false;
+}
+
+bool
+GdbJit::SetEnabled(bool enabled)
+{
+  return !enabled;
+}
+
+bool
+GdbJit::IsEnabled()
+{
+  return false;
+}
+
+void
+GdbJit::AddFunction(PluginRuntime* rt, CompiledFunction* fn)
+{
+}
+
+void
+GdbJit::RemoveFunction(CompiledFunction* fn)
+{
+}
+
+#endif // SP_HAS_GDB_JIT
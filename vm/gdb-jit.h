@@ -0,0 +1,61 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_gdb_jit_h_
+#define _include_sourcepawn_vm_gdb_jit_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <amtl/am-platform.h>
+
+// gdb reads the objects as ELF, which it only does for native code on
+// Linux.
+#if defined(SP_HAS_JIT) && defined(__linux__) && (defined(KE_ARCH_X86) || defined(KE_ARCH_X64))
+# define SP_HAS_GDB_JIT
+#endif
+
+namespace sp {
+
+class CompiledFunction;
+class PluginRuntime;
+
+// Describes compiled functions to gdb through its JIT compilation
+// interface, so that it can name them, show their source lines, and unwind
+// through them. Each function gets a small in-memory ELF object with a
+// symbol, DWARF line and debug info, and call frame information for the
+// Scripted frame layout. Building these costs time and memory on every
+// compile, so it is off unless asked for. The interface is shared by the
+// whole process.
+class GdbJit
+{
+ public:
+  static bool IsSupported();
+
+  // Describe functions compiled from now on, in any environment. Functions
+  // that were described stay described until they are destroyed.
+  static bool SetEnabled(bool enabled);
+
+  // Called from any thread, before the function is run for the first time.
+  static bool IsEnabled();
+  static void AddFunction(PluginRuntime* rt, CompiledFunction* fn);
+
+  // Called when a described function is destroyed.
+  static void RemoveFunction(CompiledFunction* fn);
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_gdb_jit_h_
@@ -16,6 +16,7 @@
 // along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include "interpreter.h"
+#include "call-stats.h"
 #include "debugging.h"
 #include "environment.h"
 #include "method-info.h"
@@ -34,10 +35,19 @@ namespace sp {
 bool
 Interpreter::Run(PluginContext* cx, RefPtr<MethodInfo> method, cell_t* rval)
 {
+  Environment* env = Environment::get();
+
+  CallTimer timer;
+  if (env->IsCallStatsEnabled())
+    timer.enter(env);
+
   Interpreter interpreter(cx, method);
   if (!interpreter.run())
     return false;
 
+  if (env->IsCallStatsEnabled())
+    timer.leave(env, method.get());
+
   *rval = interpreter.return_value();
   return true;
 }
@@ -88,7 +98,13 @@ Interpreter::invokeNative(uint32_t native_index)
 
     const cell_t* params = reinterpret_cast<const cell_t*>(cx_->memory() + cx_->sp());
 
-    regs_.pri() = native->legacy_fn(cx_, params);
+    if (native->stats) {
+      uint64_t start = ReadCallTicks();
+      regs_.pri() = native->legacy_fn(cx_, params);
+      RecordNativeCall(native->stats, start);
+    } else {
+      regs_.pri() = native->legacy_fn(cx_, params);
+    }
   } else {
     cx_->ReportErrorNumber(SP_ERROR_INVALID_NATIVE);
   }
@@ -150,15 +166,10 @@ Interpreter::visitCALL(cell_t offset)
     cx_->ReportErrorNumber(SP_ERROR_INVALID_ADDRESS);
     return false;
   }
-  int err = target->Validate();
-  if (err != SP_ERROR_NONE) {
-    cx_->ReportErrorNumber(err);
-    return false;
-  }
 
-  // We don't interleave between the interpreter and JIT (yet).
+  // Go through the environment, so hot callees can run in the JIT.
   cell_t value = 0;
-  if (!Run(cx_, target, &value))
+  if (!env_->Invoke(cx_, target, &value))
     return false;
 
   regs_.pri() = value;
@@ -290,6 +301,8 @@ bool
 Interpreter::visitJUMP(cell_t offset)
 {
   if (offset < reader_.cip_offset()) {
+    method_->addBackedge();
+
     // Check the watchdog timer if we're looping backwards.
     if (!Environment::get()->watchdog()->HandleInterrupt()) {
       cx_->ReportErrorNumber(SP_ERROR_TIMEOUT);
@@ -336,6 +349,8 @@ Interpreter::visitJcmp(CompareOp op, cell_t offset)
 
   if (jump) {
     if (offset < reader_.cip_offset()) {
+      method_->addBackedge();
+
       // Check the watchdog timer if we're looping backwards.
       if (!Environment::get()->watchdog()->HandleInterrupt()) {
         cx_->ReportErrorNumber(SP_ERROR_TIMEOUT);
@@ -980,6 +995,19 @@ Interpreter::visitFLOAT_NOT()
   return true;
 }
 
+bool
+Interpreter::visitFLOAT_MATH(FloatMathOp op)
+{
+  cell_t left, right = 0;
+  if (!cx_->popStack(&left))
+    return false;
+  if (FloatMathArity(op) == 2 && !cx_->popStack(&right))
+    return false;
+
+  regs_.pri() = EvalFloatMath(op, left, right);
+  return true;
+}
+
 bool
 Interpreter::visitGENARRAY(uint32_t dims, bool autozero)
 {
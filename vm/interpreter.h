@@ -143,6 +143,7 @@ class Interpreter final : public PcodeVisitor
   bool visitFLOATCMP() override;
   bool visitFLOAT_CMP_OP(CompareOp op) override;
   bool visitFLOAT_NOT() override;
+  bool visitFLOAT_MATH(FloatMathOp op) override;
   bool visitBOUNDS(uint32_t limit) override;
   bool visitGENARRAY(uint32_t dims, bool autozero) override;
   bool visitTRACKER_PUSH_C(cell_t amount) override;
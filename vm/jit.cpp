@@ -16,6 +16,7 @@
 // along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include "jit.h"
+#include "code-cache.h"
 #include "environment.h"
 #include "linking.h"
 #include "method-info.h"
@@ -23,10 +24,13 @@
 #include "outofline-asm.h"
 #include "pcode-reader.h"
 #include "plugin-runtime.h"
+#include "runtime-helpers.h"
 #include "stack-frames.h"
 #include "watchdog_timer.h"
 #if defined(KE_ARCH_X86)
 # include "x86/jit_x86.h"
+#elif defined(KE_ARCH_X64)
+# include "x64/jit_x64.h"
 #endif
 
 namespace sp {
@@ -40,6 +44,9 @@ CompilerBase::CompilerBase(PluginRuntime* rt, MethodInfo* method)
    rt_(rt),
    context_(rt->GetBaseContext()),
    image_(rt_->image()),
+   background_(false),
+   call_stats_(env_->IsCallStatsEnabled()),
+   code_cache_(rt->code_cache()),
    method_info_(method),
    error_(SP_ERROR_NONE),
    pcode_start_(0),
@@ -52,21 +59,120 @@ CompilerBase::~CompilerBase()
 {
 }
 
+// A method that fails to verify, or that uses an opcode or address the JIT
+// can't handle, fails the same way every time, so it is left to the
+// interpreter for good. Anything else, such as running out of memory, may
+// succeed on a later call.
+static bool
+IsPermanentCompileError(MethodInfo* method, int err)
+{
+  switch (err) {
+    case SP_ERROR_INVALID_INSTRUCTION:
+    case SP_ERROR_INVALID_ADDRESS:
+      return true;
+    default:
+      return method->validationError() != SP_ERROR_NONE;
+  }
+}
+
 CompiledFunction*
 CompilerBase::Compile(PluginContext* cx, RefPtr<MethodInfo> method, int* err)
 {
-  Compiler cc(cx->runtime(), method);
+  CompiledFunction* fun = nullptr;
+  if (CodeCache* cache = cx->runtime()->code_cache())
+    fun = cache->Lookup(method, false);
 
-  CompiledFunction* fun = cc.emit();
   if (!fun) {
-    *err = cc.error();
-    return nullptr;
+    Compiler cc(cx->runtime(), method);
+
+    fun = cc.emit();
+    if (!fun) {
+      *err = cc.error();
+      if (IsPermanentCompileError(method, *err))
+        method->setJitRefused();
+      return nullptr;
+    }
   }
 
   method->setCompiledFunction(fun);
   return fun;
 }
 
+CompiledFunction*
+CompilerBase::CompileInBackground(PluginRuntime* rt, MethodInfo* method)
+{
+  CompiledFunction* fun = nullptr;
+  if (CodeCache* cache = rt->code_cache())
+    fun = cache->Lookup(method, true);
+
+  if (!fun) {
+    Compiler cc(rt, method);
+    cc.background_ = true;
+
+    fun = cc.emit();
+    if (!fun)
+      return nullptr;
+  }
+
+  method->setCompiledFunction(fun);
+  return fun;
+}
+
+CompiledFunction*
+CompilerBase::directCallTarget(cell_t offset) const
+{
+  // Other methods may be in the middle of compiling on another thread. The
+  // code cache can't find other methods' code again, so it always calls
+  // through a thunk.
+  if (background_ || code_cache_)
+    return nullptr;
+
+  RefPtr<MethodInfo> method = rt_->GetMethod(offset);
+  if (!method || method->isCompiling())
+    return nullptr;
+  return method->jit();
+}
+
+// Once bound, natives with an opcode replacement are inlined instead of
+// called. Off the main thread we can't tell whether that will happen, so
+// methods that call them are left to be compiled lazily. The code cache
+// records them so it can tell whether its code still applies.
+bool
+CompilerBase::findReplaceableNatives()
+{
+  for (auto iter = graph_->rpoBegin(); iter != graph_->rpoEnd(); iter++) {
+    Block* block = *iter;
+    for (const uint8_t* cip = block->start(); cip < block->end(); cip = NextInstruction(cip)) {
+      const cell_t* insn = reinterpret_cast<const cell_t*>(cip);
+      if ((insn[0] == OP_SYSREQ_C || insn[0] == OP_SYSREQ_N) &&
+          rt_->GetNativeReplacement(insn[1]) != OP_NOP &&
+          !replaceable_natives_.append(insn[1]))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool
+CompilerBase::isImmutableNative(const NativeEntry* native) const
+{
+  // The main thread may be binding natives while we compile, and the code
+  // cache may be loaded against natives bound somewhere else.
+  if (background_ || code_cache_)
+    return false;
+
+  return native->status == SP_NATIVE_BOUND &&
+         !(native->flags & (SP_NTVFLAG_EPHEMERAL|SP_NTVFLAG_OPTIONAL));
+}
+
+bool
+CompilerBase::isLeafNative(const NativeEntry* native) const
+{
+  return isImmutableNative(native) && (native->flags & SP_NTVFLAG_LEAF);
+}
+
 CompiledFunction*
 CompilerBase::emit()
 {
@@ -79,6 +185,20 @@ CompilerBase::emit()
   pcode_start_ = method_info_->pcode_offset();
   code_start_ = reinterpret_cast<const cell_t*>(rt_->code().bytes + pcode_start_);
 
+  if (!findReplaceableNatives()) {
+    reportError(SP_ERROR_OUT_OF_MEMORY);
+    return nullptr;
+  }
+  if (background_ && !replaceable_natives_.empty()) {
+    reportError(SP_ERROR_INVALID_NATIVE);
+    return nullptr;
+  }
+
+  // If the analysis fails, every check is kept.
+  ranges_ = new RangeAnalysis(rt_, graph_);
+  if (!ranges_->analyze())
+    ranges_ = nullptr;
+
 #if defined JIT_SPEW
   Environment::get()->debugger()->OnDebugSpew(
       "Compiling function %s::%s\n",
@@ -94,6 +214,11 @@ CompilerBase::emit()
     block_ = *iter;
     __ bind(block_->label());
 
+    if (isBackwardJumpTarget(block_) && !osr_blocks_.append(block_)) {
+      reportError(SP_ERROR_OUT_OF_MEMORY);
+      return nullptr;
+    }
+
     PcodeReader<CompilerBase> reader(rt_, block_, this);
     reader.begin();
 
@@ -114,6 +239,23 @@ CompilerBase::emit()
       visitJUMP(0);
   }
 
+  // Emit an OSR entry wherever the interpreter counts a backedge, so an
+  // interpreted frame stuck in a loop can move into this code. Errors here
+  // map to the start of the block.
+  for (size_t i = 0; i < osr_blocks_.length(); i++) {
+    Block* target = osr_blocks_[i];
+    op_cip_ = reinterpret_cast<const cell_t*>(target->start());
+
+    OsrEntry entry;
+    entry.cipoffs = uintptr_t(target->start()) - uintptr_t(code_start_);
+    entry.pcoffs = masm.pc();
+    if (!osr_entries_.append(entry)) {
+      reportError(SP_ERROR_OUT_OF_MEMORY);
+      return nullptr;
+    }
+    emitOsrEntry(target);
+  }
+
   for (size_t i = 0; i < ool_paths_.length(); i++) {
     OutOfLinePath* path = ool_paths_[i];
     __ bind(path->label());
@@ -169,8 +311,31 @@ CompilerBase::emit()
     new FixedArray<CipMapEntry>(cip_map_.length()));
   memcpy(cipmap->buffer(), cip_map_.buffer(), cip_map_.length() * sizeof(CipMapEntry));
 
+  AutoPtr<FixedArray<OsrEntry>> osr_entries(
+    new FixedArray<OsrEntry>(osr_entries_.length()));
+  memcpy(osr_entries->buffer(), osr_entries_.buffer(), osr_entries_.length() * sizeof(OsrEntry));
+
+  AutoPtr<FixedArray<FaultSite>> fault_sites(
+    new FixedArray<FaultSite>(unchecked_accesses_.length()));
+  for (size_t i = 0; i < unchecked_accesses_.length(); i++) {
+    const UncheckedAccess& access = unchecked_accesses_[i];
+    fault_sites->at(i).pcoffs = access.pc;
+    fault_sites->at(i).path_pcoffs = access.path->label()->offset();
+  }
+
+  AutoPtr<FixedArray<ReturnSite>> return_sites(
+    new FixedArray<ReturnSite>(return_sites_.length()));
+  memcpy(return_sites->buffer(), return_sites_.buffer(), return_sites_.length() * sizeof(ReturnSite));
+
   assert(error_ == SP_ERROR_NONE);
-  return new CompiledFunction(code, pcode_start_, edges.take(), cipmap.take());
+  CompiledFunction* fun = new CompiledFunction(code, pcode_start_, edges.take(), cipmap.take(),
+                                               osr_entries.take(), fault_sites.take(),
+                                               return_sites.take());
+
+  // Save the code before anything, like the watchdog, can patch it.
+  if (code_cache_)
+    code_cache_->Add(fun, masm.relocations(), replaceable_natives_);
+  return fun;
 }
 
 void
@@ -218,6 +383,26 @@ CompilerBase::emitThrowPathIfNeeded(int err)
   emitThrowPath(err);
 }
 
+void
+CompilerBase::recordUncheckedAccess()
+{
+  ErrorPath* path = new ErrorPath(op_cip_, SP_ERROR_MEMACCESS);
+  if (!ool_paths_.append(path) ||
+      !unchecked_accesses_.append(UncheckedAccess(masm.pc(), path)))
+  {
+    reportError(SP_ERROR_OUT_OF_MEMORY);
+  }
+}
+
+void
+CompilerBase::recordReturnSite()
+{
+  ReturnSite site;
+  site.pcoffs = masm.pc();
+  if (!return_sites_.append(site))
+    reportError(SP_ERROR_OUT_OF_MEMORY);
+}
+
 void
 CompilerBase::reportError(int err)
 {
@@ -226,7 +411,7 @@ CompilerBase::reportError(int err)
 }
 
 int
-CompilerBase::CompileFromThunk(PluginContext* cx, cell_t pcode_offs, void** addrp, uint8_t* pc)
+CompilerBase::CompileFromThunk(PluginContext* cx, cell_t pcode_offs, ThunkResult* result, uint8_t* pc)
 {
   // If the watchdog timer has declared a timeout, we must process it now,
   // and possibly refuse to compile, since otherwise we will compile a
@@ -237,14 +422,25 @@ CompilerBase::CompileFromThunk(PluginContext* cx, cell_t pcode_offs, void** addr
   RefPtr<MethodInfo> method = cx->runtime()->AcquireMethod(pcode_offs);
   if (!method)
     return SP_ERROR_INVALID_ADDRESS;
+  if (method->isCompiling())
+    Environment::get()->WaitForCompile(method);
 
   CompiledFunction* fn = method->jit();
-  if (!fn) {
-    int err;
+  if (!fn && Environment::get()->ShouldCompile(method)) {
+    int err = SP_ERROR_NONE;
     fn = Compile(cx, method, &err);
-    if (!fn)
+    if (!fn && !method->isJitRefused())
       return err;
   }
+  if (!fn) {
+    // The callee is still cold, or the JIT refused it, so interpret it,
+    // leaving the call site unpatched. The thunk has synced sp for us. If
+    // this fails, the error has already been reported.
+    result->code = nullptr;
+    result->rval = 0;
+    Environment::get()->Invoke(cx, method, &result->rval);
+    return SP_ERROR_NONE;
+  }
 
 #if defined JIT_SPEW
   Environment::get()->debugger()->OnDebugSpew(
@@ -253,7 +449,7 @@ CompilerBase::CompileFromThunk(PluginContext* cx, cell_t pcode_offs, void** addr
       cx->runtime()->image()->LookupFunction(pcode_offs));
 #endif
 
-  *addrp = fn->GetEntryAddress();
+  result->code = fn->GetEntryAddress();
 
   /* Right now, we always keep the code RWE */
   PatchCallThunk(pc, fn->GetEntryAddress());
@@ -294,6 +490,15 @@ CompilerBase::InvokeReportTimeout()
   InvokeReportError(SP_ERROR_TIMEOUT);
 }
 
+// Called directly, without an exit frame, for math intrinsics that have no
+// instruction of their own. |args| points at the operands on the plugin stack.
+cell_t
+CompilerBase::InvokeFloatMath(uint32_t op, const cell_t* args)
+{
+  FloatMathOp kind = FloatMathOp(op);
+  return EvalFloatMath(kind, args[0], FloatMathArity(kind) == 2 ? args[1] : 0);
+}
+
 bool
 ErrorPath::emit(Compiler* cc)
 {
@@ -27,14 +27,17 @@
 #include "pcode-visitor.h"
 #include "compiled-function.h"
 #include "control-flow.h"
+#include "range-analysis.h"
 
 namespace sp {
 
 using namespace SourcePawn;
 
+class CodeCache;
 class PluginRuntime;
 class PluginContext;
 class LegacyImage;
+struct NativeEntry;
 
 struct BackwardJump {
   // The pc at the jump instruction (i.e. after it).
@@ -52,6 +55,29 @@ struct BackwardJump {
   {}
 };
 
+// A load or store without an address check; see FaultSite.
+struct UncheckedAccess {
+  // The pc of the load or store.
+  uint32_t pc;
+  // Where the fault handler resumes, as if a check had failed.
+  ErrorPath* path;
+
+  UncheckedAccess()
+  {}
+  UncheckedAccess(uint32_t pc, ErrorPath* path)
+   : pc(pc),
+     path(path)
+  {}
+};
+
+// Filled in by CompileFromThunk. If the callee was not hot enough to compile,
+// it has already been run in the interpreter: |code| is null and |rval| is
+// its return value.
+struct ThunkResult {
+  void* code;
+  cell_t rval;
+};
+
 class CompilerBase : public PcodeVisitor
 {
   friend class ErrorPath;
@@ -62,6 +88,15 @@ class CompilerBase : public PcodeVisitor
 
   static CompiledFunction* Compile(PluginContext* cx, RefPtr<MethodInfo> method, int* err);
 
+  // Compile |method| on a compile queue thread. The code may not depend on
+  // other methods, or on how natives are bound, since the main thread can
+  // change either at any time. Returns null on failure.
+  static CompiledFunction* CompileInBackground(PluginRuntime* rt, MethodInfo* method);
+
+  // Return the address of a helper that compiled code may call, so the code
+  // cache can find it again. Returns null past the last one.
+  static void* ExternalSymbol(uint32_t index);
+
   int error() const {
     return error_;
   }
@@ -74,12 +109,14 @@ class CompilerBase : public PcodeVisitor
   virtual void emitErrorHandlers() = 0;
   virtual void emitOutOfBoundsErrorPath(OutOfBoundsErrorPath* path) = 0;
   virtual void emitDebugBreakHandler() = 0;
+  virtual void emitOsrEntry(Block* target) = 0;
 
   // Helpers.
-  static int CompileFromThunk(PluginContext* cx, cell_t pcode_offs, void** addrp, uint8_t* pc);
+  static int CompileFromThunk(PluginContext* cx, cell_t pcode_offs, ThunkResult* result, uint8_t* pc);
   static void* find_entry_fp();
   static void InvokeReportError(int err);
   static void InvokeReportTimeout();
+  static cell_t InvokeFloatMath(uint32_t op, const cell_t* args);
   static void PatchCallThunk(uint8_t* pc, void* target);
 
  protected:
@@ -102,6 +139,44 @@ class CompilerBase : public PcodeVisitor
     return target->id() <= block_->id();
   }
 
+  // Return the callee's code if a call can go straight to it, rather than
+  // through a thunk.
+  CompiledFunction* directCallTarget(cell_t offset) const;
+
+  // Natives that are bound for good can be called without a check.
+  bool isImmutableNative(const NativeEntry* native) const;
+
+  // Immutable natives flagged SP_NTVFLAG_LEAF can be called without an exit
+  // frame or an exception check.
+  bool isLeafNative(const NativeEntry* native) const;
+
+  // Collect every native the method calls that has an opcode replacement.
+  bool findReplaceableNatives();
+
+  // Call right before emitting a load or store whose address is not
+  // checked, because the context's memory is followed by guard pages that
+  // cover any 32-bit offset. A fault there throws SP_ERROR_MEMACCESS.
+  void recordUncheckedAccess();
+
+  // Call between leaveFrame() and the ret of a RETN; see ReturnSite.
+  void recordReturnSite();
+
+  // Range analysis can prove some BOUNDS checks never fail.
+  bool isRedundantBoundsCheck() const {
+    return ranges_ && ranges_->isRedundantBoundsCheck(op_cip_);
+  }
+
+  // The interpreters count a backedge for any jump to an earlier cip, which
+  // is not quite the same as a loop header: a for loop jumps back to its
+  // increment, not to its condition.
+  static bool isBackwardJumpTarget(Block* block) {
+    for (const auto& pred : block->predecessors()) {
+      if (pred->start() >= block->start())
+        return true;
+    }
+    return false;
+  }
+
  protected:
   void emitErrorPath(ErrorPath* path);
   void emitThrowPathIfNeeded(int err);
@@ -114,8 +189,13 @@ class CompilerBase : public PcodeVisitor
   PluginContext* context_;
   LegacyImage* image_;
   PoolScope scope_;
+  bool background_;
+  // Time each call in the prologue and RETN; see Environment::SetCallStatsEnabled().
+  bool call_stats_;
+  CodeCache* code_cache_;
   ke::RefPtr<MethodInfo> method_info_;
   ke::RefPtr<ControlFlowGraph> graph_;
+  ke::AutoPtr<RangeAnalysis> ranges_;
   ke::RefPtr<Block> block_;
   int error_;
   uint32_t pcode_start_;
@@ -136,6 +216,11 @@ class CompilerBase : public PcodeVisitor
 
   ke::Vector<BackwardJump> backward_jumps_;
   ke::Vector<CipMapEntry> cip_map_;
+  ke::Vector<ke::RefPtr<Block>> osr_blocks_;
+  ke::Vector<OsrEntry> osr_entries_;
+  ke::Vector<UncheckedAccess> unchecked_accesses_;
+  ke::Vector<ReturnSite> return_sites_;
+  ke::Vector<uint32_t> replaceable_natives_;
 };
 
 } // namespace sp
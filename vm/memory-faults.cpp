@@ -0,0 +1,141 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include "memory-faults.h"
+
+#if defined(SP_HAS_UNCHECKED_MEMORY)
+#include <signal.h>
+#include <string.h>
+#include <ucontext.h>
+#include "compiled-function.h"
+#include "environment.h"
+#include "method-info.h"
+#include "plugin-context.h"
+#include "plugin-runtime.h"
+#include "stack-frames.h"
+
+using namespace sp;
+
+// Environments on any thread may ask for the handler.
+static ke::Mutex sInstallLock;
+static bool sInstalled = false;
+static struct sigaction sPrevSegv;
+static struct sigaction sPrevBus;
+
+// Return where compiled code should resume after faulting at |pc|, or null
+// if the fault is not one of ours. Nothing here may fault in turn, so the
+// frame pointer is only followed once it is known to be on the stack
+// between the fault and the innermost entry into compiled code.
+static void*
+FindResumeAddress(void* pc, uintptr_t sp, intptr_t* fp, void* addr)
+{
+  Environment* env = Environment::get();
+  if (!env)
+    return nullptr;
+
+  InvokeFrame* ivk = env->top();
+  if (!ivk || !ivk->AsJitInvokeFrame())
+    return nullptr;
+
+  PluginContext* cx = ivk->cx();
+  if (!cx->HasUncheckedMemory())
+    return nullptr;
+
+  uintptr_t base = uintptr_t(cx->memory());
+  if (uintptr_t(addr) < base || uintptr_t(addr) - base >= cx->HeapSize() + kUncheckedGuardBytes)
+    return nullptr;
+
+  uintptr_t frame_addr = uintptr_t(FrameLayout::FromFp(fp));
+  if (frame_addr < sp || uintptr_t(fp) >= uintptr_t(ivk) || (uintptr_t(fp) & (sizeof(intptr_t) - 1)))
+    return nullptr;
+
+  FrameLayout* frame = FrameLayout::FromFp(fp);
+  if (frame->frame_type != intptr_t(JitFrameType::Scripted))
+    return nullptr;
+
+  // Don't touch reference counts; the thread may be in the middle of
+  // changing one.
+  MethodInfo* method = cx->runtime()->PeekMethod(cell_t(frame->function_id));
+  if (!method)
+    return nullptr;
+
+  CompiledFunction* fn = method->jit();
+  if (!fn)
+    return nullptr;
+  return fn->FindFaultPath(pc);
+}
+
+static void
+ForwardSignal(int sig, siginfo_t* info, void* context, const struct sigaction& prev)
+{
+  if (prev.sa_flags & SA_SIGINFO) {
+    prev.sa_sigaction(sig, info, context);
+    return;
+  }
+  if (prev.sa_handler == SIG_IGN)
+    return;
+  if (prev.sa_handler != SIG_DFL) {
+    prev.sa_handler(sig);
+    return;
+  }
+
+  // Let the faulting instruction run again, and crash as it would have
+  // without us.
+  signal(sig, SIG_DFL);
+}
+
+static void
+HandleFault(int sig, siginfo_t* info, void* context)
+{
+  ucontext_t* uc = reinterpret_cast<ucontext_t*>(context);
+  greg_t* regs = uc->uc_mcontext.gregs;
+
+  void* resume = FindResumeAddress(reinterpret_cast<void*>(regs[REG_RIP]),
+                                   uintptr_t(regs[REG_RSP]),
+                                   reinterpret_cast<intptr_t*>(regs[REG_RBP]),
+                                   info->si_addr);
+  if (resume) {
+    regs[REG_RIP] = greg_t(resume);
+    return;
+  }
+
+  ForwardSignal(sig, info, context, sig == SIGBUS ? sPrevBus : sPrevSegv);
+}
+
+bool
+sp::InstallMemoryFaultHandler()
+{
+  ke::AutoLock lock(&sInstallLock);
+  if (sInstalled)
+    return true;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = HandleFault;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+
+  if (sigaction(SIGSEGV, &action, &sPrevSegv) != 0)
+    return false;
+  if (sigaction(SIGBUS, &action, &sPrevBus) != 0) {
+    sigaction(SIGSEGV, &sPrevSegv, nullptr);
+    return false;
+  }
+  sInstalled = true;
+  return true;
+}
+
+#endif // SP_HAS_UNCHECKED_MEMORY
@@ -0,0 +1,46 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_memory_faults_h_
+#define _include_sourcepawn_vm_memory_faults_h_
+
+#include <stddef.h>
+#include <amtl/am-platform.h>
+
+// Unchecked memory accesses need the whole 32-bit offset range reserved
+// after a context's memory, and a signal handler that can find its way back
+// into compiled code.
+#if defined(SP_HAS_JIT) && defined(KE_ARCH_X64) && defined(__linux__)
+# define SP_HAS_UNCHECKED_MEMORY
+#endif
+
+namespace sp {
+
+#if defined(SP_HAS_UNCHECKED_MEMORY)
+// Address space reserved after a context's memory when its accesses are
+// unchecked: enough that any 32-bit offset, plus the width of a cell, lands
+// in a guard page.
+static const size_t kUncheckedGuardBytes = (size_t(1) << 32) + 16;
+
+// Install a SIGSEGV/SIGBUS handler that turns faults on unchecked loads and
+// stores in compiled code into SP_ERROR_MEMACCESS. Any other fault goes to
+// the handler that was installed before. Returns false on failure.
+bool InstallMemoryFaultHandler();
+#endif
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_memory_faults_h_
@@ -0,0 +1,136 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <stdlib.h>
+#include <amtl/am-utility.h>
+#include "memory-region.h"
+#if defined(_WIN32)
+# include <Windows.h>
+#elif !defined(__EMSCRIPTEN__)
+# include <unistd.h>
+# include <sys/mman.h>
+#endif
+
+using namespace sp;
+
+MemoryRegion::MemoryRegion()
+ : base_(nullptr),
+   mapping_(nullptr),
+   mapping_size_(0)
+{
+}
+
+MemoryRegion::~MemoryRegion()
+{
+  Release();
+}
+
+bool
+MemoryRegion::CanReserve()
+{
+#if defined(__EMSCRIPTEN__)
+  return false;
+#else
+  return true;
+#endif
+}
+
+size_t
+MemoryRegion::PageSize()
+{
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#elif !defined(__EMSCRIPTEN__)
+  return sysconf(_SC_PAGESIZE);
+#else
+  return 0;
+#endif
+}
+
+bool
+MemoryRegion::Allocate(size_t bytes, bool reserve, size_t guard_bytes)
+{
+  Release();
+
+  if (!reserve || !CanReserve()) {
+    base_ = (uint8_t*)calloc(bytes, 1);
+    return !!base_;
+  }
+
+#if !defined(__EMSCRIPTEN__)
+  // Round up to whole pages, and leave at least one guard page on either
+  // side.
+  size_t page_size = PageSize();
+  size_t usable = ke::Align(bytes, page_size);
+  if (usable < bytes)
+    return false;
+  size_t guard = ke::Align(guard_bytes, page_size);
+  if (guard < guard_bytes)
+    return false;
+  if (guard < page_size)
+    guard = page_size;
+  size_t total = usable + page_size + guard;
+  if (total < usable)
+    return false;
+
+# if defined(_WIN32)
+  void* address = VirtualAlloc(nullptr, total, MEM_RESERVE, PAGE_NOACCESS);
+  if (!address)
+    return false;
+  mapping_ = (uint8_t*)address;
+  mapping_size_ = total;
+  if (!VirtualAlloc(mapping_ + page_size, usable, MEM_COMMIT, PAGE_READWRITE)) {
+    Release();
+    return false;
+  }
+# else
+  void* address = mmap(nullptr, total, PROT_NONE, MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+  if (address == MAP_FAILED)
+    return false;
+  mapping_ = (uint8_t*)address;
+  mapping_size_ = total;
+  if (mprotect(mapping_ + page_size, usable, PROT_READ|PROT_WRITE) != 0) {
+    Release();
+    return false;
+  }
+# endif
+  // End the usable memory right at the upper guard, so that the first byte
+  // past it faults.
+  base_ = mapping_ + page_size + (usable - bytes);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+MemoryRegion::Release()
+{
+  if (mapping_) {
+#if defined(_WIN32)
+    VirtualFree(mapping_, 0, MEM_RELEASE);
+#elif !defined(__EMSCRIPTEN__)
+    munmap(mapping_, mapping_size_);
+#endif
+  } else {
+    free(base_);
+  }
+  base_ = nullptr;
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+}
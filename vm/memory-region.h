@@ -0,0 +1,68 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_memory_region_h_
+#define _include_sourcepawn_vm_memory_region_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sp {
+
+// Backing memory for a plugin's data, heap and stack.
+//
+// By default this is one eagerly zeroed block from the C heap. A reserved
+// region is instead mapped straight from the OS: it is zero-filled by the
+// kernel, so pages are only committed once a plugin actually touches them,
+// and it is bracketed by inaccessible guard pages, so that anything that
+// runs off either end faults instead of corrupting neighbouring memory.
+class MemoryRegion
+{
+ public:
+  MemoryRegion();
+  ~MemoryRegion();
+
+  // Whether regions can be reserved on this platform.
+  static bool CanReserve();
+
+  // The granularity of a reserved region.
+  static size_t PageSize();
+
+  // Allocate |bytes| of zeroed memory. A reserved region is followed by at
+  // least |guard_bytes| of inaccessible address space, and never less than
+  // a page. Its memory ends, rather than starts, on a page boundary.
+  // Returns false on failure.
+  bool Allocate(size_t bytes, bool reserve, size_t guard_bytes = 0);
+
+  uint8_t* base() const {
+    return base_;
+  }
+  bool reserved() const {
+    return !!mapping_;
+  }
+
+ private:
+  void Release();
+
+ private:
+  uint8_t* base_;
+  uint8_t* mapping_;
+  size_t mapping_size_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_memory_region_h_
@@ -13,8 +13,11 @@
 #include "environment.h"
 #include "compiled-function.h"
 #include "method-info.h"
+#include "gdb-jit.h"
 #include "method-verifier.h"
+#include "perf-maps.h"
 #include "graph-builder.h"
+#include "threaded-interpreter.h"
 
 namespace sp {
 
@@ -23,7 +26,13 @@ MethodInfo::MethodInfo(PluginRuntime* rt, uint32_t codeOffset)
    pcode_offset_(codeOffset),
    checked_(false),
    validation_error_(SP_ERROR_NONE),
-   max_stack_(0)
+   max_stack_(0),
+   invocation_count_(0),
+   backedge_count_(0),
+   call_stats_(),
+   has_cached_code_(false),
+   jit_refused_(false),
+   compile_state_(CompileState::None)
 {
 }
 
@@ -39,9 +48,28 @@ MethodInfo::setCompiledFunction(CompiledFunction* fun)
   // Grab the lock before linking code in, since the watchdog timer will look
   // at this on another thread.
   ke::AutoLock lock(Environment::get()->lock());
+
+  // Under the lock, so that Environment::SetPerfOutputs() and
+  // SetGdbJitEnabled() either see this function or let it be added here.
+#if defined(SP_HAS_PERF_MAPS)
+  if (PerfMaps::IsEnabled())
+    PerfMaps::AddFunction(rt_, fun);
+#endif
+#if defined(SP_HAS_GDB_JIT)
+  if (GdbJit::IsEnabled())
+    GdbJit::AddFunction(rt_, fun);
+#endif
+
   jit_ = fun;
 }
 
+void
+MethodInfo::setThreadedCode(ThreadedCode* code)
+{
+  assert(!threaded_);
+  threaded_ = code;
+}
+
 void
 MethodInfo::InternalValidate()
 {
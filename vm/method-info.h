@@ -14,15 +14,31 @@
 #define _INCLUDE_SOURCEPAWN_VM_METHOD_INFO_H_
 
 #include <sp_vm_types.h>
+#include <atomic>
 #include <amtl/am-refcounting.h>
+#include <amtl/am-refcounting-threadsafe.h>
 #include "control-flow.h"
 
 namespace sp {
 
 class PluginRuntime;
 class CompiledFunction;
+class ThreadedCode;
 
-class MethodInfo final : public ke::Refcounted<MethodInfo>
+// Calls to a method that have returned, and the time spent in them, in
+// ReadCallTicks() units. Self time leaves out the time spent in callees,
+// including natives that call back into plugins. A recursive method's total
+// time counts each activation, so it can add up to more than the time spent.
+struct CallStats
+{
+  uint64_t calls;
+  uint64_t total_ticks;
+  uint64_t self_ticks;
+};
+
+// Methods are refcounted across threads, since background compilation holds
+// references to them.
+class MethodInfo final : public ke::RefcountedThreadsafe<MethodInfo>
 {
  public:
   MethodInfo(PluginRuntime* rt, uint32_t codeOffset);
@@ -56,6 +72,73 @@ class MethodInfo final : public ke::Refcounted<MethodInfo>
     return jit_;
   }
 
+  void setThreadedCode(ThreadedCode* code);
+  ThreadedCode* threaded() const {
+    return threaded_;
+  }
+
+  // How many times this method has been entered, and how many backward jumps
+  // it has taken, while running in the interpreter. Once these add up to the
+  // JIT threshold, the method is compiled.
+  uint32_t invocation_count() const {
+    return invocation_count_;
+  }
+  uint32_t backedge_count() const {
+    return backedge_count_;
+  }
+  void addInvocation() {
+    invocation_count_++;
+  }
+  void addBackedge() {
+    backedge_count_++;
+  }
+
+  // Only counted while the environment has call stats enabled. Compiled code
+  // updates these in place.
+  CallStats& call_stats() {
+    return call_stats_;
+  }
+  const CallStats& call_stats() const {
+    return call_stats_;
+  }
+
+  // Set when the code cache has code for this method, in which case it is
+  // compiled on first use.
+  bool hasCachedCode() const {
+    return has_cached_code_;
+  }
+  void setHasCachedCode() {
+    has_cached_code_ = true;
+  }
+
+  // Set when the JIT could not compile this method. It then stays in the
+  // interpreter, rather than failing each time it gets hot.
+  bool isJitRefused() const {
+    return jit_refused_;
+  }
+  void setJitRefused() {
+    jit_refused_ = true;
+  }
+
+  // Where the method is in background compilation. Until it is back to
+  // None, the method belongs to the compile queue and nothing else may look
+  // at it beyond its offset; callers must wait for it through the
+  // environment.
+  enum class CompileState : uint32_t {
+    None,
+    Queued,
+    Running
+  };
+  CompileState compileState() const {
+    return compile_state_.load(std::memory_order_acquire);
+  }
+  void setCompileState(CompileState state) {
+    compile_state_.store(state, std::memory_order_release);
+  }
+  bool isCompiling() const {
+    return compileState() != CompileState::None;
+  }
+
  private:
   void InternalValidate();
 
@@ -63,11 +146,18 @@ class MethodInfo final : public ke::Refcounted<MethodInfo>
   PluginRuntime* rt_;
   uint32_t pcode_offset_;
   ke::AutoPtr<CompiledFunction> jit_;
+  ke::AutoPtr<ThreadedCode> threaded_;
   ke::RefPtr<ControlFlowGraph> graph_;
 
   bool checked_;
   int validation_error_;
   int32_t max_stack_;
+  uint32_t invocation_count_;
+  uint32_t backedge_count_;
+  CallStats call_stats_;
+  bool has_cached_code_;
+  bool jit_refused_;
+  std::atomic<CompileState> compile_state_;
 };
 
 } // namespace sp
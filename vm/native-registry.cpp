@@ -0,0 +1,87 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include "native-registry.h"
+#include "plugin-runtime.h"
+#include "symbol-index.h"
+
+using namespace sp;
+using namespace SourcePawn;
+
+NativeRegistry::NativeRegistry()
+{
+}
+
+bool
+NativeRegistry::Initialize()
+{
+  return map_.init(256);
+}
+
+bool
+NativeRegistry::AddNative(const char* name, SPVM_NATIVE_FUNC func, uint32_t flags, void* data)
+{
+  Native native = { func, flags, data };
+
+  Key key = { name, SymbolIndex::Hash(name) };
+  Map::Insert p = map_.findForAdd(key);
+  if (p.found()) {
+    p->value = native;
+    return true;
+  }
+  return map_.add(p, ke::AString(name), native);
+}
+
+bool
+NativeRegistry::AddNatives(const sp_nativeinfo_t* natives)
+{
+  for (const sp_nativeinfo_t* iter = natives; iter->name; iter++) {
+    if (!AddNative(iter->name, iter->func, 0, nullptr))
+      return false;
+  }
+  return true;
+}
+
+size_t
+NativeRegistry::GetNativeCount()
+{
+  return map_.elements();
+}
+
+uint32_t
+NativeRegistry::Bind(PluginRuntime* rt, uint32_t* unresolved, uint32_t max_unresolved)
+{
+  uint32_t num_unresolved = 0;
+  LegacyImage* image = rt->image();
+  for (size_t i = 0; i < image->NumNatives(); i++) {
+    if (rt->NativeAt(i)->status == SP_NATIVE_BOUND)
+      continue;
+
+    // Entry names are filled in lazily, so read the name from the image.
+    const char* name = image->GetNative(i);
+    Key key = { name, SymbolIndex::Hash(name) };
+    Map::Result r = map_.find(key);
+    if (r.found() && r->value.func) {
+      rt->UpdateNativeBinding(uint32_t(i), r->value.func, r->value.flags, r->value.data);
+      continue;
+    }
+
+    if (unresolved && num_unresolved < max_unresolved)
+      unresolved[num_unresolved] = uint32_t(i);
+    num_unresolved++;
+  }
+  return num_unresolved;
+}
@@ -0,0 +1,72 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_native_registry_h_
+#define _include_sourcepawn_vm_native_registry_h_
+
+#include <string.h>
+#include <sp_vm_api.h>
+#include <amtl/am-hashmap.h>
+#include <amtl/am-string.h>
+
+namespace sp {
+
+using namespace SourcePawn;
+
+class PluginRuntime;
+
+// Implements INativeRegistry. Names are hashed with SymbolIndex::Hash(),
+// the same hash the runtime's own symbol tables use.
+class NativeRegistry final : public INativeRegistry
+{
+ public:
+  NativeRegistry();
+
+  bool Initialize();
+
+  bool AddNative(const char* name, SPVM_NATIVE_FUNC func, uint32_t flags, void* data) override;
+  bool AddNatives(const sp_nativeinfo_t* natives) override;
+  size_t GetNativeCount() override;
+
+  // See ISourcePawnEngine2::BindNatives().
+  uint32_t Bind(PluginRuntime* rt, uint32_t* unresolved, uint32_t max_unresolved);
+
+ private:
+  struct Native {
+    SPVM_NATIVE_FUNC func;
+    uint32_t flags;
+    void* data;
+  };
+  struct Key {
+    const char* name;
+    uint32_t hash;
+  };
+  struct Policy {
+    static inline uint32_t hash(const Key& key) {
+      return key.hash;
+    }
+    static inline bool matches(const Key& key, const ke::AString& name) {
+      return strcmp(key.name, name.chars()) == 0;
+    }
+  };
+  typedef ke::HashMap<ke::AString, Native, Policy> Map;
+
+  Map map_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_native_registry_h_
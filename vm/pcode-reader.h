@@ -489,14 +489,10 @@ class PcodeReader
       cell_t index = readCell();
       cell_t nparams = readCell();
 
-      NativeEntry* native = rt_->NativeAt(index);
-      if (native->status == SP_NATIVE_BOUND &&
-          !(native->flags & (SP_NTVFLAG_EPHEMERAL|SP_NTVFLAG_OPTIONAL)))
-      {
-        uint32_t replacement = rt_->GetNativeReplacement(index);
-        if (replacement != OP_NOP)
-          return visitOp((OPCODE)replacement);
-      }
+      // This checks the replacement table first: it is fixed at load, whereas
+      // the native's binding may still be changing on another thread.
+      if (rt_->IsNativeInlined(index))
+        return visitOp((OPCODE)rt_->GetNativeReplacement(index));
 
       return visitor_->visitSYSREQ_N(index, nparams);
     }
@@ -595,6 +591,21 @@ class PcodeReader
     case OP_FLOAT_NOT:
       return visitor_->visitFLOAT_NOT();
 
+    case OP_FLOAT_SQRT:
+      return visitor_->visitFLOAT_MATH(FloatMathOp::Sqrt);
+    case OP_FLOAT_SIN:
+      return visitor_->visitFLOAT_MATH(FloatMathOp::Sine);
+    case OP_FLOAT_COS:
+      return visitor_->visitFLOAT_MATH(FloatMathOp::Cosine);
+    case OP_FLOAT_ATAN2:
+      return visitor_->visitFLOAT_MATH(FloatMathOp::ArcTangent2);
+    case OP_FLOAT_POW:
+      return visitor_->visitFLOAT_MATH(FloatMathOp::Pow);
+    case OP_FLOAT_FRACTION:
+      return visitor_->visitFLOAT_MATH(FloatMathOp::Fraction);
+    case OP_FLOAT_MOD:
+      return visitor_->visitFLOAT_MATH(FloatMathOp::Mod);
+
     case OP_HALT:
     {
       cell_t value = readCell();
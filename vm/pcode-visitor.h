@@ -36,6 +36,31 @@ enum class CompareOp {
   Sgeq
 };
 
+// Math natives that are replaced with an intrinsic once bound. Arguments are
+// popped in order, so the first is at the top of the stack.
+enum class FloatMathOp {
+  Sqrt,
+  Sine,
+  Cosine,
+  ArcTangent2,
+  Pow,
+  Fraction,
+  Mod
+};
+
+static inline size_t
+FloatMathArity(FloatMathOp op)
+{
+  switch (op) {
+    case FloatMathOp::ArcTangent2:
+    case FloatMathOp::Pow:
+    case FloatMathOp::Mod:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
 struct CaseTableEntry {
   cell_t value;
   cell_t address;
@@ -132,6 +157,7 @@ class PcodeVisitor
   virtual bool visitFLOATCMP() = 0;
   virtual bool visitFLOAT_CMP_OP(CompareOp op) = 0;
   virtual bool visitFLOAT_NOT() = 0;
+  virtual bool visitFLOAT_MATH(FloatMathOp op) = 0;
   virtual bool visitHALT(cell_t value) = 0;
   virtual bool visitSWITCH(cell_t defaultOffset, const CaseTableEntry* cases, size_t ncases) = 0;
   virtual bool visitREBASE(cell_t addr, cell_t iv_size, cell_t data_size) = 0;
@@ -484,6 +510,10 @@ class IncompletePcodeVisitor : public PcodeVisitor
     assert(false);
     return false;
   }
+  virtual bool visitFLOAT_MATH(FloatMathOp op) override {
+    assert(false);
+    return false;
+  }
   virtual bool visitHALT(cell_t value) override {
     assert(false);
     return false;
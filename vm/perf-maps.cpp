@@ -0,0 +1,294 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include "perf-maps.h"
+#include <sp_vm_api.h>
+
+#if defined(SP_HAS_PERF_MAPS)
+#include <elf.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <amtl/am-thread-utils.h>
+#include <amtl/am-vector.h>
+#include "compiled-function.h"
+#include "plugin-runtime.h"
+
+using namespace sp;
+
+// Records of the jitdump format, as documented in the Linux tree under
+// tools/perf/Documentation/jitdump-specification.txt.
+static const uint32_t kJitDumpMagic = 0x4A695444;
+static const uint32_t kJitDumpVersion = 1;
+
+static const uint32_t kJitCodeLoad = 0;
+static const uint32_t kJitCodeDebugInfo = 2;
+
+struct JitDumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+
+struct JitDumpRecord {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+};
+
+// Followed by the function's name, then its code.
+struct JitCodeLoad {
+  JitDumpRecord header;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+};
+
+// Followed by |nr_entry| JitDebugEntry records. Must come before the load
+// of the code it describes.
+struct JitCodeDebugInfo {
+  JitDumpRecord header;
+  uint64_t code_addr;
+  uint64_t nr_entry;
+};
+
+// Followed by the file name.
+struct JitDebugEntry {
+  uint64_t addr;
+  uint32_t lineno;
+  uint32_t discrim;
+};
+
+// Compile threads of every environment write here.
+static ke::Mutex sLock;
+static std::atomic<uint32_t> sFlags(0);
+static FILE* sPerfMap = nullptr;
+static FILE* sJitDump = nullptr;
+static uint64_t sNextCodeIndex = 0;
+
+// perf record -k mono stamps its samples with this clock.
+static uint64_t
+Timestamp()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+static bool
+OpenJitDump()
+{
+  char path[64];
+  snprintf(path, sizeof(path), "jit-%d.dump", int(getpid()));
+
+  int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+  if (fd == -1)
+    return false;
+
+  // perf record finds the file through this mapping, which must be
+  // executable so that it shows up as an mmap event. It is never used.
+  void* marker = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+  if (marker == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  FILE* fp = fdopen(fd, "wb");
+  if (!fp) {
+    munmap(marker, sysconf(_SC_PAGESIZE));
+    close(fd);
+    return false;
+  }
+
+  JitDumpHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kJitDumpMagic;
+  header.version = kJitDumpVersion;
+  header.total_size = sizeof(header);
+#if defined(KE_ARCH_X64)
+  header.elf_mach = EM_X86_64;
+#else
+  header.elf_mach = EM_386;
+#endif
+  header.pid = uint32_t(getpid());
+  header.timestamp = Timestamp();
+  fwrite(&header, sizeof(header), 1, fp);
+  fflush(fp);
+
+  sJitDump = fp;
+  return true;
+}
+
+static void
+WriteDebugInfo(PluginRuntime* rt, CompiledFunction* fn)
+{
+  ke::Vector<LineMapEntry> lines;
+  if (!fn->BuildLineMap(rt->image(), &lines) || lines.empty())
+    return;
+
+  size_t total_size = sizeof(JitCodeDebugInfo);
+  for (const auto& line : lines)
+    total_size += sizeof(JitDebugEntry) + strlen(line.file) + 1;
+
+  uintptr_t base = uintptr_t(fn->GetEntryAddress());
+
+  JitCodeDebugInfo record;
+  record.header.id = kJitCodeDebugInfo;
+  record.header.total_size = uint32_t(total_size);
+  record.header.timestamp = Timestamp();
+  record.code_addr = base;
+  record.nr_entry = lines.length();
+  fwrite(&record, sizeof(record), 1, sJitDump);
+
+  for (const auto& line : lines) {
+    JitDebugEntry entry;
+    entry.addr = base + line.pcoffs;
+    entry.lineno = line.line;
+    entry.discrim = 0;
+    fwrite(&entry, sizeof(entry), 1, sJitDump);
+    fwrite(line.file, strlen(line.file) + 1, 1, sJitDump);
+  }
+}
+
+static void
+WriteCodeLoad(const char* name, void* address, size_t length)
+{
+  uint32_t flags = sFlags;
+
+  if (sPerfMap && (flags & SP_PERF_MAP)) {
+    fprintf(sPerfMap, "%" PRIxPTR " %zx %s\n", uintptr_t(address), length, name);
+    fflush(sPerfMap);
+  }
+
+  if (sJitDump && (flags & SP_PERF_JITDUMP)) {
+    size_t name_length = strlen(name) + 1;
+
+    JitCodeLoad record;
+    record.header.id = kJitCodeLoad;
+    record.header.total_size = uint32_t(sizeof(record) + name_length + length);
+    record.header.timestamp = Timestamp();
+    record.pid = uint32_t(getpid());
+    record.tid = uint32_t(syscall(SYS_gettid));
+    record.vma = uintptr_t(address);
+    record.code_addr = uintptr_t(address);
+    record.code_size = length;
+    record.code_index = sNextCodeIndex++;
+    fwrite(&record, sizeof(record), 1, sJitDump);
+    fwrite(name, name_length, 1, sJitDump);
+    fwrite(address, length, 1, sJitDump);
+    fflush(sJitDump);
+  }
+}
+
+bool
+PerfMaps::IsSupported()
+{
+  return true;
+}
+
+bool
+PerfMaps::SetOutputs(uint32_t flags)
+{
+  ke::AutoLock lock(&sLock);
+
+  if ((flags & SP_PERF_MAP) && !sPerfMap) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", int(getpid()));
+    if ((sPerfMap = fopen(path, "w")) == nullptr)
+      return false;
+  }
+  if ((flags & SP_PERF_JITDUMP) && !sJitDump && !OpenJitDump())
+    return false;
+
+  sFlags = flags;
+  return true;
+}
+
+bool
+PerfMaps::IsEnabled()
+{
+  return sFlags != 0;
+}
+
+void
+PerfMaps::AddStub(const char* name, void* address, size_t length)
+{
+  ke::AutoLock lock(&sLock);
+  WriteCodeLoad(name, address, length);
+}
+
+void
+PerfMaps::AddFunction(PluginRuntime* rt, CompiledFunction* fn)
+{
+  char name[256];
+  if (const char* function = rt->image()->LookupFunction(fn->GetCodeOffset()))
+    snprintf(name, sizeof(name), "%s::%s", rt->Name(), function);
+  else
+    snprintf(name, sizeof(name), "%s::%x", rt->Name(), unsigned(fn->GetCodeOffset()));
+
+  ke::AutoLock lock(&sLock);
+  if (sJitDump && (sFlags & SP_PERF_JITDUMP))
+    WriteDebugInfo(rt, fn);
+  WriteCodeLoad(name, fn->GetEntryAddress(), fn->GetCodeLength());
+}
+
+#else // SP_HAS_PERF_MAPS
+
+using namespace sp;
+
+bool
+PerfMaps::IsSupported()
+{
+  return false;
+}
+
+bool
+PerfMaps::SetOutputs(uint32_t flags)
+{
+  return !flags;
+}
+
+bool
+PerfMaps::IsEnabled()
+{
+  return false;
+}
+
+void
+PerfMaps::AddStub(const char* name, void* address, size_t length)
+{
+}
+
+void
+PerfMaps::AddFunction(PluginRuntime* rt, CompiledFunction* fn)
+{
+}
+
+#endif // SP_HAS_PERF_MAPS
@@ -0,0 +1,65 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_perf_maps_h_
+#define _include_sourcepawn_vm_perf_maps_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <amtl/am-platform.h>
+
+// Both formats are read by Linux perf.
+#if defined(SP_HAS_JIT) && defined(__linux__)
+# define SP_HAS_PERF_MAPS
+#endif
+
+namespace sp {
+
+class CompiledFunction;
+class PluginRuntime;
+
+// Tells Linux perf what generated code is, so that profiles name it rather
+// than showing anonymous memory. The files are shared by every environment
+// in the process:
+//
+//  - /tmp/perf-<pid>.map has one line per function, with its address, size
+//    and name. perf report and perf top read it as is.
+//  - jit-<pid>.dump, in the working directory, is in perf's jitdump format.
+//    It also has each function's code and line table, so perf annotate can
+//    show source lines. Record with "perf record -k mono", then run
+//    "perf inject --jit" before reporting.
+//
+// Code linked before an output is turned on is only listed if it is added
+// again; see Environment::SetPerfOutputs().
+class PerfMaps
+{
+ public:
+  static bool IsSupported();
+
+  // Write the outputs in |flags|, which are SP_PERF_* values, from now on.
+  // Files are created the first time they are needed, and kept open until
+  // the process exits. Returns false if a file could not be created.
+  static bool SetOutputs(uint32_t flags);
+
+  // Called from any thread, before code is run for the first time.
+  static bool IsEnabled();
+  static void AddStub(const char* name, void* address, size_t length);
+  static void AddFunction(PluginRuntime* rt, CompiledFunction* fn);
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_perf_maps_h_
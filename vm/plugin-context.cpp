@@ -19,6 +19,8 @@
 #include "watchdog_timer.h"
 #include "environment.h"
 #include "method-info.h"
+#include "memory-faults.h"
+#include "context-snapshot.h"
 
 using namespace sp;
 using namespace SourcePawn;
@@ -33,6 +35,7 @@ PluginContext::PluginContext(PluginRuntime* pRuntime)
    memory_(nullptr),
    data_size_(m_pRuntime->data().length),
    mem_size_(m_pRuntime->image()->HeapSize()),
+   unchecked_memory_(false),
    m_pNullVec(nullptr),
    m_pNullString(nullptr)
 {
@@ -54,17 +57,28 @@ PluginContext::PluginContext(PluginRuntime* pRuntime)
 
 PluginContext::~PluginContext()
 {
-  delete[] memory_;
 }
 
 bool
 PluginContext::Initialize()
 {
-  memory_ = new uint8_t[mem_size_];
-  if (!memory_)
+  bool reserve = env_->IsReservedMemoryEnabled();
+  size_t guard_bytes = 0;
+#if defined(SP_HAS_UNCHECKED_MEMORY)
+  if (env_->IsUncheckedMemoryEnabled()) {
+    reserve = true;
+    guard_bytes = kUncheckedGuardBytes;
+  }
+#endif
+
+  // Both kinds of region come back zeroed, so only the data section needs
+  // to be filled in; a reserved region commits the heap and stack lazily.
+  if (!region_.Allocate(mem_size_, reserve, guard_bytes))
     return false;
-  memset(memory_ + data_size_, 0, mem_size_ - data_size_);
-  memcpy(memory_, m_pRuntime->data().bytes, data_size_);
+  unchecked_memory_ = (guard_bytes != 0);
+  memory_ = region_.base();
+  if (!mapSharedData())
+    memcpy(memory_, m_pRuntime->data().bytes, data_size_);
 
   /* Initialize the null references */
   uint32_t index;
@@ -87,6 +101,26 @@ PluginContext::Initialize()
   return true;
 }
 
+bool
+PluginContext::mapSharedData()
+{
+  // Small data sections are cheaper to copy than to map.
+  size_t page_size = MemoryRegion::PageSize();
+  if (!region_.reserved() || data_size_ < page_size)
+    return false;
+
+  size_t offset = uintptr_t(memory_) & (page_size - 1);
+  data_image_ = DataImage::Acquire(m_pRuntime, offset);
+  if (!data_image_)
+    return false;
+
+  if (!data_image_->MapAt(memory_ - offset)) {
+    data_image_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
 int
 PluginContext::HeapAlloc(unsigned int cells, cell_t* local_addr, cell_t** phys_addr)
 {
@@ -380,6 +414,31 @@ PluginContext::GetNullRef(SP_NULL_TYPE type)
   return NULL;
 }
 
+IContextSnapshot*
+PluginContext::CreateSnapshot()
+{
+  if (IsInExec())
+    return nullptr;
+  return ContextSnapshot::New(this);
+}
+
+int
+PluginContext::RestoreSnapshot(IContextSnapshot* snapshot)
+{
+  ContextSnapshot* saved = static_cast<ContextSnapshot*>(snapshot);
+  if (saved->cx() != this || IsInExec())
+    return SP_ERROR_PARAM;
+
+  saved->restore();
+  return SP_ERROR_NONE;
+}
+
+void
+PluginContext::DestroySnapshot(IContextSnapshot* snapshot)
+{
+  delete static_cast<ContextSnapshot*>(snapshot);
+}
+
 bool
 PluginContext::IsInExec()
 {
@@ -391,17 +450,32 @@ PluginContext::IsInExec()
 }
 
 bool
-PluginContext::Invoke(funcid_t fnid, const cell_t* params, unsigned int num_params, cell_t* result)
+PluginContext::IsOwnerThread() const
 {
-  EnterProfileScope profileScope("SourcePawn", "EnterJIT");
+  return Environment::get() == env_;
+}
 
-  if (!env_->watchdog()->HandleInterrupt()) {
-    ReportErrorNumber(SP_ERROR_TIMEOUT);
-    return false;
-  }
+bool
+PluginContext::CheckOwnerThread()
+{
+  if (IsOwnerThread())
+    return true;
 
+  // Another thread's environment has no business touching this one, not even
+  // to report an error.
+  if (Environment* env = Environment::get())
+    env->ReportError(SP_ERROR_NOT_RUNNABLE);
+  return false;
+}
+
+bool
+PluginContext::Invoke(funcid_t fnid, const cell_t* params, unsigned int num_params, cell_t* result)
+{
   assert((fnid & 1) != 0);
 
+  if (!CheckOwnerThread())
+    return false;
+
   unsigned public_id = fnid >> 1;
   ScriptedInvoker* cfun = m_pRuntime->GetPublicFunction(public_id);
   if (!cfun) {
@@ -409,6 +483,29 @@ PluginContext::Invoke(funcid_t fnid, const cell_t* params, unsigned int num_para
     return false;
   }
 
+  return InvokeFunction(cfun, params, num_params, result);
+}
+
+bool
+PluginContext::InvokeFunction(ScriptedInvoker* cfun, const cell_t* params, unsigned int num_params,
+                              cell_t* result)
+{
+  EnterProfileScope profileScope("SourcePawn", "EnterJIT");
+  return InvokeFunctionInScope(cfun, params, num_params, result);
+}
+
+bool
+PluginContext::InvokeFunctionInScope(ScriptedInvoker* cfun, const cell_t* params,
+                                     unsigned int num_params, cell_t* result)
+{
+  // Callers check this before touching the context.
+  assert(IsOwnerThread());
+
+  if (!env_->watchdog()->HandleInterrupt()) {
+    ReportErrorNumber(SP_ERROR_TIMEOUT);
+    return false;
+  }
+
   if (m_pRuntime->IsPaused()) {
     ReportErrorNumber(SP_ERROR_NOT_RUNNABLE);
     return false;
@@ -16,6 +16,8 @@
 #include "base-context.h"
 #include "scripted-invoker.h"
 #include "plugin-runtime.h"
+#include "memory-region.h"
+#include "data-image.h"
 
 namespace sp {
 
@@ -24,9 +26,12 @@ static const cell_t STACK_MARGIN = 64; // 16 parameters of safety, I guess
 
 class Environment;
 class PluginContext;
+class ContextSnapshot;
 
 class PluginContext : public BasePluginContext
 {
+  friend class ContextSnapshot;
+
  public:
   PluginContext(PluginRuntime* pRuntime);
   ~PluginContext() override;
@@ -57,9 +62,31 @@ class PluginContext : public BasePluginContext
   int LocalToStringNULL(cell_t local_addr, char** addr) override;
   IPluginRuntime* GetRuntime() override;
   cell_t* GetLocalParams() override;
+  IContextSnapshot* CreateSnapshot() override;
+  int RestoreSnapshot(IContextSnapshot* snapshot) override;
+  void DestroySnapshot(IContextSnapshot* snapshot) override;
+
+  // Whether the calling thread runs this context's environment. Calls from
+  // any other thread are refused at the public entry points, before they
+  // touch the context.
+  bool IsOwnerThread() const;
+
+  // Same as IsOwnerThread(), but also reports SP_ERROR_NOT_RUNNABLE to the
+  // calling thread's own environment, if it has one, when it returns false.
+  bool CheckOwnerThread();
 
   bool Invoke(funcid_t fnid, const cell_t* params, unsigned int num_params, cell_t* result);
 
+  // Same as Invoke(), for callers that already have the function.
+  bool InvokeFunction(ScriptedInvoker* cfun, const cell_t* params, unsigned int num_params,
+                      cell_t* result);
+
+  // Same as InvokeFunction(), for callers that have already entered the
+  // profiler's EnterJIT scope, such as a dispatch group making many calls
+  // in a row.
+  bool InvokeFunctionInScope(ScriptedInvoker* cfun, const cell_t* params,
+                             unsigned int num_params, cell_t* result);
+
   size_t HeapSize() const {
     return mem_size_;
   }
@@ -69,16 +96,31 @@ class PluginContext : public BasePluginContext
   size_t DataSize() const {
     return data_size_;
   }
+  cell_t stp() const {
+    return stp_;
+  }
   PluginRuntime* runtime() const {
     return m_pRuntime;
   }
 
+  // Whether the memory is followed by enough guard pages that compiled code
+  // can skip address checks. See Environment::SetUncheckedMemoryEnabled().
+  bool HasUncheckedMemory() const {
+    return unchecked_memory_;
+  }
+
  public:
   bool IsInExec() override;
 
   static inline size_t offsetOfSp() {
     return offsetof(PluginContext, sp_);
   }
+  static inline size_t offsetOfHp() {
+    return offsetof(PluginContext, hp_);
+  }
+  static inline size_t offsetOfFrm() {
+    return offsetof(PluginContext, frm_);
+  }
   static inline size_t offsetOfRuntime() {
     return offsetof(PluginContext, m_pRuntime);
   }
@@ -133,11 +175,17 @@ class PluginContext : public BasePluginContext
 
   cell_t* throwIfBadAddress(cell_t addr);
 
+ private:
+  bool mapSharedData();
+
  private:
   PluginRuntime* m_pRuntime;
+  MemoryRegion region_;
+  ke::RefPtr<DataImage> data_image_;
   uint8_t* memory_;
   uint32_t data_size_;
   uint32_t mem_size_;
+  bool unchecked_memory_;
 
   cell_t* m_pNullVec;
   cell_t* m_pNullString;
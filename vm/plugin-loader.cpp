@@ -0,0 +1,235 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <amtl/am-autoptr.h>
+#include <amtl/am-function.h>
+#include <amtl/am-uniqueptr.h>
+#include <amtl/am-vector.h>
+#include <am-thread-utils.h>
+#include "api.h"
+#include "code-cache.h"
+#include "compile-queue.h"
+#include "environment.h"
+#include "method-info.h"
+#include "plugin-loader.h"
+#include "plugin-runtime.h"
+#include "pool-allocator.h"
+#include "smx-v1-image.h"
+
+using namespace sp;
+
+SmxV1Image*
+PluginLoader::ReadImage(const char* file, char* error, size_t maxlength)
+{
+  FILE* fp = fopen(file, "rb");
+
+  if (!fp) {
+    UTIL_Format(error, maxlength, "file not found");
+    return nullptr;
+  }
+
+  ke::AutoPtr<SmxV1Image> image(new SmxV1Image(fp));
+  fclose(fp);
+
+  if (!image->validate()) {
+    const char* errorMessage = image->errorMessage();
+    if (!errorMessage)
+      errorMessage = "file parse error";
+    UTIL_Format(error, maxlength, "%s", errorMessage);
+    return nullptr;
+  }
+
+  return image.take();
+}
+
+PluginRuntime*
+PluginLoader::CreateRuntime(const char* file, SmxV1Image* image, char* error, size_t maxlength)
+{
+  PluginRuntime* pRuntime = new PluginRuntime(image);
+  if (!pRuntime->Initialize()) {
+    delete pRuntime;
+
+    UTIL_Format(error, maxlength, "out of memory");
+    return nullptr;
+  }
+
+  size_t len = strlen(file);
+  for (size_t i = len - 1; i < len; i--) {
+    if (file[i] == '/' 
+# if defined WIN32
+      || file[i] == '\\'
+# endif
+    )
+    {
+      pRuntime->SetNames(file, &file[i + 1]);
+      break;
+    }
+  }
+
+  if (!pRuntime->Name())
+    pRuntime->SetNames(file, file);
+
+#if defined(SP_HAS_JIT)
+  if (Environment::get()->IsJitEnabled()) {
+    if (const char* dir = Environment::get()->code_cache_dir())
+      pRuntime->SetCodeCache(CodeCache::Open(pRuntime, dir));
+  }
+#endif
+
+  return pRuntime;
+}
+
+void
+PluginLoader::StartCompiling(PluginRuntime* rt)
+{
+#if defined(SP_HAS_JIT)
+  if (CompileQueue* queue = Environment::get()->compile_queue()) {
+    if (Environment::get()->IsJitEnabled())
+      queue->Enqueue(rt);
+  }
+#endif
+}
+
+PluginRuntime*
+PluginLoader::Load(const char* file, char* error, size_t maxlength)
+{
+  SmxV1Image* image = ReadImage(file, error, maxlength);
+  if (!image)
+    return nullptr;
+
+  PluginRuntime* rt = CreateRuntime(file, image, error, maxlength);
+  if (!rt)
+    return nullptr;
+
+  StartCompiling(rt);
+  return rt;
+}
+
+typedef ke::Lambda<void(size_t)> IndexCallback;
+
+// Call |callback| once for each index below |count|, spread over |threads|
+// worker threads that act for the calling thread's environment. The calling
+// thread takes indexes too, so this finishes even if no thread starts.
+static void
+ForEachInParallel(size_t threads, size_t count, const IndexCallback& callback)
+{
+  Environment* env = Environment::get();
+  ke::Mutex lock;
+  size_t next = 0;
+
+  auto drain = [&]() -> void {
+    for (;;) {
+      size_t index;
+      {
+        ke::AutoLock guard(&lock);
+        if (next == count)
+          return;
+        index = next++;
+      }
+      callback(index);
+    }
+  };
+
+  ke::Vector<ke::AutoPtr<ke::Thread>> workers;
+  for (size_t i = 0; i < threads && i + 1 < count; i++) {
+    ke::AutoPtr<ke::Thread> worker(new ke::Thread([&]() -> void {
+      PoolAllocator::InitDefault();
+      Environment::EnterHelperThread(env);
+      drain();
+      PoolAllocator::FreeDefault();
+    }, "SP Loader"));
+    if (!worker->Succeeded() || !workers.append(ke::Move(worker)))
+      break;
+  }
+
+  drain();
+  for (const auto& worker : workers)
+    worker->Join();
+}
+
+static int
+CompareOffsets(const void* a, const void* b)
+{
+  cell_t left = *reinterpret_cast<const cell_t*>(a);
+  cell_t right = *reinterpret_cast<const cell_t*>(b);
+  return left < right ? -1 : (left > right ? 1 : 0);
+}
+
+size_t
+PluginLoader::LoadBatch(const char* const* files, size_t count, size_t threads,
+                        PluginRuntime** runtimes, char* errors, size_t maxlength)
+{
+  struct Entry {
+    ke::AutoPtr<SmxV1Image> image;
+    char error[255];
+  };
+  ke::UniquePtr<Entry[]> entries = ke::MakeUnique<Entry[]>(count);
+  if (!entries)
+    return 0;
+
+  ForEachInParallel(threads, count, [&](size_t i) -> void {
+    entries[i].error[0] = '\0';
+    entries[i].image = ReadImage(files[i], entries[i].error, sizeof(entries[i].error));
+  });
+
+  size_t loaded = 0;
+  ke::Vector<RefPtr<MethodInfo>> methods;
+  for (size_t i = 0; i < count; i++) {
+    runtimes[i] = nullptr;
+    if (entries[i].image) {
+      runtimes[i] = CreateRuntime(files[i], entries[i].image.take(),
+                                  entries[i].error, sizeof(entries[i].error));
+    }
+    if (!runtimes[i]) {
+      if (errors)
+        UTIL_Format(errors + i * maxlength, maxlength, "%s", entries[i].error);
+      continue;
+    }
+    loaded++;
+
+    // Cached code was verified when it was compiled.
+    PluginRuntime* rt = runtimes[i];
+    if (rt->code_cache())
+      continue;
+
+    // Publics are usually found twice, so take each offset once.
+    ke::Vector<cell_t> offsets;
+    rt->FindMethods([&offsets](cell_t offset) -> void {
+      offsets.append(offset);
+    });
+    qsort(offsets.buffer(), offsets.length(), sizeof(cell_t), CompareOffsets);
+    for (size_t j = 0; j < offsets.length(); j++) {
+      if (j > 0 && offsets[j] == offsets[j - 1])
+        continue;
+      if (RefPtr<MethodInfo> method = rt->AcquireMethod(offsets[j]))
+        methods.append(method);
+    }
+  }
+
+  // A method that fails is not reported until it is called, as usual.
+  ForEachInParallel(threads, methods.length(), [&methods](size_t i) -> void {
+    methods[i]->Validate();
+  });
+
+  for (size_t i = 0; i < count; i++) {
+    if (runtimes[i])
+      StartCompiling(runtimes[i]);
+  }
+  return loaded;
+}
@@ -0,0 +1,57 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_plugin_loader_h_
+#define _include_sourcepawn_vm_plugin_loader_h_
+
+#include <stddef.h>
+
+namespace sp {
+
+class PluginRuntime;
+class SmxV1Image;
+
+// Turns .smx files into runtimes for the engine API.
+//
+// A batch is loaded in stages. Files are read, decompressed and validated on
+// worker threads. Runtimes are then created on the calling thread, since
+// they belong to its environment. Finally, every method the runtimes can
+// find is verified on the worker threads, so the first call to each does not
+// have to.
+class PluginLoader
+{
+ public:
+  // Load one plugin on the calling thread.
+  static PluginRuntime* Load(const char* file, char* error, size_t maxlength);
+
+  // Load |count| plugins, using |threads| worker threads, or only the
+  // calling thread if 0. |runtimes| receives each runtime, or null if its
+  // file could not be loaded, in which case the message is written to
+  // |errors| at |maxlength| bytes per file, if given. Returns the number of
+  // plugins loaded.
+  static size_t LoadBatch(const char* const* files, size_t count, size_t threads,
+                          PluginRuntime** runtimes, char* errors, size_t maxlength);
+
+ private:
+  static SmxV1Image* ReadImage(const char* file, char* error, size_t maxlength);
+  static PluginRuntime* CreateRuntime(const char* file, SmxV1Image* image,
+                                      char* error, size_t maxlength);
+  static void StartCompiling(PluginRuntime* rt);
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_plugin_loader_h_
@@ -15,10 +15,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 #include <smx/smx-v1-opcodes.h>
+#include "code-cache.h"
 #include "compiled-function.h"
+#include "compile-queue.h"
 #include "environment.h"
 #include "method-info.h"
+#include "opcodes.h"
 #include "plugin-context.h"
 #include "builtins.h"
 
@@ -44,6 +48,22 @@ PluginRuntime::PluginRuntime(LegacyImage* image)
 
 PluginRuntime::~PluginRuntime()
 {
+  // Samples are only resolved when they are flushed, so flush any that
+  // might point at this runtime.
+  if (SamplingProfiler* sampler = Environment::get()->sampler())
+    sampler->Flush();
+
+#if defined(SP_HAS_JIT)
+  // Compile queue threads take the lock below too, so make sure they are
+  // done with this runtime first.
+  if (CompileQueue* queue = Environment::get()->compile_queue())
+    queue->Cancel(this);
+
+  // Nothing is compiling any more, so the cache can be written out.
+  if (code_cache_)
+    code_cache_->Flush();
+#endif
+
   // The watchdog thread takes the global JIT lock while it patches all
   // runtimes. It is not enough to ensure that the unlinking of the runtime is
   // protected; we cannot delete functions or code while the watchdog might be
@@ -73,6 +93,15 @@ PluginRuntime::Initialize()
   if (!natives_)
     return false;
 
+  if (Environment::get()->IsNativeStatsEnabled()) {
+    native_stats_ = MakeUnique<NativeStats[]>(image_->NumNatives());
+    if (!native_stats_)
+      return false;
+    memset(native_stats_.get(), 0, sizeof(NativeStats) * image_->NumNatives());
+    for (size_t i = 0; i < image_->NumNatives(); i++)
+      natives_[i].stats = &native_stats_[i];
+  }
+
   publics_ = MakeUnique<sp_public_t[]>(image_->NumPublics());
   if (!publics_)
     return false;
@@ -88,15 +117,48 @@ PluginRuntime::Initialize()
     return false;
   memset(entrypoints_.get(), 0, sizeof(ScriptedInvoker*) * image_->NumPublics());
 
+  if (!BuildSymbolIndexes())
+    return false;
+
   context_ = new PluginContext(this);
   if (!context_->Initialize())
     return false;
 
   SetupFloatNativeRemapping();
 
-  if (!function_map_.init(32))
+  method_table_ = MakeUnique<RefPtr<MethodInfo>[]>(code_.length / sizeof(cell_t));
+  if (!method_table_)
+    return false;
+
+  return true;
+}
+
+bool
+PluginRuntime::BuildSymbolIndexes()
+{
+  if (!native_index_.init(image_->NumNatives()) ||
+      !public_index_.init(image_->NumPublics()) ||
+      !pubvar_index_.init(image_->NumPubvars()))
+  {
     return false;
+  }
 
+  for (size_t i = 0; i < image_->NumNatives(); i++) {
+    if (!native_index_.add(image_->GetNative(i), uint32_t(i)))
+      return false;
+  }
+  for (size_t i = 0; i < image_->NumPublics(); i++) {
+    const char* name;
+    image_->GetPublic(i, nullptr, &name);
+    if (!public_index_.add(name, uint32_t(i)))
+      return false;
+  }
+  for (size_t i = 0; i < image_->NumPubvars(); i++) {
+    const char* name;
+    image_->GetPubvar(i, nullptr, &name);
+    if (!pubvar_index_.add(name, uint32_t(i)))
+      return false;
+  }
   return true;
 }
 
@@ -125,6 +187,13 @@ static const NativeMapping sNativeMap[] = {
   { "__FLOAT_EQ__",   OP_FLOAT_EQ },
   { "__FLOAT_NE__",   OP_FLOAT_NE },
   { "__FLOAT_NOT__",  OP_FLOAT_NOT },
+  { "SquareRoot",     OP_FLOAT_SQRT },
+  { "Sine",           OP_FLOAT_SIN },
+  { "Cosine",         OP_FLOAT_COS },
+  { "ArcTangent2",    OP_FLOAT_ATAN2 },
+  { "Pow",            OP_FLOAT_POW },
+  { "FloatFraction",  OP_FLOAT_FRACTION },
+  { "FloatMod",       OP_FLOAT_MOD },
 
   // Newer versions for spshell/sp2.
   { "__float_add",    OP_FLOATADD },
@@ -191,6 +260,22 @@ PluginRuntime::GetNativeReplacement(size_t index)
   return float_table_[index].index;
 }
 
+bool
+PluginRuntime::IsNativeInlined(size_t index)
+{
+  if (GetNativeReplacement(index) == OP_NOP)
+    return false;
+  const NativeEntry* native = NativeAt(index);
+  return native->status == SP_NATIVE_BOUND &&
+         !(native->flags & (SP_NTVFLAG_EPHEMERAL|SP_NTVFLAG_OPTIONAL));
+}
+
+void
+PluginRuntime::SetCodeCache(CodeCache* cache)
+{
+  code_cache_ = cache;
+}
+
 void
 PluginRuntime::SetNames(const char* fullname, const char* name)
 {
@@ -198,39 +283,45 @@ PluginRuntime::SetNames(const char* fullname, const char* name)
   full_name_ = fullname;
 }
 
+bool
+PluginRuntime::IsMethodOffset(cell_t pcode_offset) const
+{
+  return pcode_offset >= 0 &&
+         size_t(pcode_offset) < code_.length &&
+         IsAligned(pcode_offset, sizeof(cell_t));
+}
+
 RefPtr<MethodInfo>
 PluginRuntime::GetMethod(cell_t pcode_offset) const
 {
-  FunctionMap::Result r = function_map_.find(pcode_offset);
-  if (!r.found())
+  if (!IsMethodOffset(pcode_offset))
+    return nullptr;
+  return method_table_[pcode_offset / sizeof(cell_t)];
+}
+
+MethodInfo*
+PluginRuntime::PeekMethod(cell_t pcode_offset) const
+{
+  if (!IsMethodOffset(pcode_offset))
     return nullptr;
-  return r->value;
+  return method_table_[pcode_offset / sizeof(cell_t)].get();
 }
 
 RefPtr<MethodInfo>
 PluginRuntime::AcquireMethod(cell_t pcode_offset)
 {
-  FunctionMap::Insert p = function_map_.findForAdd(pcode_offset);
-  if (p.found())
-    return p->value;
-
-  // Do some quick validation to make sure this is a valid offset. The only
-  // real reason to do this is so we don't fill the hash set with bogus
-  // methods.
-  if (pcode_offset < 0 ||
-      size_t(pcode_offset) >= code_.length ||
-      !IsAligned(pcode_offset, sizeof(cell_t)))
-  {
+  if (!IsMethodOffset(pcode_offset))
     return nullptr;
-  }
+
+  RefPtr<MethodInfo>& slot = method_table_[pcode_offset / sizeof(cell_t)];
+  if (slot)
+    return slot;
 
   const cell_t* address = reinterpret_cast<const cell_t*>(code_.bytes + pcode_offset);
   if (*address != OP_PROC)
     return nullptr;
 
   RefPtr<MethodInfo> method = new MethodInfo(this, pcode_offset);
-  if (!function_map_.add(p, pcode_offset, method))
-    return nullptr;
 
   // Grab the lock before linking code in, since the watchdog timer will look
   // at this list on another thread.
@@ -239,9 +330,51 @@ PluginRuntime::AcquireMethod(cell_t pcode_offset)
     if (!methods_.append(method))
       return nullptr;
   }
+
+  slot = method;
   return method;
 }
 
+void
+PluginRuntime::FindMethods(const MethodCallback& callback)
+{
+  // Publics go first, since they are what the host will call into.
+  for (size_t i = 0; i < image_->NumPublics(); i++) {
+    uint32_t offset;
+    image_->GetPublic(i, &offset, nullptr);
+    callback(offset);
+  }
+
+  const uint8_t* cip = code_.bytes;
+  const uint8_t* end = code_.bytes + code_.length;
+  while (size_t(end - cip) >= sizeof(cell_t)) {
+    cell_t op = *reinterpret_cast<const cell_t*>(cip);
+    if (op <= 0 || op >= OP_UNGEN_FIRST_FAKE)
+      break;
+
+    size_t cells;
+    if (op == OP_CASETBL) {
+      if (size_t(end - cip) < 2 * sizeof(cell_t))
+        break;
+      cell_t ncases = reinterpret_cast<const cell_t*>(cip)[1];
+      if (ncases < 0 || ncases > (INT_MAX - 3) / 2)
+        break;
+      cells = GetCaseTableSize(cip);
+    } else {
+      cells = kOpcodeSizes[op];
+      if (!cells)
+        break;
+    }
+
+    if (op == OP_PROC)
+      callback(cip - code_.bytes);
+
+    if (size_t(end - cip) / sizeof(cell_t) < cells)
+      break;
+    cip += cells * sizeof(cell_t);
+  }
+}
+
 const ke::Vector<RefPtr<MethodInfo>>&
 PluginRuntime::AllMethods() const
 {
@@ -252,13 +385,14 @@ PluginRuntime::AllMethods() const
 int
 PluginRuntime::FindNativeByName(const char* name, uint32_t* index)
 {
-  size_t idx;
-  if (!image_->FindNative(name, &idx))
-    return SP_ERROR_NOT_FOUND;
-
-  if (index)
-    *index = idx;
+  return FindNativeByHash(name, SymbolIndex::Hash(name), index);
+}
 
+int
+PluginRuntime::FindNativeByHash(const char* name, uint32_t hash, uint32_t* index)
+{
+  if (!native_index_.find(name, hash, index))
+    return SP_ERROR_NOT_FOUND;
   return SP_ERROR_NONE;
 }
 
@@ -315,12 +449,14 @@ PluginRuntime::GetNativesNum()
 int
 PluginRuntime::FindPublicByName(const char* name, uint32_t* index)
 {
-  size_t idx;
-  if (!image_->FindPublic(name, &idx))
-    return SP_ERROR_NOT_FOUND;
+  return FindPublicByHash(name, SymbolIndex::Hash(name), index);
+}
 
-  if (index)
-    *index = idx;
+int
+PluginRuntime::FindPublicByHash(const char* name, uint32_t hash, uint32_t* index)
+{
+  if (!public_index_.find(name, hash, index))
+    return SP_ERROR_NOT_FOUND;
   return SP_ERROR_NONE;
 }
 
@@ -371,12 +507,14 @@ PluginRuntime::GetPubvarByIndex(uint32_t index, sp_pubvar_t** out)
 int
 PluginRuntime::FindPubvarByName(const char* name, uint32_t* index)
 {
-  size_t idx;
-  if (!image_->FindPubvar(name, &idx))
-    return SP_ERROR_NOT_FOUND;
+  return FindPubvarByHash(name, SymbolIndex::Hash(name), index);
+}
 
-  if (index)
-    *index = idx;
+int
+PluginRuntime::FindPubvarByHash(const char* name, uint32_t hash, uint32_t* index)
+{
+  if (!pubvar_index_.find(name, hash, index))
+    return SP_ERROR_NOT_FOUND;
   return SP_ERROR_NONE;
 }
 
@@ -450,15 +588,103 @@ PluginRuntime::GetPublicFunction(size_t index)
 
 IPluginFunction*
 PluginRuntime::GetFunctionByName(const char* public_name)
+{
+  return GetFunctionByHash(public_name, SymbolIndex::Hash(public_name));
+}
+
+IPluginFunction*
+PluginRuntime::GetFunctionByHash(const char* public_name, uint32_t hash)
 {
   uint32_t index;
 
-  if (FindPublicByName(public_name, &index) != SP_ERROR_NONE)
+  if (FindPublicByHash(public_name, hash, &index) != SP_ERROR_NONE)
     return NULL;
 
   return GetPublicFunction(index);
 }
 
+uint32_t
+PluginRuntime::GetSampledStackCount()
+{
+  if (SamplingProfiler* sampler = Environment::get()->sampler())
+    sampler->Flush();
+  return uint32_t(sampled_stacks_.length());
+}
+
+const char*
+PluginRuntime::GetSampledStack(uint32_t index, uint64_t* samples)
+{
+  if (index >= sampled_stacks_.length())
+    return nullptr;
+  if (samples)
+    *samples = sampled_stacks_.samples(index);
+  return sampled_stacks_.stack(index);
+}
+
+void
+PluginRuntime::ResetSampledStacks()
+{
+  if (SamplingProfiler* sampler = Environment::get()->sampler())
+    sampler->Flush();
+  sampled_stacks_.Clear();
+}
+
+uint32_t
+PluginRuntime::GetFunctionStatsCount()
+{
+  ke::AutoLock lock(Environment::get()->lock());
+  return uint32_t(methods_.length());
+}
+
+bool
+PluginRuntime::GetFunctionStats(uint32_t index, sp_function_stats_t* stats)
+{
+  RefPtr<MethodInfo> method;
+  {
+    ke::AutoLock lock(Environment::get()->lock());
+    if (index >= methods_.length())
+      return false;
+    method = methods_[index];
+  }
+
+  const CallStats& counts = method->call_stats();
+  stats->code_offs = method->pcode_offset();
+  stats->name = image_->LookupFunction(method->pcode_offset());
+  stats->calls = counts.calls;
+  stats->total_ticks = counts.total_ticks;
+  stats->self_ticks = counts.self_ticks;
+  return true;
+}
+
+void
+PluginRuntime::ResetFunctionStats()
+{
+  ke::AutoLock lock(Environment::get()->lock());
+  for (size_t i = 0; i < methods_.length(); i++)
+    methods_[i]->call_stats() = CallStats();
+}
+
+bool
+PluginRuntime::GetNativeStats(uint32_t index, sp_native_stats_t* stats)
+{
+  if (!native_stats_ || index >= image_->NumNatives())
+    return false;
+
+  const NativeStats& counts = native_stats_[index];
+  stats->name = image_->GetNative(index);
+  stats->calls = counts.calls;
+  stats->total_ticks = counts.total_ticks;
+  memcpy(stats->histogram, counts.histogram, sizeof(stats->histogram));
+  return true;
+}
+
+void
+PluginRuntime::ResetNativeStats()
+{
+  if (native_stats_)
+    memset(native_stats_.get(), 0, sizeof(NativeStats) * image_->NumNatives());
+}
+
 bool
 PluginRuntime::IsDebugging()
 {
@@ -17,15 +17,18 @@
 #include <am-vector.h>
 #include <am-string.h>
 #include <am-inlinelist.h>
-#include <am-hashmap.h>
 #include <amtl/am-refcounting.h>
+#include <amtl/am-function.h>
 #include "scripted-invoker.h"
 #include "legacy-image.h"
+#include "sampling-profiler.h"
+#include "symbol-index.h"
 
 namespace sp {
 
 using namespace ke;
 
+class CodeCache;
 class PluginContext;
 class MethodInfo;
 
@@ -39,12 +42,25 @@ struct floattbl_t
   unsigned int index;
 };
 
+// Calls to one native from one plugin; see
+// Environment::SetNativeStatsEnabled(). Compiled code updates this in place.
+struct NativeStats
+{
+  uint64_t calls;
+  uint64_t total_ticks;
+  uint64_t histogram[SP_NATIVE_STATS_BUCKETS];
+};
+
 struct NativeEntry : public sp_native_t
 {
   NativeEntry()
-   : legacy_fn(nullptr)
+   : legacy_fn(nullptr),
+     stats(nullptr)
   {}
   SPVM_NATIVE_FUNC legacy_fn;
+
+  // Null unless native stats were on when the plugin was loaded.
+  NativeStats* stats;
 };
 
 /* Jit wants fast access to this so we expose things as public */
@@ -83,6 +99,8 @@ class PluginRuntime
   virtual unsigned char* GetDataHash() override;
   void SetNames(const char* fullname, const char* name);
   unsigned GetNativeReplacement(size_t index);
+  // Whether compiled code replaces calls to this native with its opcode.
+  bool IsNativeInlined(size_t index);
   ScriptedInvoker* GetPublicFunction(size_t index);
   int UpdateNativeBinding(uint32_t index, SPVM_NATIVE_FUNC pfn, uint32_t flags, void* data) override;
   const sp_native_t* GetNative(uint32_t index) override;
@@ -96,6 +114,18 @@ class PluginRuntime
   const char* GetFilename() override {
     return full_name_.chars();
   }
+  int FindNativeByHash(const char* name, uint32_t hash, uint32_t* index) override;
+  int FindPublicByHash(const char* name, uint32_t hash, uint32_t* index) override;
+  int FindPubvarByHash(const char* name, uint32_t hash, uint32_t* index) override;
+  IPluginFunction* GetFunctionByHash(const char* public_name, uint32_t hash) override;
+  uint32_t GetSampledStackCount() override;
+  const char* GetSampledStack(uint32_t index, uint64_t* samples) override;
+  void ResetSampledStacks() override;
+  uint32_t GetFunctionStatsCount() override;
+  bool GetFunctionStats(uint32_t index, sp_function_stats_t* stats) override;
+  void ResetFunctionStats() override;
+  bool GetNativeStats(uint32_t index, sp_native_stats_t* stats) override;
+  void ResetNativeStats() override;
 
   // Mark builtin natives as bound.
   void InstallBuiltinNatives();
@@ -103,10 +133,20 @@ class PluginRuntime
   // Return the method if it was previously analyzed; null otherwise.
   RefPtr<MethodInfo> GetMethod(cell_t pcode_offset) const;
 
+  // Same as GetMethod(), without taking a reference, for signal handlers.
+  MethodInfo* PeekMethod(cell_t pcode_offset) const;
+
   // If there is no method at the given offset, return null. If there is a
   // method, return it.
   RefPtr<MethodInfo> AcquireMethod(cell_t pcode_offset);
 
+  // Call |callback| with the offset of each public, then each method found
+  // by walking the code section an instruction at a time. Code is only
+  // verified per method, so the walk stops at anything that does not decode
+  // and may miss methods after it. An offset may be seen more than once.
+  typedef ke::Lambda<void(cell_t)> MethodCallback;
+  void FindMethods(const MethodCallback& callback);
+
   // Return a list of all methods. The caller must own the environment lock.
   const ke::Vector<RefPtr<MethodInfo>>& AllMethods() const;
 
@@ -141,8 +181,20 @@ class PluginRuntime
     return context_;
   }
 
+  // Set when compiled code is cached on disk. The runtime takes ownership.
+  void SetCodeCache(CodeCache* cache);
+  CodeCache* code_cache() const {
+    return code_cache_;
+  }
+
+  SampledStacks* sampled_stacks() {
+    return &sampled_stacks_;
+  }
+
  private:
   void SetupFloatNativeRemapping();
+  bool IsMethodOffset(cell_t pcode_offset) const;
+  bool BuildSymbolIndexes();
 
  private:
   ke::AutoPtr<sp::LegacyImage> image_;
@@ -153,22 +205,20 @@ class PluginRuntime
   Code code_;
   Data data_;
   ke::AutoPtr<NativeEntry[]> natives_;
+  ke::AutoPtr<NativeStats[]> native_stats_;
   ke::AutoPtr<sp_public_t[]> publics_;
   ke::AutoPtr<sp_pubvar_t[]> pubvars_;
   ke::AutoPtr<ScriptedInvoker*[]> entrypoints_;
+  SymbolIndex native_index_;
+  SymbolIndex public_index_;
+  SymbolIndex pubvar_index_;
   ke::AutoPtr<PluginContext> context_;
+  ke::AutoPtr<CodeCache> code_cache_;
+  SampledStacks sampled_stacks_;
 
-  struct FunctionMapPolicy {
-    static inline uint32_t hash(ucell_t value) {
-      return ke::HashInteger<4>(value);
-    }
-    static inline bool matches(ucell_t a, ucell_t b) {
-      return a == b;
-    }
-  };
-  typedef ke::HashMap<ucell_t, RefPtr<MethodInfo>, FunctionMapPolicy> FunctionMap;
-
-  FunctionMap function_map_;
+  // Methods indexed by pcode_offset / sizeof(cell_t). Every method starts
+  // on a cell boundary, so call sites can find theirs without hashing.
+  ke::AutoPtr<RefPtr<MethodInfo>[]> method_table_;
   ke::Vector<RefPtr<MethodInfo>> methods_;;
 
   // Pause state.
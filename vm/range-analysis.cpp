@@ -0,0 +1,1260 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2015 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#include "range-analysis.h"
+#include "environment.h"
+#include "opcodes.h"
+#include "pcode-reader.h"
+#include "plugin-runtime.h"
+#include <stdlib.h>
+
+namespace sp {
+
+// Give up if the fixpoint takes longer than this many passes over the graph.
+// Widening at loop headers means this should never happen.
+static const size_t kMaxPasses = 64;
+
+struct RangeData : public IBlockData
+{
+  RangeData()
+   : reached(false),
+     has_exit(false),
+     has_branch(false),
+     branch_target(nullptr)
+  {}
+
+  bool reached;
+  bool has_exit;
+  RangeAnalysis::State entry;
+  RangeAnalysis::State exit;
+
+  // Set if the block ends in a conditional jump.
+  bool has_branch;
+  CompareOp branch_op;
+  const uint8_t* branch_target;
+};
+
+static inline ValueRange
+FromWide(int64_t lo, int64_t hi)
+{
+  if (lo < INT_MIN || hi > INT_MAX)
+    return ValueRange::Any();
+  return ValueRange{int32_t(lo), int32_t(hi)};
+}
+
+static inline ValueRange
+Hull(const ValueRange& a, const ValueRange& b)
+{
+  return ValueRange{ke::Min(a.lo, b.lo), ke::Max(a.hi, b.hi)};
+}
+
+static inline ValueRange
+Intersect(const ValueRange& a, const ValueRange& b)
+{
+  return ValueRange{ke::Max(a.lo, b.lo), ke::Min(a.hi, b.hi)};
+}
+
+static inline ValueRange
+Add(const ValueRange& a, const ValueRange& b)
+{
+  return FromWide(int64_t(a.lo) + b.lo, int64_t(a.hi) + b.hi);
+}
+
+static inline ValueRange
+Sub(const ValueRange& a, const ValueRange& b)
+{
+  return FromWide(int64_t(a.lo) - b.hi, int64_t(a.hi) - b.lo);
+}
+
+static inline ValueRange
+Mul(const ValueRange& a, const ValueRange& b)
+{
+  int64_t products[] = {
+    int64_t(a.lo) * b.lo,
+    int64_t(a.lo) * b.hi,
+    int64_t(a.hi) * b.lo,
+    int64_t(a.hi) * b.hi,
+  };
+  int64_t lo = products[0];
+  int64_t hi = products[0];
+  for (size_t i = 1; i < 4; i++) {
+    lo = ke::Min(lo, products[i]);
+    hi = ke::Max(hi, products[i]);
+  }
+  return FromWide(lo, hi);
+}
+
+static inline ValueRange
+Shl(const ValueRange& a, cell_t amount)
+{
+  if (amount < 0 || amount > 31)
+    return ValueRange::Any();
+  return Mul(a, ValueRange::Exactly(int32_t(1) << amount));
+}
+
+// The smallest all-ones mask covering both non-negative values.
+static inline ValueRange
+BitwiseUpperBound(const ValueRange& a, const ValueRange& b)
+{
+  if (a.lo < 0 || b.lo < 0)
+    return ValueRange::Any();
+  uint32_t mask = uint32_t(ke::Max(a.hi, b.hi));
+  mask |= mask >> 1;
+  mask |= mask >> 2;
+  mask |= mask >> 4;
+  mask |= mask >> 8;
+  mask |= mask >> 16;
+  return ValueRange{0, int32_t(mask)};
+}
+
+static bool
+SameState(const RangeAnalysis::State& a, const RangeAnalysis::State& b)
+{
+  if (a.pri != b.pri || a.alt != b.alt ||
+      a.pri_slot != b.pri_slot || a.alt_slot != b.alt_slot ||
+      a.sp != b.sp)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < RangeAnalysis::kMaxTrackedSlots; i++) {
+    if (a.slots[i] != b.slots[i])
+      return false;
+  }
+  return true;
+}
+
+static inline int32_t
+SlotIndex(cell_t offset)
+{
+  if (offset >= 0 || offset % cell_t(sizeof(cell_t)) != 0)
+    return -1;
+  size_t index = size_t(-(offset / cell_t(sizeof(cell_t)))) - 1;
+  if (index >= RangeAnalysis::kMaxTrackedSlots)
+    return -1;
+  return int32_t(index);
+}
+
+static int
+CompareCips(const void* a, const void* b)
+{
+  const cell_t* cip1 = *reinterpret_cast<const cell_t* const*>(a);
+  const cell_t* cip2 = *reinterpret_cast<const cell_t* const*>(b);
+  if (cip1 < cip2)
+    return -1;
+  if (cip1 > cip2)
+    return 1;
+  return 0;
+}
+
+RangeAnalysis::RangeAnalysis(PluginRuntime* rt, ControlFlowGraph* graph)
+ : rt_(rt),
+   graph_(graph),
+   data_size_(rt->image()->DescribeData().length),
+   debug_breaks_(Environment::get()->IsDebugBreakEnabled()),
+   block_(nullptr),
+   op_cip_(nullptr),
+   last_push_c_(0),
+   record_(false)
+{
+}
+
+bool
+RangeAnalysis::analyze()
+{
+  AutoClearBlockData<RangeData> data(graph_);
+
+  Block* entry = graph_->entry();
+  RangeData* entry_data = entry->data<RangeData>();
+  entry_data->reached = true;
+  entry_data->entry.pri = ValueRange::Any();
+  entry_data->entry.alt = ValueRange::Any();
+  entry_data->entry.pri_slot = -1;
+  entry_data->entry.alt_slot = -1;
+  entry_data->entry.sp = 0;
+  for (size_t i = 0; i < kMaxTrackedSlots; i++)
+    entry_data->entry.slots[i] = ValueRange::Any();
+
+  // Iterate in RPO until nothing changes. Loop headers widen any bound that
+  // is still moving, so each loop settles after a couple of passes.
+  bool changed = true;
+  for (size_t pass = 0; changed; pass++) {
+    if (pass >= kMaxPasses)
+      return false;
+
+    changed = false;
+    for (auto iter = graph_->rpoBegin(); iter != graph_->rpoEnd(); iter++) {
+      Block* block = *iter;
+      RangeData* data = block->data<RangeData>();
+
+      State state;
+      if (block == entry) {
+        state = data->entry;
+      } else {
+        if (!computeEntryState(block, &state))
+          continue;
+        if (data->reached && block->isLoopHeader())
+          widen(&state, data->entry);
+      }
+
+      if (data->has_exit && SameState(state, data->entry))
+        continue;
+
+      data->reached = true;
+      data->entry = state;
+      if (!analyzeBlock(block))
+        return false;
+      changed = true;
+    }
+  }
+
+  // Now that every entry state is final, find the checks that are redundant.
+  record_ = true;
+  for (auto iter = graph_->rpoBegin(); iter != graph_->rpoEnd(); iter++) {
+    if (!iter->data<RangeData>()->reached)
+      continue;
+    if (!analyzeBlock(*iter))
+      return false;
+  }
+
+  qsort(redundant_bounds_.buffer(), redundant_bounds_.length(), sizeof(const cell_t*),
+        CompareCips);
+  return true;
+}
+
+bool
+RangeAnalysis::isRedundantBoundsCheck(const cell_t* cip) const
+{
+  size_t lo = 0;
+  size_t hi = redundant_bounds_.length();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (redundant_bounds_[mid] == cip)
+      return true;
+    if (redundant_bounds_[mid] < cip)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return false;
+}
+
+bool
+RangeAnalysis::analyzeBlock(Block* block)
+{
+  RangeData* data = block->data<RangeData>();
+
+  block_ = block;
+  state_ = data->entry;
+  data->has_branch = false;
+
+  PcodeReader<RangeAnalysis> reader(rt_, block, this);
+  reader.begin();
+  while (reader.more()) {
+    op_cip_ = reader.cip();
+    if (!reader.visitNext())
+      return false;
+  }
+
+  data->exit = state_;
+  data->has_exit = true;
+  return true;
+}
+
+bool
+RangeAnalysis::computeEntryState(Block* block, State* state)
+{
+  bool found = false;
+  for (const auto& pred : block->predecessors()) {
+    State edge;
+    if (!computeEdgeState(pred, block, &edge))
+      continue;
+    if (!found) {
+      *state = edge;
+      found = true;
+    } else {
+      join(state, edge);
+    }
+  }
+  return found;
+}
+
+bool
+RangeAnalysis::computeEdgeState(Block* pred, Block* succ, State* state)
+{
+  RangeData* data = pred->data<RangeData>();
+  if (!data->has_exit)
+    return false;
+
+  *state = data->exit;
+  if (!data->has_branch)
+    return true;
+
+  // A conditional jump to the very next instruction tells us nothing.
+  const uint8_t* fallthrough = NextInstruction(pred->end());
+  if (data->branch_target == fallthrough)
+    return true;
+
+  State saved = state_;
+  state_ = *state;
+  refineBranch(data->branch_op, succ->start() == data->branch_target, &state_);
+  *state = state_;
+  state_ = saved;
+
+  // If the refinement left nothing, this edge is never taken.
+  if (state->pri.isEmpty() || state->alt.isEmpty())
+    return false;
+  for (size_t i = 0; i < kMaxTrackedSlots; i++) {
+    if (state->slots[i].isEmpty())
+      return false;
+  }
+  return true;
+}
+
+void
+RangeAnalysis::refineBranch(CompareOp op, bool taken, State* state)
+{
+  assert(state == &state_);
+
+  ValueRange pri = state->pri;
+  ValueRange alt = state->alt;
+
+  if (op == CompareOp::Zero || op == CompareOp::NotZero) {
+    if ((op == CompareOp::Zero) == taken) {
+      pri = Intersect(pri, ValueRange::Exactly(0));
+    } else if (pri.lo == 0) {
+      pri.lo = 1;
+    } else if (pri.hi == 0) {
+      pri.hi = -1;
+    }
+    refine(PawnReg::Pri, pri);
+    return;
+  }
+
+  // Flip the comparison if the branch falls through.
+  if (!taken) {
+    switch (op) {
+      case CompareOp::Eq:
+        op = CompareOp::Neq;
+        break;
+      case CompareOp::Neq:
+        op = CompareOp::Eq;
+        break;
+      case CompareOp::Sless:
+        op = CompareOp::Sgeq;
+        break;
+      case CompareOp::Sleq:
+        op = CompareOp::Sgrtr;
+        break;
+      case CompareOp::Sgrtr:
+        op = CompareOp::Sleq;
+        break;
+      case CompareOp::Sgeq:
+        op = CompareOp::Sless;
+        break;
+      default:
+        assert(false);
+        return;
+    }
+  }
+
+  switch (op) {
+    case CompareOp::Eq:
+      pri = alt = Intersect(pri, alt);
+      break;
+    case CompareOp::Neq:
+      if (alt.lo == alt.hi) {
+        if (pri.lo == alt.lo)
+          pri.lo = pri.lo + (pri.lo < INT_MAX ? 1 : 0);
+        else if (pri.hi == alt.lo)
+          pri.hi = pri.hi - (pri.hi > INT_MIN ? 1 : 0);
+      }
+      break;
+    case CompareOp::Sless:
+      // pri < alt.
+      if (alt.hi == INT_MIN || pri.lo == INT_MAX) {
+        pri = ValueRange{1, 0};
+        break;
+      }
+      pri.hi = ke::Min(pri.hi, alt.hi - 1);
+      alt.lo = ke::Max(alt.lo, pri.lo + 1);
+      break;
+    case CompareOp::Sleq:
+      pri.hi = ke::Min(pri.hi, alt.hi);
+      alt.lo = ke::Max(alt.lo, pri.lo);
+      break;
+    case CompareOp::Sgrtr:
+      // pri > alt.
+      if (alt.lo == INT_MAX || pri.hi == INT_MIN) {
+        pri = ValueRange{1, 0};
+        break;
+      }
+      pri.lo = ke::Max(pri.lo, alt.lo + 1);
+      alt.hi = ke::Min(alt.hi, pri.hi - 1);
+      break;
+    case CompareOp::Sgeq:
+      pri.lo = ke::Max(pri.lo, alt.lo);
+      alt.hi = ke::Min(alt.hi, pri.hi);
+      break;
+    default:
+      assert(false);
+      return;
+  }
+
+  refine(PawnReg::Pri, pri);
+  refine(PawnReg::Alt, alt);
+}
+
+void
+RangeAnalysis::refine(PawnReg dest, const ValueRange& range)
+{
+  // Narrow the register, and the stack slot it holds a copy of.
+  reg(dest) = Intersect(reg(dest), range);
+  int32_t slot = regSlot(dest);
+  if (slot >= 0)
+    state_.slots[slot] = Intersect(state_.slots[slot], reg(dest));
+}
+
+void
+RangeAnalysis::join(State* state, const State& other)
+{
+  assert(state->sp == other.sp);
+
+  state->pri = Hull(state->pri, other.pri);
+  state->alt = Hull(state->alt, other.alt);
+  if (state->pri_slot != other.pri_slot)
+    state->pri_slot = -1;
+  if (state->alt_slot != other.alt_slot)
+    state->alt_slot = -1;
+  for (size_t i = 0; i < kMaxTrackedSlots; i++)
+    state->slots[i] = Hull(state->slots[i], other.slots[i]);
+}
+
+static inline ValueRange
+Widen(const ValueRange& prev, const ValueRange& next)
+{
+  ValueRange range = prev;
+  if (next.lo < prev.lo)
+    range.lo = INT_MIN;
+  if (next.hi > prev.hi)
+    range.hi = INT_MAX;
+  return range;
+}
+
+void
+RangeAnalysis::widen(State* state, const State& prev)
+{
+  state->pri = Widen(prev.pri, state->pri);
+  state->alt = Widen(prev.alt, state->alt);
+  if (state->pri_slot != prev.pri_slot)
+    state->pri_slot = -1;
+  if (state->alt_slot != prev.alt_slot)
+    state->alt_slot = -1;
+  for (size_t i = 0; i < kMaxTrackedSlots; i++)
+    state->slots[i] = Widen(prev.slots[i], state->slots[i]);
+}
+
+ValueRange
+RangeAnalysis::readSlot(cell_t offset)
+{
+  int32_t slot = SlotIndex(offset);
+  if (slot < 0)
+    return ValueRange::Any();
+  return state_.slots[slot];
+}
+
+void
+RangeAnalysis::writeSlot(cell_t offset, const ValueRange& range)
+{
+  if (offset >= 0)
+    return;
+  if (offset % cell_t(sizeof(cell_t)) != 0) {
+    forgetSlots();
+    return;
+  }
+
+  int32_t slot = SlotIndex(offset);
+  if (slot < 0)
+    return;
+  state_.slots[slot] = range;
+  if (state_.pri_slot == slot)
+    state_.pri_slot = -1;
+  if (state_.alt_slot == slot)
+    state_.alt_slot = -1;
+}
+
+void
+RangeAnalysis::push(const ValueRange& range)
+{
+  state_.sp -= sizeof(cell_t);
+  writeSlot(state_.sp, range);
+}
+
+ValueRange
+RangeAnalysis::pop()
+{
+  ValueRange range = readSlot(state_.sp);
+  drop(sizeof(cell_t));
+  return range;
+}
+
+void
+RangeAnalysis::drop(cell_t amount)
+{
+  // Whatever was in the freed slots is dead.
+  for (cell_t offset = state_.sp; offset < state_.sp + amount; offset += sizeof(cell_t))
+    writeSlot(offset, ValueRange::Any());
+  state_.sp += amount;
+}
+
+void
+RangeAnalysis::forgetSlots()
+{
+  for (size_t i = 0; i < kMaxTrackedSlots; i++)
+    state_.slots[i] = ValueRange::Any();
+  state_.pri_slot = -1;
+  state_.alt_slot = -1;
+}
+
+void
+RangeAnalysis::writeGlobal(cell_t address)
+{
+  // The stack lives above the data section, so a constant address inside
+  // the data section cannot touch it.
+  if (address < 0 || size_t(address) >= data_size_)
+    forgetSlots();
+}
+
+bool
+RangeAnalysis::visitBREAK()
+{
+  // The debugger may change locals when it stops here.
+  if (debug_breaks_)
+    forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitLOAD(PawnReg dest, cell_t srcaddr)
+{
+  setReg(dest, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitLOAD_S(PawnReg dest, cell_t srcoffs)
+{
+  setReg(dest, readSlot(srcoffs));
+  regSlot(dest) = SlotIndex(srcoffs);
+  return true;
+}
+
+bool
+RangeAnalysis::visitLREF_S(PawnReg dest, cell_t srcoffs)
+{
+  setReg(dest, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitLOAD_I()
+{
+  setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitLODB_I(cell_t width)
+{
+  if (width == 1)
+    setReg(PawnReg::Pri, ValueRange{0, 0xff});
+  else if (width == 2)
+    setReg(PawnReg::Pri, ValueRange{0, 0xffff});
+  else
+    setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitCONST(PawnReg dest, cell_t imm)
+{
+  setReg(dest, ValueRange::Exactly(imm));
+  return true;
+}
+
+bool
+RangeAnalysis::visitADDR(PawnReg dest, cell_t offset)
+{
+  setReg(dest, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitSTOR(cell_t address, PawnReg src)
+{
+  writeGlobal(address);
+  return true;
+}
+
+bool
+RangeAnalysis::visitSTOR_S(cell_t offset, PawnReg src)
+{
+  writeSlot(offset, reg(src));
+  regSlot(src) = SlotIndex(offset);
+  return true;
+}
+
+bool
+RangeAnalysis::visitSREF_S(cell_t offset, PawnReg src)
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitSTOR_I()
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitSTRB_I(cell_t width)
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitLIDX()
+{
+  setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitIDXADDR()
+{
+  setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitMOVE(PawnReg dest)
+{
+  PawnReg src = (dest == PawnReg::Pri) ? PawnReg::Alt : PawnReg::Pri;
+  reg(dest) = reg(src);
+  regSlot(dest) = regSlot(src);
+  return true;
+}
+
+bool
+RangeAnalysis::visitXCHG()
+{
+  ke::Swap(state_.pri, state_.alt);
+  ke::Swap(state_.pri_slot, state_.alt_slot);
+  return true;
+}
+
+bool
+RangeAnalysis::visitPUSH(PawnReg src)
+{
+  push(reg(src));
+  return true;
+}
+
+bool
+RangeAnalysis::visitPUSH_C(const cell_t* vals, size_t nvals)
+{
+  for (size_t i = 0; i < nvals; i++)
+    push(ValueRange::Exactly(vals[i]));
+  last_push_c_ = vals[nvals - 1];
+  return true;
+}
+
+bool
+RangeAnalysis::visitPUSH(const cell_t* addresses, size_t nvals)
+{
+  for (size_t i = 0; i < nvals; i++)
+    push(ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitPUSH_S(const cell_t* offsets, size_t nvals)
+{
+  for (size_t i = 0; i < nvals; i++)
+    push(readSlot(offsets[i]));
+  return true;
+}
+
+bool
+RangeAnalysis::visitPOP(PawnReg dest)
+{
+  setReg(dest, pop());
+  return true;
+}
+
+bool
+RangeAnalysis::visitSTACK(cell_t amount)
+{
+  if (amount >= 0) {
+    drop(amount);
+  } else {
+    // Newly reserved slots hold whatever was there before.
+    for (cell_t i = 0; i < -amount; i += sizeof(cell_t))
+      push(ValueRange::Any());
+  }
+  return true;
+}
+
+bool
+RangeAnalysis::visitHEAP(cell_t amount)
+{
+  setReg(PawnReg::Alt, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitRETN()
+{
+  return true;
+}
+
+bool
+RangeAnalysis::visitCALL(cell_t offset)
+{
+  // The callee pops its arguments and their count, which the verifier
+  // requires to be pushed by the instruction before the call.
+  drop((last_push_c_ + 1) * sizeof(cell_t));
+  forgetSlots();
+  setReg(PawnReg::Pri, ValueRange::Any());
+  setReg(PawnReg::Alt, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitJUMP(cell_t offset)
+{
+  return true;
+}
+
+bool
+RangeAnalysis::visitJcmp(CompareOp op, cell_t offset)
+{
+  RangeData* data = block_->data<RangeData>();
+  data->has_branch = true;
+  data->branch_op = op;
+  data->branch_target = rt_->code().bytes + offset;
+  return true;
+}
+
+bool
+RangeAnalysis::visitSHL()
+{
+  if (state_.alt.lo == state_.alt.hi)
+    setReg(PawnReg::Pri, Shl(state_.pri, state_.alt.lo));
+  else
+    setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitSHR()
+{
+  ValueRange pri = state_.pri;
+  ValueRange alt = state_.alt;
+  if (pri.lo < 0)
+    setReg(PawnReg::Pri, ValueRange::Any());
+  else if (alt.lo == alt.hi && alt.lo >= 0 && alt.lo <= 31)
+    setReg(PawnReg::Pri, ValueRange{pri.lo >> alt.lo, pri.hi >> alt.lo});
+  else
+    setReg(PawnReg::Pri, ValueRange{0, pri.hi});
+  return true;
+}
+
+bool
+RangeAnalysis::visitSSHR()
+{
+  ValueRange pri = state_.pri;
+  ValueRange alt = state_.alt;
+  if (alt.lo == alt.hi && alt.lo >= 0 && alt.lo <= 31)
+    setReg(PawnReg::Pri, ValueRange{pri.lo >> alt.lo, pri.hi >> alt.lo});
+  else
+    setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitSHL_C(PawnReg dest, cell_t amount)
+{
+  setReg(dest, Shl(reg(dest), amount));
+  return true;
+}
+
+bool
+RangeAnalysis::visitSMUL()
+{
+  setReg(PawnReg::Pri, Mul(state_.pri, state_.alt));
+  return true;
+}
+
+bool
+RangeAnalysis::visitSDIV(PawnReg dest)
+{
+  ValueRange dividend = (dest == PawnReg::Pri) ? state_.pri : state_.alt;
+  ValueRange divisor = (dest == PawnReg::Pri) ? state_.alt : state_.pri;
+
+  // The quotient goes to pri and the remainder to alt. The remainder is
+  // smaller in magnitude than the divisor, and has the dividend's sign.
+  ValueRange quotient = ValueRange::Any();
+  if (dividend.lo >= 0 && divisor.lo > 0)
+    quotient = ValueRange{dividend.lo / divisor.hi, dividend.hi / divisor.lo};
+
+  int64_t limit = ke::Max(llabs(int64_t(divisor.lo)), llabs(int64_t(divisor.hi))) - 1;
+  ValueRange remainder;
+  if (dividend.lo >= 0)
+    remainder = FromWide(0, ke::Min(limit, int64_t(dividend.hi)));
+  else if (dividend.hi <= 0)
+    remainder = FromWide(ke::Max(-limit, int64_t(dividend.lo)), 0);
+  else
+    remainder = FromWide(-limit, limit);
+
+  setReg(PawnReg::Pri, quotient);
+  setReg(PawnReg::Alt, remainder);
+  return true;
+}
+
+bool
+RangeAnalysis::visitADD()
+{
+  setReg(PawnReg::Pri, Add(state_.pri, state_.alt));
+  return true;
+}
+
+bool
+RangeAnalysis::visitSUB()
+{
+  setReg(PawnReg::Pri, Sub(state_.pri, state_.alt));
+  return true;
+}
+
+bool
+RangeAnalysis::visitSUB_ALT()
+{
+  setReg(PawnReg::Pri, Sub(state_.alt, state_.pri));
+  return true;
+}
+
+bool
+RangeAnalysis::visitAND()
+{
+  ValueRange pri = state_.pri;
+  ValueRange alt = state_.alt;
+  if (pri.lo >= 0 && alt.lo >= 0)
+    setReg(PawnReg::Pri, ValueRange{0, ke::Min(pri.hi, alt.hi)});
+  else if (pri.lo >= 0)
+    setReg(PawnReg::Pri, ValueRange{0, pri.hi});
+  else if (alt.lo >= 0)
+    setReg(PawnReg::Pri, ValueRange{0, alt.hi});
+  else
+    setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitOR()
+{
+  setReg(PawnReg::Pri, BitwiseUpperBound(state_.pri, state_.alt));
+  return true;
+}
+
+bool
+RangeAnalysis::visitXOR()
+{
+  setReg(PawnReg::Pri, BitwiseUpperBound(state_.pri, state_.alt));
+  return true;
+}
+
+bool
+RangeAnalysis::visitNOT()
+{
+  setReg(PawnReg::Pri, ValueRange{0, 1});
+  return true;
+}
+
+bool
+RangeAnalysis::visitNEG()
+{
+  setReg(PawnReg::Pri, FromWide(-int64_t(state_.pri.hi), -int64_t(state_.pri.lo)));
+  return true;
+}
+
+bool
+RangeAnalysis::visitINVERT()
+{
+  setReg(PawnReg::Pri, FromWide(~int64_t(state_.pri.hi), ~int64_t(state_.pri.lo)));
+  return true;
+}
+
+bool
+RangeAnalysis::visitADD_C(cell_t value)
+{
+  setReg(PawnReg::Pri, Add(state_.pri, ValueRange::Exactly(value)));
+  return true;
+}
+
+bool
+RangeAnalysis::visitSMUL_C(cell_t value)
+{
+  setReg(PawnReg::Pri, Mul(state_.pri, ValueRange::Exactly(value)));
+  return true;
+}
+
+bool
+RangeAnalysis::visitZERO(PawnReg dest)
+{
+  setReg(dest, ValueRange::Exactly(0));
+  return true;
+}
+
+bool
+RangeAnalysis::visitZERO(cell_t address)
+{
+  writeGlobal(address);
+  return true;
+}
+
+bool
+RangeAnalysis::visitZERO_S(cell_t offset)
+{
+  writeSlot(offset, ValueRange::Exactly(0));
+  return true;
+}
+
+bool
+RangeAnalysis::visitCompareOp(CompareOp op)
+{
+  setReg(PawnReg::Pri, ValueRange{0, 1});
+  return true;
+}
+
+bool
+RangeAnalysis::visitEQ_C(PawnReg src, cell_t value)
+{
+  setReg(PawnReg::Pri, ValueRange{0, 1});
+  return true;
+}
+
+bool
+RangeAnalysis::visitINC(PawnReg dest)
+{
+  setReg(dest, Add(reg(dest), ValueRange::Exactly(1)));
+  return true;
+}
+
+bool
+RangeAnalysis::visitINC(cell_t address)
+{
+  writeGlobal(address);
+  return true;
+}
+
+bool
+RangeAnalysis::visitINC_S(cell_t offset)
+{
+  writeSlot(offset, Add(readSlot(offset), ValueRange::Exactly(1)));
+  return true;
+}
+
+bool
+RangeAnalysis::visitINC_I()
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitDEC(PawnReg dest)
+{
+  setReg(dest, Sub(reg(dest), ValueRange::Exactly(1)));
+  return true;
+}
+
+bool
+RangeAnalysis::visitDEC(cell_t address)
+{
+  writeGlobal(address);
+  return true;
+}
+
+bool
+RangeAnalysis::visitDEC_S(cell_t offset)
+{
+  writeSlot(offset, Sub(readSlot(offset), ValueRange::Exactly(1)));
+  return true;
+}
+
+bool
+RangeAnalysis::visitDEC_I()
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitMOVS(uint32_t amount)
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitFILL(uint32_t amount)
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitBOUNDS(uint32_t limit)
+{
+  // Checks are unsigned, so a negative index fails too (unless the limit is
+  // so large that it wraps, which no real array has).
+  if (limit > uint32_t(INT_MAX))
+    return true;
+
+  ValueRange in_bounds{0, int32_t(limit)};
+  if (record_ && state_.pri.isWithin(in_bounds.lo, in_bounds.hi)) {
+    if (!redundant_bounds_.append(op_cip_))
+      return false;
+  }
+
+  // Past this point, the index is known to be in bounds.
+  refine(PawnReg::Pri, in_bounds);
+  return true;
+}
+
+bool
+RangeAnalysis::visitSYSREQ_C(uint32_t native_index)
+{
+  forgetSlots();
+  setReg(PawnReg::Pri, ValueRange::Any());
+  setReg(PawnReg::Alt, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitSWAP(PawnReg dest)
+{
+  ValueRange top = readSlot(state_.sp);
+  writeSlot(state_.sp, reg(dest));
+  setReg(dest, top);
+  return true;
+}
+
+bool
+RangeAnalysis::visitPUSH_ADR(const cell_t* offsets, size_t nvals)
+{
+  for (size_t i = 0; i < nvals; i++)
+    push(ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitSYSREQ_N(uint32_t native_index, uint32_t nparams)
+{
+  drop(nparams * sizeof(cell_t));
+  return visitSYSREQ_C(native_index);
+}
+
+bool
+RangeAnalysis::visitLOAD_BOTH(cell_t addressForPri, cell_t addressForAlt)
+{
+  setReg(PawnReg::Pri, ValueRange::Any());
+  setReg(PawnReg::Alt, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitLOAD_S_BOTH(cell_t offsetForPri, cell_t offsetForAlt)
+{
+  visitLOAD_S(PawnReg::Pri, offsetForPri);
+  visitLOAD_S(PawnReg::Alt, offsetForAlt);
+  return true;
+}
+
+bool
+RangeAnalysis::visitCONST(cell_t address, cell_t value)
+{
+  writeGlobal(address);
+  return true;
+}
+
+bool
+RangeAnalysis::visitCONST_S(cell_t offset, cell_t value)
+{
+  writeSlot(offset, ValueRange::Exactly(value));
+  return true;
+}
+
+bool
+RangeAnalysis::visitTRACKER_PUSH_C(cell_t amount)
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitTRACKER_POP_SETHEAP()
+{
+  forgetSlots();
+  return true;
+}
+
+bool
+RangeAnalysis::visitGENARRAY(uint32_t dims, bool autozero)
+{
+  // The dimension counts are replaced by the array's address.
+  drop((dims - 1) * sizeof(cell_t));
+  forgetSlots();
+  setReg(PawnReg::Pri, ValueRange::Any());
+  setReg(PawnReg::Alt, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitSTRADJUST_PRI()
+{
+  setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitFABS()
+{
+  pop();
+  setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitFLOAT()
+{
+  return visitFABS();
+}
+
+bool
+RangeAnalysis::visitFLOATADD()
+{
+  pop();
+  pop();
+  setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitFLOATSUB()
+{
+  return visitFLOATADD();
+}
+
+bool
+RangeAnalysis::visitFLOATMUL()
+{
+  return visitFLOATADD();
+}
+
+bool
+RangeAnalysis::visitFLOATDIV()
+{
+  return visitFLOATADD();
+}
+
+bool
+RangeAnalysis::visitRND_TO_NEAREST()
+{
+  return visitFABS();
+}
+
+bool
+RangeAnalysis::visitRND_TO_FLOOR()
+{
+  return visitFABS();
+}
+
+bool
+RangeAnalysis::visitRND_TO_CEIL()
+{
+  return visitFABS();
+}
+
+bool
+RangeAnalysis::visitRND_TO_ZERO()
+{
+  return visitFABS();
+}
+
+bool
+RangeAnalysis::visitFLOATCMP()
+{
+  pop();
+  pop();
+  setReg(PawnReg::Pri, ValueRange{-1, 1});
+  return true;
+}
+
+bool
+RangeAnalysis::visitFLOAT_CMP_OP(CompareOp op)
+{
+  pop();
+  pop();
+  setReg(PawnReg::Pri, ValueRange{0, 1});
+  return true;
+}
+
+bool
+RangeAnalysis::visitFLOAT_NOT()
+{
+  pop();
+  setReg(PawnReg::Pri, ValueRange{0, 1});
+  return true;
+}
+
+bool
+RangeAnalysis::visitFLOAT_MATH(FloatMathOp op)
+{
+  for (size_t i = 0; i < FloatMathArity(op); i++)
+    pop();
+  setReg(PawnReg::Pri, ValueRange::Any());
+  return true;
+}
+
+bool
+RangeAnalysis::visitHALT(cell_t value)
+{
+  return false;
+}
+
+bool
+RangeAnalysis::visitSWITCH(cell_t defaultOffset, const CaseTableEntry* cases, size_t ncases)
+{
+  return true;
+}
+
+bool
+RangeAnalysis::visitREBASE(cell_t addr, cell_t iv_size, cell_t data_size)
+{
+  forgetSlots();
+  return true;
+}
+
+} // namespace sp
@@ -0,0 +1,224 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2015 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef _include_sourcepawn_vm_range_analysis_h_
+#define _include_sourcepawn_vm_range_analysis_h_
+
+#include <limits.h>
+#include <amtl/am-vector.h>
+#include <sp_vm_types.h>
+#include "control-flow.h"
+#include "pcode-visitor.h"
+
+namespace sp {
+
+class PluginRuntime;
+
+// The signed values a cell might hold, as a closed interval.
+struct ValueRange {
+  int32_t lo;
+  int32_t hi;
+
+  static ValueRange Any() {
+    return ValueRange{INT_MIN, INT_MAX};
+  }
+  static ValueRange Exactly(int32_t value) {
+    return ValueRange{value, value};
+  }
+
+  bool isEmpty() const {
+    return lo > hi;
+  }
+  bool isWithin(int32_t min, int32_t max) const {
+    return lo >= min && hi <= max;
+  }
+  bool operator ==(const ValueRange& other) const {
+    return lo == other.lo && hi == other.hi;
+  }
+  bool operator !=(const ValueRange& other) const {
+    return !(*this == other);
+  }
+};
+
+// A forward dataflow pass over a method's control-flow graph, which tracks
+// the range of values in pri, alt, and the method's own stack slots. The JIT
+// uses it to drop BOUNDS checks that can never fail.
+//
+// Only stack slots written by the method itself are tracked. Anything that
+// writes memory through a computed address (including calls and natives,
+// which may be handed one) could alias the frame, so it forgets every slot.
+class RangeAnalysis final : public PcodeVisitor
+{
+ public:
+  RangeAnalysis(PluginRuntime* rt, ControlFlowGraph* graph);
+
+  // Returns false if the method could not be analyzed, in which case no
+  // checks are considered redundant.
+  bool analyze();
+
+  // Returns true if the BOUNDS instruction at |cip| can never fail.
+  bool isRedundantBoundsCheck(const cell_t* cip) const;
+
+  // Only cells within this many slots of the frame pointer are tracked.
+  static const size_t kMaxTrackedSlots = 128;
+
+  struct State {
+    ValueRange pri;
+    ValueRange alt;
+    // The stack slot that pri or alt was last loaded from or stored to, if
+    // it still holds the same value; otherwise -1.
+    int32_t pri_slot;
+    int32_t alt_slot;
+    // The offset of sp from frm, which is the same on every path.
+    cell_t sp;
+    ValueRange slots[kMaxTrackedSlots];
+  };
+
+ private:
+  bool analyzeBlock(Block* block);
+  bool computeEntryState(Block* block, State* state);
+  bool computeEdgeState(Block* pred, Block* succ, State* state);
+  void refineBranch(CompareOp op, bool taken, State* state);
+  void refine(PawnReg reg, const ValueRange& range);
+  void join(State* state, const State& other);
+  void widen(State* state, const State& prev);
+
+  ValueRange& reg(PawnReg reg) {
+    return reg == PawnReg::Pri ? state_.pri : state_.alt;
+  }
+  int32_t& regSlot(PawnReg reg) {
+    return reg == PawnReg::Pri ? state_.pri_slot : state_.alt_slot;
+  }
+  void setReg(PawnReg dest, const ValueRange& range) {
+    reg(dest) = range;
+    regSlot(dest) = -1;
+  }
+  ValueRange readSlot(cell_t offset);
+  void writeSlot(cell_t offset, const ValueRange& range);
+  void push(const ValueRange& range);
+  ValueRange pop();
+  void drop(cell_t amount);
+  void forgetSlots();
+  void writeGlobal(cell_t address);
+
+ public:
+  bool visitBREAK() override;
+  bool visitLOAD(PawnReg dest, cell_t srcaddr) override;
+  bool visitLOAD_S(PawnReg dest, cell_t srcoffs) override;
+  bool visitLREF_S(PawnReg dest, cell_t srcoffs) override;
+  bool visitLOAD_I() override;
+  bool visitLODB_I(cell_t width) override;
+  bool visitCONST(PawnReg dest, cell_t imm) override;
+  bool visitADDR(PawnReg dest, cell_t offset) override;
+  bool visitSTOR(cell_t address, PawnReg src) override;
+  bool visitSTOR_S(cell_t offset, PawnReg src) override;
+  bool visitSREF_S(cell_t offset, PawnReg src) override;
+  bool visitSTOR_I() override;
+  bool visitSTRB_I(cell_t width) override;
+  bool visitLIDX() override;
+  bool visitIDXADDR() override;
+  bool visitMOVE(PawnReg reg) override;
+  bool visitXCHG() override;
+  bool visitPUSH(PawnReg src) override;
+  bool visitPUSH_C(const cell_t* vals, size_t nvals) override;
+  bool visitPUSH(const cell_t* addresses, size_t nvals) override;
+  bool visitPUSH_S(const cell_t* offsets, size_t nvals) override;
+  bool visitPOP(PawnReg dest) override;
+  bool visitSTACK(cell_t amount) override;
+  bool visitHEAP(cell_t amount) override;
+  bool visitRETN() override;
+  bool visitCALL(cell_t offset) override;
+  bool visitJUMP(cell_t offset) override;
+  bool visitJcmp(CompareOp op, cell_t offset) override;
+  bool visitSHL() override;
+  bool visitSHR() override;
+  bool visitSSHR() override;
+  bool visitSHL_C(PawnReg dest, cell_t amount) override;
+  bool visitSMUL() override;
+  bool visitSDIV(PawnReg dest) override;
+  bool visitADD() override;
+  bool visitSUB() override;
+  bool visitSUB_ALT() override;
+  bool visitAND() override;
+  bool visitOR() override;
+  bool visitXOR() override;
+  bool visitNOT() override;
+  bool visitNEG() override;
+  bool visitINVERT() override;
+  bool visitADD_C(cell_t value) override;
+  bool visitSMUL_C(cell_t value) override;
+  bool visitZERO(PawnReg dest) override;
+  bool visitZERO(cell_t address) override;
+  bool visitZERO_S(cell_t offset) override;
+  bool visitCompareOp(CompareOp op) override;
+  bool visitEQ_C(PawnReg src, cell_t value) override;
+  bool visitINC(PawnReg dest) override;
+  bool visitINC(cell_t address) override;
+  bool visitINC_S(cell_t offset) override;
+  bool visitINC_I() override;
+  bool visitDEC(PawnReg dest) override;
+  bool visitDEC(cell_t address) override;
+  bool visitDEC_S(cell_t offset) override;
+  bool visitDEC_I() override;
+  bool visitMOVS(uint32_t amount) override;
+  bool visitFILL(uint32_t amount) override;
+  bool visitBOUNDS(uint32_t limit) override;
+  bool visitSYSREQ_C(uint32_t native_index) override;
+  bool visitSWAP(PawnReg dest) override;
+  bool visitPUSH_ADR(const cell_t* offsets, size_t nvals) override;
+  bool visitSYSREQ_N(uint32_t native_index, uint32_t nparams) override;
+  bool visitLOAD_BOTH(cell_t addressForPri, cell_t addressForAlt) override;
+  bool visitLOAD_S_BOTH(cell_t offsetForPri, cell_t offsetForAlt) override;
+  bool visitCONST(cell_t address, cell_t value) override;
+  bool visitCONST_S(cell_t offset, cell_t value) override;
+  bool visitTRACKER_PUSH_C(cell_t amount) override;
+  bool visitTRACKER_POP_SETHEAP() override;
+  bool visitGENARRAY(uint32_t dims, bool autozero) override;
+  bool visitSTRADJUST_PRI() override;
+  bool visitFABS() override;
+  bool visitFLOAT() override;
+  bool visitFLOATADD() override;
+  bool visitFLOATSUB() override;
+  bool visitFLOATMUL() override;
+  bool visitFLOATDIV() override;
+  bool visitRND_TO_NEAREST() override;
+  bool visitRND_TO_FLOOR() override;
+  bool visitRND_TO_CEIL() override;
+  bool visitRND_TO_ZERO() override;
+  bool visitFLOATCMP() override;
+  bool visitFLOAT_CMP_OP(CompareOp op) override;
+  bool visitFLOAT_NOT() override;
+  bool visitFLOAT_MATH(FloatMathOp op) override;
+  bool visitHALT(cell_t value) override;
+  bool visitSWITCH(cell_t defaultOffset, const CaseTableEntry* cases, size_t ncases) override;
+  bool visitREBASE(cell_t addr, cell_t iv_size, cell_t data_size) override;
+
+ private:
+  PluginRuntime* rt_;
+  ke::RefPtr<ControlFlowGraph> graph_;
+  size_t data_size_;
+  bool debug_breaks_;
+
+  // State for the block being visited.
+  Block* block_;
+  State state_;
+  const cell_t* op_cip_;
+  cell_t last_push_c_;
+  bool record_;
+
+  ke::Vector<const cell_t*> redundant_bounds_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_range_analysis_h_
@@ -14,6 +14,8 @@
 // 
 // You should have received a copy of the GNU General Public License
 // along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <assert.h>
+#include <math.h>
 #include "runtime-helpers.h"
 #include "environment.h"
 
@@ -40,4 +42,31 @@ ReportOutOfBoundsError(cell_t index, cell_t bounds)
   }
 }
 
+cell_t
+EvalFloatMath(FloatMathOp op, cell_t a, cell_t b)
+{
+  // These compute in double precision, like the natives do.
+  float left = sp_ctof(a);
+  float right = sp_ctof(b);
+  switch (op) {
+    case FloatMathOp::Sqrt:
+      return sp_ftoc(float(sqrt(left)));
+    case FloatMathOp::Sine:
+      return sp_ftoc(float(sin(left)));
+    case FloatMathOp::Cosine:
+      return sp_ftoc(float(cos(left)));
+    case FloatMathOp::ArcTangent2:
+      return sp_ftoc(float(atan2(left, right)));
+    case FloatMathOp::Pow:
+      return sp_ftoc(float(pow(left, right)));
+    case FloatMathOp::Fraction:
+      return sp_ftoc(float(left - floor(left)));
+    case FloatMathOp::Mod:
+      return sp_ftoc(fmodf(left, right));
+    default:
+      assert(false);
+      return 0;
+  }
+}
+
 } // namespace sp
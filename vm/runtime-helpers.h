@@ -18,11 +18,16 @@
 #define _include_sourcepawn_runtime_helpers_h_
 
 #include <sp_vm_types.h>
+#include "pcode-visitor.h"
 
 namespace sp {
 
 void ReportOutOfBoundsError(cell_t index, cell_t bounds);
 
+// Evaluate a math intrinsic the same way the native it replaces does. Unary
+// operations ignore |b|.
+cell_t EvalFloatMath(FloatMathOp op, cell_t a, cell_t b);
+
 } // namespace sp
 
 #endif // _include_sourcepawn_runtime_helpers_h_
@@ -0,0 +1,465 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#include <atomic>
+#include "compiled-function.h"
+#include "environment.h"
+#include "method-info.h"
+#include "plugin-context.h"
+#include "plugin-runtime.h"
+#include "sampling-profiler.h"
+#include "stack-frames.h"
+#include "symbol-index.h"
+#if defined(SP_HAS_SAMPLING_PROFILER)
+# include <errno.h>
+# include <signal.h>
+# include <ucontext.h>
+#endif
+#if defined(KE_ARCH_X86)
+# include "x86/frames-x86.h"
+#elif defined(KE_ARCH_X64)
+# include "x64/frames-x64.h"
+#elif !defined(SP_HAS_JIT)
+# include "null-frame-layout.h"
+#endif
+
+using namespace sp;
+
+SampledStacks::SampledStacks()
+{
+}
+
+bool
+SampledStacks::Add(const char* stack, uint64_t samples)
+{
+  if (!map_.elements() && !map_.init(64))
+    return false;
+
+  Key key = { stack, SymbolIndex::Hash(stack) };
+  Map::Insert p = map_.findForAdd(key);
+  if (p.found()) {
+    entries_[p->value].samples += samples;
+    return true;
+  }
+
+  Entry entry;
+  entry.stack = stack;
+  entry.samples = samples;
+  if (!entries_.append(ke::Move(entry)))
+    return false;
+  if (!map_.add(p, entries_.back().stack.chars(), entries_.length() - 1)) {
+    entries_.pop();
+    return false;
+  }
+  return true;
+}
+
+void
+SampledStacks::Clear()
+{
+  map_.clear();
+  entries_.clear();
+}
+
+SamplingProfiler::SamplingProfiler(Environment* env)
+ : env_(env),
+   terminate_(false),
+   interval_ms_(0),
+   used_(0),
+   flushing_(false),
+   dropped_(0)
+{
+}
+
+SamplingProfiler::~SamplingProfiler()
+{
+  Stop();
+}
+
+#if defined(SP_HAS_SAMPLING_PROFILER)
+// Environments on any thread may start sampling.
+static ke::Mutex sInstallLock;
+static bool sInstalled = false;
+static struct sigaction sPrevProf;
+
+static void
+HandleProfSignal(int sig, siginfo_t* info, void* context)
+{
+  // Only signals from our own sampling threads are ours. Anything else, such
+  // as a process-wide profiling timer, goes to whoever was there before.
+  Environment* env = Environment::get();
+  SamplingProfiler* sampler = env ? env->sampler() : nullptr;
+  if (info->si_code != SI_TKILL || !sampler || !sampler->IsSamplingThread()) {
+    if (sPrevProf.sa_flags & SA_SIGINFO)
+      sPrevProf.sa_sigaction(sig, info, context);
+    else if (sPrevProf.sa_handler != SIG_IGN && sPrevProf.sa_handler != SIG_DFL)
+      sPrevProf.sa_handler(sig);
+    return;
+  }
+
+  int saved_errno = errno;
+
+  ucontext_t* uc = reinterpret_cast<ucontext_t*>(context);
+  greg_t* regs = uc->uc_mcontext.gregs;
+# if defined(KE_ARCH_X64)
+  sampler->TakeSample(reinterpret_cast<void*>(regs[REG_RIP]),
+                      uintptr_t(regs[REG_RSP]),
+                      reinterpret_cast<intptr_t*>(regs[REG_RBP]));
+# else
+  sampler->TakeSample(reinterpret_cast<void*>(regs[REG_EIP]),
+                      uintptr_t(regs[REG_ESP]),
+                      reinterpret_cast<intptr_t*>(regs[REG_EBP]));
+# endif
+
+  errno = saved_errno;
+}
+
+static bool
+InstallProfSignalHandler()
+{
+  ke::AutoLock lock(&sInstallLock);
+  if (sInstalled)
+    return true;
+
+  // Restart system calls, since natives may be interrupted in the middle of
+  // one.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = HandleProfSignal;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+
+  if (sigaction(SIGPROF, &action, &sPrevProf) != 0)
+    return false;
+  sInstalled = true;
+  return true;
+}
+
+// Frames are only followed if they are on the stack, between what has been
+// walked so far and the invoke frame they belong to, so that nothing here
+// can fault.
+static inline bool
+IsFrameOnStack(intptr_t* fp, uintptr_t low, uintptr_t high)
+{
+  if (uintptr_t(fp) & (sizeof(intptr_t) - 1))
+    return false;
+  return uintptr_t(FrameLayout::FromFp(fp)) >= low && uintptr_t(fp) < high;
+}
+
+# if defined(SP_HAS_JIT)
+// Whether |pc| is in the compiled code of the method at |function_id|. This
+// must not touch reference counts, since the thread may be in the middle of
+// changing one.
+static bool
+IsInFunction(PluginRuntime* rt, intptr_t function_id, void* pc)
+{
+  MethodInfo* method = rt->PeekMethod(cell_t(function_id));
+  if (!method)
+    return false;
+  CompiledFunction* fn = method->jit();
+  if (!fn)
+    return false;
+
+  uintptr_t start = uintptr_t(fn->GetEntryAddress());
+  return uintptr_t(pc) >= start && uintptr_t(pc) - start < fn->GetCodeLength();
+}
+
+// Find the innermost frame of the JIT invoke frame that is running. The
+// frame pointer is only trusted if the pc is in its function; otherwise the
+// thread is most likely in a native or helper, below an exit frame. Leaf
+// natives and stubs have no exit frame, but leave the frame pointer alone,
+// so that is the last resort.
+static FrameLayout*
+FindInnermostJitFrame(PluginRuntime* rt, void* pc, uintptr_t sp, intptr_t* fp,
+                      intptr_t* exit_fp, uintptr_t high)
+{
+  FrameLayout* frame = nullptr;
+  if (IsFrameOnStack(fp, sp, high)) {
+    frame = FrameLayout::FromFp(fp);
+    if (frame->frame_type != intptr_t(JitFrameType::Scripted))
+      frame = nullptr;
+    else if (IsInFunction(rt, frame->function_id, pc))
+      return frame;
+  }
+
+  if (exit_fp && IsFrameOnStack(exit_fp, sp, high)) {
+    FrameLayout* exit = FrameLayout::FromFp(exit_fp);
+    if (exit->frame_type == intptr_t(JitFrameType::Exit))
+      return exit;
+  }
+  return frame;
+}
+# endif
+
+bool
+SamplingProfiler::Push(RawFrame* frames, size_t* depth, PluginRuntime* rt, int32_t id,
+                       FrameType type)
+{
+  // Keep the last slot to mark the stack as cut off.
+  if (*depth == kMaxFrames - 1) {
+    frames[(*depth)++] = { nullptr, 0, uint8_t(FrameType::Internal) };
+    return false;
+  }
+  frames[(*depth)++] = { rt, id, uint8_t(type) };
+  return true;
+}
+
+// Walk the compiled frames of one JIT invoke frame, from |frame| to its entry
+// frame. Returns false if the walk went wrong, or the stack was cut off.
+bool
+SamplingProfiler::WalkJitFrames(RawFrame* frames, size_t* depth, PluginRuntime* rt,
+                                FrameLayout* frame, uintptr_t high, bool* ok)
+{
+  while (frame->frame_type != intptr_t(JitFrameType::Entry)) {
+    if (frame->frame_type == intptr_t(JitFrameType::Scripted)) {
+      if (!Push(frames, depth, rt, int32_t(frame->function_id), FrameType::Scripted))
+        return false;
+    } else if (frame->frame_type == intptr_t(JitFrameType::Exit)) {
+      uintptr_t id = uintptr_t(frame->function_id);
+      if (GetExitFrameType(id) == ExitFrameType::Native) {
+        if (!Push(frames, depth, rt, int32_t(GetExitFramePayload(id)), FrameType::Native))
+          return false;
+      }
+    } else {
+      *ok = false;
+      return false;
+    }
+
+    // Frames only ever get older going up the stack.
+    uintptr_t above = uintptr_t(frame) + sizeof(FrameLayout);
+    if (!IsFrameOnStack(frame->prev_fp, above, high)) {
+      *ok = false;
+      return false;
+    }
+    frame = FrameLayout::FromFp(frame->prev_fp);
+  }
+  return true;
+}
+
+void
+SamplingProfiler::TakeSample(void* pc, uintptr_t sp, intptr_t* fp)
+{
+  if (flushing_ || !env_->top())
+    return;
+
+  size_t start = used_;
+  if (kBufferFrames - start < kMaxFrames + 1) {
+    dropped_++;
+    return;
+  }
+
+  RawFrame* frames = &buffer_[start + 1];
+  size_t depth = 0;
+  bool ok = true;
+
+  intptr_t* exit_fp = env_->exit_fp();
+  uintptr_t low = sp;
+  for (InvokeFrame* ivk = env_->top(); ivk; ivk = ivk->prev()) {
+    PluginRuntime* rt = ivk->cx()->runtime();
+    uintptr_t high = uintptr_t(ivk);
+
+    if (InterpInvokeFrame* interp = ivk->AsInterpInvokeFrame()) {
+      // As in FrameIterator, frames replaced through OSR were already walked
+      // as compiled frames.
+      if (interp->replaced() && !interp->inlineCallers()) {
+        low = high;
+        continue;
+      }
+
+      InterpFrameIterator iter(interp);
+      bool more = true;
+      for (;;) {
+        if (iter.type() == FrameType::Native)
+          more = Push(frames, &depth, rt, int32_t(iter.native_index()), FrameType::Native);
+        else
+          more = Push(frames, &depth, rt, iter.function_cip(), FrameType::Scripted);
+        if (!more || iter.done())
+          break;
+        iter.next();
+      }
+      if (!more)
+        break;
+    } else if (ivk->AsJitInvokeFrame()) {
+# if defined(SP_HAS_JIT)
+      FrameLayout* frame;
+      if (ivk == env_->top()) {
+        frame = FindInnermostJitFrame(rt, pc, sp, fp, exit_fp, high);
+      } else if (exit_fp && IsFrameOnStack(exit_fp, low, high)) {
+        // An outer invoke frame can only be left through a native call.
+        frame = FrameLayout::FromFp(exit_fp);
+      } else {
+        frame = nullptr;
+      }
+      if (!frame) {
+        ok = false;
+        break;
+      }
+      if (!WalkJitFrames(frames, &depth, rt, frame, high, &ok))
+        break;
+      exit_fp = ivk->AsJitInvokeFrame()->prev_exit_fp();
+# else
+      ok = false;
+      break;
+# endif
+    } else {
+      // Still being constructed, so there is nothing in it yet.
+    }
+
+    low = high;
+  }
+
+  if (!ok || !depth) {
+    dropped_++;
+    return;
+  }
+
+  buffer_[start] = { nullptr, int32_t(depth), uint8_t(FrameType::Internal) };
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  used_ = start + depth + 1;
+}
+#endif // SP_HAS_SAMPLING_PROFILER
+
+bool
+SamplingProfiler::IsSupported()
+{
+#if defined(SP_HAS_SAMPLING_PROFILER)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool
+SamplingProfiler::Start(uint32_t interval_ms)
+{
+#if defined(SP_HAS_SAMPLING_PROFILER)
+  if (thread_ || !interval_ms || !InstallProfSignalHandler())
+    return false;
+
+  interval_ms_ = interval_ms;
+  target_ = pthread_self();
+
+  thread_ = new ke::Thread([this]() -> void {
+    Run();
+  }, "SP Sampler");
+  if (!thread_->Succeeded()) {
+    thread_ = nullptr;
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+SamplingProfiler::Stop()
+{
+  if (!thread_)
+    return;
+
+  {
+    ke::AutoLock lock(&cv_);
+    terminate_ = true;
+    cv_.Notify();
+  }
+
+  // Any signal the thread sent is handled by the time this thread returns
+  // from waiting on it.
+  thread_->Join();
+  thread_ = nullptr;
+}
+
+void
+SamplingProfiler::Run()
+{
+#if defined(SP_HAS_SAMPLING_PROFILER)
+  ke::AutoLock lock(&cv_);
+
+  while (!terminate_) {
+    ke::WaitResult rv = cv_.Wait(interval_ms_);
+    if (terminate_ || rv == ke::Wait_Error)
+      return;
+    if (rv != ke::Wait_Timeout)
+      continue;
+
+    // Time spent in the host is not ours to sample. This races with the
+    // thread entering and leaving code, which is fine: the handler checks
+    // again.
+    if (env_->RunningCode())
+      pthread_kill(target_, SIGPROF);
+  }
+#endif
+}
+
+static void
+AppendName(ke::Vector<char>* out, const char* name)
+{
+  for (const char* iter = name; *iter; iter++)
+    out->append(*iter);
+}
+
+void
+SamplingProfiler::Flush()
+{
+  flushing_ = true;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+
+  ke::Vector<char> stack;
+  size_t used = used_;
+  for (size_t pos = 0; pos < used; ) {
+    size_t depth = size_t(buffer_[pos].id);
+    const RawFrame* frames = &buffer_[pos + 1];
+    pos += depth + 1;
+
+    // The sample belongs to the plugin of its innermost frame. Frames from
+    // other plugins are named after their plugin too.
+    PluginRuntime* owner = frames[0].rt;
+
+    stack.clear();
+    for (size_t i = depth; i-- > 0; ) {
+      const RawFrame& frame = frames[i];
+      const char* name = nullptr;
+      switch (FrameType(frame.type)) {
+        case FrameType::Scripted:
+          name = frame.rt->image()->LookupFunction(frame.id);
+          if (name && frame.rt != owner) {
+            AppendName(&stack, frame.rt->Name());
+            AppendName(&stack, "::");
+          }
+          break;
+        case FrameType::Native:
+          if (const sp_native_t* native = frame.rt->GetNative(frame.id))
+            name = native->name;
+          break;
+        default:
+          name = "[truncated]";
+          break;
+      }
+
+      AppendName(&stack, name ? name : "<unknown>");
+      if (i)
+        stack.append(';');
+    }
+    stack.append('\0');
+
+    owner->sampled_stacks()->Add(stack.buffer(), 1);
+  }
+
+  used_ = 0;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  flushing_ = false;
+}
@@ -0,0 +1,186 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_sampling_profiler_h_
+#define _include_sourcepawn_vm_sampling_profiler_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sp_vm_types.h>
+#include <am-thread-utils.h>
+#include <amtl/am-autoptr.h>
+#include <amtl/am-hashmap.h>
+#include <amtl/am-platform.h>
+#include <amtl/am-string.h>
+#include <amtl/am-vector.h>
+#if defined(__linux__)
+# include <pthread.h>
+#endif
+
+// Samples are taken by signalling the thread that runs plugins, and reading
+// its registers from the signal handler.
+#if defined(__linux__) && (defined(KE_ARCH_X86) || defined(KE_ARCH_X64))
+# define SP_HAS_SAMPLING_PROFILER
+#endif
+
+namespace sp {
+
+class Environment;
+class PluginRuntime;
+struct FrameLayout;
+enum class FrameType;
+
+// The call stacks sampled in one plugin, and how many samples landed in
+// each. A stack is the folded form flame graph tools take: function names
+// from the outermost frame to the innermost, separated by semicolons.
+class SampledStacks
+{
+ public:
+  SampledStacks();
+
+  bool Add(const char* stack, uint64_t samples);
+  void Clear();
+
+  size_t length() const {
+    return entries_.length();
+  }
+  const char* stack(size_t index) const {
+    return entries_[index].stack.chars();
+  }
+  uint64_t samples(size_t index) const {
+    return entries_[index].samples;
+  }
+
+ private:
+  struct Entry {
+    ke::AString stack;
+    uint64_t samples;
+  };
+  struct Key {
+    const char* stack;
+    uint32_t hash;
+  };
+  struct Policy {
+    static inline uint32_t hash(const Key& key) {
+      return key.hash;
+    }
+    static inline bool matches(const Key& key, const char* stack) {
+      return strcmp(key.stack, stack) == 0;
+    }
+  };
+
+  // Keys point into the entries' strings, which stay put when the vector
+  // grows.
+  typedef ke::HashMap<const char*, size_t, Policy> Map;
+
+  ke::Vector<Entry> entries_;
+  Map map_;
+};
+
+// Samples the stacks of plugins running in one environment at a fixed
+// interval, cheaply enough to leave on in production.
+//
+// A helper thread signals the environment's thread whenever it is running
+// code. The signal handler copies the frames it finds into a fixed buffer,
+// without allocating or taking locks. The buffer is folded into each
+// plugin's SampledStacks later, on the environment's thread, which is when
+// names are looked up.
+class SamplingProfiler
+{
+ public:
+  explicit SamplingProfiler(Environment* env);
+  ~SamplingProfiler();
+
+  static bool IsSupported();
+
+  // Start and stop sampling. Called from the environment's thread. Once
+  // Stop() returns, the signal handler will not run for this profiler
+  // again.
+  bool Start(uint32_t interval_ms);
+  void Stop();
+
+  // Fold buffered samples into their plugins' stacks. Called from the
+  // environment's thread, and before any runtime is destroyed, since the
+  // buffer points at runtimes.
+  void Flush();
+
+  // True once the buffer is half full, so that the environment flushes it
+  // the next time no code is running.
+  bool ShouldFlush() const {
+    return used_ >= kBufferFrames / 2;
+  }
+
+  // Samples lost because the buffer was full or a stack could not be walked.
+  uint64_t dropped() const {
+    return dropped_;
+  }
+
+#if defined(SP_HAS_SAMPLING_PROFILER)
+  // Called from the signal handler, on the environment's thread.
+  bool IsSamplingThread() const {
+    return pthread_equal(pthread_self(), target_) != 0;
+  }
+  void TakeSample(void* pc, uintptr_t sp, intptr_t* fp);
+#endif
+
+ private:
+  void Run();
+
+ private:
+  // Samples are stored as a header, whose |id| is the number of frames that
+  // follow it, then the frames from the innermost out.
+  struct RawFrame {
+    PluginRuntime* rt;
+
+    // Function cip for scripted frames, native index for native frames.
+    int32_t id;
+
+    // Internal marks a stack that was cut off at kMaxFrames.
+    uint8_t type;
+  };
+
+  static const size_t kBufferFrames = 16384;
+  static const size_t kMaxFrames = 64;
+
+#if defined(SP_HAS_SAMPLING_PROFILER)
+  bool Push(RawFrame* frames, size_t* depth, PluginRuntime* rt, int32_t id, FrameType type);
+  bool WalkJitFrames(RawFrame* frames, size_t* depth, PluginRuntime* rt, FrameLayout* frame,
+                     uintptr_t high, bool* ok);
+#endif
+
+ private:
+  Environment* env_;
+
+  bool terminate_;
+  uint32_t interval_ms_;
+  ke::AutoPtr<ke::Thread> thread_;
+  ke::ConditionVariable cv_;
+#if defined(SP_HAS_SAMPLING_PROFILER)
+  pthread_t target_;
+#endif
+
+  // Written by the signal handler, and read on the same thread, so these
+  // only need to be safe against being interrupted.
+  RawFrame buffer_[kBufferFrames];
+  volatile size_t used_;
+  volatile bool flushing_;
+  uint64_t dropped_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_sampling_profiler_h_
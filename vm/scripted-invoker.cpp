@@ -18,6 +18,7 @@
 #include "environment.h"
 #include "plugin-context.h"
 #include "method-info.h"
+#include "call-signature.h"
 
 /********************
 * FUNCTION CALLING*
@@ -172,6 +173,11 @@ ScriptedInvoker::Cancel()
 int
 ScriptedInvoker::Execute(cell_t* result)
 {
+  if (!context_->IsOwnerThread()) {
+    Cancel();
+    return SP_ERROR_NOT_RUNNABLE;
+  }
+
   Environment* env = Environment::get();
   env->clearPendingException();
 
@@ -198,6 +204,12 @@ ScriptedInvoker::Execute(cell_t* result)
 bool
 ScriptedInvoker::Invoke(cell_t* result)
 {
+  // Nothing here may touch the context from another thread, not even the
+  // heap allocations for array parameters.
+  if (!context_->CheckOwnerThread()) {
+    Cancel();
+    return false;
+  }
   if (!IsRunnable()) {
     Cancel();
     env_->ReportError(SP_ERROR_NOT_RUNNABLE);
@@ -331,6 +343,18 @@ ScriptedInvoker::Invoke(cell_t* result)
   return !env_->hasPendingException();
 }
 
+ICallSignature*
+ScriptedInvoker::CreateSignature(const SignatureParam* params, unsigned int num_params)
+{
+  return CallSignature::New(context_, this, params, num_params);
+}
+
+void
+ScriptedInvoker::DestroySignature(ICallSignature* sig)
+{
+  delete static_cast<CallSignature*>(sig);
+}
+
 int
 ScriptedInvoker::Execute2(IPluginContext* ctx, cell_t* result)
 {
@@ -71,6 +71,8 @@ class ScriptedInvoker : public IPluginFunction
   const char* DebugName() {
     return full_name_.get();
   }
+  ICallSignature* CreateSignature(const SignatureParam* params, unsigned int num_params);
+  void DestroySignature(ICallSignature* sig);
 
  public:
   sp_public_t* Public() const {
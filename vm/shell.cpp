@@ -11,9 +11,12 @@
 // SourcePawn. If not, see http://www.gnu.org/licenses/.
 //
 #include <sp_vm_api.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <chrono>
 #include <amtl/am-cxx.h>
+#include <amtl/am-thread-utils.h>
 #include <amtl/experimental/am-argparser.h>
 #include "dll_exports.h"
 #include "environment.h"
@@ -34,6 +37,10 @@ using namespace sp;
 using namespace SourcePawn;
 
 Environment* sEnv;
+static const char* sPluginFile;
+static INativeRegistry* sNatives;
+
+static void BindShellNatives(PluginRuntime* rt);
 
 static const char*
 BaseFilename(const char* path)
@@ -127,16 +134,6 @@ static cell_t DoNothing(IPluginContext* cx, const cell_t* params)
   return 1;
 }
 
-static void BindNative(IPluginRuntime* rt, const char* name, SPVM_NATIVE_FUNC fn)
-{
-  int err;
-  uint32_t index;
-  if ((err = rt->FindNativeByName(name, &index)) != SP_ERROR_NONE)
-    return;
-
-  rt->UpdateNativeBinding(index, fn, 0, nullptr);
-}
-
 static cell_t PrintFloat(IPluginContext* cx, const cell_t* params)
 {
   return printf("%f\n", sp_ctof(params[1]));
@@ -171,6 +168,380 @@ static cell_t DoInvoke(IPluginContext* cx, const cell_t* params)
   return 1;
 }
 
+static cell_t DoInvokeBound(IPluginContext* cx, const cell_t* params)
+{
+  IPluginFunction* fn = cx->GetFunctionById(params[2]);
+  if (!fn)
+    return cx->ThrowNativeError("Invalid function id %x", params[2]);
+
+  static const SignatureParam kParams[] = {
+    { SP_SIGPARAM_CELL, 0, 0, 0 },
+    { SP_SIGPARAM_CELL, 0, 0, 0 },
+    { SP_SIGPARAM_ARRAY, 3, 0, SM_PARAM_COPYBACK },
+    { SP_SIGPARAM_STRING, 16, SM_PARAM_STRING_COPY, SM_PARAM_COPYBACK },
+  };
+  ICallSignature* sig = fn->CreateSignature(kParams, sizeof(kParams) / sizeof(kParams[0]));
+  if (!sig)
+    return cx->ThrowNativeError("Could not create signature");
+
+  // The array and string stay bound, so whatever the callback writes is
+  // passed back to it on the next call.
+  cell_t values[3] = { 0, 0, 0 };
+  char buffer[16] = "a";
+  sig->BindArray(2, values);
+  sig->BindString(3, buffer);
+
+  cell_t calls = 0;
+  for (cell_t i = 0; i < params[1]; i++) {
+    sig->SetCell(0, i);
+    sig->SetFloat(1, float(i) / 2);
+    if (!sig->Invoke())
+      break;
+    calls++;
+  }
+
+  fn->DestroySignature(sig);
+  return calls;
+}
+
+static cell_t DoDispatch(IPluginContext* cx, const cell_t* params)
+{
+  char* name;
+  if (int err = cx->LocalToString(params[1], &name))
+    return cx->ThrowNativeErrorEx(err, "Could not read argument");
+  cell_t* calls;
+  if (int err = cx->LocalToPhysAddr(params[5], &calls))
+    return cx->ThrowNativeErrorEx(err, "Could not read argument");
+
+  static const SignatureParam kParams[] = {
+    { SP_SIGPARAM_CELL, 0, 0, 0 },
+    { SP_SIGPARAM_ARRAY, 1, 0, SM_PARAM_COPYBACK },
+  };
+  IDispatchGroup* group = Environment::get()->APIv2()->CreateDispatchGroup(
+    name, kParams, sizeof(kParams) / sizeof(kParams[0]));
+  if (!group)
+    return cx->ThrowNativeError("Could not create dispatch group");
+
+  // Load extra copies of this plugin, so there is more than one runtime to
+  // dispatch to.
+  group->AddRuntime(cx->GetRuntime());
+
+  Vector<IPluginRuntime*> copies;
+  for (cell_t i = 0; i < params[2]; i++) {
+    char error[255];
+    IPluginRuntime* copy = Environment::get()->APIv2()->LoadBinaryFromFile(sPluginFile, error, sizeof(error));
+    if (!copy)
+      break;
+    BindShellNatives(PluginRuntime::FromAPI(copy));
+    copies.append(copy);
+    group->AddRuntime(copy);
+  }
+
+  // The counter is copied back after each plugin, so each one sees how many
+  // ran before it.
+  cell_t counter = 0;
+  group->SetCell(0, params[4]);
+  group->BindArray(1, &counter);
+
+  cell_t result;
+  *calls = group->Dispatch(DispatchPolicy(params[3]), &result);
+
+  Environment::get()->APIv2()->DestroyDispatchGroup(group);
+  for (IPluginRuntime* copy : copies)
+    delete copy;
+  return result;
+}
+
+static cell_t DoResetCopy(IPluginContext* cx, const cell_t* params)
+{
+  char error[255];
+  AutoPtr<IPluginRuntime> copy(Environment::get()->APIv2()->LoadBinaryFromFile(sPluginFile, error, sizeof(error)));
+  if (!copy)
+    return cx->ThrowNativeError("Could not load plugin: %s", error);
+  BindShellNatives(PluginRuntime::FromAPI(copy));
+
+  IPluginContext* copy_cx = copy->GetDefaultContext();
+  IPluginFunction* start = copy->GetFunctionByName("OnStart");
+  IPluginFunction* round = copy->GetFunctionByName("OnRound");
+  if (!start || !round)
+    return cx->ThrowNativeError("Plugin must have OnStart and OnRound");
+  if (!start->Invoke())
+    return cx->ThrowNativeError("OnStart failed");
+
+  // Every round starts from the state OnStart left behind.
+  IContextSnapshot* snapshot = copy_cx->CreateSnapshot();
+  if (!snapshot)
+    return cx->ThrowNativeError("Could not create snapshot");
+
+  cell_t sum = 0;
+  for (cell_t i = 0; i < params[1]; i++) {
+    if (i > 0 && copy_cx->RestoreSnapshot(snapshot) != SP_ERROR_NONE)
+      break;
+    cell_t result;
+    if (!round->Invoke(&result))
+      break;
+    sum += result;
+  }
+
+  copy_cx->DestroySnapshot(snapshot);
+  return sum;
+}
+
+// Settings that each isolated environment copies from the main one.
+struct IsolateOptions
+{
+  bool jit;
+  bool threaded_interp;
+  uint32_t jit_threshold;
+  bool reserved_memory;
+  bool unchecked_memory;
+  bool call_stats;
+  bool native_stats;
+  IDebugListener* debugger;
+};
+
+static void
+GetIsolateOptions(IsolateOptions* options)
+{
+  Environment* env = Environment::get();
+  options->jit = env->IsJitEnabled();
+  options->threaded_interp = env->IsThreadedInterpEnabled();
+  options->jit_threshold = env->jit_threshold();
+  options->reserved_memory = env->IsReservedMemoryEnabled();
+  options->unchecked_memory = env->IsUncheckedMemoryEnabled();
+  options->call_stats = env->IsCallStatsEnabled();
+  options->native_stats = env->IsNativeStatsEnabled();
+  options->debugger = env->debugger();
+}
+
+typedef cell_t (*CallCounter)(IPluginRuntime* rt, const char* name);
+
+static cell_t
+CountCalls(IPluginRuntime* rt, const char* name)
+{
+  sp_function_stats_t stats;
+  for (uint32_t i = 0; i < rt->GetFunctionStatsCount(); i++) {
+    if (rt->GetFunctionStats(i, &stats) && stats.name && strcmp(stats.name, name) == 0)
+      return cell_t(stats.calls);
+  }
+  return 0;
+}
+
+// Returns -1 if the histogram does not add up to the number of calls.
+static cell_t
+CountNativeCalls(IPluginRuntime* rt, const char* name)
+{
+  uint32_t index;
+  sp_native_stats_t stats;
+  if (rt->FindNativeByName(name, &index) != SP_ERROR_NONE || !rt->GetNativeStats(index, &stats))
+    return 0;
+
+  uint64_t bucketed = 0;
+  for (size_t i = 0; i < SP_NATIVE_STATS_BUCKETS; i++)
+    bucketed += stats.histogram[i];
+  return bucketed == stats.calls ? cell_t(stats.calls) : -1;
+}
+
+// If |count| is given, |calls| receives the number of calls to |counted|.
+static bool
+RunIsolated(const IsolateOptions& options, const char* name, cell_t index, cell_t* result,
+            CallCounter count = nullptr, const char* counted = nullptr, cell_t* calls = nullptr)
+{
+  Environment* env = Environment::New();
+  if (!env)
+    return false;
+
+  env->SetJitEnabled(options.jit);
+  env->SetThreadedInterpEnabled(options.threaded_interp);
+  env->SetJitThreshold(options.jit_threshold);
+  env->SetReservedMemoryEnabled(options.reserved_memory);
+  env->SetUncheckedMemoryEnabled(options.unchecked_memory);
+  env->SetCallStatsEnabled(options.call_stats);
+  env->SetNativeStatsEnabled(options.native_stats);
+  env->SetDebugger(options.debugger);
+
+  bool ok = false;
+  {
+    char error[255];
+    AutoPtr<IPluginRuntime> rt(env->APIv2()->LoadBinaryFromFile(sPluginFile, error, sizeof(error)));
+    if (rt) {
+      BindShellNatives(PluginRuntime::FromAPI(rt));
+      if (IPluginFunction* fn = rt->GetFunctionByName(name)) {
+        fn->PushCell(index);
+        ok = fn->Execute(result) == SP_ERROR_NONE;
+      }
+      if (ok && count)
+        *calls = count(rt, counted);
+    }
+  }
+
+  env->SetDebugger(nullptr);
+  env->Shutdown();
+  delete env;
+  return ok;
+}
+
+static cell_t DoRunIsolated(IPluginContext* cx, const cell_t* params)
+{
+  char* name;
+  if (int err = cx->LocalToString(params[1], &name))
+    return cx->ThrowNativeErrorEx(err, "Could not read argument");
+
+  IsolateOptions options;
+  GetIsolateOptions(&options);
+
+  // Each thread loads its own copy of this plugin into its own environment,
+  // so nothing is shared but the plugin file and the native registry.
+  cell_t threads = params[2];
+  Vector<cell_t> results;
+  Vector<bool> succeeded;
+  Vector<AutoPtr<ke::Thread>> workers;
+  if (threads < 0 || !results.resize(threads) || !succeeded.resize(threads))
+    return cx->ThrowNativeError("Invalid thread count %d", threads);
+
+  for (cell_t i = 0; i < threads; i++) {
+    cell_t* result = &results[i];
+    bool* ok = &succeeded[i];
+    *ok = false;
+    AutoPtr<ke::Thread> worker(new ke::Thread([=, &options]() -> void {
+      *ok = RunIsolated(options, name, i, result);
+    }, "SP Isolate"));
+    if (!worker->Succeeded() || !workers.append(ke::Move(worker)))
+      break;
+  }
+
+  cell_t sum = 0;
+  bool ok = workers.length() == size_t(threads);
+  for (size_t i = 0; i < workers.length(); i++) {
+    workers[i]->Join();
+    ok &= succeeded[i];
+    sum += results[i];
+  }
+  return ok ? sum : -1;
+}
+
+// Stats must be on before the plugin is loaded, so load a fresh copy
+// in an environment of its own, on a thread of its own.
+static cell_t
+CountIsolated(IPluginContext* cx, const cell_t* params, const IsolateOptions& options,
+              CallCounter count)
+{
+  char* name;
+  char* counted;
+  cx->LocalToString(params[1], &name);
+  cx->LocalToString(params[2], &counted);
+
+  cell_t result = 0;
+  cell_t calls = 0;
+  bool ok = false;
+  AutoPtr<ke::Thread> worker(new ke::Thread([&]() -> void {
+    ok = RunIsolated(options, name, 0, &result, count, counted, &calls);
+  }, "SP Isolate"));
+  if (!worker->Succeeded())
+    return -1;
+  worker->Join();
+  return ok ? calls : -1;
+}
+
+static cell_t DoCountCalls(IPluginContext* cx, const cell_t* params)
+{
+  IsolateOptions options;
+  GetIsolateOptions(&options);
+  options.call_stats = true;
+  return CountIsolated(cx, params, options, CountCalls);
+}
+
+static cell_t DoCountNativeCalls(IPluginContext* cx, const cell_t* params)
+{
+  IsolateOptions options;
+  GetIsolateOptions(&options);
+  options.native_stats = true;
+  return CountIsolated(cx, params, options, CountNativeCalls);
+}
+
+static cell_t DoLoadBatch(IPluginContext* cx, const cell_t* params)
+{
+  // Every copy of this plugin, then one file that does not exist.
+  cell_t copies = params[1];
+  Vector<const char*> files;
+  for (cell_t i = 0; i < copies; i++)
+    files.append(sPluginFile);
+  files.append("does-not-exist.smx");
+
+  Vector<IPluginRuntime*> runtimes;
+  Vector<char> errors;
+  if (!runtimes.resize(files.length()) || !errors.resize(files.length() * 64))
+    return cx->ThrowNativeError("Out of memory");
+
+  size_t loaded = Environment::get()->APIv2()->LoadBinariesFromFiles(
+    files.buffer(), files.length(), params[2], runtimes.buffer(), errors.buffer(), 64);
+  if (loaded != size_t(copies))
+    fprintf(stdout, "loaded %d of %d\n", int(loaded), copies);
+
+  cell_t sum = 0;
+  for (size_t i = 0; i < runtimes.length(); i++) {
+    IPluginRuntime* rt = runtimes[i];
+    if (!rt) {
+      fprintf(stdout, "%s: %s\n", files[i], &errors[i * 64]);
+      continue;
+    }
+
+    BindShellNatives(PluginRuntime::FromAPI(rt));
+    if (IPluginFunction* fn = rt->GetFunctionByName("OnLoaded")) {
+      cell_t result = 0;
+      fn->PushCell(cell_t(i));
+      if (fn->Execute(&result) == SP_ERROR_NONE)
+        sum += result;
+    }
+    delete rt;
+  }
+  return sum;
+}
+
+static cell_t DoSampleStack(IPluginContext* cx, const cell_t* params)
+{
+  char* name;
+  char* expected;
+  cx->LocalToString(params[1], &name);
+  cx->LocalToString(params[2], &expected);
+
+  IPluginRuntime* rt = cx->GetRuntime();
+  IPluginFunction* fn = rt->GetFunctionByName(name);
+  if (!fn)
+    return cx->ThrowNativeError("function %s not found", name);
+
+  ISourcePawnEngine2* api = Environment::get()->APIv2();
+  if (!api->SetSamplingInterval(1))
+    return 1;
+
+  // At one sample per millisecond, this usually takes a handful of calls.
+  // A loaded machine can delay the signal for a long time, so the budget is
+  // generous, and in wall time rather than calls.
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  bool found = false;
+  bool failed = false;
+  uint32_t calls = 0;
+  while (!found && std::chrono::steady_clock::now() < deadline) {
+    cell_t result;
+    if (fn->Execute(&result) != SP_ERROR_NONE) {
+      failed = true;
+      break;
+    }
+    calls++;
+    for (uint32_t j = 0; j < rt->GetSampledStackCount(); j++) {
+      if (strcmp(rt->GetSampledStack(j, nullptr), expected) == 0)
+        found = true;
+    }
+  }
+
+  api->SetSamplingInterval(0);
+  if (!found && !failed) {
+    fprintf(stdout, "sample_stack: %s was not sampled in %u calls; saw %u other stacks\n",
+            expected, calls, rt->GetSampledStackCount());
+  }
+  return found;
+}
+
 static cell_t DumpStackTrace(IPluginContext* cx, const cell_t* params)
 {
   FrameIterator iter;
@@ -178,12 +549,126 @@ static cell_t DumpStackTrace(IPluginContext* cx, const cell_t* params)
   return 0;
 }
 
+static cell_t ListUnboundNatives(IPluginContext* cx, const cell_t* params)
+{
+  // Binding again leaves bound natives alone, and reports the rest.
+  IPluginRuntime* rt = cx->GetRuntime();
+  uint32_t unresolved[8];
+  uint32_t count = Environment::get()->APIv2()->BindNatives(rt, sNatives, unresolved, 8);
+  for (uint32_t i = 0; i < count && i < 8; i++)
+    fprintf(stdout, "%s\n", rt->GetNative(unresolved[i])->name);
+  return count;
+}
+
+static cell_t DoCallFails(IPluginContext* cx, const cell_t* params)
+{
+  char* name;
+  if (int err = cx->LocalToString(params[1], &name))
+    return cx->ThrowNativeErrorEx(err, "Could not read argument");
+
+  IPluginFunction* fn = cx->GetRuntime()->GetFunctionByName(name);
+  if (!fn)
+    return cx->ThrowNativeError("Function %s not found", name);
+
+  // Error messages can differ between tiers, so keep them out of the output.
+  Environment* env = Environment::get();
+  IDebugListener* debugger = env->debugger();
+  env->SetDebugger(nullptr);
+
+  bool failed;
+  {
+    ExceptionHandler eh(cx);
+    failed = !fn->Invoke();
+  }
+
+  env->SetDebugger(debugger);
+  return failed;
+}
+
+static cell_t DoFindByHash(IPluginContext* cx, const cell_t* params)
+{
+  char* name;
+  if (int err = cx->LocalToString(params[1], &name))
+    return cx->ThrowNativeErrorEx(err, "Could not read argument");
+
+  IPluginRuntime* rt = cx->GetRuntime();
+  uint32_t hash = Environment::get()->APIv2()->HashSymbolName(name);
+
+  // Each lookup must agree with its by-name counterpart.
+  cell_t found = 0;
+  uint32_t index, expected;
+  if (rt->FindPublicByHash(name, hash, &index) == SP_ERROR_NONE) {
+    if (rt->FindPublicByName(name, &expected) != SP_ERROR_NONE || index != expected)
+      return cx->ThrowNativeError("public %s found at the wrong index", name);
+    found |= 1;
+  }
+  if (IPluginFunction* fn = rt->GetFunctionByHash(name, hash)) {
+    if (fn != rt->GetFunctionByName(name))
+      return cx->ThrowNativeError("public %s has the wrong function", name);
+    found |= 2;
+  }
+  if (rt->FindNativeByHash(name, hash, &index) == SP_ERROR_NONE) {
+    if (rt->FindNativeByName(name, &expected) != SP_ERROR_NONE || index != expected)
+      return cx->ThrowNativeError("native %s found at the wrong index", name);
+    found |= 4;
+  }
+  return found;
+}
+
 static cell_t ReportError(IPluginContext* cx, const cell_t* params)
 {
   cx->ReportError("What the crab?!");
   return 0;
 }
 
+static int CompareSelfTicks(const void* a, const void* b)
+{
+  const sp_function_stats_t* left = reinterpret_cast<const sp_function_stats_t*>(a);
+  const sp_function_stats_t* right = reinterpret_cast<const sp_function_stats_t*>(b);
+  if (left->self_ticks == right->self_ticks)
+    return 0;
+  return left->self_ticks > right->self_ticks ? -1 : 1;
+}
+
+// Print every function that was called, by self time, most first.
+static void DumpCallStats(IPluginRuntime* rt)
+{
+  Vector<sp_function_stats_t> functions;
+  for (uint32_t i = 0; i < rt->GetFunctionStatsCount(); i++) {
+    sp_function_stats_t stats;
+    if (rt->GetFunctionStats(i, &stats) && stats.calls)
+      functions.append(stats);
+  }
+  qsort(functions.buffer(), functions.length(), sizeof(sp_function_stats_t), CompareSelfTicks);
+
+  fprintf(stderr, "%12s %16s %16s  %s\n", "calls", "self ticks", "total ticks", "function");
+  for (const auto& stats : functions) {
+    fprintf(stderr, "%12" PRIu64 " %16" PRIu64 " %16" PRIu64 "  ",
+            stats.calls, stats.self_ticks, stats.total_ticks);
+    if (stats.name)
+      fprintf(stderr, "%s\n", stats.name);
+    else
+      fprintf(stderr, "%x\n", stats.code_offs);
+  }
+}
+
+// Print every native that was called, and how many calls fell in each
+// latency range.
+static void DumpNativeStats(IPluginRuntime* rt)
+{
+  fprintf(stderr, "%12s %16s  %s\n", "calls", "total ticks", "native");
+  for (uint32_t i = 0; i < rt->GetNativesNum(); i++) {
+    sp_native_stats_t stats;
+    if (!rt->GetNativeStats(i, &stats) || !stats.calls)
+      continue;
+    fprintf(stderr, "%12" PRIu64 " %16" PRIu64 "  %s\n", stats.calls, stats.total_ticks, stats.name);
+    for (size_t bucket = 0; bucket < SP_NATIVE_STATS_BUCKETS; bucket++) {
+      if (stats.histogram[bucket])
+        fprintf(stderr, "%12" PRIu64 "   < 2^%d ticks\n", stats.histogram[bucket], int(bucket + 1));
+    }
+  }
+}
+
 static int Execute(const char* file)
 {
   char error[255];
@@ -193,25 +678,14 @@ static int Execute(const char* file)
     return 1;
   }
 
-  PluginRuntime* rt = PluginRuntime::FromAPI(rtb);
+  sPluginFile = file;
+  BindShellNatives(PluginRuntime::FromAPI(rtb));
 
-  rt->InstallBuiltinNatives();
-  BindNative(rt, "print", Print);
-  BindNative(rt, "printnum", PrintNum);
-  BindNative(rt, "printnums", PrintNums);
-  BindNative(rt, "printfloat", PrintFloat);
-  BindNative(rt, "writefloat", WriteFloat);
-  BindNative(rt, "donothing", DoNothing);
-  BindNative(rt, "execute", DoExecute);
-  BindNative(rt, "invoke", DoInvoke);
-  BindNative(rt, "dump_stack_trace", DumpStackTrace);
-  BindNative(rt, "report_error", ReportError);
-
-  IPluginFunction* fun = rt->GetFunctionByName("main");
+  IPluginFunction* fun = rtb->GetFunctionByName("main");
   if (!fun)
     return 0;
 
-  IPluginContext* cx = rt->GetDefaultContext();
+  IPluginContext* cx = rtb->GetDefaultContext();
 
   int result;
   {
@@ -222,9 +696,50 @@ static int Execute(const char* file)
     }
   }
 
+  if (sEnv->IsCallStatsEnabled())
+    DumpCallStats(rtb);
+  if (sEnv->IsNativeStatsEnabled())
+    DumpNativeStats(rtb);
   return result;
 }
 
+static INativeRegistry*
+CreateShellNatives()
+{
+  INativeRegistry* natives = sEnv->APIv2()->CreateNativeRegistry();
+  if (!natives)
+    return nullptr;
+  natives->AddNative("print", Print, SP_NTVFLAG_LEAF, nullptr);
+  natives->AddNative("printnum", PrintNum, SP_NTVFLAG_LEAF, nullptr);
+  natives->AddNative("printnums", PrintNums, 0, nullptr);
+  natives->AddNative("printfloat", PrintFloat, SP_NTVFLAG_LEAF, nullptr);
+  natives->AddNative("writefloat", WriteFloat, SP_NTVFLAG_LEAF, nullptr);
+  natives->AddNative("donothing", DoNothing, SP_NTVFLAG_LEAF, nullptr);
+  natives->AddNative("execute", DoExecute, 0, nullptr);
+  natives->AddNative("invoke", DoInvoke, 0, nullptr);
+  natives->AddNative("invoke_bound", DoInvokeBound, 0, nullptr);
+  natives->AddNative("dump_stack_trace", DumpStackTrace, 0, nullptr);
+  natives->AddNative("dispatch", DoDispatch, 0, nullptr);
+  natives->AddNative("report_error", ReportError, 0, nullptr);
+  natives->AddNative("call_fails", DoCallFails, 0, nullptr);
+  natives->AddNative("find_by_hash", DoFindByHash, 0, nullptr);
+  natives->AddNative("list_unbound_natives", ListUnboundNatives, 0, nullptr);
+  natives->AddNative("reset_copy", DoResetCopy, 0, nullptr);
+  natives->AddNative("run_isolated", DoRunIsolated, 0, nullptr);
+  natives->AddNative("load_batch", DoLoadBatch, 0, nullptr);
+  natives->AddNative("sample_stack", DoSampleStack, 0, nullptr);
+  natives->AddNative("count_calls", DoCountCalls, 0, nullptr);
+  natives->AddNative("count_native_calls", DoCountNativeCalls, 0, nullptr);
+  return natives;
+}
+
+static void
+BindShellNatives(PluginRuntime* rt)
+{
+  rt->InstallBuiltinNatives();
+  Environment::get()->APIv2()->BindNatives(rt, sNatives, nullptr, 0);
+}
+
 int main(int argc, char** argv)
 {
 #ifdef __EMSCRIPTEN__
@@ -243,6 +758,50 @@ int main(int argc, char** argv)
     "i", "disable-jit",
     Some(false),
     "Disable the just-in-time compiler.");
+  BoolOption disable_threaded_interp(parser,
+    "t", "disable-threaded-interp",
+    Some(false),
+    "Use the legacy interpreter instead of the threaded interpreter.");
+  IntOption jit_threshold(parser,
+    "j", "jit-threshold",
+    Maybe<int>(),
+    "Number of calls and loop iterations before a function is compiled (0 = always).");
+  IntOption compile_threads(parser,
+    "c", "compile-threads",
+    Maybe<int>(),
+    "Compile every function ahead of time on this many background threads.");
+  StringOption code_cache(parser,
+    "k", "code-cache",
+    Maybe<const char*>(),
+    "Cache compiled code in this directory, and reuse it on later runs.");
+  BoolOption reserve_memory(parser,
+    "m", "reserve-memory",
+    Some(false),
+    "Reserve plugin memory with guard pages, and commit it as it is used.");
+  BoolOption unchecked_memory(parser,
+    "u", "unchecked-memory",
+    Some(false),
+    "Let compiled code skip address checks, and catch bad addresses with guard pages.");
+  BoolOption perf_map(parser,
+    "p", "perf-map",
+    Some(false),
+    "Name compiled functions for perf in /tmp/perf-<pid>.map.");
+  BoolOption jitdump(parser,
+    "d", "jitdump",
+    Some(false),
+    "Write compiled functions and their lines for perf to jit-<pid>.dump.");
+  BoolOption gdb_jit(parser,
+    "g", "gdb-jit",
+    Some(false),
+    "Describe compiled functions to gdb, with their lines and frames.");
+  BoolOption call_stats(parser,
+    "s", "call-stats",
+    Some(false),
+    "Count calls to each function, and print them by self time when main returns.");
+  BoolOption native_stats(parser,
+    "n", "native-stats",
+    Some(false),
+    "Count calls to each native, and print them with their latencies when main returns.");
   BoolOption disable_watchdog(parser,
     "w", "disable-watchdog",
     Some(false),
@@ -276,6 +835,54 @@ int main(int argc, char** argv)
 
   if (getenv("DISABLE_JIT") || disable_jit.value())
     sEnv->SetJitEnabled(false);
+  if (disable_threaded_interp.value())
+    sEnv->SetThreadedInterpEnabled(false);
+  if (jit_threshold.hasValue())
+    sEnv->SetJitThreshold(jit_threshold.value());
+  if (compile_threads.hasValue() && !sEnv->SetCompileThreads(compile_threads.value())) {
+    fprintf(stderr, "Could not start compiler threads\n");
+    return 1;
+  }
+
+  if (code_cache.hasValue() && !sEnv->SetCodeCacheDirectory(code_cache.value().chars())) {
+    fprintf(stderr, "Could not use code cache directory\n");
+    return 1;
+  }
+
+  if (reserve_memory.value() && !sEnv->SetReservedMemoryEnabled(true)) {
+    fprintf(stderr, "Could not reserve plugin memory on this platform\n");
+    return 1;
+  }
+
+  if (unchecked_memory.value() && !sEnv->SetUncheckedMemoryEnabled(true)) {
+    fprintf(stderr, "Could not skip address checks on this platform\n");
+    return 1;
+  }
+
+  uint32_t perf_outputs = 0;
+  if (perf_map.value())
+    perf_outputs |= SP_PERF_MAP;
+  if (jitdump.value())
+    perf_outputs |= SP_PERF_JITDUMP;
+  if (perf_outputs && !sEnv->SetPerfOutputs(perf_outputs)) {
+    fprintf(stderr, "Could not write perf outputs on this platform\n");
+    return 1;
+  }
+
+  if (gdb_jit.value() && !sEnv->SetGdbJitEnabled(true)) {
+    fprintf(stderr, "Could not describe code to gdb on this platform\n");
+    return 1;
+  }
+
+  if (call_stats.value() && !sEnv->SetCallStatsEnabled(true)) {
+    fprintf(stderr, "Could not count calls with a code cache\n");
+    return 1;
+  }
+
+  if (native_stats.value() && !sEnv->SetNativeStatsEnabled(true)) {
+    fprintf(stderr, "Could not count native calls with a code cache\n");
+    return 1;
+  }
 
   ShellDebugListener debug;
   sEnv->SetDebugger(&debug);
@@ -283,8 +890,14 @@ int main(int argc, char** argv)
   if (!getenv("DISABLE_WATCHDOG") && !disable_watchdog.value())
     sEnv->InstallWatchdogTimer(5000);
 
+  if ((sNatives = CreateShellNatives()) == nullptr) {
+    fprintf(stderr, "Could not create native registry\n");
+    return 1;
+  }
+
   int errcode = Execute(filename.value().chars());
 
+  sEnv->APIv2()->DestroyNativeRegistry(sNatives);
   sEnv->SetDebugger(NULL);
   sEnv->Shutdown();
   delete sEnv;
@@ -16,6 +16,7 @@
 #include "stack-frames.h"
 #include "compiled-function.h"
 #include "method-info.h"
+#include "threaded-interpreter.h"
 #if defined(KE_ARCH_X86)
 # include "x86/frames-x86.h"
 #elif defined(KE_ARCH_X64)
@@ -47,8 +48,25 @@ InterpInvokeFrame::InterpInvokeFrame(PluginContext* cx,
                                      const cell_t* const& cip)
  : InvokeFrame(cx, method->pcode_offset()),
    method_(method),
-   cip_(cip),
-   native_index_(-1)
+   cip_(&cip),
+   pc_(nullptr),
+   calls_(nullptr),
+   native_index_(-1),
+   replaced_(false)
+{
+}
+
+InterpInvokeFrame::InterpInvokeFrame(PluginContext* cx,
+                                     MethodInfo* method,
+                                     const ThreadedSlot* const& pc,
+                                     const ke::Vector<InterpCallFrame>* calls)
+ : InvokeFrame(cx, method->pcode_offset()),
+   method_(method),
+   cip_(nullptr),
+   pc_(&pc),
+   calls_(calls),
+   native_index_(-1),
+   replaced_(false)
 {
 }
 
@@ -83,25 +101,35 @@ JitInvokeFrame::~JitInvokeFrame()
 }
 
 InterpFrameIterator::InterpFrameIterator(InterpInvokeFrame* ivk)
- : ivk_(ivk)
+ : ivk_(ivk),
+   depth_(ivk->inlineCallers())
 {
   if (ivk_->native_index_ != -1)
     current_ = FrameType::Native;
   else
     current_ = FrameType::Scripted;
+
+  // The innermost frame was replaced through OSR, so start at its caller.
+  if (ivk_->replaced()) {
+    assert(depth_ > 0);
+    depth_--;
+  }
 }
 
 bool
 InterpFrameIterator::done() const
 {
-  return current_ == FrameType::Scripted;
+  return current_ == FrameType::Scripted && depth_ == 0;
 }
 
 void
 InterpFrameIterator::next()
 {
   assert(!done());
-  current_ = FrameType::Scripted;
+  if (current_ == FrameType::Native)
+    current_ = FrameType::Scripted;
+  else
+    depth_--;
 }
 
 FrameType
@@ -114,6 +142,8 @@ cell_t
 InterpFrameIterator::function_cip() const
 {
   assert(current_ == FrameType::Scripted);
+  if (depth_ < ivk_->inlineCallers())
+    return ivk_->calls_->at(depth_).method->pcode_offset();
   return ivk_->method_->pcode_offset();
 }
 
@@ -121,9 +151,16 @@ cell_t
 InterpFrameIterator::cip() const
 {
   assert(current_ == FrameType::Scripted);
+  if (depth_ < ivk_->inlineCallers()) {
+    const InterpCallFrame& frame = ivk_->calls_->at(depth_);
+    return frame.method->threaded()->FindCipByPc(frame.pc);
+  }
+  if (ivk_->pc_)
+    return ivk_->method_->threaded()->FindCipByPc(*ivk_->pc_);
+
   auto& code = ivk_->cx()->runtime()->code();
 
-  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(ivk_->cip_);
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(*ivk_->cip_);
   assert(ptr >= code.bytes && ptr < code.bytes + code.length);
 
   return ptr - code.bytes;
@@ -230,6 +267,16 @@ FrameIterator::FrameIterator()
 void
 FrameIterator::nextInvokeFrame()
 {
+  // Skip interpreter frames that were replaced through OSR. Their JIT frames
+  // have already been walked.
+  while (InterpInvokeFrame* ivk = ivk_->AsInterpInvokeFrame()) {
+    if (!ivk->replaced() || ivk->inlineCallers())
+      break;
+    ivk_ = ivk_->prev();
+    if (!ivk_)
+      return;
+  }
+
   runtime_ = ivk_->cx()->runtime();
   if (JitInvokeFrame* jvk = ivk_->AsJitInvokeFrame()) {
     frame_cursor_ = new JitFrameIterator(runtime_, next_exit_fp_);
@@ -19,6 +19,7 @@
 #include <amtl/am-autoptr.h>
 #include <amtl/am-platform.h>
 #include <amtl/am-refcounting.h>
+#include <amtl/am-vector.h>
 #include <amtl/am-enum.h>
 #if defined(KE_ARCH_X86)
 # include "x86/frames-x86.h"
@@ -79,6 +80,15 @@ static inline uintptr_t GetExitFramePayload(uintptr_t stack_val)
 
 class JitInvokeFrame;
 class InterpInvokeFrame;
+union ThreadedSlot;
+
+// A scripted frame that the threaded interpreter has suspended to run one of
+// its callees inline, rather than recursing. |pc| is the CALL instruction.
+struct InterpCallFrame
+{
+  MethodInfo* method;
+  const ThreadedSlot* pc;
+};
 
 // An InvokeFrame represents one activation of Execute2().
 class InvokeFrame
@@ -121,19 +131,55 @@ class InterpInvokeFrame final : public InvokeFrame
   InterpInvokeFrame(PluginContext* cx,
                     MethodInfo* method,
                     const cell_t* const& cip);
+  // For methods running from their pre-decoded form, where |pc| is mapped
+  // back to a cip on demand. |calls| holds the frames of any callers that
+  // were entered inline, innermost last.
+  InterpInvokeFrame(PluginContext* cx,
+                    MethodInfo* method,
+                    const ThreadedSlot* const& pc,
+                    const ke::Vector<InterpCallFrame>* calls);
   ~InterpInvokeFrame();
 
   void enterNativeCall(uint32_t native_index);
   void leaveNativeCall();
 
+  // Called when the threaded interpreter enters or returns to a method
+  // inline, so the innermost frame reports the right method.
+  void setMethod(MethodInfo* method) {
+    method_ = method;
+  }
+
+  // Called when the innermost frame continues in compiled code through an
+  // OSR entry. The JIT frame then stands in for it, so it no longer appears
+  // in stack walks. Once it returns to an inline caller, the interpreter
+  // resumes.
+  void replaceWithJit() {
+    replaced_ = true;
+  }
+  void resume() {
+    replaced_ = false;
+  }
+  bool replaced() const {
+    return replaced_;
+  }
+
+  size_t inlineCallers() const {
+    return calls_ ? calls_->length() : 0;
+  }
+
   InterpInvokeFrame* AsInterpInvokeFrame() override {
     return this;
   }
 
  private:
-  ke::RefPtr<MethodInfo> method_;
-  const cell_t* const& cip_;
+  // Methods live as long as their runtime, so this need not hold a
+  // reference.
+  MethodInfo* method_;
+  const cell_t* const* cip_;
+  const ThreadedSlot* const* pc_;
+  const ke::Vector<InterpCallFrame>* calls_;
   int native_index_;
+  bool replaced_;
 };
 
 // JIT frames are always contained within JitInvokeFrame.
@@ -186,6 +232,10 @@ class InterpFrameIterator final : public InlineFrameIterator
  private:
   InterpInvokeFrame* ivk_;
   FrameType current_;
+
+  // The number of frames left after the current scripted frame. The
+  // innermost frame has one for every inline caller.
+  size_t depth_;
 };
 
 class JitFrameIterator final : public InlineFrameIterator
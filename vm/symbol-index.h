@@ -0,0 +1,86 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _include_sourcepawn_vm_symbol_index_h_
+#define _include_sourcepawn_vm_symbol_index_h_
+
+#include <stdint.h>
+#include <string.h>
+#include <amtl/am-hashmap.h>
+
+namespace sp {
+
+// Maps the names in one of an image's symbol tables (natives, publics or
+// pubvars) to their indexes. Names are not copied; they must live as long
+// as the index, which is true of anything in the image's name table.
+class SymbolIndex
+{
+ public:
+  // The hash exposed through ISourcePawnEngine2::HashSymbolName(). Hosts
+  // may keep these, so it must not change within an API version.
+  static uint32_t Hash(const char* name) {
+    return ke::FastHashCharSequence(name, strlen(name));
+  }
+
+  bool init(size_t count) {
+    // Keep the table at most half full, so lookups rarely probe.
+    uint32_t capacity = 16;
+    while (capacity < count * 2)
+      capacity *= 2;
+    return map_.init(capacity);
+  }
+
+  // If a name appears more than once, the first index is kept, so that
+  // lookups agree with a linear scan of the table.
+  bool add(const char* name, uint32_t index) {
+    Key key = { name, Hash(name) };
+    Map::Insert p = map_.findForAdd(key);
+    if (p.found())
+      return true;
+    return map_.add(p, name, index);
+  }
+
+  bool find(const char* name, uint32_t hash, uint32_t* indexp) {
+    Key key = { name, hash };
+    Map::Result r = map_.find(key);
+    if (!r.found())
+      return false;
+    if (indexp)
+      *indexp = r->value;
+    return true;
+  }
+
+ private:
+  struct Key {
+    const char* name;
+    uint32_t hash;
+  };
+  struct Policy {
+    static inline uint32_t hash(const Key& key) {
+      return key.hash;
+    }
+    static inline bool matches(const Key& key, const char* name) {
+      return strcmp(key.name, name) == 0;
+    }
+  };
+  typedef ke::HashMap<const char*, uint32_t, Policy> Map;
+
+  Map map_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_symbol_index_h_
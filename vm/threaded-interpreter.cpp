@@ -0,0 +1,1705 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "threaded-interpreter.h"
+#include "call-stats.h"
+#include "debugging.h"
+#include "environment.h"
+#include "method-info.h"
+#include "plugin-context.h"
+#include "plugin-runtime.h"
+#include "pcode-visitor.h"
+#include "pcode-reader.h"
+#include "runtime-helpers.h"
+#include "stack-frames.h"
+#include "watchdog_timer.h"
+#if defined(SP_HAS_JIT)
+# include "compiled-function.h"
+# include "jit.h"
+#endif
+#include <amtl/am-float.h>
+#include <amtl/am-vector.h>
+#include <fenv.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace sp {
+
+// Handlers are specialized by register wherever the pcode has separate
+// PRI/ALT forms, so none of them need to branch on an operand to find out
+// what to do. Branches that jump backwards have a _BACK variant which also
+// counts the backedge and polls the watchdog timer. These carry the code
+// offset of their target as an extra operand, so a hot loop can be entered
+// in the JIT at the same place.
+#define THREADED_OPS(_)                                                   \
+  _(LOAD_PRI) _(LOAD_ALT) _(LOAD_S_PRI) _(LOAD_S_ALT) _(LREF_S_PRI)       \
+  _(LREF_S_ALT) _(LOAD_I) _(LODB_I) _(CONST_PRI) _(CONST_ALT)             \
+  _(ADDR_PRI) _(ADDR_ALT) _(STOR_PRI) _(STOR_ALT) _(STOR_S_PRI)           \
+  _(STOR_S_ALT) _(SREF_S_PRI) _(SREF_S_ALT) _(STOR_I) _(STRB_I) _(LIDX)   \
+  _(IDXADDR) _(MOVE_PRI) _(MOVE_ALT) _(XCHG) _(PUSH_PRI) _(PUSH_ALT)      \
+  _(PUSH_C) _(PUSH) _(PUSH_S) _(PUSH_ADR) _(POP_PRI) _(POP_ALT) _(STACK)  \
+  _(HEAP) _(RETN) _(CALL) _(JUMP) _(JUMP_BACK) _(JZER) _(JZER_BACK)       \
+  _(JNZ) _(JNZ_BACK) _(JEQ) _(JEQ_BACK) _(JNEQ) _(JNEQ_BACK) _(JSLESS)    \
+  _(JSLESS_BACK) _(JSLEQ) _(JSLEQ_BACK) _(JSGRTR) _(JSGRTR_BACK)         \
+  _(JSGEQ) _(JSGEQ_BACK) _(SHL) _(SHR) _(SSHR) _(SHL_C_PRI) _(SHL_C_ALT)  \
+  _(SMUL) _(SDIV) _(SDIV_ALT) _(ADD) _(SUB) _(SUB_ALT) _(AND) _(OR)       \
+  _(XOR) _(NOT) _(NEG) _(INVERT) _(ADD_C) _(SMUL_C) _(ZERO_PRI)           \
+  _(ZERO_ALT) _(ZERO) _(ZERO_S) _(EQ) _(NEQ) _(SLESS) _(SLEQ) _(SGRTR)    \
+  _(SGEQ) _(EQ_C_PRI) _(EQ_C_ALT) _(INC_PRI) _(INC_ALT) _(INC) _(INC_S)   \
+  _(INC_I) _(DEC_PRI) _(DEC_ALT) _(DEC) _(DEC_S) _(DEC_I) _(MOVS) _(FILL) \
+  _(BOUNDS) _(SYSREQ_C) _(SYSREQ_N) _(SWAP_PRI) _(SWAP_ALT) _(LOAD_BOTH)  \
+  _(LOAD_S_BOTH) _(CONST) _(CONST_S) _(TRACKER_PUSH_C)                    \
+  _(TRACKER_POP_SETHEAP) _(GENARRAY) _(STRADJUST_PRI) _(FABS) _(FLOAT)    \
+  _(FLOATADD) _(FLOATSUB) _(FLOATMUL) _(FLOATDIV) _(RND_TO_NEAREST)       \
+  _(RND_TO_FLOOR) _(RND_TO_CEIL) _(RND_TO_ZERO) _(FLOATCMP) _(FLOAT_GT)   \
+  _(FLOAT_GE) _(FLOAT_LE) _(FLOAT_LT) _(FLOAT_EQ) _(FLOAT_NE)             \
+  _(FLOAT_NOT) _(FLOAT_MATH) _(SWITCH) _(SWITCH_TABLE) _(BREAK) _(HALT)   \
+  _(REBASE) _(END)
+
+enum ThreadedOp
+{
+#define _(name) TOP_##name,
+  THREADED_OPS(_)
+#undef _
+  TOTAL_THREADED_OPS
+};
+
+static inline cell_t
+ReadCell(const uint8_t* ptr)
+{
+  cell_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+static inline void
+WriteCell(uint8_t* ptr, cell_t value)
+{
+  memcpy(ptr, &value, sizeof(value));
+}
+
+class ThreadedTranslator final : public PcodeVisitor
+{
+ public:
+  ThreadedTranslator(PluginContext* cx, MethodInfo* method, const void* const* table)
+   : rt_(cx->runtime()),
+     method_(method),
+     table_(table),
+     reader_(rt_, method->pcode_offset(), this),
+     op_cip_(0),
+     oom_(false)
+  {}
+
+  ThreadedCode* translate(int* err);
+
+ public:
+  bool visitBREAK() override {
+    // Like the JIT, we decide this once. It cannot change after plugins
+    // have been loaded.
+    if (Environment::get()->IsDebugBreakEnabled())
+      emit(TOP_BREAK);
+    return true;
+  }
+  bool visitLOAD(PawnReg dest, cell_t srcaddr) override {
+    emit(dest == PawnReg::Pri ? TOP_LOAD_PRI : TOP_LOAD_ALT, srcaddr);
+    return true;
+  }
+  bool visitLOAD_S(PawnReg dest, cell_t srcoffs) override {
+    emit(dest == PawnReg::Pri ? TOP_LOAD_S_PRI : TOP_LOAD_S_ALT, srcoffs);
+    return true;
+  }
+  bool visitLREF_S(PawnReg dest, cell_t srcoffs) override {
+    emit(dest == PawnReg::Pri ? TOP_LREF_S_PRI : TOP_LREF_S_ALT, srcoffs);
+    return true;
+  }
+  bool visitLOAD_I() override {
+    emit(TOP_LOAD_I);
+    return true;
+  }
+  bool visitLODB_I(cell_t width) override {
+    emit(TOP_LODB_I, width);
+    return true;
+  }
+  bool visitCONST(PawnReg dest, cell_t imm) override {
+    emit(dest == PawnReg::Pri ? TOP_CONST_PRI : TOP_CONST_ALT, imm);
+    return true;
+  }
+  bool visitADDR(PawnReg dest, cell_t offset) override {
+    emit(dest == PawnReg::Pri ? TOP_ADDR_PRI : TOP_ADDR_ALT, offset);
+    return true;
+  }
+  bool visitSTOR(cell_t address, PawnReg src) override {
+    emit(src == PawnReg::Pri ? TOP_STOR_PRI : TOP_STOR_ALT, address);
+    return true;
+  }
+  bool visitSTOR_S(cell_t offset, PawnReg src) override {
+    emit(src == PawnReg::Pri ? TOP_STOR_S_PRI : TOP_STOR_S_ALT, offset);
+    return true;
+  }
+  bool visitSREF_S(cell_t offset, PawnReg src) override {
+    emit(src == PawnReg::Pri ? TOP_SREF_S_PRI : TOP_SREF_S_ALT, offset);
+    return true;
+  }
+  bool visitSTOR_I() override {
+    emit(TOP_STOR_I);
+    return true;
+  }
+  bool visitSTRB_I(cell_t width) override {
+    emit(TOP_STRB_I, width);
+    return true;
+  }
+  bool visitLIDX() override {
+    emit(TOP_LIDX);
+    return true;
+  }
+  bool visitIDXADDR() override {
+    emit(TOP_IDXADDR);
+    return true;
+  }
+  bool visitMOVE(PawnReg reg) override {
+    emit(reg == PawnReg::Pri ? TOP_MOVE_PRI : TOP_MOVE_ALT);
+    return true;
+  }
+  bool visitXCHG() override {
+    emit(TOP_XCHG);
+    return true;
+  }
+  bool visitPUSH(PawnReg src) override {
+    emit(src == PawnReg::Pri ? TOP_PUSH_PRI : TOP_PUSH_ALT);
+    return true;
+  }
+  bool visitPUSH_C(const cell_t* vals, size_t nvals) override {
+    emitList(TOP_PUSH_C, vals, nvals);
+    return true;
+  }
+  bool visitPUSH(const cell_t* addresses, size_t nvals) override {
+    emitList(TOP_PUSH, addresses, nvals);
+    return true;
+  }
+  bool visitPUSH_S(const cell_t* offsets, size_t nvals) override {
+    emitList(TOP_PUSH_S, offsets, nvals);
+    return true;
+  }
+  bool visitPUSH_ADR(const cell_t* offsets, size_t nvals) override {
+    emitList(TOP_PUSH_ADR, offsets, nvals);
+    return true;
+  }
+  bool visitPOP(PawnReg dest) override {
+    emit(dest == PawnReg::Pri ? TOP_POP_PRI : TOP_POP_ALT);
+    return true;
+  }
+  bool visitSTACK(cell_t amount) override {
+    emit(TOP_STACK, amount);
+    return true;
+  }
+  bool visitHEAP(cell_t amount) override {
+    emit(TOP_HEAP, amount);
+    return true;
+  }
+  bool visitRETN() override {
+    emit(TOP_RETN);
+    return true;
+  }
+  bool visitCALL(cell_t offset) override {
+    // The runtime owns every MethodInfo it hands out, so the raw pointer
+    // lives as long as this code does. A bad target is reported when the
+    // call actually executes, as the legacy interpreter does.
+    ThreadedSlot slot;
+    slot.method = rt_->AcquireMethod(offset);
+    emit(TOP_CALL);
+    append(slot);
+    return true;
+  }
+  bool visitJUMP(cell_t offset) override {
+    if (offset <= op_cip_) {
+      emit(TOP_JUMP_BACK);
+      emitTarget(offset);
+      emitValue(offset);
+    } else {
+      emit(TOP_JUMP);
+      emitTarget(offset);
+    }
+    return true;
+  }
+  bool visitJcmp(CompareOp op, cell_t offset) override {
+    ThreadedOp top;
+    switch (op) {
+      case CompareOp::Zero:
+        top = TOP_JZER;
+        break;
+      case CompareOp::NotZero:
+        top = TOP_JNZ;
+        break;
+      case CompareOp::Eq:
+        top = TOP_JEQ;
+        break;
+      case CompareOp::Neq:
+        top = TOP_JNEQ;
+        break;
+      case CompareOp::Sless:
+        top = TOP_JSLESS;
+        break;
+      case CompareOp::Sleq:
+        top = TOP_JSLEQ;
+        break;
+      case CompareOp::Sgrtr:
+        top = TOP_JSGRTR;
+        break;
+      case CompareOp::Sgeq:
+        top = TOP_JSGEQ;
+        break;
+      default:
+        assert(false);
+        return false;
+    }
+
+    // Each conditional jump is immediately followed by its _BACK form.
+    if (offset <= op_cip_) {
+      emit(ThreadedOp(top + 1));
+      emitTarget(offset);
+      emitValue(offset);
+    } else {
+      emit(top);
+      emitTarget(offset);
+    }
+    return true;
+  }
+  bool visitSHL() override {
+    emit(TOP_SHL);
+    return true;
+  }
+  bool visitSHR() override {
+    emit(TOP_SHR);
+    return true;
+  }
+  bool visitSSHR() override {
+    emit(TOP_SSHR);
+    return true;
+  }
+  bool visitSHL_C(PawnReg dest, cell_t amount) override {
+    emit(dest == PawnReg::Pri ? TOP_SHL_C_PRI : TOP_SHL_C_ALT, amount);
+    return true;
+  }
+  bool visitSMUL() override {
+    emit(TOP_SMUL);
+    return true;
+  }
+  bool visitSDIV(PawnReg dest) override {
+    emit(dest == PawnReg::Pri ? TOP_SDIV : TOP_SDIV_ALT);
+    return true;
+  }
+  bool visitADD() override {
+    emit(TOP_ADD);
+    return true;
+  }
+  bool visitSUB() override {
+    emit(TOP_SUB);
+    return true;
+  }
+  bool visitSUB_ALT() override {
+    emit(TOP_SUB_ALT);
+    return true;
+  }
+  bool visitAND() override {
+    emit(TOP_AND);
+    return true;
+  }
+  bool visitOR() override {
+    emit(TOP_OR);
+    return true;
+  }
+  bool visitXOR() override {
+    emit(TOP_XOR);
+    return true;
+  }
+  bool visitNOT() override {
+    emit(TOP_NOT);
+    return true;
+  }
+  bool visitNEG() override {
+    emit(TOP_NEG);
+    return true;
+  }
+  bool visitINVERT() override {
+    emit(TOP_INVERT);
+    return true;
+  }
+  bool visitADD_C(cell_t value) override {
+    emit(TOP_ADD_C, value);
+    return true;
+  }
+  bool visitSMUL_C(cell_t value) override {
+    emit(TOP_SMUL_C, value);
+    return true;
+  }
+  bool visitZERO(PawnReg dest) override {
+    emit(dest == PawnReg::Pri ? TOP_ZERO_PRI : TOP_ZERO_ALT);
+    return true;
+  }
+  bool visitZERO(cell_t address) override {
+    emit(TOP_ZERO, address);
+    return true;
+  }
+  bool visitZERO_S(cell_t offset) override {
+    emit(TOP_ZERO_S, offset);
+    return true;
+  }
+  bool visitCompareOp(CompareOp op) override {
+    switch (op) {
+      case CompareOp::Eq:
+        emit(TOP_EQ);
+        break;
+      case CompareOp::Neq:
+        emit(TOP_NEQ);
+        break;
+      case CompareOp::Sless:
+        emit(TOP_SLESS);
+        break;
+      case CompareOp::Sleq:
+        emit(TOP_SLEQ);
+        break;
+      case CompareOp::Sgrtr:
+        emit(TOP_SGRTR);
+        break;
+      case CompareOp::Sgeq:
+        emit(TOP_SGEQ);
+        break;
+      default:
+        assert(false);
+        return false;
+    }
+    return true;
+  }
+  bool visitEQ_C(PawnReg src, cell_t value) override {
+    emit(src == PawnReg::Pri ? TOP_EQ_C_PRI : TOP_EQ_C_ALT, value);
+    return true;
+  }
+  bool visitINC(PawnReg dest) override {
+    emit(dest == PawnReg::Pri ? TOP_INC_PRI : TOP_INC_ALT);
+    return true;
+  }
+  bool visitINC(cell_t address) override {
+    emit(TOP_INC, address);
+    return true;
+  }
+  bool visitINC_S(cell_t offset) override {
+    emit(TOP_INC_S, offset);
+    return true;
+  }
+  bool visitINC_I() override {
+    emit(TOP_INC_I);
+    return true;
+  }
+  bool visitDEC(PawnReg dest) override {
+    emit(dest == PawnReg::Pri ? TOP_DEC_PRI : TOP_DEC_ALT);
+    return true;
+  }
+  bool visitDEC(cell_t address) override {
+    emit(TOP_DEC, address);
+    return true;
+  }
+  bool visitDEC_S(cell_t offset) override {
+    emit(TOP_DEC_S, offset);
+    return true;
+  }
+  bool visitDEC_I() override {
+    emit(TOP_DEC_I);
+    return true;
+  }
+  bool visitMOVS(uint32_t amount) override {
+    emit(TOP_MOVS, amount);
+    return true;
+  }
+  bool visitFILL(uint32_t amount) override {
+    emit(TOP_FILL, amount);
+    return true;
+  }
+  bool visitBOUNDS(uint32_t limit) override {
+    emit(TOP_BOUNDS, limit);
+    return true;
+  }
+  bool visitSYSREQ_C(uint32_t native_index) override {
+    emitNative(TOP_SYSREQ_C, native_index);
+    return true;
+  }
+  bool visitSYSREQ_N(uint32_t native_index, uint32_t nparams) override {
+    emitNative(TOP_SYSREQ_N, native_index);
+    emitValue(nparams);
+    return true;
+  }
+  bool visitSWAP(PawnReg dest) override {
+    emit(dest == PawnReg::Pri ? TOP_SWAP_PRI : TOP_SWAP_ALT);
+    return true;
+  }
+  bool visitLOAD_BOTH(cell_t addressForPri, cell_t addressForAlt) override {
+    emit(TOP_LOAD_BOTH, addressForPri);
+    emitValue(addressForAlt);
+    return true;
+  }
+  bool visitLOAD_S_BOTH(cell_t offsetForPri, cell_t offsetForAlt) override {
+    emit(TOP_LOAD_S_BOTH, offsetForPri);
+    emitValue(offsetForAlt);
+    return true;
+  }
+  bool visitCONST(cell_t address, cell_t value) override {
+    emit(TOP_CONST, address);
+    emitValue(value);
+    return true;
+  }
+  bool visitCONST_S(cell_t offset, cell_t value) override {
+    emit(TOP_CONST_S, offset);
+    emitValue(value);
+    return true;
+  }
+  bool visitTRACKER_PUSH_C(cell_t amount) override {
+    emit(TOP_TRACKER_PUSH_C, amount);
+    return true;
+  }
+  bool visitTRACKER_POP_SETHEAP() override {
+    emit(TOP_TRACKER_POP_SETHEAP);
+    return true;
+  }
+  bool visitGENARRAY(uint32_t dims, bool autozero) override {
+    emit(TOP_GENARRAY, dims);
+    emitValue(autozero ? 1 : 0);
+    return true;
+  }
+  bool visitSTRADJUST_PRI() override {
+    emit(TOP_STRADJUST_PRI);
+    return true;
+  }
+  bool visitFABS() override {
+    emit(TOP_FABS);
+    return true;
+  }
+  bool visitFLOAT() override {
+    emit(TOP_FLOAT);
+    return true;
+  }
+  bool visitFLOATADD() override {
+    emit(TOP_FLOATADD);
+    return true;
+  }
+  bool visitFLOATSUB() override {
+    emit(TOP_FLOATSUB);
+    return true;
+  }
+  bool visitFLOATMUL() override {
+    emit(TOP_FLOATMUL);
+    return true;
+  }
+  bool visitFLOATDIV() override {
+    emit(TOP_FLOATDIV);
+    return true;
+  }
+  bool visitRND_TO_NEAREST() override {
+    emit(TOP_RND_TO_NEAREST);
+    return true;
+  }
+  bool visitRND_TO_FLOOR() override {
+    emit(TOP_RND_TO_FLOOR);
+    return true;
+  }
+  bool visitRND_TO_CEIL() override {
+    emit(TOP_RND_TO_CEIL);
+    return true;
+  }
+  bool visitRND_TO_ZERO() override {
+    emit(TOP_RND_TO_ZERO);
+    return true;
+  }
+  bool visitFLOATCMP() override {
+    emit(TOP_FLOATCMP);
+    return true;
+  }
+  bool visitFLOAT_CMP_OP(CompareOp op) override {
+    switch (op) {
+      case CompareOp::Sgrtr:
+        emit(TOP_FLOAT_GT);
+        break;
+      case CompareOp::Sgeq:
+        emit(TOP_FLOAT_GE);
+        break;
+      case CompareOp::Sleq:
+        emit(TOP_FLOAT_LE);
+        break;
+      case CompareOp::Sless:
+        emit(TOP_FLOAT_LT);
+        break;
+      case CompareOp::Eq:
+        emit(TOP_FLOAT_EQ);
+        break;
+      case CompareOp::Neq:
+        emit(TOP_FLOAT_NE);
+        break;
+      default:
+        assert(false);
+        return false;
+    }
+    return true;
+  }
+  bool visitFLOAT_NOT() override {
+    emit(TOP_FLOAT_NOT);
+    return true;
+  }
+  bool visitFLOAT_MATH(FloatMathOp op) override {
+    emit(TOP_FLOAT_MATH, cell_t(op));
+    return true;
+  }
+  bool visitSWITCH(cell_t defaultOffset, const CaseTableEntry* cases, size_t ncases) override;
+  bool visitHALT(cell_t value) override {
+    emit(TOP_HALT);
+    return true;
+  }
+  bool visitREBASE(cell_t addr, cell_t iv_size, cell_t data_size) override {
+    emit(TOP_REBASE, addr);
+    emitValue(iv_size);
+    emitValue(data_size);
+    return true;
+  }
+
+ private:
+  void append(const ThreadedSlot& slot) {
+    if (!code_.append(slot))
+      oom_ = true;
+  }
+  void emit(ThreadedOp op) {
+    ThreadedSlot slot;
+    if (table_)
+      slot.handler = table_[op];
+    else
+      slot.handler = reinterpret_cast<const void*>(uintptr_t(op));
+    append(slot);
+  }
+  void emit(ThreadedOp op, cell_t operand) {
+    emit(op);
+    emitValue(operand);
+  }
+  void emitValue(cell_t value) {
+    ThreadedSlot slot;
+    slot.value = value;
+    append(slot);
+  }
+  void emitList(ThreadedOp op, const cell_t* vals, size_t nvals) {
+    emit(op, cell_t(nvals));
+    for (size_t i = 0; i < nvals; i++)
+      emitValue(vals[i]);
+  }
+  void emitTarget(cell_t offset) {
+    // Targets are recorded as code offsets, and resolved to slots once the
+    // whole method has been translated.
+    if (!jumps_.append(code_.length()))
+      oom_ = true;
+    emitValue(offset);
+  }
+  void emitNative(ThreadedOp op, uint32_t native_index) {
+    emit(op);
+    ThreadedSlot slot;
+    slot.native = rt_->NativeAt(native_index);
+    append(slot);
+    emitValue(native_index);
+  }
+
+  bool resolve(ThreadedSlot* code, ThreadedSlot* slot);
+
+ private:
+  PluginRuntime* rt_;
+  MethodInfo* method_;
+  const void* const* table_;
+  PcodeReader<ThreadedTranslator> reader_;
+  cell_t op_cip_;
+  bool oom_;
+  ke::Vector<ThreadedSlot> code_;
+  ke::Vector<CipMapEntry> cip_map_;
+  ke::Vector<size_t> jumps_;
+};
+
+bool
+ThreadedTranslator::visitSWITCH(cell_t defaultOffset, const CaseTableEntry* cases, size_t ncases)
+{
+  // Case values are sorted. If they are also contiguous, index straight into
+  // a table of targets instead of searching.
+  bool sequential = ncases > 0;
+  for (size_t i = 1; i < ncases; i++) {
+    if (cases[i].value != cases[i - 1].value + 1) {
+      sequential = false;
+      break;
+    }
+  }
+
+  if (sequential) {
+    emit(TOP_SWITCH_TABLE, cases[0].value);
+    emitValue(cell_t(ncases));
+    emitTarget(defaultOffset);
+    for (size_t i = 0; i < ncases; i++)
+      emitTarget(cases[i].address);
+    return true;
+  }
+
+  emit(TOP_SWITCH, cell_t(ncases));
+  emitTarget(defaultOffset);
+  for (size_t i = 0; i < ncases; i++) {
+    emitValue(cases[i].value);
+    emitTarget(cases[i].address);
+  }
+  return true;
+}
+
+ThreadedCode*
+ThreadedTranslator::translate(int* err)
+{
+  assert(reader_.peekOpcode() == OP_PROC);
+  reader_.begin();
+
+  cell_t base = method_->pcode_offset();
+  while (reader_.more()) {
+    if (reader_.peekOpcode() == OP_PROC || reader_.peekOpcode() == OP_ENDPROC)
+      break;
+
+    // Instructions that translate to nothing (NOP, CASETBL) share a slot with
+    // whatever comes next, so only the last cip for each slot is kept.
+    op_cip_ = reader_.cip_offset();
+    CipMapEntry entry;
+    entry.cipoffs = op_cip_ - base;
+    entry.pcoffs = code_.length();
+    if (!cip_map_.empty() && cip_map_.back().pcoffs == entry.pcoffs)
+      cip_map_.back() = entry;
+    else if (!cip_map_.append(entry))
+      oom_ = true;
+
+    if (!reader_.visitNext()) {
+      *err = SP_ERROR_INVALID_INSTRUCTION;
+      return nullptr;
+    }
+  }
+
+  // Falling off the end of a method returns 0, as in the legacy interpreter.
+  CipMapEntry entry;
+  entry.cipoffs = reader_.cip_offset() - base;
+  entry.pcoffs = code_.length();
+  if (!cip_map_.empty() && cip_map_.back().pcoffs == entry.pcoffs)
+    cip_map_.back() = entry;
+  else if (!cip_map_.append(entry))
+    oom_ = true;
+  emit(TOP_END);
+
+  if (oom_) {
+    *err = SP_ERROR_OUT_OF_MEMORY;
+    return nullptr;
+  }
+
+  AutoPtr<FixedArray<ThreadedSlot>> code(new FixedArray<ThreadedSlot>(code_.length()));
+  AutoPtr<FixedArray<CipMapEntry>> cip_map(new FixedArray<CipMapEntry>(cip_map_.length()));
+  memcpy(code->buffer(), code_.buffer(), code_.length() * sizeof(ThreadedSlot));
+  memcpy(cip_map->buffer(), cip_map_.buffer(), cip_map_.length() * sizeof(CipMapEntry));
+
+  for (size_t i = 0; i < jumps_.length(); i++) {
+    if (!resolve(code->buffer(), &code->at(jumps_[i]))) {
+      *err = SP_ERROR_INVALID_INSTRUCTION;
+      return nullptr;
+    }
+  }
+
+  return new ThreadedCode(base, code.take(), cip_map.take());
+}
+
+bool
+ThreadedTranslator::resolve(ThreadedSlot* code, ThreadedSlot* slot)
+{
+  // The cip map is in code order, so find the first instruction at or after
+  // the target. This also steps over instructions with no translation.
+  uint32_t cipoffs = uint32_t(cell_t(slot->value) - method_->pcode_offset());
+  size_t lo = 0;
+  size_t hi = cip_map_.length();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cip_map_[mid].cipoffs < cipoffs)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == cip_map_.length())
+    return false;
+
+  slot->target = &code[cip_map_[lo].pcoffs];
+  return true;
+}
+
+ThreadedCode::ThreadedCode(cell_t pcode_offs,
+                           FixedArray<ThreadedSlot>* code,
+                           FixedArray<CipMapEntry>* cip_map)
+ : code_offset_(pcode_offs),
+   code_(code),
+   cip_map_(cip_map)
+{
+}
+
+ThreadedCode*
+ThreadedCode::Translate(PluginContext* cx, MethodInfo* method, int* err)
+{
+  ThreadedTranslator translator(cx, method, ThreadedInterpreter::DispatchTable());
+  return translator.translate(err);
+}
+
+static int cip_map_entry_cmp(const void* a1, const void* aEntry)
+{
+  uint32_t pcoffs = (uint32_t)(intptr_t)a1;
+  const CipMapEntry* entry = reinterpret_cast<const CipMapEntry*>(aEntry);
+  if (pcoffs < entry->pcoffs)
+    return -1;
+  if (pcoffs == entry->pcoffs)
+    return 0;
+  return 1;
+}
+
+ucell_t
+ThreadedCode::FindCipByPc(const ThreadedSlot* pc) const
+{
+  if (pc < code_->buffer() || pc >= code_->buffer() + code_->length())
+    return kInvalidCip;
+
+  uint32_t pcoffs = uint32_t(pc - code_->buffer());
+  void* ptr = bsearch(
+    (void*)(uintptr_t)pcoffs,
+    cip_map_->buffer(),
+    cip_map_->length(),
+    sizeof(CipMapEntry),
+    cip_map_entry_cmp);
+  assert(ptr);
+
+  if (!ptr) {
+    // Shouldn't happen, but fail gracefully.
+    return kInvalidCip;
+  }
+
+  return code_offset_ + reinterpret_cast<CipMapEntry*>(ptr)->cipoffs;
+}
+
+// Validate and translate a method the first time it is interpreted. Once it
+// has threaded code, it is known to be valid.
+static int
+PrepareMethod(PluginContext* cx, MethodInfo* method)
+{
+  if (method->threaded())
+    return SP_ERROR_NONE;
+
+  int err = method->Validate();
+  if (err != SP_ERROR_NONE)
+    return err;
+
+  ThreadedCode* code = ThreadedCode::Translate(cx, method, &err);
+  if (!code)
+    return err;
+  method->setThreadedCode(code);
+  return SP_ERROR_NONE;
+}
+
+// The method is compiled once its invocations and backedges together reach
+// the JIT threshold, so work out how many backedges that leaves.
+static inline uint32_t
+OsrBackedges(Environment* env, MethodInfo* method)
+{
+  if (!env->IsJitEnabled() || method->isJitRefused())
+    return UINT32_MAX;
+
+  uint32_t threshold = env->jit_threshold();
+  uint32_t invocations = method->invocation_count();
+  return threshold > invocations ? threshold - invocations : 0;
+}
+
+bool
+ThreadedInterpreter::Run(PluginContext* cx, MethodInfo* method, cell_t* rval)
+{
+  int err = PrepareMethod(cx, method);
+  if (err != SP_ERROR_NONE) {
+    cx->ReportErrorNumber(err);
+    return false;
+  }
+
+  return Execute(cx, method, rval, nullptr);
+}
+
+const void* const*
+ThreadedInterpreter::DispatchTable()
+{
+  const void* const* table = nullptr;
+  Execute(nullptr, nullptr, nullptr, &table);
+  return table;
+}
+
+#if defined(SP_THREADED_COMPUTED_GOTO)
+# define CASE(name)   op_##name
+# define DISPATCH()   goto *pc->handler
+#else
+# define CASE(name)   case TOP_##name
+# define DISPATCH()   goto dispatch
+#endif
+
+#define NEXT(n)                                                           \
+  do {                                                                    \
+    pc += (n);                                                            \
+    DISPATCH();                                                           \
+  } while (0)
+
+#define OPERAND(n)    cell_t(pc[n].value)
+
+#define THROW(code)                                                       \
+  do {                                                                    \
+    err = (code);                                                         \
+    goto error;                                                           \
+  } while (0)
+
+// sp, hp and frm live in locals while running, and are written back to the
+// context before anything that might look at them.
+#define SYNC()                                                            \
+  do {                                                                    \
+    *cx->addressOfSp() = sp;                                              \
+    *cx->addressOfHp() = hp;                                              \
+    *cx->addressOfFrm() = frm;                                            \
+  } while (0)
+#define RELOAD()                                                          \
+  do {                                                                    \
+    sp = cx->sp();                                                        \
+    hp = cx->hp();                                                        \
+    frm = cx->frm();                                                      \
+  } while (0)
+
+// These mirror the checks in PluginContext, and raise the same errors.
+#define CHECK_ADDRESS(a)                                                  \
+  do {                                                                    \
+    if ((a) < 0 || ((a) >= hp && (a) < sp) || (a) >= stp)                \
+      THROW(SP_ERROR_INVALID_ADDRESS);                                    \
+  } while (0)
+#define CHECK_RANGE(a, bytes)                                             \
+  do {                                                                    \
+    CHECK_ADDRESS(a);                                                     \
+    if (bytes) {                                                          \
+      addr = (a) + (bytes) - 1;                                           \
+      CHECK_ADDRESS(addr);                                                \
+    }                                                                     \
+  } while (0)
+#define PUSH(v)                                                           \
+  do {                                                                    \
+    if (sp <= cell_t(hp + sizeof(cell_t)))                                \
+      THROW(SP_ERROR_STACKLOW);                                           \
+    sp -= sizeof(cell_t);                                                 \
+    WriteCell(mem + sp, (v));                                             \
+  } while (0)
+#define POP(out)                                                          \
+  do {                                                                    \
+    if (sp >= stp)                                                        \
+      THROW(SP_ERROR_STACKMIN);                                           \
+    (out) = ReadCell(mem + sp);                                           \
+    sp += sizeof(cell_t);                                                 \
+  } while (0)
+#define LOAD_CELL(a, out)                                                 \
+  do {                                                                    \
+    addr = (a);                                                           \
+    CHECK_ADDRESS(addr);                                                  \
+    (out) = ReadCell(mem + addr);                                         \
+  } while (0)
+#define STORE_CELL(a, v)                                                  \
+  do {                                                                    \
+    addr = (a);                                                           \
+    CHECK_ADDRESS(addr);                                                  \
+    WriteCell(mem + addr, (v));                                           \
+  } while (0)
+// Once a loop gets hot enough, leave for the JIT at its header.
+#define BACKEDGE()                                                        \
+  do {                                                                    \
+    method->addBackedge();                                                \
+    if (!env->watchdog()->HandleInterrupt())                              \
+      THROW(SP_ERROR_TIMEOUT);                                            \
+    if (method->backedge_count() >= osr_backedges) {                      \
+      osr_target = pc[1].target;                                          \
+      osr_cip = OPERAND(2);                                               \
+      goto osr;                                                           \
+    }                                                                     \
+  } while (0)
+#define JCOND(name, cond)                                                 \
+  CASE(name):                                                             \
+    if (cond) {                                                           \
+      pc = pc[1].target;                                                  \
+      DISPATCH();                                                         \
+    }                                                                     \
+    NEXT(2);                                                              \
+  CASE(name##_BACK):                                                      \
+    if (cond) {                                                           \
+      BACKEDGE();                                                         \
+      pc = pc[1].target;                                                  \
+      DISPATCH();                                                         \
+    }                                                                     \
+    NEXT(3);
+#define FLOAT_BINOP(name, op)                                             \
+  CASE(name):                                                             \
+    POP(left);                                                            \
+    POP(right);                                                           \
+    pri = sp_ftoc(sp_ctof(left) op sp_ctof(right));                       \
+    NEXT(1);
+#define FLOAT_CMPOP(name, op)                                             \
+  CASE(name):                                                             \
+    POP(left);                                                            \
+    POP(right);                                                           \
+    fleft = sp_ctof(left);                                                \
+    fright = sp_ctof(right);                                              \
+    if (ke::IsNaN(fleft) || ke::IsNaN(fright))                            \
+      pri = 0;                                                            \
+    else                                                                  \
+      pri = (fleft op fright) ? 1 : 0;                                    \
+    NEXT(1);
+
+bool
+ThreadedInterpreter::Execute(PluginContext* cx, MethodInfo* method, cell_t* rval,
+                             const void* const** table)
+{
+#if defined(SP_THREADED_COMPUTED_GOTO)
+  static const void* const kDispatchTable[] = {
+# define _(name) &&op_##name,
+    THREADED_OPS(_)
+# undef _
+  };
+  static_assert(sizeof(kDispatchTable) / sizeof(kDispatchTable[0]) == TOTAL_THREADED_OPS,
+                "dispatch table must cover every op");
+  if (table) {
+    *table = kDispatchTable;
+    return true;
+  }
+#else
+  if (table) {
+    *table = nullptr;
+    return true;
+  }
+#endif
+
+  Environment* env = Environment::get();
+  const ThreadedSlot* pc = method->threaded()->entry();
+
+  // Every local used by a handler is declared up front, since handlers are
+  // entered by jumping past any declaration in between.
+  uint8_t* const mem = cx->memory();
+  const cell_t stp = cx->stp();
+  cell_t pri = 0;
+  cell_t alt = 0;
+  cell_t sp, hp, frm;
+  cell_t addr, value, left, right;
+  float fleft, fright;
+  size_t count;
+  int err;
+  MethodInfo* target;
+  NativeEntry* native;
+  const ThreadedSlot* osr_target;
+  cell_t osr_cip;
+#if defined(SP_HAS_JIT)
+  CompiledFunction* fn;
+  void* entry;
+#endif
+
+  uint32_t osr_backedges = OsrBackedges(env, method);
+
+  // Calls to methods that are not compiled are run by this same loop, so
+  // script recursion does not grow the C stack. These are the suspended
+  // callers, innermost last.
+  ke::Vector<InterpCallFrame> calls;
+
+  // With call stats on, the timer of the running method, and those of the
+  // suspended callers.
+  const bool call_stats = env->IsCallStatsEnabled();
+  CallTimer timer;
+  ke::Vector<CallTimer> caller_timers;
+
+  InterpInvokeFrame ivk(cx, method, pc, &calls);
+
+  if (!cx->pushAmxFrame())
+    return false;
+
+  if (call_stats)
+    timer.enter(env);
+
+  RELOAD();
+
+#if defined(SP_THREADED_COMPUTED_GOTO)
+  DISPATCH();
+  {
+#else
+ dispatch:
+  switch (ThreadedOp(uintptr_t(pc->handler))) {
+#endif
+  CASE(LOAD_PRI):
+    LOAD_CELL(OPERAND(1), pri);
+    NEXT(2);
+  CASE(LOAD_ALT):
+    LOAD_CELL(OPERAND(1), alt);
+    NEXT(2);
+  CASE(LOAD_S_PRI):
+    LOAD_CELL(frm + OPERAND(1), pri);
+    NEXT(2);
+  CASE(LOAD_S_ALT):
+    LOAD_CELL(frm + OPERAND(1), alt);
+    NEXT(2);
+  CASE(LREF_S_PRI):
+    LOAD_CELL(frm + OPERAND(1), value);
+    LOAD_CELL(value, pri);
+    NEXT(2);
+  CASE(LREF_S_ALT):
+    LOAD_CELL(frm + OPERAND(1), value);
+    LOAD_CELL(value, alt);
+    NEXT(2);
+  CASE(LOAD_I):
+    LOAD_CELL(pri, pri);
+    NEXT(1);
+  CASE(LODB_I):
+    LOAD_CELL(pri, pri);
+    if (OPERAND(1) == 1)
+      pri &= 0xff;
+    else if (OPERAND(1) == 2)
+      pri &= 0xffff;
+    NEXT(2);
+  CASE(CONST_PRI):
+    pri = OPERAND(1);
+    NEXT(2);
+  CASE(CONST_ALT):
+    alt = OPERAND(1);
+    NEXT(2);
+  CASE(ADDR_PRI):
+    pri = frm + OPERAND(1);
+    NEXT(2);
+  CASE(ADDR_ALT):
+    alt = frm + OPERAND(1);
+    NEXT(2);
+  CASE(STOR_PRI):
+    STORE_CELL(OPERAND(1), pri);
+    NEXT(2);
+  CASE(STOR_ALT):
+    STORE_CELL(OPERAND(1), alt);
+    NEXT(2);
+  CASE(STOR_S_PRI):
+    STORE_CELL(frm + OPERAND(1), pri);
+    NEXT(2);
+  CASE(STOR_S_ALT):
+    STORE_CELL(frm + OPERAND(1), alt);
+    NEXT(2);
+  CASE(SREF_S_PRI):
+    LOAD_CELL(frm + OPERAND(1), value);
+    STORE_CELL(value, pri);
+    NEXT(2);
+  CASE(SREF_S_ALT):
+    LOAD_CELL(frm + OPERAND(1), value);
+    STORE_CELL(value, alt);
+    NEXT(2);
+  CASE(STOR_I):
+    STORE_CELL(alt, pri);
+    NEXT(1);
+  CASE(STRB_I):
+    CHECK_ADDRESS(alt);
+    if (OPERAND(1) == 1)
+      *reinterpret_cast<uint8_t*>(mem + alt) = uint8_t(pri);
+    else if (OPERAND(1) == 2)
+      *reinterpret_cast<uint16_t*>(mem + alt) = uint16_t(pri);
+    else
+      WriteCell(mem + alt, pri);
+    NEXT(2);
+  CASE(LIDX):
+    LOAD_CELL(cell_t(alt + pri * sizeof(cell_t)), pri);
+    NEXT(1);
+  CASE(IDXADDR):
+    pri = alt + pri * sizeof(cell_t);
+    NEXT(1);
+  CASE(MOVE_PRI):
+    pri = alt;
+    NEXT(1);
+  CASE(MOVE_ALT):
+    alt = pri;
+    NEXT(1);
+  CASE(XCHG):
+    value = pri;
+    pri = alt;
+    alt = value;
+    NEXT(1);
+  CASE(PUSH_PRI):
+    PUSH(pri);
+    NEXT(1);
+  CASE(PUSH_ALT):
+    PUSH(alt);
+    NEXT(1);
+  CASE(PUSH_C):
+    count = OPERAND(1);
+    for (size_t i = 0; i < count; i++)
+      PUSH(OPERAND(2 + i));
+    NEXT(2 + count);
+  CASE(PUSH):
+    count = OPERAND(1);
+    for (size_t i = 0; i < count; i++) {
+      LOAD_CELL(OPERAND(2 + i), value);
+      PUSH(value);
+    }
+    NEXT(2 + count);
+  CASE(PUSH_S):
+    count = OPERAND(1);
+    for (size_t i = 0; i < count; i++) {
+      LOAD_CELL(frm + OPERAND(2 + i), value);
+      PUSH(value);
+    }
+    NEXT(2 + count);
+  CASE(PUSH_ADR):
+    count = OPERAND(1);
+    for (size_t i = 0; i < count; i++)
+      PUSH(frm + OPERAND(2 + i));
+    NEXT(2 + count);
+  CASE(POP_PRI):
+    POP(pri);
+    NEXT(1);
+  CASE(POP_ALT):
+    POP(alt);
+    NEXT(1);
+  CASE(STACK):
+    value = sp + OPERAND(1);
+    if (OPERAND(1) < 0) {
+      // Note: signed compare, in case the new sp is negative.
+      if (value < hp + STACK_MARGIN)
+        THROW(SP_ERROR_STACKLOW);
+    } else if (value > stp) {
+      THROW(SP_ERROR_STACKMIN);
+    }
+    sp = value;
+    NEXT(2);
+  CASE(HEAP):
+    value = hp + OPERAND(1);
+    if (OPERAND(1) < 0) {
+      // Note: signed compare, in case the new hp is negative.
+      if (value < cell_t(cx->DataSize()))
+        THROW(SP_ERROR_HEAPMIN);
+    } else if (value + STACK_MARGIN > sp) {
+      THROW(SP_ERROR_HEAPLOW);
+    }
+    alt = hp;
+    hp = value;
+    NEXT(2);
+  CASE(RETN):
+    sp = frm;
+    POP(hp);
+    POP(frm);
+    POP(value);
+    if (value < 0 || cell_t(sp + value * sizeof(cell_t)) > stp)
+      THROW(SP_ERROR_STACKMIN);
+    sp += value * sizeof(cell_t);
+    if (call_stats)
+      timer.leave(env, method);
+    if (calls.empty()) {
+      SYNC();
+      *rval = pri;
+      return true;
+    }
+  leave:
+    // Return to the caller that entered this method inline. pri already
+    // holds the return value.
+    method = calls.back().method;
+    pc = calls.back().pc;
+    calls.pop();
+    if (call_stats) {
+      timer = caller_timers.back();
+      caller_timers.pop();
+    }
+    ivk.setMethod(method);
+    osr_backedges = OsrBackedges(env, method);
+    NEXT(2);
+  CASE(CALL):
+    target = pc[1].method;
+    if (!target)
+      THROW(SP_ERROR_INVALID_ADDRESS);
+
+#if defined(SP_HAS_JIT)
+    if (target->isCompiling())
+      env->WaitForCompile(target);
+
+    // Go through the environment for callees that run in the JIT.
+    if (env->IsJitEnabled() && (target->jit() || env->ShouldCompile(target))) {
+      SYNC();
+      if (!env->Invoke(cx, target, &value))
+        goto reported;
+      RELOAD();
+      pri = value;
+      NEXT(2);
+    }
+#endif
+
+    if (!target->threaded()) {
+      SYNC();
+      err = PrepareMethod(cx, target);
+      if (err != SP_ERROR_NONE)
+        goto error;
+    }
+    target->addInvocation();
+
+    PUSH(frm);
+    PUSH(hp);
+    frm = sp;
+
+    if (!calls.append(InterpCallFrame{method, pc}))
+      THROW(SP_ERROR_OUT_OF_MEMORY);
+    if (call_stats) {
+      if (!caller_timers.append(timer))
+        THROW(SP_ERROR_OUT_OF_MEMORY);
+      timer.enter(env);
+    }
+    method = target;
+    ivk.setMethod(method);
+    osr_backedges = OsrBackedges(env, method);
+    pc = method->threaded()->entry();
+    DISPATCH();
+  CASE(JUMP):
+    pc = pc[1].target;
+    DISPATCH();
+  CASE(JUMP_BACK):
+    BACKEDGE();
+    pc = pc[1].target;
+    DISPATCH();
+  JCOND(JZER, pri == 0)
+  JCOND(JNZ, pri != 0)
+  JCOND(JEQ, pri == alt)
+  JCOND(JNEQ, pri != alt)
+  JCOND(JSLESS, pri < alt)
+  JCOND(JSLEQ, pri <= alt)
+  JCOND(JSGRTR, pri > alt)
+  JCOND(JSGEQ, pri >= alt)
+  CASE(SHL):
+    pri <<= alt;
+    NEXT(1);
+  CASE(SHR):
+    pri = uint32_t(pri) >> uint32_t(alt);
+    NEXT(1);
+  CASE(SSHR):
+    pri >>= alt;
+    NEXT(1);
+  CASE(SHL_C_PRI):
+    pri <<= OPERAND(1);
+    NEXT(2);
+  CASE(SHL_C_ALT):
+    alt <<= OPERAND(1);
+    NEXT(2);
+  CASE(SMUL):
+    pri *= alt;
+    NEXT(1);
+  CASE(SDIV):
+    left = pri;
+    right = alt;
+    goto sdiv;
+  CASE(SDIV_ALT):
+    left = alt;
+    right = pri;
+  sdiv:
+    if (right == 0)
+      THROW(SP_ERROR_DIVIDE_BY_ZERO);
+    // -INT_MIN / -1 is an overflow.
+    if (right == -1 && left == cell_t(0x80000000))
+      THROW(SP_ERROR_INTEGER_OVERFLOW);
+    pri = left / right;
+    alt = left % right;
+    NEXT(1);
+  CASE(ADD):
+    pri += alt;
+    NEXT(1);
+  CASE(SUB):
+    pri -= alt;
+    NEXT(1);
+  CASE(SUB_ALT):
+    pri = alt - pri;
+    NEXT(1);
+  CASE(AND):
+    pri &= alt;
+    NEXT(1);
+  CASE(OR):
+    pri |= alt;
+    NEXT(1);
+  CASE(XOR):
+    pri ^= alt;
+    NEXT(1);
+  CASE(NOT):
+    pri = pri ? 0 : 1;
+    NEXT(1);
+  CASE(NEG):
+    pri = -pri;
+    NEXT(1);
+  CASE(INVERT):
+    pri = ~pri;
+    NEXT(1);
+  CASE(ADD_C):
+    pri += OPERAND(1);
+    NEXT(2);
+  CASE(SMUL_C):
+    pri *= OPERAND(1);
+    NEXT(2);
+  CASE(ZERO_PRI):
+    pri = 0;
+    NEXT(1);
+  CASE(ZERO_ALT):
+    alt = 0;
+    NEXT(1);
+  CASE(ZERO):
+    STORE_CELL(OPERAND(1), 0);
+    NEXT(2);
+  CASE(ZERO_S):
+    STORE_CELL(frm + OPERAND(1), 0);
+    NEXT(2);
+  CASE(EQ):
+    pri = (pri == alt) ? 1 : 0;
+    NEXT(1);
+  CASE(NEQ):
+    pri = (pri != alt) ? 1 : 0;
+    NEXT(1);
+  CASE(SLESS):
+    pri = (pri < alt) ? 1 : 0;
+    NEXT(1);
+  CASE(SLEQ):
+    pri = (pri <= alt) ? 1 : 0;
+    NEXT(1);
+  CASE(SGRTR):
+    pri = (pri > alt) ? 1 : 0;
+    NEXT(1);
+  CASE(SGEQ):
+    pri = (pri >= alt) ? 1 : 0;
+    NEXT(1);
+  CASE(EQ_C_PRI):
+    pri = (pri == OPERAND(1)) ? 1 : 0;
+    NEXT(2);
+  CASE(EQ_C_ALT):
+    pri = (alt == OPERAND(1)) ? 1 : 0;
+    NEXT(2);
+  CASE(INC_PRI):
+    pri += 1;
+    NEXT(1);
+  CASE(INC_ALT):
+    alt += 1;
+    NEXT(1);
+  CASE(INC):
+    LOAD_CELL(OPERAND(1), value);
+    WriteCell(mem + addr, value + 1);
+    NEXT(2);
+  CASE(INC_S):
+    LOAD_CELL(frm + OPERAND(1), value);
+    WriteCell(mem + addr, value + 1);
+    NEXT(2);
+  CASE(INC_I):
+    LOAD_CELL(pri, value);
+    WriteCell(mem + addr, value + 1);
+    NEXT(1);
+  CASE(DEC_PRI):
+    pri -= 1;
+    NEXT(1);
+  CASE(DEC_ALT):
+    alt -= 1;
+    NEXT(1);
+  CASE(DEC):
+    LOAD_CELL(OPERAND(1), value);
+    WriteCell(mem + addr, value - 1);
+    NEXT(2);
+  CASE(DEC_S):
+    LOAD_CELL(frm + OPERAND(1), value);
+    WriteCell(mem + addr, value - 1);
+    NEXT(2);
+  CASE(DEC_I):
+    LOAD_CELL(pri, value);
+    WriteCell(mem + addr, value - 1);
+    NEXT(1);
+  CASE(MOVS):
+    CHECK_RANGE(pri, OPERAND(1));
+    CHECK_RANGE(alt, OPERAND(1));
+    memmove(mem + alt, mem + pri, OPERAND(1));
+    NEXT(2);
+  CASE(FILL):
+    CHECK_RANGE(alt, OPERAND(1));
+    count = OPERAND(1) / sizeof(cell_t);
+    for (size_t i = 0; i < count; i++)
+      WriteCell(mem + alt + i * sizeof(cell_t), pri);
+    NEXT(2);
+  CASE(BOUNDS):
+    if (size_t(pri) > size_t(uint32_t(OPERAND(1)))) {
+      SYNC();
+      ReportOutOfBoundsError(pri, OPERAND(1));
+      goto reported;
+    }
+    NEXT(2);
+  CASE(SYSREQ_C):
+    count = 3;
+    goto sysreq;
+  CASE(SYSREQ_N):
+    PUSH(OPERAND(3));
+    count = 4;
+  sysreq:
+    native = pc[1].native;
+    SYNC();
+    ivk.enterNativeCall(uint32_t(OPERAND(2)));
+    if (native->status != SP_NATIVE_BOUND) {
+      cx->ReportErrorNumber(SP_ERROR_INVALID_NATIVE);
+    } else if (native->stats) {
+      uint64_t start = ReadCallTicks();
+      pri = native->legacy_fn(cx, reinterpret_cast<const cell_t*>(mem + sp));
+      RecordNativeCall(native->stats, start);
+    } else {
+      pri = native->legacy_fn(cx, reinterpret_cast<const cell_t*>(mem + sp));
+    }
+    ivk.leaveNativeCall();
+
+    // Natives may not change sp or hp, so put back what they saw.
+    SYNC();
+    if (env->hasPendingException())
+      goto reported;
+
+    // SYSREQ.N pops its own arguments, and the count pushed above.
+    if (count == 4) {
+      for (cell_t i = 0; i <= OPERAND(3); i++)
+        POP(value);
+    }
+    NEXT(count);
+  CASE(SWAP_PRI):
+    value = pri;
+    POP(pri);
+    PUSH(value);
+    NEXT(1);
+  CASE(SWAP_ALT):
+    value = alt;
+    POP(alt);
+    PUSH(value);
+    NEXT(1);
+  CASE(LOAD_BOTH):
+    LOAD_CELL(OPERAND(1), pri);
+    LOAD_CELL(OPERAND(2), alt);
+    NEXT(3);
+  CASE(LOAD_S_BOTH):
+    LOAD_CELL(frm + OPERAND(1), pri);
+    LOAD_CELL(frm + OPERAND(2), alt);
+    NEXT(3);
+  CASE(CONST):
+    STORE_CELL(OPERAND(1), OPERAND(2));
+    NEXT(3);
+  CASE(CONST_S):
+    STORE_CELL(frm + OPERAND(1), OPERAND(2));
+    NEXT(3);
+  CASE(TRACKER_PUSH_C):
+    SYNC();
+    err = cx->pushTracker(OPERAND(1));
+    RELOAD();
+    if (err != SP_ERROR_NONE)
+      goto error;
+    NEXT(2);
+  CASE(TRACKER_POP_SETHEAP):
+    SYNC();
+    err = cx->popTrackerAndSetHeap();
+    RELOAD();
+    if (err != SP_ERROR_NONE)
+      goto error;
+    NEXT(1);
+  CASE(GENARRAY):
+    count = OPERAND(1);
+    CHECK_RANGE(sp, cell_t(count * sizeof(cell_t)));
+    SYNC();
+    err = cx->generateArray(cell_t(count), reinterpret_cast<cell_t*>(mem + sp), !!OPERAND(2));
+    RELOAD();
+    if (err != SP_ERROR_NONE)
+      goto error;
+
+    // Remove all but the last argument, which is where the new address is
+    // stored.
+    for (size_t i = 0; i < count - 1; i++)
+      POP(value);
+    NEXT(3);
+  CASE(STRADJUST_PRI):
+    pri = (pri + 4) >> 2;
+    NEXT(1);
+  CASE(FABS):
+    POP(pri);
+    pri &= 0x7fffffff;
+    NEXT(1);
+  CASE(FLOAT):
+    POP(value);
+    pri = sp_ftoc(float(value));
+    NEXT(1);
+  FLOAT_BINOP(FLOATADD, +)
+  FLOAT_BINOP(FLOATSUB, -)
+  FLOAT_BINOP(FLOATMUL, *)
+  FLOAT_BINOP(FLOATDIV, /)
+  CASE(RND_TO_NEAREST):
+  {
+    POP(value);
+    int oldmethod = fegetround();
+    fesetround(FE_TONEAREST);
+    pri = lrintf(sp_ctof(value));
+    fesetround(oldmethod);
+    NEXT(1);
+  }
+  CASE(RND_TO_FLOOR):
+    POP(value);
+    pri = int(floor(sp_ctof(value)));
+    NEXT(1);
+  CASE(RND_TO_CEIL):
+    POP(value);
+    pri = int(ceil(sp_ctof(value)));
+    NEXT(1);
+  CASE(RND_TO_ZERO):
+    POP(value);
+    fleft = sp_ctof(value);
+    if (fleft >= 0.0f)
+      pri = int(floor(fleft));
+    else
+      pri = int(ceil(fleft));
+    NEXT(1);
+  CASE(FLOATCMP):
+    POP(left);
+    POP(right);
+    fleft = sp_ctof(left);
+    fright = sp_ctof(right);
+    if (fleft > fright)
+      pri = 1;
+    else if (fleft < fright)
+      pri = -1;
+    else
+      pri = 0;
+    NEXT(1);
+  FLOAT_CMPOP(FLOAT_GT, >)
+  FLOAT_CMPOP(FLOAT_GE, >=)
+  FLOAT_CMPOP(FLOAT_LE, <=)
+  FLOAT_CMPOP(FLOAT_LT, <)
+  FLOAT_CMPOP(FLOAT_EQ, ==)
+  FLOAT_CMPOP(FLOAT_NE, !=)
+  CASE(FLOAT_NOT):
+    POP(value);
+    fleft = sp_ctof(value);
+    if (ke::IsNaN(fleft))
+      pri = 1;
+    else
+      pri = fleft ? 0 : 1;
+    NEXT(1);
+  CASE(FLOAT_MATH):
+    POP(left);
+    right = 0;
+    if (FloatMathArity(FloatMathOp(OPERAND(1))) == 2)
+      POP(right);
+    pri = EvalFloatMath(FloatMathOp(OPERAND(1)), left, right);
+    NEXT(2);
+  CASE(SWITCH):
+    // Operands are a case count, the default target, then value/target
+    // pairs.
+    count = OPERAND(1);
+    for (size_t i = 0; i < count; i++) {
+      if (OPERAND(3 + i * 2) == pri) {
+        pc = pc[4 + i * 2].target;
+        DISPATCH();
+      }
+    }
+    pc = pc[2].target;
+    DISPATCH();
+  CASE(SWITCH_TABLE):
+    // Operands are the lowest case value, a case count, the default target,
+    // then one target per case.
+    value = cell_t(uint32_t(pri) - uint32_t(OPERAND(1)));
+    if (uint32_t(value) < uint32_t(OPERAND(2)))
+      pc = pc[4 + uint32_t(value)].target;
+    else
+      pc = pc[3].target;
+    DISPATCH();
+  CASE(BREAK):
+    SYNC();
+    InvokeDebugger(cx, nullptr);
+    if (env->hasPendingException())
+      goto reported;
+    NEXT(1);
+  CASE(HALT):
+    // We don't support this. It's included in the bytestream by default, but
+    // it must be unreachable.
+    THROW(SP_ERROR_INVALID_INSTRUCTION);
+  CASE(REBASE):
+    SYNC();
+    err = cx->rebaseArray(pri, OPERAND(1), OPERAND(2), OPERAND(3));
+    RELOAD();
+    if (err != SP_ERROR_NONE)
+      goto error;
+    NEXT(4);
+  CASE(END):
+    if (call_stats)
+      timer.leave(env, method);
+    SYNC();
+    *rval = 0;
+    return true;
+#if !defined(SP_THREADED_COMPUTED_GOTO)
+  default:
+    assert(false);
+    THROW(SP_ERROR_INVALID_INSTRUCTION);
+#endif
+  }
+
+ osr:
+  // Only try once per invocation; if there is no way in, keep interpreting.
+  osr_backedges = UINT32_MAX;
+#if defined(SP_HAS_JIT)
+  if (method->isCompiling())
+    env->WaitForCompile(method);
+  fn = method->jit();
+  if (!fn) {
+    // The JIT may have refused the method while we were waiting.
+    if (method->isJitRefused()) {
+      pc = osr_target;
+      DISPATCH();
+    }
+    SYNC();
+    fn = CompilerBase::Compile(cx, method, &err);
+    if (!fn) {
+      // Either the JIT refused the method, or it couldn't compile it this
+      // time. Both ways, this invocation stays here.
+      pc = osr_target;
+      DISPATCH();
+    }
+  }
+
+  entry = fn->FindOsrEntry(osr_cip);
+  if (!entry || frm - method->max_stack() < hp + STACK_MARGIN) {
+    pc = osr_target;
+    DISPATCH();
+  }
+
+  // The compiled code picks pri and alt up from the stack, and takes over
+  // the rest of this frame as-is.
+  sp -= 2 * sizeof(cell_t);
+  WriteCell(mem + sp, pri);
+  WriteCell(mem + sp + sizeof(cell_t), alt);
+  SYNC();
+  ivk.replaceWithJit();
+  if (call_stats)
+    timer.handOff(env, method);
+  if (calls.empty())
+    return env->InvokeCompiled(cx, fn, entry, rval);
+
+  // The compiled code returns through this frame's RETN, so pick up in the
+  // caller.
+  if (!env->InvokeCompiled(cx, fn, entry, &value))
+    goto reported;
+  ivk.resume();
+  RELOAD();
+  pri = value;
+  goto leave;
+#else
+  pc = osr_target;
+  DISPATCH();
+#endif
+
+ error:
+  SYNC();
+  cx->ReportErrorNumber(err);
+ reported:
+  return false;
+}
+
+} // namespace sp
@@ -0,0 +1,90 @@
+// vim: set ts=8 sts=2 sw=2 tw=99 et:
+//
+// This file is part of SourcePawn.
+//
+// SourcePawn is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SourcePawn is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _include_sourcepawn_vm_threaded_interpreter_h_
+#define _include_sourcepawn_vm_threaded_interpreter_h_
+
+#include <sp_vm_types.h>
+#include <amtl/am-autoptr.h>
+#include <amtl/am-fixedarray.h>
+#include "compiled-function.h"
+
+// GCC and Clang support taking the address of a label, which lets every
+// handler jump straight to the next one. Elsewhere we fall back to a switch.
+#if defined(__GNUC__) || defined(__clang__)
+# define SP_THREADED_COMPUTED_GOTO
+#endif
+
+namespace sp {
+
+class MethodInfo;
+class PluginContext;
+struct NativeEntry;
+
+// A single word of pre-decoded code. Each instruction is a handler followed
+// by its operands, all of which are fully resolved: jumps point directly at
+// their target instruction, and calls at their MethodInfo or NativeEntry.
+union ThreadedSlot
+{
+  const void* handler;
+  intptr_t value;
+  const ThreadedSlot* target;
+  MethodInfo* method;
+  NativeEntry* native;
+};
+
+// The pre-decoded form of a method, cached on its MethodInfo. This is built
+// once, the first time the method is interpreted.
+class ThreadedCode
+{
+ public:
+  ThreadedCode(cell_t pcode_offs,
+               FixedArray<ThreadedSlot>* code,
+               FixedArray<CipMapEntry>* cip_map);
+
+  static ThreadedCode* Translate(PluginContext* cx, MethodInfo* method, int* err);
+
+  const ThreadedSlot* entry() const {
+    return code_->buffer();
+  }
+
+  // Map the instruction at |pc| back to its code offset.
+  ucell_t FindCipByPc(const ThreadedSlot* pc) const;
+
+ private:
+  cell_t code_offset_;
+  AutoPtr<FixedArray<ThreadedSlot>> code_;
+  AutoPtr<FixedArray<CipMapEntry>> cip_map_;
+};
+
+class ThreadedInterpreter
+{
+ public:
+  static bool Run(PluginContext* cx, MethodInfo* method, cell_t* rval);
+
+  // Return the handler table that translated code is threaded through, or
+  // null if handlers are dispatched by index.
+  static const void* const* DispatchTable();
+
+ private:
+  static bool Execute(PluginContext* cx, MethodInfo* method, cell_t* rval,
+                      const void* const** table);
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_threaded_interpreter_h_
@@ -30,6 +30,17 @@ Assembler::emitToExecutableMemory(void* code)
 
     *reinterpret_cast<void**>(base + offset - 8) = base + target;
   }
+
+  // Local references are emitted as a rel32 followed by four bytes of
+  // padding, and are rewritten here as absolute addresses.
+  for (size_t i = 0; i < local_refs_.length(); i++) {
+    size_t offset = local_refs_[i] - 4;
+    int32_t delta = *reinterpret_cast<int32_t*>(base + offset - 4);
+    size_t target = offset + delta;
+    assert(target <= length());
+
+    *reinterpret_cast<void**>(base + offset - 4) = base + target;
+  }
 }
 
 } // namespace sp
@@ -75,6 +75,11 @@ struct FloatRegister
     assert(code <= 15);
     return uint8_t(code) >> 3;
   }
+
+  // Return the low bits used for encoding reg/rm fields.
+  uint8_t low_bits() const {
+    return uint8_t(code) & 0x7;
+  }
 };
 
 const Register rax = { 0 };
@@ -182,8 +187,10 @@ class AddressOperand
   intptr_t asIntPtr() const {
     return address_.value();
   }
+  // Absolute [disp32] operands are sign-extended in long mode, so only the
+  // low 2GB can be encoded directly.
   bool has32BitEncoding() const {
-    return address_.has32BitEncoding();
+    return address_.value() >= 0 && address_.value() <= INT_MAX;
   }
 
  private:
@@ -257,9 +264,18 @@ struct Operand
     return rex_bits_;
   }
 
+  // Whether this is an absolute [disp32] address. Base registers never use
+  // this encoding, since [rbp] and [r13] are always given a displacement.
+  bool isAbsolute() const {
+    return mode() == kModeDisp0 &&
+           rm() == kSIB.low_bits() &&
+           (bytes_[1] & 7) == rbp.low_bits();
+  }
+
  private:
   explicit Operand(Register reg)
-   : length_(0)
+   : rex_bits_(0),
+     length_(0)
   {
     modrm(kModeReg, reg);
   }
@@ -267,7 +283,7 @@ struct Operand
    : rex_bits_(0)
   {
     // Callers must ensure this is encodable as a 32-bit address.
-    KE_RELEASE_ASSERT(address.has32BitEncoding());
+    KE_RELEASE_ASSERT(AddressOperand(address.address()).has32BitEncoding());
     sib(kModeDisp0, NoScale, kNoIndex, rbp);
     *reinterpret_cast<int32_t*>(bytes_ + 2) = int32_t(address.value());
     length_ = 6;
@@ -378,6 +394,9 @@ class Assembler : public AssemblerBase
   void leave() {
     emit1(0xc9);
   }
+  void rdtsc() {
+    emit2(0x0f, 0x31);
+  }
   void ret() {
     emit1(0xc3);
   }
@@ -386,6 +405,11 @@ class Assembler : public AssemblerBase
     emit1(0xcc);
   }
 
+  // Always emits a rel32 jump, so the displacement can be patched later.
+  void jmp32(Label* dest) {
+    emit1(0xe9);
+    emitJumpTarget(dest);
+  }
   void jmp(Label* dest) {
     int8_t d8;
     if (canEmitSmallJump(dest, &d8)) {
@@ -400,6 +424,11 @@ class Assembler : public AssemblerBase
     emit1(0xff, 4, target);
   }
 
+  // Always emits a rel32 jump, so the displacement can be patched later.
+  void j32(ConditionCode cc, Label* dest) {
+    emit2(0x0f, 0x80 + uint8_t(cc));
+    emitJumpTarget(dest);
+  }
   void j(ConditionCode cc, Label* dest) {
     int8_t d8;
     if (canEmitSmallJump(dest, &d8)) {
@@ -429,6 +458,9 @@ class Assembler : public AssemblerBase
   void leaq(Register dest, const Operand& src) {
     emit1_64(0x8d, dest, src);
   }
+  void leal(Register dest, const Operand& src) {
+    emit1(0x8d, dest, src);
+  }
 
   void movq(Register dest, Register src) {
     emit1_64(0x8b, dest, src);
@@ -445,7 +477,8 @@ class Assembler : public AssemblerBase
       movl(dest, int32_t(value));
     } else if (value >= INT_MIN && value <= INT_MAX) {
       // Perform a sign-extended move.
-      emit1_64(0xc7, 1, dest);
+      emit1_64(0xc7, 0, dest);
+      writeInt32(int32_t(value));
     } else {
       // Do a full 64-bit move.
       emit1_64_rex(0xb8 + dest.low_bits(), dest);
@@ -460,6 +493,7 @@ class Assembler : public AssemblerBase
     } else {
       writeInt64(src->offset());
     }
+    recordRelocation(RelocationKind::Pointer);
     if (patch)
       bind(patch);
     if (!absolute_code_refs_.append(pc()))
@@ -474,7 +508,14 @@ class Assembler : public AssemblerBase
     writeInt32(value);
   }
   void movq(Register dest, const AddressValue& address) {
-    movq(dest, address.value());
+    intptr_t value = address.value();
+    movq(dest, value);
+    if (value >= 0 && value <= UINT32_MAX)
+      recordRelocation(RelocationKind::Unsigned32);
+    else if (value >= INT_MIN && value <= INT_MAX)
+      recordRelocation(RelocationKind::Signed32);
+    else
+      recordRelocation(RelocationKind::Pointer);
   }
   void movl(Register dest, const Operand& src) {
     emit1(0x8b, dest, src);
@@ -483,10 +524,36 @@ class Assembler : public AssemblerBase
   void movl(const T& src, Register dest) {
     emit1(0x89, dest, src);
   }
+  void movw(const Operand& dest, Register src) {
+    emit1(0x66);
+    emit1(0x89, src, dest);
+  }
+  void movb(const Operand& dest, Register src) {
+    // Without a REX prefix, codes 4-7 would encode ah/ch/dh/bh.
+    ensureSpace();
+    uint8_t bits = static_cast<uint8_t>((src.rex_bit() << 2) | dest.rex_bits());
+    if (bits || src.code >= 4)
+      *pos_++ = 0x40 | bits;
+    emit1_tail(0x88, src, dest);
+  }
+  void xchgl(Register dest, Register src) {
+    if (src == rax)
+      emit1_maybe_rex(0x90 + dest.low_bits(), dest);
+    else if (dest == rax)
+      emit1_maybe_rex(0x90 + src.low_bits(), src);
+    else
+      emit1(0x87, src, dest);
+  }
 
   void addq(Register dest, Register src) {
     emit1_64(0x01, src, dest);
   }
+  void addq(const Operand& dest, Register src) {
+    emit1_64(0x01, src, dest);
+  }
+  void addq(Register dest, const Operand& src) {
+    emit1_64(0x03, dest, src);
+  }
   template <typename T>
   void addq(const T& rm, int32_t imm) {
     alu_imm_64(0, imm, rm);
@@ -495,10 +562,171 @@ class Assembler : public AssemblerBase
   void addl(const T& rm, int32_t imm) {
     alu_imm_32(0, imm, rm);
   }
+  void addl(Register dest, Register src) {
+    emit1(0x01, src, dest);
+  }
+  template <typename T>
+  void subl(const T& rm, int32_t imm) {
+    alu_imm_32(5, imm, rm);
+  }
+  void subl(Register dest, Register src) {
+    emit1(0x29, src, dest);
+  }
+  template <typename T>
+  void andl(const T& rm, int32_t imm) {
+    alu_imm_32(4, imm, rm);
+  }
+  void andl(Register dest, Register src) {
+    emit1(0x21, src, dest);
+  }
+  template <typename T>
+  void orl(const T& rm, int32_t imm) {
+    alu_imm_32(1, imm, rm);
+  }
+  void orl(Register dest, Register src) {
+    emit1(0x09, src, dest);
+  }
+  void orq(Register dest, Register src) {
+    emit1_64(0x09, src, dest);
+  }
+  void xorl(Register dest, Register src) {
+    emit1(0x31, src, dest);
+  }
+  void notl(Register srcdest) {
+    emit1(0xf7, 2, srcdest);
+  }
+  void negl(Register srcdest) {
+    emit1(0xf7, 3, srcdest);
+  }
+  void imull(Register dest, Register src) {
+    emit2_maybe_rex(0x0f, 0xaf, dest, src);
+  }
+  // dest is undefined if src is zero.
+  void bsrq(Register dest, Register src) {
+    ensureSpace();
+    emit_rex_64(dest, src);
+    *pos_++ = 0x0f;
+    *pos_++ = 0xbd;
+    emit_modrm(dest, src);
+  }
+  void imull(Register dest, Register src, int32_t imm) {
+    if (imm >= SCHAR_MIN && imm <= SCHAR_MAX) {
+      emit1(0x6b, dest, src);
+      *pos_++ = uint8_t(imm & 0xff);
+    } else {
+      emit1(0x69, dest, src);
+      writeInt32(imm);
+    }
+  }
+  void idivl(Register divisor) {
+    emit1(0xf7, 7, divisor);
+  }
+
+  void shll(Register dest, uint8_t imm) {
+    shift_imm(4, dest, imm);
+  }
+  void shrl(Register dest, uint8_t imm) {
+    shift_imm(5, dest, imm);
+  }
+  void sarl(Register dest, uint8_t imm) {
+    shift_imm(7, dest, imm);
+  }
+  void shlq(Register dest, uint8_t imm) {
+    emit1_64(0xc1, 4, dest);
+    *pos_++ = imm;
+  }
+  void shll_cl(Register dest) {
+    emit1(0xd3, 4, dest);
+  }
+  void shrl_cl(Register dest) {
+    emit1(0xd3, 5, dest);
+  }
+  void sarl_cl(Register dest) {
+    emit1(0xd3, 7, dest);
+  }
+
+  void set(ConditionCode cc, Register dest) {
+    // Without a REX prefix, codes 4-7 would encode ah/ch/dh/bh.
+    ensureSpace();
+    if (dest.code >= 4)
+      *pos_++ = 0x40 | dest.rex_bit();
+    *pos_++ = 0x0f;
+    *pos_++ = 0x90 + uint8_t(cc);
+    emit_modrm(0, dest);
+  }
+
+  void cld() {
+    emit1(0xfc);
+  }
+  void rep_movsb() {
+    emit2(0xf3, 0xa4);
+  }
+  void rep_movsd() {
+    emit2(0xf3, 0xa5);
+  }
+  void rep_stosd() {
+    emit2(0xf3, 0xab);
+  }
+
+  // SSE/SSE2 instructions. Both are part of the x86-64 baseline.
+  void movss(FloatRegister dest, const Operand& src) {
+    emit_sse(0xf3, 0x10, dest, src);
+  }
+  void addss(FloatRegister dest, const Operand& src) {
+    emit_sse(0xf3, 0x58, dest, src);
+  }
+  void mulss(FloatRegister dest, const Operand& src) {
+    emit_sse(0xf3, 0x59, dest, src);
+  }
+  void subss(FloatRegister dest, const Operand& src) {
+    emit_sse(0xf3, 0x5c, dest, src);
+  }
+  void divss(FloatRegister dest, const Operand& src) {
+    emit_sse(0xf3, 0x5e, dest, src);
+  }
+  void sqrtss(FloatRegister dest, const Operand& src) {
+    emit_sse(0xf3, 0x51, dest, src);
+  }
+  template <typename T>
+  void cvtsi2ss(FloatRegister dest, const T& src) {
+    emit_sse(0xf3, 0x2a, dest, src);
+  }
+  template <typename T>
+  void cvttss2si(Register dest, const T& src) {
+    emit_sse(0xf3, 0x2c, dest, src);
+  }
+  template <typename T>
+  void cvtss2si(Register dest, const T& src) {
+    emit_sse(0xf3, 0x2d, dest, src);
+  }
+  void movd(Register dest, FloatRegister src) {
+    emit_sse(0x66, 0x7e, src, dest);
+  }
+  void xorps(FloatRegister dest, FloatRegister src) {
+    emit_sse(0, 0x57, dest, src);
+  }
+  // Sets flags as if computing |left - right|.
+  template <typename T>
+  void ucomiss(FloatRegister left, const T& right) {
+    emit_sse(0, 0x2e, left, right);
+  }
+
+  // Emit a 64-bit absolute code address of |address|, for jump tables.
+  void emit_absolute_address(Label* address) {
+    ensureSpace();
+    emitJumpTarget(address);
+    writeInt32(0);
+    recordRelocation(RelocationKind::Pointer);
+    if (!local_refs_.append(pc()))
+      outOfMemory_ = true;
+  }
 
   void subq(Register dest, Register src) {
     emit1_64(0x29, src, dest);
   }
+  void subq(Register dest, const Operand& src) {
+    emit1_64(0x2b, dest, src);
+  }
   template <typename T>
   void subq(const T& rm, int32_t imm) {
     alu_imm_64(5, imm, rm);
@@ -509,6 +737,11 @@ class Assembler : public AssemblerBase
     alu_imm_64(4, imm, rm);
   }
 
+  template <typename T>
+  void orq(const T& rm, int32_t imm) {
+    alu_imm_64(1, imm, rm);
+  }
+
   template <typename T>
   void testq(const T& left, Register right) {
     emit1_64(0x85, right, left);
@@ -533,7 +766,6 @@ class Assembler : public AssemblerBase
   void cmpq(const T& left, Register right) {
     emit1_64(0x39, right, left);
   }
-  template <typename T>
   void cmpq(Register left, const Operand& right) {
     emit1_64(0x3b, left, right);
   }
@@ -541,7 +773,6 @@ class Assembler : public AssemblerBase
   void cmpl(const T& left, Register right) {
     emit1(0x39, right, left);
   }
-  template <typename T>
   void cmpl(Register left, const Operand& right) {
     emit1(0x3b, left, right);
   }
@@ -561,6 +792,7 @@ class Assembler : public AssemblerBase
     if (src == rax) {
       emit1_64(0xa3);
       writeInt64(address.asIntPtr());
+      recordRelocation(RelocationKind::Pointer);
     } else {
       movq(Operand(address.asValue()), src);
     }
@@ -569,6 +801,7 @@ class Assembler : public AssemblerBase
     if (dest == rax) {
       emit1_64(0xa1);
       writeInt64(src.asIntPtr());
+      recordRelocation(RelocationKind::Pointer);
     } else {
       movq(dest, Operand(src.asValue()));
     }
@@ -639,6 +872,46 @@ class Assembler : public AssemblerBase
     }
   }
 
+  void shift_imm(uint8_t r, Register dest, uint8_t imm) {
+    if (imm == 1) {
+      emit1(0xd1, r, dest);
+    } else {
+      emit1(0xc1, r, dest);
+      *pos_++ = imm;
+    }
+  }
+
+  // Emit an (optionally prefixed) 0x0f-escaped instruction, where the REX
+  // prefix must come after the mandatory prefix.
+  template <typename RegType, typename RMType>
+  void emit_sse(uint8_t prefix, uint8_t opcode, const RegType& opreg, const RMType& rm) {
+    ensureSpace();
+    if (prefix)
+      *pos_++ = prefix;
+    uint8_t bits = static_cast<uint8_t>((opreg.rex_bit() << 2) | rex_bits_of(rm));
+    if (bits)
+      *pos_++ = 0x40 | bits;
+    *pos_++ = 0x0f;
+    *pos_++ = opcode;
+    emit_modrm(opreg.low_bits(), rm);
+  }
+  void emit2_maybe_rex(uint8_t prefix, uint8_t opcode, Register opreg, Register rm) {
+    ensureSpace();
+    maybe_emit_rex(opreg, rm);
+    *pos_++ = prefix;
+    *pos_++ = opcode;
+    emit_modrm(opreg, rm);
+  }
+  static uint8_t rex_bits_of(const Register& rm) {
+    return rm.rex_bit();
+  }
+  static uint8_t rex_bits_of(const FloatRegister& rm) {
+    return rm.rex_bit();
+  }
+  static uint8_t rex_bits_of(const Operand& rm) {
+    return static_cast<uint8_t>(rm.rex_bits());
+  }
+
   // Instructions can fall into one or more of the following categories, and
   // we slice up helpers to cover them all:
   //  - REX prefix definitely needed (64-bit operand size).
@@ -756,6 +1029,9 @@ class Assembler : public AssemblerBase
   void emit_modrm(uint8_t opreg, const Register& rm) {
     emit_modrm(opreg, rm.low_bits());
   }
+  void emit_modrm(uint8_t opreg, const FloatRegister& rm) {
+    emit_modrm(opreg, rm.low_bits());
+  }
   void emit_modrm(uint8_t opreg, uint8_t rm) {
     *pos_++ = (kModeReg << 6) | (opreg << 3) | rm;
   }
@@ -767,12 +1043,41 @@ class Assembler : public AssemblerBase
     size_t length = operand.length();
     for (size_t i = 1; i < length; i++)
       *pos_++ = operand.getByte(i);
+    if (operand.isAbsolute())
+      recordRelocation(RelocationKind::Signed32);
   }
 
  private:
   ke::Vector<uint32_t> absolute_code_refs_;
+  ke::Vector<uint32_t> local_refs_;
 };
 
+static inline ConditionCode
+InvertConditionCode(ConditionCode cc)
+{
+  switch (cc) {
+    case overflow: return no_overflow;
+    case no_overflow: return overflow;
+    case below: return not_below;
+    case not_below: return below;
+    case equal: return not_equal;
+    case not_equal: return equal;
+    case not_above: return above;
+    case above: return not_above;
+    case negative: return not_negative;
+    case not_negative: return negative;
+    case even_parity: return odd_parity;
+    case odd_parity: return even_parity;
+    case less: return not_less;
+    case not_less: return less;
+    case not_greater: return greater;
+    case greater: return not_greater;
+    default:
+      assert(false);
+      return zero;
+  }
+}
+
 } // namespace sp
 
 #endif // _include_sourcepawn_vm_assembler_x64_h__
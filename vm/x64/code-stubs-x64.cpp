@@ -16,6 +16,7 @@
 #include "macro-assembler-x64.h"
 #include "constants-x64.h"
 #include "plugin-context.h"
+#include "perf-maps.h"
 
 #define __ masm.
 
@@ -47,14 +48,14 @@ CodeStubs::CompileInvokeStub()
   // arg2 = rval
   
   // Save the context and rval pointers.
-  const Register context = saved1;
+  const Register context = cxreg;
   const Register rvalptr = saved0;
   __ movq(context, ArgReg0);
   __ movq(rvalptr, ArgReg2);
   
   // Set up runtime registers.
   __ movq(dat, Operand(context, static_cast<int32_t>(PluginContext::offsetOfMemory())));
-  __ movq(stk, Operand(context, static_cast<int32_t>(PluginContext::offsetOfSp())));
+  __ movl(stk, Operand(context, static_cast<int32_t>(PluginContext::offsetOfSp())));
   __ addq(stk, dat);
 
   // Align the stack.
@@ -64,14 +65,14 @@ CodeStubs::CompileInvokeStub()
   __ call(ArgReg1);
 
   // Store the rval.
-  __ movq(Operand(rvalptr, 0), pri);
+  __ movl(Operand(rvalptr, 0), pri);
 
   // Store latest stk. If we have an error code, we'll jump directly to here,
   // so rax will already be set.
   Label ret;
   __ bind(&ret);
   __ subq(stk, dat);
-  __ movq(Operand(context, static_cast<int32_t>(PluginContext::offsetOfSp())), stk);
+  __ movl(Operand(context, static_cast<int32_t>(PluginContext::offsetOfSp())), stk);
 
   // Restore registers and leave.
   __ leaq(rsp, Operand(rbp, kFpOffsetToPreAlignedSp));
@@ -113,7 +114,12 @@ CodeStubs::CreateFakeNativeStub(SPVM_FAKENATIVE_FUNC callback, void* pData)
   __ leave();
   __ ret();
 
-  return (SPVM_NATIVE_FUNC)LinkCodeToLegacyPtr(env_, masm);
+  uint8_t* code = LinkCodeToLegacyPtr(env_, masm);
+#if defined(SP_HAS_PERF_MAPS)
+  if (code && PerfMaps::IsEnabled())
+    PerfMaps::AddStub("sp::FakeNativeStub", code, masm.length());
+#endif
+  return (SPVM_NATIVE_FUNC)code;
 }
 
 } // namespace sp
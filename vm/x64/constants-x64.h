@@ -33,11 +33,17 @@ static const Register frm = rbx;
 static const Register saved0 = r12;
 static const Register saved1 = r13;
 
+// The invoke stub holds the PluginContext here for the duration of a call.
+static const Register cxreg = saved1;
+
 static const Register scratch0 = rcx;
-static const Register scratch1 = r11;
+static const Register scratch1 = r8;
 static const Register scratch2 = r10;
 static const Register scratch3 = r9;
-static const Register reserved_scratch = r8;
+
+// The MacroAssembler uses this for 64-bit addresses, including call targets,
+// so it must not be an argument register in either calling convention.
+static const Register reserved_scratch = r11;
 
 } // namespace sp
 
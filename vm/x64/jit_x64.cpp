@@ -0,0 +1,1795 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2015 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "jit_x64.h"
+#include "plugin-runtime.h"
+#include "plugin-context.h"
+#include "watchdog_timer.h"
+#include "environment.h"
+#include "code-stubs.h"
+#include "linking.h"
+#include "frames-x64.h"
+#include "outofline-asm.h"
+#include "method-info.h"
+#include "runtime-helpers.h"
+#include "debugging.h"
+
+#define __ masm.
+
+namespace sp {
+
+static inline ConditionCode
+OpToCondition(CompareOp op)
+{
+  switch (op) {
+  case CompareOp::Eq:
+    return equal;
+  case CompareOp::Neq:
+    return not_equal;
+  case CompareOp::Sless:
+    return less;
+  case CompareOp::Sleq:
+    return less_equal;
+  case CompareOp::Sgrtr:
+    return greater;
+  case CompareOp::Sgeq:
+    return greater_equal;
+  default:
+    assert(false);
+    return negative;
+  }
+}
+
+Compiler::Compiler(PluginRuntime* rt, MethodInfo* method)
+ : CompilerBase(rt, method)
+{
+}
+
+Compiler::~Compiler()
+{
+}
+
+// No exit frame - error code is returned directly.
+static int
+InvokePushTracker(PluginContext* cx, uint32_t amount)
+{
+  return cx->pushTracker(amount);
+}
+
+// No exit frame - error code is returned directly.
+static int
+InvokePopTrackerAndSetHeap(PluginContext* cx)
+{
+  return cx->popTrackerAndSetHeap();
+}
+
+// No exit frame - error code is returned directly.
+static int
+InvokeGenerateFullArray(PluginContext* cx, uint32_t argc, cell_t* argv, int autozero)
+{
+  return cx->generateFullArray(argc, argv, autozero);
+}
+
+// No exit frame - error code is returned directly. Win64 only has four
+// argument registers, so the two sizes are passed through memory.
+static int
+InvokeRebaseArray(PluginContext* cx,
+                  cell_t base_addr,
+                  cell_t dat_addr,
+                  const cell_t* sizes)
+{
+  return cx->rebaseArray(base_addr, dat_addr, sizes[0], sizes[1]);
+}
+
+bool
+Compiler::visitMOVE(PawnReg reg)
+{
+  if (reg == PawnReg::Pri)
+    __ movl(pri, alt);
+  else
+    __ movl(alt, pri);
+  return true;
+}
+
+bool
+Compiler::visitXCHG()
+{
+  __ xchgl(pri, alt);
+  return true;
+}
+
+bool
+Compiler::visitZERO(cell_t offset)
+{
+  __ movl(Operand(dat, offset), 0);
+  return true;
+}
+
+bool
+Compiler::visitZERO_S(cell_t offset)
+{
+  __ movl(Operand(frm, offset), 0);
+  return true;
+}
+
+bool
+Compiler::visitPUSH(PawnReg src)
+{
+  Register reg = (src == PawnReg::Pri) ? pri : alt;
+  __ movl(Operand(stk, -4), reg);
+  __ subq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitPUSH_C(const cell_t* vals, size_t nvals)
+{
+  for (size_t i = 1; i <= nvals; i++)
+    __ movl(Operand(stk, -(4 * int(i))), vals[i - 1]);
+  __ subq(stk, 4 * nvals);
+  return true;
+}
+
+bool
+Compiler::visitPUSH_ADR(const cell_t* offsets, size_t nvals)
+{
+  // We temporarily relocate FRM to be a local address instead of an
+  // absolute address.
+  __ subq(frm, dat);
+  for (size_t i = 1; i <= nvals; i++) {
+    __ leal(tmp, Operand(frm, offsets[i - 1]));
+    __ movl(Operand(stk, -(4 * int(i))), tmp);
+  }
+  __ subq(stk, 4 * nvals);
+  __ addq(frm, dat);
+  return true;
+}
+
+bool
+Compiler::visitPUSH_S(const cell_t* offsets, size_t nvals)
+{
+  for (size_t i = 1; i <= nvals; i++) {
+    __ movl(tmp, Operand(frm, offsets[i - 1]));
+    __ movl(Operand(stk, -(4 * int(i))), tmp);
+  }
+  __ subq(stk, 4 * nvals);
+  return true;
+}
+
+bool
+Compiler::visitPUSH(const cell_t* offsets, size_t nvals)
+{
+  for (size_t i = 1; i <= nvals; i++) {
+    __ movl(tmp, Operand(dat, offsets[i - 1]));
+    __ movl(Operand(stk, -(4 * int(i))), tmp);
+  }
+  __ subq(stk, 4 * nvals);
+  return true;
+}
+
+bool
+Compiler::visitZERO(PawnReg dest)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ xorl(reg, reg);
+  return true;
+}
+
+bool
+Compiler::visitADD()
+{
+  __ addl(pri, alt);
+  return true;
+}
+
+bool
+Compiler::visitSUB()
+{
+  __ subl(pri, alt);
+  return true;
+}
+
+bool
+Compiler::visitSUB_ALT()
+{
+  __ movl(tmp, alt);
+  __ subl(tmp, pri);
+  __ movl(pri, tmp);
+  return true;
+}
+
+// With call stats on, Scripted frames keep the call's start time and the
+// caller's callee ticks (see CallTimer) right below the frame header.
+static const int32_t kCallStartOffset = -24;
+static const int32_t kSavedCalleeTicksOffset = -32;
+
+void
+Compiler::emitEnterCallStats()
+{
+  // Two words, so the stack stays aligned.
+  __ rdtsc();
+  __ shlq(rdx, 32);
+  __ orq(rax, rdx);
+  __ push(rax);
+  __ movq(scratch0, AddressValue(env_->addressOfCalleeTicks()));
+  __ movq(rax, Operand(scratch0, 0));
+  __ push(rax);
+  __ xorl(rax, rax);
+  __ movq(Operand(scratch0, 0), rax);
+}
+
+void
+Compiler::emitLeaveCallStats()
+{
+  CallStats* stats = &method_info_->call_stats();
+
+  __ movq(scratch1, pri);
+
+  // rax = the time spent in this call.
+  __ rdtsc();
+  __ shlq(rdx, 32);
+  __ orq(rax, rdx);
+  __ subq(rax, Operand(rbp, kCallStartOffset));
+
+  __ movq(scratch0, AddressValue(env_->addressOfCalleeTicks()));
+  __ movq(scratch2, intptr_t(stats));
+  __ addq(Operand(scratch2, int32_t(offsetof(CallStats, calls))), 1);
+  __ addq(Operand(scratch2, int32_t(offsetof(CallStats, total_ticks))), rax);
+  __ movq(rdx, rax);
+  __ subq(rdx, Operand(scratch0, 0));
+  __ addq(Operand(scratch2, int32_t(offsetof(CallStats, self_ticks))), rdx);
+
+  // Hand the caller its callee ticks, with this call added.
+  __ addq(rax, Operand(rbp, kSavedCalleeTicksOffset));
+  __ movq(Operand(scratch0, 0), rax);
+
+  __ movq(pri, scratch1);
+}
+
+void
+Compiler::emitPrologue()
+{
+  __ enterFrame(JitFrameType::Scripted, pcode_start_);
+  if (call_stats_)
+    emitEnterCallStats();
+
+  // Push the old frame onto the stack.
+  __ subq(stk, 8);
+  __ movl(tmp, frmAddr());
+  __ movl(Operand(stk, 4), tmp);
+  __ movl(tmp, hpAddr());
+  __ movl(Operand(stk, 0), tmp);
+
+  // Get and store the new frame.
+  __ movq(tmp, stk);
+  __ movq(frm, stk);
+  __ subq(tmp, dat);
+  __ movl(frmAddr(), tmp);
+
+  int32_t max_stack = method_info_->max_stack();
+  assert(max_stack >= 0);
+
+  if (max_stack) {
+    __ movl(rax, hpAddr());
+    __ leaq(rax, Operand(dat, rax, NoScale, STACK_MARGIN));
+    __ leaq(rcx, Operand(stk, -max_stack));
+    __ cmpq(rcx, rax);
+    jumpOnError(below, SP_ERROR_STACKLOW);
+  }
+}
+
+void
+Compiler::emitOsrEntry(Block* target)
+{
+  __ enterFrame(JitFrameType::Scripted, pcode_start_);
+
+  // The interpreter has timed the call up to here; the rest counts as a
+  // new call's time, and RETN counts the call.
+  if (call_stats_)
+    emitEnterCallStats();
+
+  // The interpreter has already built the frame, so just pick it up.
+  __ movl(frm, frmAddr());
+  __ addq(frm, dat);
+
+  // The prologue checked the stack from the start of the frame, and the heap
+  // may have grown since, so check again.
+  int32_t max_stack = method_info_->max_stack();
+  if (max_stack) {
+    __ movl(rax, hpAddr());
+    __ leaq(rax, Operand(dat, rax, NoScale, STACK_MARGIN));
+    __ leaq(rcx, Operand(frm, -max_stack));
+    __ cmpq(rcx, rax);
+    jumpOnError(below, SP_ERROR_STACKLOW);
+  }
+
+  // Pop pri and alt, which the interpreter left on top of its stack.
+  __ movl(pri, Operand(stk, 0));
+  __ movl(alt, Operand(stk, 4));
+  __ addq(stk, 8);
+
+  __ jmp(target->label());
+}
+
+bool
+Compiler::visitSHL()
+{
+  __ movl(rcx, alt);
+  __ shll_cl(pri);
+  return true;
+}
+
+bool
+Compiler::visitSHR()
+{
+  __ movl(rcx, alt);
+  __ shrl_cl(pri);
+  return true;
+}
+
+bool
+Compiler::visitSSHR()
+{
+  __ movl(rcx, alt);
+  __ sarl_cl(pri);
+  return true;
+}
+
+bool
+Compiler::visitSHL_C(PawnReg dest, cell_t amount)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ shll(reg, amount);
+  return true;
+}
+
+bool
+Compiler::visitSMUL()
+{
+  __ imull(pri, alt);
+  return true;
+}
+
+bool
+Compiler::visitNOT()
+{
+  __ testl(rax, rax);
+  __ movl(rax, 0);
+  __ set(zero, rax);
+  return true;
+}
+
+bool
+Compiler::visitNEG()
+{
+  __ negl(rax);
+  return true;
+}
+
+bool
+Compiler::visitXOR()
+{
+  __ xorl(pri, alt);
+  return true;
+}
+
+bool
+Compiler::visitOR()
+{
+  __ orl(pri, alt);
+  return true;
+}
+
+bool
+Compiler::visitAND()
+{
+  __ andl(pri, alt);
+  return true;
+}
+
+bool
+Compiler::visitINVERT()
+{
+  __ notl(pri);
+  return true;
+}
+
+bool
+Compiler::visitADD_C(cell_t value)
+{
+  __ addl(pri, value);
+  return true;
+}
+
+bool
+Compiler::visitSMUL_C(cell_t value)
+{
+  __ imull(pri, pri, value);
+  return true;
+}
+
+bool
+Compiler::visitCompareOp(CompareOp op)
+{
+  ConditionCode cc = OpToCondition(op);
+  __ cmpl(pri, alt);
+  __ movl(pri, 0);
+  __ set(cc, pri);
+  return true;
+}
+
+bool
+Compiler::visitEQ_C(PawnReg src, cell_t value)
+{
+  Register reg = (src == PawnReg::Pri) ? pri : alt;
+  __ cmpl(reg, value);
+  __ movl(pri, 0);
+  __ set(equal, pri);
+  return true;
+}
+
+bool
+Compiler::visitINC(PawnReg dest)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ addl(reg, 1);
+  return true;
+}
+
+bool
+Compiler::visitINC(cell_t offset)
+{
+  __ addl(Operand(dat, offset), 1);
+  return true;
+}
+
+bool
+Compiler::visitINC_S(cell_t offset)
+{
+  __ addl(Operand(frm, offset), 1);
+  return true;
+}
+
+bool
+Compiler::visitINC_I()
+{
+  __ addl(Operand(dat, pri, NoScale), 1);
+  return true;
+}
+
+bool
+Compiler::visitDEC(PawnReg dest)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ subl(reg, 1);
+  return true;
+}
+
+bool
+Compiler::visitDEC(cell_t offset)
+{
+  __ subl(Operand(dat, offset), 1);
+  return true;
+}
+
+bool
+Compiler::visitDEC_S(cell_t offset)
+{
+  __ subl(Operand(frm, offset), 1);
+  return true;
+}
+
+bool
+Compiler::visitDEC_I()
+{
+  __ subl(Operand(dat, pri, NoScale), 1);
+  return true;
+}
+
+bool
+Compiler::visitLOAD(PawnReg dest, cell_t srcaddr)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ movl(reg, Operand(dat, srcaddr));
+  return true;
+}
+
+bool
+Compiler::visitLOAD_BOTH(cell_t offsetForPri, cell_t offsetForAlt)
+{
+  visitLOAD(PawnReg::Pri, offsetForPri);
+  visitLOAD(PawnReg::Alt, offsetForAlt);
+  return true;
+}
+
+bool
+Compiler::visitLOAD_S(PawnReg dest, cell_t srcoffs)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ movl(reg, Operand(frm, srcoffs));
+  return true;
+}
+
+bool
+Compiler::visitLOAD_S_BOTH(cell_t offsetForPri, cell_t offsetForAlt)
+{
+  visitLOAD_S(PawnReg::Pri, offsetForPri);
+  visitLOAD_S(PawnReg::Alt, offsetForAlt);
+  return true;
+}
+
+bool
+Compiler::visitLREF_S(PawnReg dest, cell_t srcoffs)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ movl(reg, Operand(frm, srcoffs));
+  __ movl(reg, Operand(dat, reg, NoScale));
+  return true;
+}
+
+bool
+Compiler::visitCONST(PawnReg dest, cell_t val)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ movl(reg, val);
+  return true;
+}
+
+bool
+Compiler::visitADDR(PawnReg dest, cell_t offset)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ movl(reg, frmAddr());
+  __ addl(reg, offset);
+  return true;
+}
+
+bool
+Compiler::visitSTOR(cell_t offset, PawnReg src)
+{
+  Register reg = (src == PawnReg::Pri) ? pri : alt;
+  __ movl(Operand(dat, offset), reg);
+  return true;
+}
+
+bool
+Compiler::visitSTOR_S(cell_t offset, PawnReg src)
+{
+  Register reg = (src == PawnReg::Pri) ? pri : alt;
+  __ movl(Operand(frm, offset), reg);
+  return true;
+}
+
+bool
+Compiler::visitIDXADDR()
+{
+  __ leal(pri, Operand(alt, pri, ScaleFour));
+  return true;
+}
+
+bool
+Compiler::visitSREF_S(cell_t offset, PawnReg src)
+{
+  Register reg = (src == PawnReg::Pri) ? pri : alt;
+  __ movl(tmp, Operand(frm, offset));
+  __ movl(Operand(dat, tmp, NoScale), reg);
+  return true;
+}
+
+bool
+Compiler::visitPOP(PawnReg dest)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ movl(reg, Operand(stk, 0));
+  __ addq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitSWAP(PawnReg dest)
+{
+  Register reg = (dest == PawnReg::Pri) ? pri : alt;
+  __ movl(tmp, Operand(stk, 0));
+  __ movl(Operand(stk, 0), reg);
+  __ movl(reg, tmp);
+  return true;
+}
+
+bool
+Compiler::visitLIDX()
+{
+  __ leal(pri, Operand(alt, pri, ScaleFour));
+  __ movl(pri, Operand(dat, pri, NoScale));
+  return true;
+}
+
+bool
+Compiler::visitCONST(cell_t offset, cell_t value)
+{
+  __ movl(Operand(dat, offset), value);
+  return true;
+}
+
+bool
+Compiler::visitCONST_S(cell_t offset, cell_t value)
+{
+  __ movl(Operand(frm, offset), value);
+  return true;
+}
+
+bool
+Compiler::visitLOAD_I()
+{
+  emitCheckAddress(pri);
+  __ movl(pri, Operand(dat, pri, NoScale));
+  return true;
+}
+
+bool
+Compiler::visitSTOR_I()
+{
+  emitCheckAddress(alt);
+  __ movl(Operand(dat, alt, NoScale), pri);
+  return true;
+}
+
+bool
+Compiler::visitSDIV(PawnReg dest)
+{
+  Register dividend = (dest == PawnReg::Pri) ? pri : alt;
+  Register divisor = (dest == PawnReg::Pri) ? alt : pri;
+
+  // Guard against divide-by-zero.
+  __ testl(divisor, divisor);
+  jumpOnError(zero, SP_ERROR_DIVIDE_BY_ZERO);
+
+  // A more subtle case; -INT_MIN / -1 yields an overflow exception.
+  Label ok;
+  __ cmpl(divisor, -1);
+  __ j(not_equal, &ok);
+  __ cmpl(dividend, 0x80000000);
+  jumpOnError(equal, SP_ERROR_INTEGER_OVERFLOW);
+  __ bind(&ok);
+
+  // Now we can actually perform the divide.
+  __ movl(tmp, divisor);
+  if (dest == PawnReg::Pri)
+    __ movl(rdx, dividend);
+  else
+    __ movl(rax, dividend);
+  __ sarl(rdx, 31);
+  __ idivl(tmp);
+  return true;
+}
+
+bool
+Compiler::visitLODB_I(cell_t width)
+{
+  emitCheckAddress(pri);
+  __ movl(pri, Operand(dat, pri, NoScale));
+  if (width == 1)
+    __ andl(pri, 0xff);
+  else if (width == 2)
+    __ andl(pri, 0xffff);
+  return true;
+}
+
+bool
+Compiler::visitSTRB_I(cell_t width)
+{
+  emitCheckAddress(alt);
+  if (width == 1)
+    __ movb(Operand(dat, alt, NoScale), pri);
+  else if (width == 2)
+    __ movw(Operand(dat, alt, NoScale), pri);
+  else if (width == 4)
+    __ movl(Operand(dat, alt, NoScale), pri);
+  return true;
+}
+
+bool
+Compiler::visitRETN()
+{
+  // Restore the old stack and frame pointer.
+  __ movq(stk, frm);
+  __ movl(frm, Operand(stk, 4));              // get the old frm
+  __ movl(tmp, Operand(stk, 0));              // get the old hp
+  __ movl(hpAddr(), tmp);
+  __ addq(stk, 8);                            // pop stack
+  __ movl(frmAddr(), frm);                    // store back old frm
+  __ addq(frm, dat);                          // relocate
+
+  // Remove parameters.
+  __ movl(tmp, Operand(stk, 0));
+  __ leaq(stk, Operand(stk, tmp, ScaleFour, 4));
+
+  if (call_stats_)
+    emitLeaveCallStats();
+
+  __ leaveFrame();
+  recordReturnSite();
+  __ ret();
+  return true;
+}
+
+bool
+Compiler::visitMOVS(uint32_t amount)
+{
+  unsigned dwords = amount / 4;
+  unsigned bytes = amount % 4;
+
+  // Neither rsi nor rdi hold VM state, so they need not be saved.
+  __ cld();
+  __ leaq(rdi, Operand(dat, alt, NoScale));
+  __ leaq(rsi, Operand(dat, pri, NoScale));
+  if (dwords) {
+    __ movl(rcx, dwords);
+    __ rep_movsd();
+  }
+  if (bytes) {
+    __ movl(rcx, bytes);
+    __ rep_movsb();
+  }
+  return true;
+}
+
+bool
+Compiler::visitFILL(uint32_t amount)
+{
+  // eax/pri is used implicitly.
+  unsigned dwords = amount / 4;
+  __ leaq(rdi, Operand(dat, alt, NoScale));
+  __ movl(rcx, dwords);
+  __ cld();
+  __ rep_stosd();
+  return true;
+}
+
+bool
+Compiler::visitSTRADJUST_PRI()
+{
+  __ addl(pri, 4);
+  __ sarl(pri, 2);
+  return true;
+}
+
+bool
+Compiler::visitFABS()
+{
+  __ movl(pri, Operand(stk, 0));
+  __ andl(pri, 0x7fffffff);
+  __ addq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitFLOAT()
+{
+  __ cvtsi2ss(xmm0, Operand(stk, 0));
+  __ movd(pri, xmm0);
+  __ addq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitFLOATADD()
+{
+  __ movss(xmm0, Operand(stk, 0));
+  __ addss(xmm0, Operand(stk, 4));
+  __ movd(pri, xmm0);
+  __ addq(stk, 8);
+  return true;
+}
+
+bool
+Compiler::visitFLOATSUB()
+{
+  __ movss(xmm0, Operand(stk, 0));
+  __ subss(xmm0, Operand(stk, 4));
+  __ movd(pri, xmm0);
+  __ addq(stk, 8);
+  return true;
+}
+
+bool
+Compiler::visitFLOATMUL()
+{
+  __ movss(xmm0, Operand(stk, 0));
+  __ mulss(xmm0, Operand(stk, 4));
+  __ movd(pri, xmm0);
+  __ addq(stk, 8);
+  return true;
+}
+
+bool
+Compiler::visitFLOATDIV()
+{
+  __ movss(xmm0, Operand(stk, 0));
+  __ divss(xmm0, Operand(stk, 4));
+  __ movd(pri, xmm0);
+  __ addq(stk, 8);
+  return true;
+}
+
+bool
+Compiler::visitRND_TO_NEAREST()
+{
+  // Docs say that MXCSR must be preserved across function calls, so we
+  // assume that we'll always get the defualt round-to-nearest.
+  __ cvtss2si(pri, Operand(stk, 0));
+  __ addq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitRND_TO_CEIL()
+{
+  // Truncate, then round up if the truncated value is below the input. On
+  // overflow or NaN, cvttss2si produces 0x80000000 which we leave as-is.
+  Label done;
+  __ movss(xmm0, Operand(stk, 0));
+  __ cvttss2si(pri, xmm0);
+  __ cmpl(pri, 0x80000000);
+  __ j(equal, &done);
+  __ cvtsi2ss(xmm1, pri);
+  __ ucomiss(xmm0, xmm1);
+  __ j(not_above, &done);
+  __ addl(pri, 1);
+  __ bind(&done);
+  __ addq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitRND_TO_ZERO()
+{
+  __ cvttss2si(pri, Operand(stk, 0));
+  __ addq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitRND_TO_FLOOR()
+{
+  // See visitRND_TO_CEIL(); this rounds down instead.
+  Label done;
+  __ movss(xmm0, Operand(stk, 0));
+  __ cvttss2si(pri, xmm0);
+  __ cmpl(pri, 0x80000000);
+  __ j(equal, &done);
+  __ cvtsi2ss(xmm1, pri);
+  __ ucomiss(xmm1, xmm0);
+  __ j(not_above, &done);
+  __ subl(pri, 1);
+  __ bind(&done);
+  __ addq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitFLOATCMP()
+{
+  // This is the old float cmp, which returns ordered results. In newly
+  // compiled code it should not be used or generated.
+  //
+  // Note that the checks here are inverted: the test is |rhs OP lhs|.
+  Label bl, ab, done;
+  __ movss(xmm0, Operand(stk, 4));
+  __ ucomiss(xmm0, Operand(stk, 0));
+  __ j(above, &ab);
+  __ j(below, &bl);
+  __ xorl(pri, pri);
+  __ jmp(&done);
+  __ bind(&ab);
+  __ movl(pri, -1);
+  __ jmp(&done);
+  __ bind(&bl);
+  __ movl(pri, 1);
+  __ bind(&done);
+  __ addq(stk, 8);
+  return true;
+}
+
+bool
+Compiler::visitFLOAT_CMP_OP(CompareOp op)
+{
+  ConditionCode code;
+  switch (op) {
+  case CompareOp::Sgrtr:
+    code = above;
+    break;
+  case CompareOp::Sgeq:
+    code = above_equal;
+    break;
+  case CompareOp::Sleq:
+    code = below_equal;
+    break;
+  case CompareOp::Sless:
+    code = below;
+    break;
+  case CompareOp::Eq:
+    code = equal;
+    break;
+  case CompareOp::Neq:
+    code = not_equal;
+    break;
+  default:
+    assert(false);
+    reportError(SP_ERROR_INVALID_INSTRUCTION);
+    return false;
+  }
+  emitFloatCmp(code);
+  return true;
+}
+
+bool
+Compiler::visitFLOAT_NOT()
+{
+  __ xorps(xmm0, xmm0);
+  __ ucomiss(xmm0, Operand(stk, 0));
+
+  // See emitFloatCmp() - this is a shorter version.
+  Label done;
+  __ movl(rax, 1);
+  __ j(parity, &done);
+  __ set(zero, rax);
+  __ bind(&done);
+
+  __ addq(stk, 4);
+  return true;
+}
+
+bool
+Compiler::visitFLOAT_MATH(FloatMathOp op)
+{
+  size_t arity = FloatMathArity(op);
+
+  if (op == FloatMathOp::Sqrt) {
+    __ sqrtss(xmm0, Operand(stk, 0));
+    __ movd(pri, xmm0);
+  } else {
+    // Everything else goes through a plain C call; these natives cannot
+    // fail, so no exit frame is needed. Two pushes keep the stack aligned.
+    __ push(alt);
+    __ subq(rsp, 8);
+
+    __ movq(ArgReg1, stk);
+    __ movl(ArgReg0, int32_t(op));
+    __ callWithABI(AddressValue((void*)InvokeFloatMath));
+
+    // Natives return a 32-bit cell; clear the upper half of pri.
+    __ movl(pri, pri);
+    __ addq(rsp, 8);
+    __ pop(alt);
+  }
+
+  __ addq(stk, int32_t(arity * sizeof(cell_t)));
+  return true;
+}
+
+bool
+Compiler::visitSTACK(cell_t amount)
+{
+  __ addq(stk, amount);
+  return true;
+}
+
+bool
+Compiler::visitHEAP(cell_t amount)
+{
+  // Note: this must not clobber PRI.
+  __ movl(alt, hpAddr());
+  __ addl(hpAddr(), amount);
+
+  if (amount < 0) {
+    __ cmpl(hpAddr(), context_->DataSize());
+    jumpOnError(below, SP_ERROR_HEAPMIN);
+  } else {
+    __ movl(tmp, hpAddr());
+    __ leaq(tmp, Operand(dat, tmp, NoScale, STACK_MARGIN));
+    __ cmpq(tmp, stk);
+    jumpOnError(above, SP_ERROR_HEAPLOW);
+  }
+  return true;
+}
+
+bool
+Compiler::visitJUMP(cell_t offset)
+{
+  assert(block_->successors().length() == 1);
+
+  Block* successor = block_->successors()[0];
+  if (isNextBlock(successor)) {
+    // We'll visit this block next, and this terminates the block, so there's
+    // no need to emit a jump instruction.
+    assert(!isBackedge(successor));
+    return true;
+  }
+
+  Label* target = successor->label();
+  if (isBackedge(successor)) {
+    __ jmp32(target);
+    backward_jumps_.append(BackwardJump(masm.pc(), op_cip_));
+  } else {
+    __ jmp(target);
+  }
+  return true;
+}
+
+bool
+Compiler::visitJcmp(CompareOp op, cell_t offset)
+{
+  ConditionCode cc;
+  switch (op) {
+    case CompareOp::Zero:
+    case CompareOp::NotZero:
+      cc = (op == CompareOp::Zero) ? zero : not_zero;
+      __ testl(pri, pri);
+      break;
+    case CompareOp::Eq:
+    case CompareOp::Neq:
+    case CompareOp::Sless:
+    case CompareOp::Sleq:
+    case CompareOp::Sgrtr:
+    case CompareOp::Sgeq:
+      cc = OpToCondition(op);
+      __ cmpl(pri, alt);
+      break;
+    default:
+      assert(false);
+      return false;
+  }
+
+  assert(block_->successors().length() == 2);
+  Block* fallthrough = block_->successors()[0];
+  Block* target = block_->successors()[1];
+
+  assert(!isBackedge(fallthrough));
+
+  if (isBackedge(target)) {
+    __ j32(cc, target->label());
+    backward_jumps_.append(BackwardJump(masm.pc(), op_cip_));
+
+    if (!isNextBlock(fallthrough))
+      __ jmp(fallthrough->label());
+    return true;
+  }
+
+  if (isNextBlock(target)) {
+    // Invert the condition so we can fallthrough to the target instead.
+    __ j(InvertConditionCode(cc), fallthrough->label());
+  } else {
+    __ j(cc, target->label());
+    if (!isNextBlock(fallthrough))
+      __ jmp(fallthrough->label());
+  }
+  return true;
+}
+
+bool
+Compiler::visitTRACKER_PUSH_C(cell_t amount)
+{
+  // Two pushes keep the stack aligned.
+  __ push(pri);
+  __ push(alt);
+
+  __ movl(ArgReg1, amount);
+  __ movq(ArgReg0, cxreg);
+  __ callWithABI(AddressValue((void*)InvokePushTracker));
+  __ testl(rax, rax);
+  jumpOnError(not_zero);
+
+  __ pop(alt);
+  __ pop(pri);
+  return true;
+}
+
+bool
+Compiler::visitTRACKER_POP_SETHEAP()
+{
+  // Save registers.
+  __ push(pri);
+  __ push(alt);
+
+  // Get the context pointer and call the sanity checker.
+  __ movq(ArgReg0, cxreg);
+  __ callWithABI(AddressValue((void*)InvokePopTrackerAndSetHeap));
+  __ testl(rax, rax);
+  jumpOnError(not_zero);
+
+  __ pop(alt);
+  __ pop(pri);
+  return true;
+}
+
+bool
+Compiler::visitREBASE(cell_t addr, cell_t iv_size, cell_t data_size)
+{
+  // We need to sync |sp| first.
+  __ movq(tmp, stk);
+  __ subq(tmp, dat);
+  __ movl(spAddr(), tmp);
+
+  // Note: pri must be read before it could be clobbered by an argument.
+  __ movl(ArgReg1, pri);
+  __ subq(rsp, 16);
+  __ movl(Operand(rsp, 0), iv_size);
+  __ movl(Operand(rsp, 4), data_size);
+  __ movq(ArgReg3, rsp);
+  __ movl(ArgReg2, addr);
+  __ movq(ArgReg0, cxreg);
+  __ callWithABI(AddressValue((void*)InvokeRebaseArray));
+  __ addq(rsp, 16);
+  __ testl(rax, rax);
+  jumpOnError(not_zero);
+  return true;
+}
+
+bool
+Compiler::visitBREAK()
+{
+  if (!Environment::get()->IsDebugBreakEnabled())
+    return true;
+
+  __ call(&debug_break_);
+  emitCipMapping(op_cip_);
+  return true;
+}
+
+bool
+Compiler::visitHALT(cell_t value)
+{
+  // We don't support this. It's included in the bytestream by default, but it
+  // must be unreachable.
+  reportError(SP_ERROR_INVALID_INSTRUCTION);
+  return false;
+}
+
+bool
+Compiler::visitBOUNDS(uint32_t limit)
+{
+  if (isRedundantBoundsCheck())
+    return true;
+
+  OutOfBoundsErrorPath* bounds = new OutOfBoundsErrorPath(op_cip_, limit);
+  if (!ool_paths_.append(bounds)) {
+    reportError(SP_ERROR_OUT_OF_MEMORY);
+    return false;
+  }
+
+  __ cmpl(rax, limit);
+  __ j(above, bounds->label());
+  return true;
+}
+
+void
+Compiler::emitCheckAddress(Register reg)
+{
+  if (context_->HasUncheckedMemory()) {
+    // Any 32-bit offset past the end of memory faults in the guard pages, so
+    // just make sure the upper half of the register is clear.
+    __ movl(reg, reg);
+  } else {
+    // Check if we're in memory bounds.
+    __ cmpl(reg, context_->HeapSize());
+    jumpOnError(not_below, SP_ERROR_MEMACCESS);
+  }
+
+  // Check if we're in the invalid region between hp and sp.
+  Label done;
+  __ cmpl(reg, hpAddr());
+  __ j(below, &done);
+  __ leaq(tmp, Operand(dat, reg, NoScale));
+  __ cmpq(tmp, stk);
+  jumpOnError(below, SP_ERROR_MEMACCESS);
+  __ bind(&done);
+
+  if (context_->HasUncheckedMemory())
+    recordUncheckedAccess();
+}
+
+bool
+Compiler::visitGENARRAY(uint32_t dims, bool autozero)
+{
+  if (dims == 1)
+  {
+    // flat array; we can generate this without indirection tables.
+    // Note that we can overwrite ALT because technically STACK should be destroying ALT
+    __ movl(alt, hpAddr());
+    __ movl(tmp, Operand(stk, 0));
+    __ movl(Operand(stk, 0), alt);    // store base of the array into the stack.
+    __ leal(alt, Operand(alt, tmp, ScaleFour));
+    __ movl(hpAddr(), alt);
+    __ addq(alt, dat);
+    __ cmpq(alt, stk);
+    jumpOnError(not_below, SP_ERROR_HEAPLOW);
+
+    // Save tmp across the call; two pushes keep the stack aligned.
+    __ shll(tmp, 2);
+    __ push(tmp);
+    __ push(tmp);
+    __ movl(ArgReg1, tmp);
+    __ movq(ArgReg0, cxreg);
+    __ callWithABI(AddressValue((void*)InvokePushTracker));
+    __ pop(tmp);
+    __ pop(tmp);
+    __ shrl(tmp, 2);
+    __ testl(rax, rax);
+    jumpOnError(not_zero);
+
+    if (autozero) {
+      // Note - tmp is rcx and still intact.
+      __ xorl(rax, rax);
+      __ movl(rdi, Operand(stk, 0));
+      __ addq(rdi, dat);
+      __ cld();
+      __ rep_stosd();
+    }
+  } else {
+    __ push(pri);
+    __ push(pri);
+
+    // int GenerateArray(cx, vars[], uint32_t, cell_t*, int, unsigned*);
+    __ movl(ArgReg3, autozero ? 1 : 0);
+    __ movq(ArgReg2, stk);
+    __ movl(ArgReg1, dims);
+    __ movq(ArgReg0, cxreg);
+    __ callWithABI(AddressValue((void*)InvokeGenerateFullArray));
+
+    // restore pri to tmp
+    __ pop(tmp);
+    __ pop(tmp);
+
+    __ testl(rax, rax);
+    jumpOnError(not_zero);
+
+    // Move tmp back to pri, remove pushed args.
+    __ movl(pri, tmp);
+    __ addq(stk, (dims - 1) * 4);
+  }
+  return true;
+}
+
+class CallThunk : public OutOfLinePath
+{
+ public:
+  CallThunk(cell_t pcode_offset)
+   : pcode_offset(pcode_offset)
+  {
+  }
+
+  bool emit(Compiler* cc) override {
+    cc->emitCallThunk(this);
+    return true;
+  }
+
+  cell_t pcode_offset;
+};
+
+bool
+Compiler::visitCALL(cell_t offset)
+{
+  // Scripted callees need no Win64 home space, and a plain call leaves the
+  // return address right where the cip mapping below is recorded.
+  __ assertStackAligned();
+
+  CompiledFunction* target = directCallTarget(offset);
+  if (!target) {
+    // Need to emit a delayed thunk.
+    CallThunk* thunk = new CallThunk(offset);
+    __ call(thunk->label());
+    if (!ool_paths_.append(thunk)) {
+      reportError(SP_ERROR_OUT_OF_MEMORY);
+      return false;
+    }
+  } else {
+    // Function is already emitted, we can do a direct call.
+    __ call(AddressValue(target->GetEntryAddress()));
+  }
+
+  // Map the return address to the cip that started this call.
+  emitCipMapping(op_cip_);
+  return true;
+}
+
+void
+Compiler::emitCallThunk(CallThunk* thunk)
+{
+  // Get the return address, since that is the call that we need to patch.
+  __ movq(ArgReg3, Operand(rsp, 0));
+
+  // Enter the exit frame. The return address and three frame words leave
+  // the stack aligned.
+  __ enterExitFrame(ExitFrameType::Helper, 0);
+
+  // If the callee is still cold it will be interpreted, which needs the
+  // context's view of the arguments.
+  __ movq(rax, stk);
+  __ subq(rax, dat);
+  __ movl(spAddr(), rax);
+
+  // Reserve an aligned slot for the ThunkResult.
+  static_assert(sizeof(ThunkResult) <= 16, "ThunkResult must fit in its slot");
+  __ subq(rsp, 16);
+
+  // Set arguments.
+  __ movq(ArgReg2, rsp);
+  __ movl(ArgReg1, thunk->pcode_offset);
+  __ movq(ArgReg0, cxreg);
+
+  __ callWithABI(AddressValue((void*)CompileFromThunk));
+  __ movq(rdx, Operand(rsp, offsetof(ThunkResult, code)));
+  __ movl(rcx, Operand(rsp, offsetof(ThunkResult, rval)));
+  __ leaveExitFrame();
+
+  __ testl(rax, rax);
+  jumpOnError(not_zero);
+
+  Label interpreted;
+  __ testq(rdx, rdx);
+  __ j(zero, &interpreted);
+  __ jmp(rdx);
+
+  // The callee ran in the interpreter, which has already popped its
+  // arguments. Pick up the new stack and return straight to the caller.
+  __ bind(&interpreted);
+  __ movl(pri, rcx);
+  __ movl(stk, spAddr());
+  __ addq(stk, dat);
+
+  __ cmpl(AddressOperand(Environment::get()->addressOfExceptionCode()), 0);
+  __ j(not_zero, &return_reported_error_);
+  __ ret();
+}
+
+bool
+Compiler::visitSYSREQ_N(uint32_t native_index, uint32_t nparams)
+{
+  NativeEntry* native = rt_->NativeAt(native_index);
+
+  // Store the number of parameters on the stack.
+  __ movl(Operand(stk, -4), nparams);
+  __ subq(stk, 4);
+  emitLegacyNativeCall(native_index, native);
+  __ addq(stk, (nparams + 1) * sizeof(cell_t));
+  return true;
+}
+
+bool
+Compiler::visitSYSREQ_C(uint32_t native_index)
+{
+  emitLegacyNativeCall(native_index, rt_->NativeAt(native_index));
+  return true;
+}
+
+void
+Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
+{
+  if (isLeafNative(native)) {
+    emitLeafNativeCall(native);
+    return;
+  }
+
+  CodeLabel return_address;
+  __ enterInlineExitFrame(ExitFrameType::Native, native_index, &return_address);
+
+  // Save ALT and the old heap pointer. Two pushes keep the stack aligned.
+  __ movl(tmp, hpAddr());
+  __ push(alt);
+  __ push(tmp);
+
+  // With native stats on, keep the start time in another two words. This
+  // clobbers pri and alt, so it has to come first.
+  if (native->stats) {
+    __ rdtsc();
+    __ shlq(rdx, 32);
+    __ orq(rax, rdx);
+    __ push(rax);
+    __ subq(rsp, 8);
+  }
+
+  // Check whether the native is bound.
+  bool immutable = isImmutableNative(native);
+  if (!immutable) {
+    __ movq(rax, AddressOperand(&native->legacy_fn));
+    __ testq(rax, rax);
+    jumpOnError(zero, SP_ERROR_INVALID_NATIVE);
+  }
+
+  // The second parameter is the absolute stack address.
+  __ movq(ArgReg1, stk);
+
+  // Relocate our absolute stk to be dat-relative, and update the context's
+  // view.
+  __ subq(stk, dat);
+  __ movl(spAddr(), stk);
+
+  // The first parameter is the context.
+  __ movq(ArgReg0, cxreg);
+
+  // Invoke the native.
+  if (immutable)
+    __ callWithABI(AddressValue((void*)native->legacy_fn));
+  else
+    __ callWithABI(rax);
+  __ bind(&return_address);
+  // Map the return address to the cip that initiated this call.
+  emitCipMapping(op_cip_);
+
+  // Natives return a 32-bit cell; clear the upper half of pri.
+  __ movl(pri, pri);
+
+  if (native->stats) {
+    emitNativeStats(native, Operand(rsp, 8));
+    __ addq(rsp, 16);
+  }
+
+  // Restore the heap pointer and ALT.
+  __ pop(tmp);
+  __ movl(hpAddr(), tmp);
+  __ pop(alt);
+
+  // Restore SP.
+  __ addq(stk, dat);
+
+  __ leaveInlineExitFrame();
+
+  // Check for errors. Note we jump directly to the return stub since the
+  // error has already been reported.
+  __ cmpl(AddressOperand(Environment::get()->addressOfExceptionCode()), 0);
+  __ j(not_zero, &return_reported_error_);
+}
+
+// Leaf natives can't throw or re-enter the VM, so there is no exit frame, the
+// heap pointer is left alone, and there is nothing to check afterward. The
+// context still needs sp to resolve addresses on the stack.
+void
+Compiler::emitLeafNativeCall(NativeEntry* native)
+{
+  // Save ALT, and pad so the stack stays aligned. With native stats on, the
+  // pad holds the start time.
+  __ push(alt);
+  if (native->stats) {
+    __ rdtsc();
+    __ shlq(rdx, 32);
+    __ orq(rax, rdx);
+    __ push(rax);
+  } else {
+    __ subq(rsp, 8);
+  }
+
+  __ movq(ArgReg1, stk);
+  __ movq(tmp, stk);
+  __ subq(tmp, dat);
+  __ movl(spAddr(), tmp);
+  __ movq(ArgReg0, cxreg);
+  __ callWithABI(AddressValue((void*)native->legacy_fn));
+
+  // Natives return a 32-bit cell; clear the upper half of pri.
+  __ movl(pri, pri);
+  if (native->stats)
+    emitNativeStats(native, Operand(rsp, 0));
+  __ addq(rsp, 8);
+  __ pop(alt);
+}
+
+// Counts a native call that started at the time stored in |start|; see
+// RecordNativeCall. pri holds the native's return value.
+void
+Compiler::emitNativeStats(NativeEntry* native, const Operand& start)
+{
+  NativeStats* stats = native->stats;
+
+  __ movq(scratch1, pri);
+
+  // rax = the time spent in the native.
+  __ rdtsc();
+  __ shlq(rdx, 32);
+  __ orq(rax, rdx);
+  __ subq(rax, start);
+
+  __ movq(scratch2, intptr_t(stats));
+  __ addq(Operand(scratch2, int32_t(offsetof(NativeStats, calls))), 1);
+  __ addq(Operand(scratch2, int32_t(offsetof(NativeStats, total_ticks))), rax);
+
+  // The histogram bucket is the highest set bit; see NativeStatsBucket.
+  __ orq(rax, 1);
+  __ bsrq(tmp, rax);
+  __ addq(Operand(scratch2, tmp, ScaleEight, int32_t(offsetof(NativeStats, histogram))), 1);
+
+  __ movq(pri, scratch1);
+}
+
+bool
+Compiler::visitSWITCH(cell_t defaultOffset,
+                      const CaseTableEntry* cases,
+                      size_t ncases)
+{
+  assert(block_->successors().length() == ncases + 1);
+  Block* defaultCase = block_->successors()[0];
+
+  // Degenerate - 0 cases.
+  if (!ncases) {
+    if (!isNextBlock(defaultCase))
+      __ jmp(defaultCase->label());
+    return true;
+  }
+
+  // Degenerate - 1 case.
+  if (ncases == 1) {
+    Block* maybe = block_->successors()[1];
+    __ cmpl(pri, cases[0].value);
+    __ j(equal, maybe->label());
+    if (!isNextBlock(defaultCase))
+      __ jmp(defaultCase->label());
+    return true;
+  }
+
+  // We have two or more cases, so let's generate a full switch. Decide
+  // whether we'll make an if chain, or a jump table, based on whether
+  // the numbers are strictly sequential.
+  bool sequential = true;
+  {
+    cell_t first = cases[0].value;
+    cell_t last = first;
+    for (size_t i = 1; i < ncases; i++) {
+      if (cases[i].value != ++last) {
+        sequential = false;
+        break;
+      }
+    }
+  }
+
+  // First check whether the bounds are correct: if (a < LOW || a > HIGH);
+  // this check is valid whether or not we emit a sequential-optimized switch.
+  cell_t low = cases[0].value;
+  if (low != 0) {
+    // negate it so we'll get a lower bound of 0.
+    low = -low;
+    __ leal(tmp, Operand(pri, low));
+  } else {
+    __ movl(tmp, pri);
+  }
+
+  cell_t high = abs(cases[0].value - cases[ncases - 1].value);
+  __ cmpl(tmp, high);
+  __ j(above, defaultCase->label());
+
+  if (sequential) {
+    // Optimized table version. Unlike x86 we have spare scratch registers,
+    // so pri and alt are left alone.
+    CodeLabel table;
+    __ movq(scratch1, &table);
+    __ jmp(Operand(scratch1, tmp, ScaleEight));
+
+    __ bind(&table);
+    for (size_t i = 0; i < ncases; i++) {
+      Block* target = block_->successors()[i + 1];
+      __ emit_absolute_address(target->label());
+    }
+  } else {
+    // Slower version. Go through each case and generate a check.
+    for (size_t i = 0; i < ncases; i++) {
+      Block* target = block_->successors()[i + 1];
+      __ cmpl(pri, cases[i].value);
+      __ j(equal, target->label());
+    }
+    __ jmp(defaultCase->label());
+  }
+  return true;
+}
+
+void
+Compiler::emitFloatCmp(ConditionCode cc)
+{
+  unsigned lhs = 4;
+  unsigned rhs = 0;
+  if (cc == below || cc == below_equal) {
+    // NaN results in ZF=1 PF=1 CF=1
+    //
+    // ja/jae check for ZF,CF=0 and CF=0. If we make all relational compares
+    // look like ja/jae, we'll guarantee all NaN comparisons will fail (which
+    // would not be true for jb/jbe, unless we checked with jp).
+    if (cc == below)
+      cc = above;
+    else
+      cc = above_equal;
+    rhs = 4;
+    lhs = 0;
+  }
+
+  __ movss(xmm0, Operand(stk, rhs));
+  __ ucomiss(xmm0, Operand(stk, lhs));
+
+  // An equal or not-equal needs special handling for the parity bit.
+  if (cc == equal || cc == not_equal) {
+    // If NaN, PF=1, ZF=1, and E/Z tests ZF=1.
+    //
+    // If NaN, PF=1, ZF=1 and NE/NZ tests Z=0. But, we want any != with NaNs
+    // to return true, including NaN != NaN.
+    //
+    // To make checks simpler, we set |eax| to the expected value of a NaN
+    // beforehand. This also clears the top bits of |eax| for setcc.
+    Label done;
+    __ movl(rax, (cc == equal) ? 0 : 1);
+    __ j(parity, &done);
+    __ set(cc, rax);
+    __ bind(&done);
+  } else {
+    __ movl(rax, 0);
+    __ set(cc, rax);
+  }
+  __ addq(stk, 8);
+}
+
+void
+Compiler::jumpOnError(ConditionCode cc, int err)
+{
+  // Note: we accept 0 for err. In this case we expect the error to be in eax.
+  ErrorPath* path = new ErrorPath(op_cip_, err);
+  if (!ool_paths_.append(path))
+    reportError(SP_ERROR_OUT_OF_MEMORY);
+
+  __ j(cc, path->label());
+}
+
+void
+Compiler::emitOutOfBoundsErrorPath(OutOfBoundsErrorPath* path)
+{
+  CodeLabel return_address;
+  __ alignStack();
+  __ enterInlineExitFrame(ExitFrameType::Helper, 0, &return_address);
+  __ movl(ArgReg1, path->bounds);
+  __ movl(ArgReg0, rax);
+  __ callWithABI(AddressValue((void*)ReportOutOfBoundsError));
+  __ bind(&return_address);
+  emitCipMapping(path->cip);
+  __ leaveInlineExitFrame();
+  __ jmp(&return_reported_error_);
+}
+
+void
+Compiler::emitErrorHandlers()
+{
+  Label return_to_invoke;
+
+  if (report_error_.used()) {
+    __ bind(&report_error_);
+
+    // Create the exit frame. We always get here through a call from the opcode
+    // (and always via an out-of-line thunk).
+    __ enterExitFrame(ExitFrameType::Helper, 0);
+
+    __ movl(ArgReg0, rax);
+    __ callWithABI(AddressValue((void*)InvokeReportError));
+    __ leaveExitFrame();
+    __ jmp(&return_reported_error_);
+  }
+
+  // The timeout uses a special stub.
+  if (throw_timeout_.used()) {
+    __ bind(&throw_timeout_);
+
+    // Create the exit frame.
+    __ enterExitFrame(ExitFrameType::Helper, 0);
+
+    __ callWithABI(AddressValue((void*)InvokeReportTimeout));
+    __ leaveExitFrame();
+    __ jmp(&return_reported_error_);
+  }
+
+  // We get here if we know an exception is already pending.
+  if (return_reported_error_.used() || report_error_.used()) {
+    __ bind(&return_reported_error_);
+    __ call(&return_to_invoke);
+  }
+
+  if (return_to_invoke.used()) {
+    __ bind(&return_to_invoke);
+
+    // We get here through a call, from several paths with different stack
+    // alignments, so align explicitly after entering the frame.
+    __ enterExitFrame(ExitFrameType::Helper, 0);
+    __ alignStack();
+
+    // We cannot jump to the return stub just yet. We could be multiple frames
+    // deep, and our |rbp| does not match the initial frame. Find and restore
+    // it now.
+    __ callWithABI(AddressValue((void*)find_entry_fp));
+    __ leaveExitFrame();
+
+    __ movq(rbp, rax);
+    __ jmp(AddressValue(env_->stubs()->ReturnStub()));
+  }
+}
+
+void
+Compiler::emitThrowPath(int err)
+{
+  __ movl(rax, err);
+  __ jmp(&report_error_);
+}
+
+void
+Compiler::emitDebugBreakHandler()
+{
+  // Common path for invoking debugger.
+  __ bind(&debug_break_);
+
+  // Get and store the current stack pointer.
+  __ movq(tmp, stk);
+  __ subq(tmp, dat);
+  __ movl(spAddr(), tmp);
+
+  // Enter the exit frame. The return address and three frame words leave
+  // the stack aligned.
+  __ enterExitFrame(ExitFrameType::Helper, 0);
+
+  // Get the context pointer and call the debugging break handler.
+  __ movl(ArgReg1, 0); // IErrorReport*
+  __ movq(ArgReg0, cxreg);
+  __ callWithABI(AddressValue((void *)InvokeDebugger));
+  __ leaveExitFrame();
+  __ testl(rax, rax);
+  jumpOnError(not_zero);
+  __ ret();
+}
+
+void*
+CompilerBase::ExternalSymbol(uint32_t index)
+{
+  // The code cache stores these by index, so only ever add to the end.
+  switch (index) {
+    case 0:
+      return (void*)InvokePushTracker;
+    case 1:
+      return (void*)InvokePopTrackerAndSetHeap;
+    case 2:
+      return (void*)InvokeGenerateFullArray;
+    case 3:
+      return (void*)InvokeRebaseArray;
+    case 4:
+      return (void*)CompileFromThunk;
+    case 5:
+      return (void*)ReportOutOfBoundsError;
+    case 6:
+      return (void*)InvokeReportError;
+    case 7:
+      return (void*)InvokeReportTimeout;
+    case 8:
+      return (void*)find_entry_fp;
+    case 9:
+      return (void*)InvokeDebugger;
+    case 10:
+      return (void*)Environment::get()->stubs()->ReturnStub();
+    case 11:
+      return (void*)InvokeFloatMath;
+    default:
+      return nullptr;
+  }
+}
+
+void
+CompilerBase::PatchCallThunk(uint8_t* pc, void* target)
+{
+  // If the target is out of rel32 range, the call keeps going through its
+  // thunk, which looks up the compiled function each time.
+  intptr_t delta = intptr_t(target) - intptr_t(pc);
+  if (delta < INT_MIN || delta > INT_MAX)
+    return;
+  *(int32_t*)(pc - 4) = int32_t(delta);
+}
+
+} // namespace sp
@@ -46,6 +46,14 @@ MacroAssembler::enterInlineExitFrame(ExitFrameType type, uintptr_t payload, Code
   enterExitFrame(type, payload);
 }
 
+void
+MacroAssembler::leaveInlineExitFrame()
+{
+  // Note: no ret, the frame is inline. We pop the return address instead.
+  leaveExitFrame();
+  addq(rsp, 8);
+}
+
 void
 MacroAssembler::enterExitFrame(ExitFrameType type, uintptr_t payload)
 {
@@ -133,7 +141,7 @@ MacroAssembler::cmpl(const AddressOperand& dest, int32_t imm)
   } else {
     ReserveScratch scratch(this);
     movq(scratch.reg(), dest.asValue());
-    cmpl(Operand(scratch.reg(), 0), 0);
+    cmpl(Operand(scratch.reg(), 0), imm);
   }
 }
 
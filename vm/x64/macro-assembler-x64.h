@@ -38,6 +38,7 @@ class MacroAssembler : public Assembler
   // Inline exit frames are not entered via a call; instead they simulate a
   // call by pushing a return address.
   void enterInlineExitFrame(ExitFrameType type, uintptr_t payload, CodeLabel* return_address);
+  void leaveInlineExitFrame();
 
   void enterExitFrame(ExitFrameType type, uintptr_t payload);
   void leaveExitFrame();
@@ -62,7 +63,14 @@ class MacroAssembler : public Assembler
   template <typename T>
   void callWithABI(const T& address) {
     assertStackAligned();
+#if defined(KE_WINDOWS)
+    // Win64 callers must reserve home space for the four register arguments.
+    subq(rsp, 32);
     call(address);
+    addq(rsp, 32);
+#else
+    call(address);
+#endif
   }
 
   using Assembler::jmp;
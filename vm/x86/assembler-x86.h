@@ -485,6 +485,9 @@ class Assembler : public AssemblerBase
   void orl(Register dest, const Operand& src) {
     emit1(0x0b, dest.code, src);
   }
+  void orl(Register dest, int32_t imm) {
+    alu_imm(1, imm, Operand(dest));
+  }
   void xorl(Register dest, Register src) {
     emit1(0x31, src.code, dest.code);
   }
@@ -531,6 +534,20 @@ class Assembler : public AssemblerBase
   void adcl(const Operand& dest, int32_t imm) {
     alu_imm(2, imm, dest);
   }
+  void adcl(const Operand& dest, Register src) {
+    emit1(0x11, src.code, dest);
+  }
+  void adcl(Register dest, const Operand& src) {
+    emit1(0x13, dest.code, src);
+  }
+  void sbbl(Register dest, const Operand& src) {
+    emit1(0x1b, dest.code, src);
+  }
+
+  // dest is undefined if src is zero.
+  void bsrl(Register dest, Register src) {
+    emit2(0x0f, 0xbd, dest.code, src.code);
+  }
 
   void imull(Register dest, const Operand& src) {
     emit2(0x0f, 0xaf, dest.code, src);
@@ -827,6 +844,9 @@ class Assembler : public AssemblerBase
   void cpuid() {
     emit2(0x0f, 0xa2);
   }
+  void rdtsc() {
+    emit2(0x0f, 0x31);
+  }
 
 
   // SSE operations can only be used if the feature detection function has
@@ -867,6 +887,10 @@ class Assembler : public AssemblerBase
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x5c, dest.code, src);
   }
+  void subss(FloatRegister dest, FloatRegister src) {
+    assert(Features().sse);
+    emit3(0xf3, 0x0f, 0x5c, dest.code, src.code);
+  }
   void mulss(FloatRegister dest, const Operand& src) {
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x59, dest.code, src);
@@ -875,6 +899,10 @@ class Assembler : public AssemblerBase
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x5e, dest.code, src);
   }
+  void sqrtss(FloatRegister dest, const Operand& src) {
+    assert(Features().sse);
+    emit3(0xf3, 0x0f, 0x51, dest.code, src);
+  }
   void xorps(FloatRegister dest, FloatRegister src) {
     assert(Features().sse);
     emit2(0x0f, 0x57, src.code, dest.code);
@@ -897,6 +925,15 @@ class Assembler : public AssemblerBase
     emit3(0x66, 0x0f, 0x7e, dest.code, src);
   }
 
+  // SSE4.1-only instructions. |mode| is the immediate rounding control; bit 3
+  // suppresses the precision exception.
+  void roundss(FloatRegister dest, FloatRegister src, uint8_t mode) {
+    assert(Features().sse4_1);
+    emit1(0x66);
+    emit3(0x0f, 0x3a, 0x0a, dest.code, src.code);
+    writeByte(mode);
+  }
+
   static void PatchRel32Absolute(uint8_t* ip, void* ptr) {
     int32_t delta = uint32_t(ptr) - uint32_t(ip);
     *reinterpret_cast<int32_t*>(ip - 4) = delta;
@@ -15,6 +15,7 @@
 #include "linking.h"
 #include "jit_x86.h"
 #include "environment.h"
+#include "perf-maps.h"
 
 using namespace sp;
 using namespace SourcePawn;
@@ -129,5 +130,10 @@ CodeStubs::CreateFakeNativeStub(SPVM_FAKENATIVE_FUNC callback, void* pData)
   __ pop(ebx);
   __ ret();
 
-  return (SPVM_NATIVE_FUNC)LinkCodeToLegacyPtr(env_, masm);
+  uint8_t* code = LinkCodeToLegacyPtr(env_, masm);
+#if defined(SP_HAS_PERF_MAPS)
+  if (code && PerfMaps::IsEnabled())
+    PerfMaps::AddStub("sp::FakeNativeStub", code, masm.length());
+#endif
+  return (SPVM_NATIVE_FUNC)code;
 }
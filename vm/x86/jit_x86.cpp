@@ -229,10 +229,71 @@ Compiler::visitSUB_ALT()
   return true;
 }
 
+// With call stats on, Scripted frames keep the call's start time and the
+// caller's callee ticks (see CallTimer) right below the frame header, as
+// pairs of words.
+static const int32_t kCallStartOffset = -16;
+static const int32_t kSavedCalleeTicksOffset = -24;
+
+void
+Compiler::emitEnterCallStats()
+{
+  uint8_t* callee_ticks = reinterpret_cast<uint8_t*>(env_->addressOfCalleeTicks());
+  ExternalAddress callee_ticks_lo(callee_ticks);
+  ExternalAddress callee_ticks_hi(callee_ticks + 4);
+
+  // Four words, so the stack stays aligned.
+  __ rdtsc();
+  __ push(edx);
+  __ push(eax);
+  __ push(Operand(callee_ticks_hi));
+  __ push(Operand(callee_ticks_lo));
+  __ movl(Operand(callee_ticks_lo), 0);
+  __ movl(Operand(callee_ticks_hi), 0);
+}
+
+void
+Compiler::emitLeaveCallStats()
+{
+  uint8_t* callee_ticks = reinterpret_cast<uint8_t*>(env_->addressOfCalleeTicks());
+  ExternalAddress callee_ticks_lo(callee_ticks);
+  ExternalAddress callee_ticks_hi(callee_ticks + 4);
+  CallStats* stats = &method_info_->call_stats();
+
+  __ push(pri);
+
+  // edx:eax = the time spent in this call.
+  __ rdtsc();
+  __ subl(eax, Operand(ebp, kCallStartOffset));
+  __ sbbl(edx, Operand(ebp, kCallStartOffset + 4));
+
+  __ movl(ecx, intptr_t(stats));
+  __ addl(Operand(ecx, offsetof(CallStats, calls)), 1);
+  __ adcl(Operand(ecx, offsetof(CallStats, calls) + 4), 0);
+  __ addl(Operand(ecx, offsetof(CallStats, total_ticks)), eax);
+  __ adcl(Operand(ecx, offsetof(CallStats, total_ticks) + 4), edx);
+  __ subl(eax, Operand(callee_ticks_lo));
+  __ sbbl(edx, Operand(callee_ticks_hi));
+  __ addl(Operand(ecx, offsetof(CallStats, self_ticks)), eax);
+  __ adcl(Operand(ecx, offsetof(CallStats, self_ticks) + 4), edx);
+
+  // Hand the caller its callee ticks, with this call added.
+  __ addl(eax, Operand(callee_ticks_lo));
+  __ adcl(edx, Operand(callee_ticks_hi));
+  __ addl(eax, Operand(ebp, kSavedCalleeTicksOffset));
+  __ adcl(edx, Operand(ebp, kSavedCalleeTicksOffset + 4));
+  __ movl(Operand(callee_ticks_lo), eax);
+  __ movl(Operand(callee_ticks_hi), edx);
+
+  __ pop(pri);
+}
+
 void
 Compiler::emitPrologue()
 {
   __ enterFrame(JitFrameType::Scripted, pcode_start_);
+  if (call_stats_)
+    emitEnterCallStats();
 
   // Push the old frame onto the stack.
   __ subl(stk, 8);
@@ -259,6 +320,39 @@ Compiler::emitPrologue()
   }
 }
 
+void
+Compiler::emitOsrEntry(Block* target)
+{
+  __ enterFrame(JitFrameType::Scripted, pcode_start_);
+
+  // The interpreter has timed the call up to here; the rest counts as a
+  // new call's time, and RETN counts the call.
+  if (call_stats_)
+    emitEnterCallStats();
+
+  // The interpreter has already built the frame, so just pick it up.
+  __ movl(frm, Operand(frmAddr()));
+  __ addl(frm, dat);
+
+  // The prologue checked the stack from the start of the frame, and the heap
+  // may have grown since, so check again.
+  int32_t max_stack = method_info_->max_stack();
+  if (max_stack) {
+    __ movl(eax, Operand(hpAddr()));
+    __ lea(eax, Operand(dat, eax, NoScale, STACK_MARGIN));
+    __ lea(ecx, Operand(frm, -max_stack));
+    __ cmpl(ecx, eax);
+    jumpOnError(below, SP_ERROR_STACKLOW);
+  }
+
+  // Pop pri and alt, which the interpreter left on top of its stack.
+  __ movl(pri, Operand(stk, 0));
+  __ movl(alt, Operand(stk, 4));
+  __ addl(stk, 8);
+
+  __ jmp(target->label());
+}
+
 bool
 Compiler::visitSHL()
 {
@@ -651,7 +745,11 @@ Compiler::visitRETN()
   __ movl(tmp, Operand(stk, 0));
   __ lea(stk, Operand(stk, tmp, ScaleFour, 4));
 
+  if (call_stats_)
+    emitLeaveCallStats();
+
   __ leaveFrame();
+  recordReturnSite();
   __ ret();
   return true;
 }
@@ -973,6 +1071,36 @@ Compiler::visitFLOAT_NOT()
   return true;
 }
 
+bool
+Compiler::visitFLOAT_MATH(FloatMathOp op)
+{
+  size_t arity = FloatMathArity(op);
+
+  if (op == FloatMathOp::Sqrt && MacroAssembler::Features().sse2) {
+    __ sqrtss(xmm0, Operand(stk, 0));
+    __ movd(pri, xmm0);
+  } else if (op == FloatMathOp::Fraction && MacroAssembler::Features().sse4_1) {
+    // Round toward negative infinity, without raising precision exceptions.
+    __ movss(xmm0, Operand(stk, 0));
+    __ roundss(xmm1, xmm0, 0x9);
+    __ subss(xmm0, xmm1);
+    __ movd(pri, xmm0);
+  } else {
+    // These natives cannot fail, so the helper is called directly without
+    // building an exit frame.
+    __ push(alt);
+    __ subl(esp, 4);
+    __ push(stk);
+    __ push(int32_t(op));
+    __ callWithABI(ExternalAddress((void*)InvokeFloatMath));
+    __ addl(esp, 12);
+    __ pop(alt);
+  }
+
+  __ addl(stk, int32_t(arity * sizeof(cell_t)));
+  return true;
+}
+
 bool
 Compiler::visitSTACK(cell_t amount)
 {
@@ -1156,6 +1284,9 @@ Compiler::visitHALT(cell_t value)
 bool
 Compiler::visitBOUNDS(uint32_t limit)
 {
+  if (isRedundantBoundsCheck())
+    return true;
+
   OutOfBoundsErrorPath* bounds = new OutOfBoundsErrorPath(op_cip_, limit);
   if (!ool_paths_.append(bounds)) {
     reportError(SP_ERROR_OUT_OF_MEMORY);
@@ -1267,8 +1398,8 @@ class CallThunk : public OutOfLinePath
 bool
 Compiler::visitCALL(cell_t offset)
 {
-  RefPtr<MethodInfo> method = rt_->GetMethod(offset);
-  if (!method || !method->jit()) {
+  CompiledFunction* target = directCallTarget(offset);
+  if (!target) {
     // Need to emit a delayed thunk.
     CallThunk* thunk = new CallThunk(offset);
     __ callWithABI(thunk->label());
@@ -1278,7 +1409,7 @@ Compiler::visitCALL(cell_t offset)
     }
   } else {
     // Function is already emitted, we can do a direct call.
-    __ callWithABI(ExternalAddress(method->jit()->GetEntryAddress()));
+    __ callWithABI(ExternalAddress(target->GetEntryAddress()));
   }
 
   // Map the return address to the cip that started this call.
@@ -1295,29 +1426,52 @@ Compiler::emitCallThunk(CallThunk* thunk)
   // Enter the exit frame. This aligns the stack.
   __ enterExitFrame(ExitFrameType::Helper, 0);
 
-  // We need to push 4 arguments, and one of them will need an extra word
-  // on the stack. Allocate a big block so we're aligned.
+  // If the callee is still cold it will be interpreted, which needs the
+  // context's view of the arguments.
+  __ movl(ecx, stk);
+  __ subl(ecx, dat);
+  __ movl(Operand(spAddr()), ecx);
+
+  // We need to push 4 arguments, plus a ThunkResult on the stack. Allocate a
+  // big block so we're aligned.
   //
   // Note: we add 12 since the push above misaligned the stack.
-  static const size_t kStackNeeded = 5 * sizeof(void*);
+  static const size_t kResultOffset = 4 * sizeof(void*);
+  static const size_t kStackNeeded = kResultOffset + sizeof(ThunkResult);
   static const size_t kStackReserve = ke::Align(kStackNeeded, 16);
   __ subl(esp, kStackReserve);
 
   // Set arguments.
   __ movl(Operand(esp, 3 * sizeof(void*)), eax);
-  __ lea(edx, Operand(esp, 4 * sizeof(void*)));
+  __ lea(edx, Operand(esp, kResultOffset));
   __ movl(Operand(esp, 2 * sizeof(void*)), edx);
   __ movl(Operand(esp, 1 * sizeof(void*)), intptr_t(thunk->pcode_offset));
   __ movl(Operand(esp, 0 * sizeof(void*)), intptr_t(context_));
 
   __ callWithABI(ExternalAddress((void*)CompileFromThunk));
-  __ movl(edx, Operand(esp, 4 * sizeof(void*)));
+  __ movl(edx, Operand(esp, kResultOffset + offsetof(ThunkResult, code)));
+  __ movl(ecx, Operand(esp, kResultOffset + offsetof(ThunkResult, rval)));
   __ leaveExitFrame();
 
   __ testl(eax, eax);
   jumpOnError(not_zero);
 
+  Label interpreted;
+  __ testl(edx, edx);
+  __ j(zero, &interpreted);
   __ jmp(edx);
+
+  // The callee ran in the interpreter, which has already popped its
+  // arguments. Pick up the new stack and return straight to the caller.
+  __ bind(&interpreted);
+  __ movl(pri, ecx);
+  __ movl(stk, Operand(spAddr()));
+  __ addl(stk, dat);
+
+  ExternalAddress exn_code(Environment::get()->addressOfExceptionCode());
+  __ cmpl(Operand(exn_code), 0);
+  __ j(not_zero, &return_reported_error_);
+  __ ret();
 }
 
 bool
@@ -1343,6 +1497,11 @@ Compiler::visitSYSREQ_C(uint32_t native_index)
 void
 Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
 {
+  if (isLeafNative(native)) {
+    emitLeafNativeCall(native);
+    return;
+  }
+
   CodeLabel return_address;
   __ enterInlineExitFrame(ExitFrameType::Native, native_index, &return_address);
 
@@ -1355,9 +1514,18 @@ Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
   // Save registers.
   __ push(edx);
 
+  // With native stats on, keep the start time in another four words, so
+  // the stack stays aligned. This clobbers pri and alt, so it has to come
+  // first.
+  if (native->stats) {
+    __ rdtsc();
+    __ push(edx);
+    __ push(eax);
+    __ subl(esp, 2 * sizeof(intptr_t));
+  }
+
   // Check whether the native is bound.
-  bool immutable = native->status == SP_NATIVE_BOUND &&
-                   !(native->flags & (SP_NTVFLAG_EPHEMERAL|SP_NTVFLAG_OPTIONAL));
+  bool immutable = isImmutableNative(native);
   if (!immutable) {
     __ movl(edx, Operand(ExternalAddress(&native->legacy_fn)));
     __ testl(edx, edx);
@@ -1387,12 +1555,15 @@ Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
   // Map the return address to the cip that initiated this call.
   emitCipMapping(op_cip_);
 
+  if (native->stats)
+    emitNativeStats(native, 5 * sizeof(intptr_t));
+
   // Restore the heap pointer.
   __ movl(edx, Operand(esp, 2 * sizeof(intptr_t)));
   __ movl(Operand(hpAddr()), edx);
 
   // Restore ALT.
-  __ movl(edx, Operand(esp, 3 * sizeof(intptr_t)));
+  __ movl(edx, Operand(esp, (native->stats ? 7 : 3) * sizeof(intptr_t)));
 
   // Restore SP.
   __ addl(stk, dat);
@@ -1407,6 +1578,84 @@ Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
   __ j(not_zero, &return_reported_error_);
 }
 
+// Leaf natives can't throw or re-enter the VM, so there is no exit frame, the
+// heap pointer is left alone, and there is nothing to check afterward. The
+// context still needs sp to resolve addresses on the stack.
+void
+Compiler::emitLeafNativeCall(NativeEntry* native)
+{
+  // Save ALT, and pad so the stack is aligned at the call. With native stats
+  // on, the start time and two more words of padding go in between.
+  size_t saved_words = 2;
+  __ push(edx);
+  if (native->stats) {
+    __ rdtsc();
+    __ push(edx);
+    __ push(eax);
+    __ subl(esp, 3 * sizeof(intptr_t));
+    saved_words = 6;
+  } else {
+    __ subl(esp, sizeof(intptr_t));
+  }
+
+  // Push the last parameter for the C++ function.
+  __ push(stk);
+
+  __ movl(edx, stk);
+  __ subl(edx, dat);
+  __ movl(Operand(spAddr()), edx);
+
+  // Push the first parameter, the context.
+  __ push(intptr_t(rt_->GetBaseContext()));
+
+  __ callWithABI(ExternalAddress((void*)native->legacy_fn));
+
+  if (native->stats)
+    emitNativeStats(native, 5 * sizeof(intptr_t));
+
+  // Restore ALT.
+  __ movl(edx, Operand(esp, (saved_words + 1) * sizeof(intptr_t)));
+  __ addl(esp, (saved_words + 2) * sizeof(intptr_t));
+}
+
+// Counts a native call that started at the time stored |start_offset| bytes
+// above esp; see RecordNativeCall. pri holds the native's return value.
+void
+Compiler::emitNativeStats(NativeEntry* native, int32_t start_offset)
+{
+  NativeStats* stats = native->stats;
+
+  __ push(pri);
+  start_offset += sizeof(intptr_t);
+
+  // edx:eax = the time spent in the native.
+  __ rdtsc();
+  __ subl(eax, Operand(esp, start_offset));
+  __ sbbl(edx, Operand(esp, start_offset + 4));
+
+  __ movl(ecx, intptr_t(stats));
+  __ addl(Operand(ecx, offsetof(NativeStats, calls)), 1);
+  __ adcl(Operand(ecx, offsetof(NativeStats, calls) + 4), 0);
+  __ addl(Operand(ecx, offsetof(NativeStats, total_ticks)), eax);
+  __ adcl(Operand(ecx, offsetof(NativeStats, total_ticks) + 4), edx);
+
+  // The histogram bucket is the highest set bit; see NativeStatsBucket.
+  Label low_half, bucketed;
+  __ testl(edx, edx);
+  __ j(zero, &low_half);
+  __ bsrl(edx, edx);
+  __ addl(edx, 32);
+  __ jmp(&bucketed);
+  __ bind(&low_half);
+  __ orl(eax, 1);
+  __ bsrl(edx, eax);
+  __ bind(&bucketed);
+  __ addl(Operand(ecx, edx, ScaleEight, offsetof(NativeStats, histogram)), 1);
+  __ adcl(Operand(ecx, edx, ScaleEight, offsetof(NativeStats, histogram) + 4), 0);
+
+  __ pop(pri);
+}
+
 bool
 Compiler::visitSWITCH(cell_t defaultOffset,
                       const CaseTableEntry* cases,
@@ -1661,6 +1910,13 @@ Compiler::emitDebugBreakHandler()
   __ ret();
 }
 
+void*
+CompilerBase::ExternalSymbol(uint32_t index)
+{
+  // The x86 assembler does not record relocations, so nothing is cached.
+  return nullptr;
+}
+
 void
 CompilerBase::PatchCallThunk(uint8_t* pc, void* target)
 {
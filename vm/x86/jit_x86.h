@@ -130,6 +130,7 @@ class Compiler : public CompilerBase
   bool visitFLOATCMP() override;
   bool visitFLOAT_CMP_OP(CompareOp op) override;
   bool visitFLOAT_NOT() override;
+  bool visitFLOAT_MATH(FloatMathOp op) override;
   bool visitHALT(cell_t value) override;
   bool visitSWITCH(
     cell_t defaultOffset,
@@ -146,12 +147,17 @@ class Compiler : public CompilerBase
   void emitErrorHandlers() override;
   void emitOutOfBoundsErrorPath(OutOfBoundsErrorPath* path) override;
   void emitDebugBreakHandler() override;
+  void emitOsrEntry(Block* target) override;
 
   void emitLegacyNativeCall(uint32_t native_index, NativeEntry* native);
+  void emitLeafNativeCall(NativeEntry* native);
   void emitGenArray(bool autozero);
   void emitCheckAddress(Register reg);
   void emitFloatCmp(ConditionCode cc);
   void emitCallThunk(CallThunk* thunk);
+  void emitEnterCallStats();
+  void emitLeaveCallStats();
+  void emitNativeStats(NativeEntry* native, int32_t start_offset);
   void jumpOnError(ConditionCode cc, int err = 0);
 
   ExternalAddress hpAddr() {